@@ -13,18 +13,173 @@
 #include <dirent.h>
 #include <unistd.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <string.h>
 #include <math.h>
 #include <fcntl.h>
 #include <inttypes.h>
 #include <limits.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <time.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define X86_SIMD 1
+#else
+#define X86_SIMD 0
+#endif
 
 #define NUM_STEPS 4000000
 #define STEP_REPORT_INTERVAL 100
 #define LAMBDA 0.0001
+// Number of principal components samples are projected onto before training
+// 0 = Train on the pixel bytes themselves
+#define PCA_COMPONENTS 0
+#define PCA_OVERSAMPLING 10
+#define PCA_POWER_ITERATIONS 2
+// Downsampling factors and step budgets of the coarse stages trained before
+// the NUM_STEPS full resolution steps, coarsest first
+// {0} = Train at full resolution only
+#define COARSE_STAGE_FACTORS {0}
+#define COARSE_STAGE_STEPS {0}
+// Solver used to train the vectors
+// Subgradient descent = 0, SAGA = 1, SVRG = 2
+#define SOLVER 0
+// Loss minimized by SAGA and SVRG
+// Squared hinge = 0, Smoothed hinge = 1
+#define SMOOTH_LOSS 0
+#define HINGE_SMOOTHING 0.5
+// Give each dimension of a vector its own learning rate with AdaGrad when
+// training with subgradient descent
+// Off = 0, On = 1
+#define ADAGRAD 0
+#define ADAGRAD_LEARN_RATE 0.1
+// Draw samples near the margin more often when training with subgradient
+// descent, weighting their steps to compensate
+// Off = 0, On = 1
+#define IMPORTANCE_SAMPLING 0
+// Importance of samples outside the margin of every vector, relative to
+// samples inside the margin of every vector
+#define IMPORTANCE_FLOOR 0.1
+// Skip the dot products of samples well outside the margin of a vector when
+// training with subgradient descent
+// Off = 0, On = 1
+#define ACTIVE_SET_SHRINKING 0
+// Margin beyond which a sample is skipped for a vector
+#define SHRINKING_MARGIN 1.5
+// Number of steps between rechecks of every skipped sample
+#define SHRINKING_RECHECK_INTERVAL 10000
+// Number of samples recently found inside the margin of a vector replayed for
+// each fresh sample when training with subgradient descent, or 0 for none
+#define REPLAY_RATIO 0
+// Number of samples kept for replay per vector
+#define REPLAY_BUFFER_SIZE 64
+// Flip each sample horizontally with probability 1/2 when training with
+// subgradient descent on pixel bytes
+// Off = 0, On = 1
+#define AUGMENT_FLIP 0
+// Largest number of pixels each sample is moved by in each direction
+#define AUGMENT_MAX_SHIFT 0
+// Largest relative change in the brightness of each sample
+#define AUGMENT_BRIGHTNESS 0.0
+// Seed of every random choice made during training, or 0 to seed from
+// /dev/urandom
+#define RANDOM_SEED 0
+// Resample images whose dimensions differ from the model's as they are
+// decoded, instead of rejecting them
+// Off = 0, Area = 1, Bilinear = 2
+#define RESAMPLE 0
+// Dimensions images are resampled to, where 0 takes the dimension from the
+// first class directory found
+#define RESAMPLE_WIDTH 0
+#define RESAMPLE_HEIGHT 0
+#define RESAMPLE_BITS_PER_PIXEL 0
+// Bytes of each pixel kept as features
+// All = 0, Luminance = 1, Bytes in CHANNEL_MASK = 2
+#define CHANNEL_MODE 0
+// Bit n keeps byte n of each pixel, where bytes are in BGR(A) order
+#define CHANNEL_MASK 0x7
+// Pixels kept as features
+// All = 0, Nonzero pixels of the BMP file at MASK_PATH = 1,
+// Pixels inside MASK_RECTANGLES = 2, Pixels varying across the samples = 3
+#define MASK_MODE 0
+#define MASK_PATH "mask.bmp"
+// Left, top, width and height of each kept rectangle, in pixels from the top
+// left corner
+#define MASK_RECTANGLES {0, 0, 0, 0}
+// Smallest variance of a pixel's bytes across the samples, summed over its
+// bytes, for the pixel to be kept
+#define MASK_MIN_VARIANCE 1.0
+// Magnitude, as a fraction of the largest compared, below which the prune
+// command drops weights
+#define PRUNE_THRESHOLD 0.01
+// Fraction of compared weights kept by the prune command
+// 0 = Use PRUNE_THRESHOLD
+#define PRUNE_DENSITY 0.0
+// Weights compared with each other by the prune command
+// Each vector's = 0, All = 1, Whole dimensions across vectors = 2
+#define PRUNE_SCOPE 0
+// Format of the vector weights in written files
+// Double = 0, Float = 1, Half precision = 2, Bfloat16 = 3
+#define WEIGHT_FORMAT 0
+// Percentage points of validation accuracy the cascade command may give up
+// so that more files are classified by the gate alone
+#define CASCADE_MAX_ACCURACY_LOSS 0.5
+// How the ensemble command combines the results of its SVM files
+// Votes of each file = 0, Summed margins of each class = 1
+#define ENSEMBLE_COMBINATION 0
+// Results of files kept by the classify command for later files that decode
+// to the same pixels, or 0 to keep none
+#define RESULT_CACHE_SIZE 1024
+// Folds the cross-validate command splits the samples of each class into
+#define CROSS_VALIDATION_FOLDS 5
+// Values of the training macros combined into the configurations tried by
+// the search command
+#define SEARCH_LAMBDAS {0.0001, 0.001, 0.01}
+#define SEARCH_NUM_STEPS {1000000, 4000000}
+#define SEARCH_PCA_COMPONENTS {0}
+#define SEARCH_SOLVERS {0}
+// Configurations drawn at random from the combinations for the search
+// command to try, or 0 to try every combination
+#define SEARCH_RANDOM_CONFIGS 0
+// Configurations of each search round for each one that trains on into the
+// next round, with rounds training this many times as many steps as the
+// round before
+#define SEARCH_HALVING_FACTOR 3
+// Pixels between the top left corners of neighboring windows scored by the
+// detect command
+#define DETECT_STRIDE 4
+// Smallest margin by which the class of a window must win each of its pairs
+// for the detect command to report the window
+#define DETECT_THRESHOLD 0.5
+// Largest fraction of the union of two windows of the same class they may
+// share before the detect command drops the one with the smaller margin
+#define DETECT_OVERLAP 0.3
+// Class never reported by the detect command, or "" to report every class
+#define DETECT_BACKGROUND ""
+// Method the detect command scores windows with
+// Cheaper by estimate = 0, Direct dot products = 1, FFT correlation = 2
+#define DETECT_SCORING 0
+// Factor by which each level of the detect command's image pyramid is
+// smaller than the level before, so that classes appearing larger than the
+// model's images are found
+// 1.0 = Search the frame at its own scale only
+#define DETECT_SCALE_STEP 1.0
+// Most levels of the image pyramid searched, the frame itself included
+// 0 = Every level at least as large as the model's images
+#define DETECT_MAX_LEVELS 0
+// Threads that work is spread over
+// 0 = One for each online processor
+#define NUM_THREADS 0
 // Debug = 0, Info = 1, Off >= 2
 #define DEBUG_LEVEL 0
 
+#if RESAMPLE_BITS_PER_PIXEL != 0 && RESAMPLE_BITS_PER_PIXEL != 8 && \
+	RESAMPLE_BITS_PER_PIXEL != 16 && RESAMPLE_BITS_PER_PIXEL != 24 && \
+	RESAMPLE_BITS_PER_PIXEL != 32
+#error "RESAMPLE_BITS_PER_PIXEL must be 0, 8, 16, 24 or 32"
+#endif
+
 
 // Determine if system is little-endian
 bool systemIsLittleEndian(){
@@ -38,7 +193,39 @@ void usage(char *programName){
 		"Usage:"
 		"\t%s <Path to directory> <Path to output vector file>\n"
 		"\t%s <Path to BMP-formatted file> <Path to input vector file>"
-		"\n",
+		"\n"
+		"\t%s cross-validate <Path to directory>\n"
+		"\t%s search <Path to directory> <Path to output vector file>\n"
+		"\t%s prune <Path to input vector file> <Path to output vector "
+		"file> [Path to validation directory]\n"
+		"\t%s convert <Path to input vector file> <Path to output "
+		"vector file> [Path to validation directory]\n"
+		"\t%s export <Path to input vector file> <Path to output C "
+		"file>\n"
+		"\t%s detect <Path to BMP-formatted file> <Path to input "
+		"vector file>\n"
+		"\t%s classify <Path to input vector file> <Path to "
+		"BMP-formatted file>...\n"
+		"\t%s ensemble <Path to BMP-formatted file> <Path to input "
+		"vector file>...\n"
+		"\t%s evaluate <Path to input vector file> <Path to "
+		"validation directory> [Path to output JSON file]\n"
+		"\t%s cascade <Path to gate vector file> <Path to full vector "
+		"file> <Path to validation directory> <Path to output cascade "
+		"file>\n"
+		"\t%s bundle <Path to output bundle file> <Path to input "
+		"vector or cascade file>...\n",
+		programName,
+		programName,
+		programName,
+		programName,
+		programName,
+		programName,
+		programName,
+		programName,
+		programName,
+		programName,
+		programName,
 		programName,
 		programName
 		);
@@ -390,11 +577,11 @@ bool getBmpDims(
 		return false;
 	}
 
+	// Rows are padded to a multiple of 4 bytes
+	uintmax_t rowStride =
+		((uintmax_t)*width * (*bitsPerPixel >> 3) + 3) & ~(uintmax_t)3;
 	uintmax_t expectedSize = 
-		((uintmax_t)*width + (4 - *width % 4) % 4) *
-		(uintmax_t)imaxabs(*height) *
-		(*bitsPerPixel >> 3) + 
-		headersSize;
+		rowStride * (uintmax_t)imaxabs(*height) + headersSize;
 	if(
 		expectedSize > 0xFFFFFFFF || 
 		fileSize != expectedSize
@@ -414,11 +601,14 @@ bool getBmpDims(
 
 // Checks that all regular files with the BMP magic number have the same 
 // dimensions
+// If allowMismatch is set, only checks that they are valid BMP files, and
+// gives the dimensions of the first
 bool allFilesSameDims(
 		char *pathToClassDir,
 		uint32_t *width,
 		int32_t *height,
-		uint16_t * bitsPerPixel
+		uint16_t * bitsPerPixel,
+		bool allowMismatch
 		){
 	struct stat direntStatus;
 	struct dirent *dirEntry;
@@ -522,9 +712,12 @@ bool allFilesSameDims(
 				return false;
 			}
 			if(
-				sampleWidth != *width ||
-				imaxabs(sampleHeight) != imaxabs(*height) ||
-				sampleBitsPerPixel != *bitsPerPixel
+				!allowMismatch &&
+				(
+				 sampleWidth != *width ||
+				 imaxabs(sampleHeight) != imaxabs(*height) ||
+				 sampleBitsPerPixel != *bitsPerPixel
+				)
 			  ){
 				if(sampleWidth != *width)
 					fprintf(
@@ -577,2408 +770,12678 @@ bool allFilesSameDims(
 	return true;
 }
 
-bool initializeOutputFile(
-		char *pathToInputDir,
-		char *pathToOutputFile
-		){
-	if(access(pathToOutputFile, F_OK) == 0){
-		if(access(pathToOutputFile, W_OK) != 0){
-			fprintf(
-				stderr,
-				"Insufficient permission to overwrite %s\n",
-				pathToOutputFile
-			       );
-			return false;
+// Function to clean up class stored class names
+void freeClassNames(char **classNames, uint64_t numClasses){
+	for(uint64_t classNum = 0; classNum < numClasses; classNum++){
+		if(classNames[classNum] != NULL){
+			free(classNames[classNum]);
+			classNames[classNum] = NULL;
 		}
 	}
+	free(classNames);
+	classNames = NULL;
+}
 
-	FILE *output = fopen(pathToOutputFile, "wb");
-	if(!output){
+// Join a directory and an entry name into a newly allocated path
+char *getPathInDir(char *pathToDir, char *entryName){
+	char *pathToEntry =
+		(char *)
+		malloc(
+			strlen(pathToDir) +
+			strlen(entryName) +
+			2
+		      );
+	if(!pathToEntry){
 		fprintf(
 			stderr,
-			"Error opening %s for writing\n",
-			pathToOutputFile
+			"Error allocating memory for path to %s in %s\n",
+			entryName,
+			pathToDir
 		       );
-		return false;
+		return NULL;
 	}
+	strcpy(pathToEntry, pathToDir);
+	strcat(pathToEntry, "/");
+	strcat(pathToEntry, entryName);
+	return pathToEntry;
+}
 
-	// Write magic number to output file
-	char *svmMagicNumber = "NSVM";
-	if(fwrite(svmMagicNumber, 1, 4, output) != 4){
+// Seed a xorshift64* generator from /dev/urandom, so that drawing samples
+// doesn't require opening /dev/urandom every time
+bool seedRandomState(uint64_t *randomState){
+	FILE *randPipe = fopen("/dev/urandom", "rb");
+	if(!randPipe){
 		fprintf(
 			stderr,
-			"Error writing magic number to %s\n",
-			pathToOutputFile
+			"Error opening /dev/urandom\n"
 		       );
-		fclose(output);
 		return false;
 	}
-
-	// Write size of double (in chars) to output file
-	uint8_t doubleSize = sizeof(double);
-	if(!fwrite(&doubleSize, sizeof(uint8_t), 1, output)){
+	if(
+		!fread(
+			randomState,
+			sizeof(uint64_t),
+			1,
+			randPipe
+		      )
+	  ){
 		fprintf(
 			stderr,
-			"Error writing size of double to %s\n",
-			pathToOutputFile
+			"Error reading a uint64_t from /dev/urandom\n"
 		       );
-		fclose(output);
+		fclose(randPipe);
 		return false;
 	}
-
-	uint32_t width;
-	int32_t height;
-	uint16_t bitsPerPixel;
-	uint64_t numClasses = 0;
-
-	struct dirent *firstLevelDirEntry;
-	DIR *firstLevelDir = opendir(pathToInputDir);
-	if(!firstLevelDir){
+	if(fclose(randPipe) != 0){
 		fprintf(
 			stderr,
-			"Error opening directory %s\n",
-			pathToInputDir
+			"Error closing /dev/urandom\n"
 		       );
-		fclose(output);
 		return false;
 	}
-	while(firstLevelDirEntry = readdir(firstLevelDir)){
-		// Disregard hidden entries and anything that isn't a directory
-		if(firstLevelDirEntry->d_name[0] == '.')
-			continue;
-		char *pathToFirstLevelDir = 
-			(char *)
-			malloc(
-				sizeof(char) *
-				(
-				strlen(pathToInputDir) +
-				strlen(firstLevelDirEntry->d_name) +
-				2
-			      	)
-			      );
-		if(!pathToFirstLevelDir){
-			fprintf(
-				stderr,
-				"Error allocating memory for path to first "
-				"level directory\n"
-			       );
-			fclose(output);
-			closedir(firstLevelDir);
-			return false;
-		}
-		strcpy(pathToFirstLevelDir, pathToInputDir);
-		strcat(pathToFirstLevelDir, "/");
-		strcat(pathToFirstLevelDir, firstLevelDirEntry->d_name);
+	// xorshift never leaves a state of 0
+	if(*randomState == 0)
+		*randomState = 0x9E3779B97F4A7C15;
+	return true;
+}
 
-		struct stat direntStatus;
-		if(stat(pathToFirstLevelDir, &direntStatus) != 0){
-			fprintf(
-				stderr,
-				"Error getting status of %s\n",
-				pathToFirstLevelDir
-			       );
-			free(pathToFirstLevelDir);
-			fclose(output);
-			closedir(firstLevelDir);
-			return false;
-		}
-		if(!S_ISDIR(direntStatus.st_mode)){
-			free(pathToFirstLevelDir);
-			continue;
+uint64_t nextRandom(uint64_t *randomState){
+	*randomState ^= *randomState >> 12;
+	*randomState ^= *randomState << 25;
+	*randomState ^= *randomState >> 27;
+	return *randomState * 0x2545F4914F6CDD1D;
+}
+
+// Standard normal value using the Box-Muller transform
+double nextGaussian(uint64_t *randomState){
+	double uniformA =
+		((nextRandom(randomState) >> 11) + 1) * 0x1.0p-53;
+	double uniformB = (nextRandom(randomState) >> 11) * 0x1.0p-53;
+	return sqrt(-2.0 * log(uniformA)) * cos(2.0 * M_PI * uniformB);
+}
+
+uint32_t getNumThreads(){
+	if(NUM_THREADS > 0)
+		return NUM_THREADS;
+	long numProcessors = sysconf(_SC_NPROCESSORS_ONLN);
+	return numProcessors > 0 ? (uint32_t)numProcessors : 1;
+}
+
+// Jobs shared by a pool of threads, each of which claims the next unclaimed
+// job until none are left, so that jobs of uneven cost balance out
+typedef struct {
+	uintmax_t numJobs;
+	uintmax_t nextJob;
+	bool (*runJob)(void *context, uintmax_t jobNum, uint32_t threadNum);
+	void *context;
+	bool isFailed;
+} JobQueue;
+
+typedef struct {
+	JobQueue *queue;
+	uint32_t threadNum;
+} JobThread;
+
+void *runQueuedJobs(void *jobThread){
+	JobThread *thread = (JobThread *)jobThread;
+	JobQueue *queue = thread->queue;
+	while(true){
+		uintmax_t jobNum =
+			__atomic_fetch_add(
+				&queue->nextJob,
+				1,
+				__ATOMIC_RELAXED
+				);
+		if(jobNum >= queue->numJobs)
+			break;
+		if(!queue->runJob(queue->context, jobNum, thread->threadNum)){
+			__atomic_store_n(
+				&queue->isFailed,
+				true,
+				__ATOMIC_RELAXED
+				);
 		}
+	}
+	return NULL;
+}
 
-		// Disregard directories with regular files that don't all
-		// match the established dimensions
-		uint32_t dirWidth;
-		int32_t dirHeight;
-		uint16_t dirBitsPerPixel;
+// Run jobs 0 to numJobs - 1 on up to numThreads threads, the calling thread
+// included, returning whether every job succeeded
+//
+// Each job is passed the number of the thread running it, below numThreads,
+// so that threads can keep scratch space across the jobs they run. Jobs are
+// claimed in order, so putting the costliest first balances them best.
+bool runJobsInParallel(
+		uintmax_t numJobs,
+		uint32_t numThreads,
+		bool (*runJob)(
+			void *context,
+			uintmax_t jobNum,
+			uint32_t threadNum
+			),
+		void *context
+		){
+	if(numThreads > numJobs)
+		numThreads = numJobs;
+	if(numThreads == 0)
+		return true;
+	JobQueue queue;
+	queue.numJobs = numJobs;
+	queue.nextJob = 0;
+	queue.runJob = runJob;
+	queue.context = context;
+	queue.isFailed = false;
+	JobThread *threads =
+		(JobThread *)malloc(numThreads * sizeof(JobThread));
+	pthread_t *threadIds =
+		(pthread_t *)malloc(numThreads * sizeof(pthread_t));
+	if(!threads || !threadIds){
+		fprintf(
+			stderr,
+			"Error allocating memory for %" PRIu32 " threads\n",
+			numThreads
+		       );
+		free(threads);
+		free(threadIds);
+		return false;
+	}
+	// Jobs are left to the threads already running if one can't start
+	uint32_t numStarted = 1;
+	for(; numStarted < numThreads; numStarted++){
+		threads[numStarted].queue = &queue;
+		threads[numStarted].threadNum = numStarted;
 		if(
-			!allFilesSameDims(
-				pathToFirstLevelDir,
-				&dirWidth,
-				&dirHeight,
-				&dirBitsPerPixel
-				)
+			pthread_create(
+				threadIds + numStarted,
+				NULL,
+				runQueuedJobs,
+				threads + numStarted
+				) != 0
 		  ){
-			free(pathToFirstLevelDir);
-			continue;
-		}else if (numClasses != 0){
-			if(
-				dirWidth != width ||
-				dirHeight != height ||
-				dirBitsPerPixel != bitsPerPixel ||
-				// Currently only whole bytes per pixel
-				// supported
-				dirBitsPerPixel & 7
-			  ){
-				free(pathToFirstLevelDir);
-				continue;
-			}
-		// Establish dimensions on first valid directory
-		}else{
-			width = dirWidth;
-			height = dirHeight;
-			bitsPerPixel = dirBitsPerPixel;
-			if(
-				!fwrite(
-					&width, 
-					sizeof(uint32_t), 
-					1, 
-					output
-					) ||
-				!fwrite(
-					&height, 
-					sizeof(int32_t), 
-					1, 
-					output
-					) ||
-				!fwrite(
-					&bitsPerPixel, 
-					sizeof(uint16_t), 
-					1, 
-					output
-					) ||
-				// Reserve space to be overwritten later
-				!fwrite(
-					&numClasses,
-					sizeof(uint64_t),
-					1,
-					output
-				       )
-			  ){
+			if(DEBUG_LEVEL < 1){
 				fprintf(
 					stderr,
-					"Error writing BMP dimensions to %s "
-					"using files from %s\n",
-					pathToOutputFile,
-					pathToFirstLevelDir
+					"\tDebug: Only %" PRIu32 " of %" PRIu32
+					" threads started\n",
+					numStarted,
+					numThreads
 				       );
-				fclose(output);
-				closedir(firstLevelDir);
-				free(pathToFirstLevelDir);
-				return false;
 			}
+			break;
 		}
-
-		// Write the class name preceeded by its run length to the 
-		// output file and 
-		// increment the number of classes
-		uint8_t classNameLength = strlen(firstLevelDirEntry->d_name);
-		if(
-			!fwrite(
-				&classNameLength,
-				sizeof(uint8_t),
-				1,
-				output
-			       ) ||
-			fwrite(
-				&firstLevelDirEntry->d_name,
-				sizeof(char),
-				classNameLength,
-				output
-			      ) != classNameLength
-		  ){
-			fprintf(
-				stderr,
-				"Error writing class name and run length of "
-				"%s to %s\n",
-				pathToFirstLevelDir,
-				pathToOutputFile
-			       );
-			free(pathToFirstLevelDir);
-			return false;
-		}
-		free(pathToFirstLevelDir);
-		numClasses++;
 	}
-	if(closedir(firstLevelDir) != 0){
+	threads[0].queue = &queue;
+	threads[0].threadNum = 0;
+	runQueuedJobs(threads);
+	for(uint32_t threadNum = 1; threadNum < numStarted; threadNum++)
+		pthread_join(threadIds[threadNum], NULL);
+	free(threads);
+	free(threadIds);
+	return !queue.isFailed;
+}
+
+// Read the pixel data of a BMP file into memory, top row first and without
+// row padding, so that a byte offset refers to the same position in every
+// sample regardless of the sign of its height
+uint8_t *decodeBmp(
+		char *pathToFile,
+		uint32_t *width,
+		int32_t *height,
+		uint16_t *bitsPerPixel
+		){
+	if(!getBmpDims(pathToFile, width, height, bitsPerPixel)){
 		fprintf(
 			stderr,
-			"Error closing %s\n",
-			pathToInputDir
+			"Could not get dimensions of %s\n",
+			pathToFile
 		       );
-		fclose(output);
-		return false;
+		return NULL;
 	}
-	if(numClasses < 2){
+	FILE *bmpFile = fopen(pathToFile, "rb");
+	if(!bmpFile){
 		fprintf(
 			stderr,
-			"Error: fewer than 2 valid class directories\n"
+			"Error opening %s for reading\n",
+			pathToFile
 		       );
-		fclose(output);
-		return false;
-	}
-
-	// Write initial vectors to output file
-	double initialDimVal = 0.0d;
-	uintmax_t numPixels = (uintmax_t)width * (uintmax_t)imaxabs(height);
-	uint16_t bytesPerPixel = bitsPerPixel >> 3;
-	for(uintmax_t i = 1; i < numClasses; i++){
-		for(uintmax_t j = i; j < numClasses; j++){
-			for(
-				uintmax_t pixelNum = 0;
-				pixelNum < numPixels;
-				pixelNum++
-			){
-				for(
-					uint16_t byteNum = 0;
-					byteNum < bytesPerPixel;
-					byteNum++
-				   ){
-					if(
-						!fwrite(
-							&initialDimVal,
-							sizeof(double),
-							1,
-							output
-						       )
-					  ){
-						fprintf(
-							stderr,
-							"Error writing "
-							"initial vectors to %s"
-							"\n",
-							pathToOutputFile
-						       );
-						fclose(output);
-						return false;
-					}
-				}
-			}
-		}
+		return NULL;
 	}
-
-	// Write number of classes to file
+	uint32_t offsetToData;
 	if(
-		fseek(
-			output,
-			4 * sizeof(char) + 
-			sizeof(uint8_t) +
-			sizeof(uint32_t) + 
-			sizeof(int32_t) +
-			sizeof(uint16_t),
-			SEEK_SET
-		     ) != 0
+		fseek(bmpFile, 10, SEEK_SET) != 0 ||
+		!fread(&offsetToData, sizeof(uint32_t), 1, bmpFile) ||
+		fseek(bmpFile, offsetToData, SEEK_SET) != 0
 	  ){
 		fprintf(
 			stderr,
-			"Error seeking to class number field in %s\n",
-			pathToOutputFile
+			"Error seeking to data in %s\n",
+			pathToFile
 		       );
-		fclose(output);
-		return false;
+		fclose(bmpFile);
+		return NULL;
 	}
-	if(
-		!fwrite(
-			&numClasses,
-			sizeof(uint64_t),
-			1,
-			output
-		      )
-	  ){
+
+	uint64_t numRows = (uint64_t)imaxabs(*height);
+	uintmax_t rowBytes = (uintmax_t)*width * (*bitsPerPixel >> 3);
+	uintmax_t rowStride = (rowBytes + 3) & ~(uintmax_t)3;
+	uint8_t *pixelBytes = (uint8_t *)malloc(rowBytes * numRows);
+	uint8_t *paddedBytes = (uint8_t *)malloc(rowStride * numRows);
+	if(!pixelBytes || !paddedBytes){
 		fprintf(
 			stderr,
-			"Error writing number of classes to %s\n",
-			pathToOutputFile
+			"Error allocating memory for pixel data of %s\n",
+			pathToFile
 		       );
-		fclose(output);
-		return false;
+		free(pixelBytes);
+		free(paddedBytes);
+		fclose(bmpFile);
+		return NULL;
 	}
-	
-	if(fclose(output) != 0){
+	uintmax_t numRowsRead =
+		fread(paddedBytes, rowStride, numRows, bmpFile);
+	if(numRowsRead != numRows){
 		fprintf(
 			stderr,
-			"Error closing %s\n",
-			pathToOutputFile
+			"Error reading row %ju of %s\n",
+			numRowsRead,
+			pathToFile
 		       );
-		return false;
+		free(pixelBytes);
+		free(paddedBytes);
+		fclose(bmpFile);
+		return NULL;
 	}
-	return true;
-}
 
-char **getClassNamesFromFile(char *pathToSvmFile, uint64_t *classCount){
-	if(access(pathToSvmFile, F_OK) != 0){
+	// Rows of BMP files with positive heights are stored bottom-up, so
+	// the row order decides only where copying starts and which way it
+	// goes
+	uint64_t topRowNum = *height > 0 ? numRows - 1 : 0;
+	uint64_t topRowStep = *height > 0 ? -(uint64_t)1 : 1;
+	for(uint64_t rowNum = 0; rowNum < numRows; rowNum++){
+		memcpy(
+			pixelBytes + topRowNum * rowBytes,
+			paddedBytes + rowNum * rowStride,
+			rowBytes
+		      );
+		topRowNum += topRowStep;
+	}
+	free(paddedBytes);
+	if(fclose(bmpFile) != 0){
+		fprintf(
+			stderr,
+			"Error closing %s\n",
+			pathToFile
+		       );
+		free(pixelBytes);
+		return NULL;
+	}
+	return pixelBytes;
+}
+
+#define RESAMPLE_OFF 0
+#define RESAMPLE_AREA 1
+#define RESAMPLE_BILINEAR 2
+
+// Source pixels contributing to each output pixel along one axis, and their
+// weights
+typedef struct {
+	uint32_t maxTaps;
+	uint32_t *firstTaps;
+	uint32_t *numTaps;
+	float *weights;
+} ResampleTaps;
+
+void freeResampleTaps(ResampleTaps *taps){
+	free(taps->firstTaps);
+	free(taps->numTaps);
+	free(taps->weights);
+	taps->firstTaps = NULL;
+	taps->numTaps = NULL;
+	taps->weights = NULL;
+}
+
+// Area resampling weights each source pixel by how much of the output
+// pixel it covers. Bilinear resampling interpolates between the two source
+// pixels nearest the output pixel's center.
+bool buildResampleTaps(
+		uint32_t numInputs,
+		uint32_t numOutputs,
+		uint8_t mode,
+		ResampleTaps *taps
+		){
+	double scale = (double)numInputs / numOutputs;
+	taps->maxTaps = mode == RESAMPLE_AREA ? (uint32_t)ceil(scale) + 1 : 2;
+	taps->firstTaps = (uint32_t *)malloc(numOutputs * sizeof(uint32_t));
+	taps->numTaps = (uint32_t *)malloc(numOutputs * sizeof(uint32_t));
+	taps->weights =
+		(float *)
+		malloc((uintmax_t)numOutputs * taps->maxTaps * sizeof(float));
+	if(!taps->firstTaps || !taps->numTaps || !taps->weights){
+		fprintf(
+			stderr,
+			"Error allocating memory for resampling\n"
+		       );
+		freeResampleTaps(taps);
+		return false;
+	}
+	for(uint32_t outputNum = 0; outputNum < numOutputs; outputNum++){
+		float *weights = taps->weights + outputNum * taps->maxTaps;
+		if(mode == RESAMPLE_AREA){
+			double start = outputNum * scale;
+			double end = (outputNum + 1) * scale;
+			uint32_t firstTap = (uint32_t)start;
+			uint32_t lastTap = (uint32_t)ceil(end) - 1;
+			if(lastTap >= numInputs)
+				lastTap = numInputs - 1;
+			taps->firstTaps[outputNum] = firstTap;
+			taps->numTaps[outputNum] = lastTap - firstTap + 1;
+			for(
+				uint32_t tapNum = firstTap;
+				tapNum <= lastTap;
+				tapNum++
+			   ){
+				double overlap =
+					fmin(end, tapNum + 1.0) -
+					fmax(start, (double)tapNum);
+				weights[tapNum - firstTap] = overlap / scale;
+			}
+			continue;
+		}
+		double center = (outputNum + 0.5) * scale - 0.5;
+		if(center < 0.0)
+			center = 0.0;
+		if(center > numInputs - 1)
+			center = numInputs - 1;
+		uint32_t firstTap = (uint32_t)center;
+		taps->firstTaps[outputNum] = firstTap;
+		if(firstTap + 1 >= numInputs){
+			taps->numTaps[outputNum] = 1;
+			weights[0] = 1.0f;
+		}else{
+			taps->numTaps[outputNum] = 2;
+			weights[0] = 1.0f - (float)(center - firstTap);
+			weights[1] = (float)(center - firstTap);
+		}
+	}
+	return true;
+}
+
+// Convert pixels between numbers of bytes per pixel, taking 1 byte as gray,
+// 3 as BGR and 4 as BGRA
+bool convertPixelChannels(
+		const uint8_t *pixelBytes,
+		uint16_t bytesPerPixel,
+		float *values,
+		uint16_t outputBytesPerPixel,
+		uintmax_t numPixels
+		){
+	if(bytesPerPixel == outputBytesPerPixel){
+		for(
+			uintmax_t byteNum = 0;
+			byteNum < numPixels * bytesPerPixel;
+			byteNum++
+		   )
+			values[byteNum] = pixelBytes[byteNum];
+		return true;
+	}
+	if(
+		bytesPerPixel == 2 ||
+		outputBytesPerPixel == 2
+	  ){
+		fprintf(
+			stderr,
+			"Error: 16 bit pixels can't be converted to or from "
+			"other bits per pixel\n"
+		       );
+		return false;
+	}
+	for(uintmax_t pixelNum = 0; pixelNum < numPixels; pixelNum++){
+		const uint8_t *pixel = pixelBytes + pixelNum * bytesPerPixel;
+		float *output = values + pixelNum * outputBytesPerPixel;
+		if(outputBytesPerPixel == 1){
+			output[0] =
+				0.114f * pixel[0] +
+				0.587f * pixel[1] +
+				0.299f * pixel[2];
+			continue;
+		}
+		for(uint16_t byteNum = 0; byteNum < 3; byteNum++)
+			output[byteNum] =
+				pixel[bytesPerPixel == 1 ? 0 : byteNum];
+		if(outputBytesPerPixel == 4)
+			output[3] = bytesPerPixel == 4 ? pixel[3] : 255.0f;
+	}
+	return true;
+}
+
+// Add weight times one row of values to another
+void addWeightedRow(
+		const float *values,
+		uintmax_t numValues,
+		float weight,
+		float *output
+		){
+	for(uintmax_t valueNum = 0; valueNum < numValues; valueNum++)
+		output[valueNum] += weight * values[valueNum];
+}
+
+#if X86_SIMD
+__attribute__((target("avx2")))
+void addWeightedRowAvx2(
+		const float *values,
+		uintmax_t numValues,
+		float weight,
+		float *output
+		){
+	__m256 weights = _mm256_set1_ps(weight);
+	uintmax_t valueNum = 0;
+	for(; valueNum + 8 <= numValues; valueNum += 8){
+		__m256 sum =
+			_mm256_add_ps(
+				_mm256_loadu_ps(output + valueNum),
+				_mm256_mul_ps(
+					weights,
+					_mm256_loadu_ps(values + valueNum)
+					)
+				);
+		_mm256_storeu_ps(output + valueNum, sum);
+	}
+	addWeightedRow(
+		values + valueNum,
+		numValues - valueNum,
+		weight,
+		output + valueNum
+		);
+}
+#endif
+
+// Resample top-down pixel bytes to other dimensions, converting between
+// numbers of bytes per pixel first
+//
+// Rows are resampled across first, then each output row is a weighted sum of
+// whole resampled rows, which vectorizes without gathering.
+uint8_t *resamplePixelBytes(
+		const uint8_t *pixelBytes,
+		uint32_t width,
+		uint32_t numRows,
+		uint16_t bytesPerPixel,
+		uint32_t outputWidth,
+		uint32_t outputNumRows,
+		uint16_t outputBytesPerPixel,
+		uint8_t mode
+		){
+#if X86_SIMD
+	bool useAvx2 = __builtin_cpu_supports("avx2");
+#endif
+	uintmax_t rowValues = (uintmax_t)width * outputBytesPerPixel;
+	uintmax_t outputRowValues =
+		(uintmax_t)outputWidth * outputBytesPerPixel;
+	ResampleTaps columnTaps;
+	ResampleTaps rowTaps;
+	if(!buildResampleTaps(width, outputWidth, mode, &columnTaps))
+		return NULL;
+	if(!buildResampleTaps(numRows, outputNumRows, mode, &rowTaps)){
+		freeResampleTaps(&columnTaps);
+		return NULL;
+	}
+	float *values = (float *)malloc(rowValues * numRows * sizeof(float));
+	float *columnValues =
+		(float *)malloc(outputRowValues * numRows * sizeof(float));
+	float *outputRow = (float *)malloc(outputRowValues * sizeof(float));
+	uint8_t *outputBytes =
+		(uint8_t *)malloc(outputRowValues * outputNumRows);
+	if(!values || !columnValues || !outputRow || !outputBytes){
+		fprintf(
+			stderr,
+			"Error allocating memory for resampling\n"
+		       );
+		free(values);
+		free(columnValues);
+		free(outputRow);
+		free(outputBytes);
+		freeResampleTaps(&columnTaps);
+		freeResampleTaps(&rowTaps);
+		return NULL;
+	}
+	if(
+		!convertPixelChannels(
+			pixelBytes,
+			bytesPerPixel,
+			values,
+			outputBytesPerPixel,
+			(uintmax_t)width * numRows
+			)
+	  ){
+		free(values);
+		free(columnValues);
+		free(outputRow);
+		free(outputBytes);
+		freeResampleTaps(&columnTaps);
+		freeResampleTaps(&rowTaps);
+		return NULL;
+	}
+
+	for(uint32_t rowNum = 0; rowNum < numRows; rowNum++){
+		const float *row = values + rowNum * rowValues;
+		float *columnRow = columnValues + rowNum * outputRowValues;
+		for(
+			uint32_t columnNum = 0;
+			columnNum < outputWidth;
+			columnNum++
+		   ){
+			const float *weights =
+				columnTaps.weights +
+				columnNum * columnTaps.maxTaps;
+			const float *firstPixel =
+				row +
+				(uintmax_t)columnTaps.firstTaps[columnNum] *
+				outputBytesPerPixel;
+			float *outputPixel =
+				columnRow + columnNum * outputBytesPerPixel;
+			for(
+				uint16_t byteNum = 0;
+				byteNum < outputBytesPerPixel;
+				byteNum++
+			   ){
+				const float *tapByte = firstPixel + byteNum;
+				float sum = 0.0f;
+				for(
+					uint32_t tapNum = 0;
+					tapNum < columnTaps.numTaps[columnNum];
+					tapNum++
+				   ){
+					sum += weights[tapNum] * *tapByte;
+					tapByte += outputBytesPerPixel;
+				}
+				outputPixel[byteNum] = sum;
+			}
+		}
+	}
+
+	for(uint32_t rowNum = 0; rowNum < outputNumRows; rowNum++){
+		const float *weights =
+			rowTaps.weights + rowNum * rowTaps.maxTaps;
+		memset(outputRow, 0, outputRowValues * sizeof(float));
+		for(
+			uint32_t tapNum = 0;
+			tapNum < rowTaps.numTaps[rowNum];
+			tapNum++
+		   ){
+			uintmax_t columnRowNum =
+				rowTaps.firstTaps[rowNum] + tapNum;
+			const float *columnRow =
+				columnValues + columnRowNum * outputRowValues;
+#if X86_SIMD
+			if(useAvx2){
+				addWeightedRowAvx2(
+					columnRow,
+					outputRowValues,
+					weights[tapNum],
+					outputRow
+					);
+				continue;
+			}
+#endif
+			addWeightedRow(
+				columnRow,
+				outputRowValues,
+				weights[tapNum],
+				outputRow
+				);
+		}
+		uint8_t *outputRowBytes =
+			outputBytes + rowNum * outputRowValues;
+		for(
+			uintmax_t valueNum = 0;
+			valueNum < outputRowValues;
+			valueNum++
+		   ){
+			float value = outputRow[valueNum] + 0.5f;
+			outputRowBytes[valueNum] =
+				value <= 0.0f ? 0 :
+				value >= 255.0f ? 255 :
+				(uint8_t)value;
+		}
+	}
+	free(values);
+	free(columnValues);
+	free(outputRow);
+	freeResampleTaps(&columnTaps);
+	freeResampleTaps(&rowTaps);
+	return outputBytes;
+}
+
+// Magnitude of a sample's bytes, which each byte is divided by to normalize
+// the sample
+double getNormDivisor(
+	const uint8_t *pixelBytes,
+	uintmax_t numBytes
+	){
+	uintmax_t sumSquareByteValues = 0;
+	for(uintmax_t byteNum = 0; byteNum < numBytes; byteNum++){
+		sumSquareByteValues +=
+			(uint16_t)pixelBytes[byteNum] * pixelBytes[byteNum];
+	}
+	return sqrt((double)sumSquareByteValues);
+}
+
+// Number of vectors required to separate every pair of classes
+uintmax_t getNumPairs(uint64_t numClasses){
+	return (uintmax_t)numClasses * (numClasses - 1) / 2;
+}
+
+// Index of the vector separating posClass from negClass, where
+// posClass < negClass, in the order that vectors are stored
+uintmax_t getPairIndex(
+		uint64_t posClass,
+		uint64_t negClass,
+		uint64_t numClasses
+		){
+	return
+		(uintmax_t)posClass * (2 * numClasses - posClass - 1) / 2 +
+		(negClass - posClass - 1);
+}
+
+// Types of feature stages stored in NSV2 files
+#define STAGE_PCA 1
+#define STAGE_CHANNELS 2
+#define STAGE_MASK 3
+#define STAGE_SPARSE_VECTORS 4
+
+#define CHANNELS_ALL 0
+#define CHANNELS_LUMINANCE 1
+#define CHANNELS_SELECTED 2
+
+#define MASK_NONE 0
+#define MASK_BMP 1
+#define MASK_RECTANGLE_LIST 2
+#define MASK_VARIANCE 3
+
+#define PRUNE_EACH_VECTOR 0
+#define PRUNE_ALL_VECTORS 1
+#define PRUNE_DIMENSIONS 2
+
+// Vectors stored as weights over lists of dimension indices, where pairs
+// that keep the same dimensions share one list
+typedef struct {
+	uint32_t numIndexLists;
+	// Indices of list l occupy listOffsets[l] up to listOffsets[l + 1], in
+	// increasing order
+	uintmax_t *listOffsets;
+	uint32_t *indices;
+	// Index list of each pair, whose weights occupy weightOffsets[p] up to
+	// weightOffsets[p + 1]
+	uint32_t *pairLists;
+	uintmax_t *weightOffsets;
+	double *weights;
+} SparseVectors;
+
+void freeSparseVectors(SparseVectors *sparse){
+	if(!sparse)
+		return;
+	free(sparse->listOffsets);
+	free(sparse->indices);
+	free(sparse->pairLists);
+	free(sparse->weightOffsets);
+	free(sparse->weights);
+	free(sparse);
+}
+
+// Formats of vector weights
+#define WEIGHTS_DOUBLE 0
+#define WEIGHTS_FLOAT 1
+#define WEIGHTS_HALF 2
+#define WEIGHTS_BFLOAT16 3
+#define NUM_WEIGHT_FORMATS 4
+
+// The byte of an SVM file that once held the size of a double holds the size
+// of its weights, with the high bit set for bfloat16
+const uint8_t weightFormatCodes[NUM_WEIGHT_FORMATS] = {8, 4, 2, 0x82};
+const char *weightFormatNames[NUM_WEIGHT_FORMATS] = {
+	"double",
+	"float",
+	"half precision",
+	"bfloat16"
+};
+
+uint8_t getWeightSize(uint8_t weightFormat){
+	return weightFormatCodes[weightFormat] & 0x7F;
+}
+
+// Round a double to the nearest half precision value, with ties to even
+uint16_t getHalfFromDouble(double value){
+	float narrowValue = (float)value;
+	uint32_t bits;
+	memcpy(&bits, &narrowValue, sizeof(uint32_t));
+	uint16_t sign = bits >> 16 & 0x8000;
+	uint32_t magnitude = bits & 0x7FFFFFFF;
+	// Infinities and NaNs stay so, and values of 65520 or more overflow
+	if(magnitude >= 0x7F800000)
+		return sign | 0x7C00 | (magnitude > 0x7F800000 ? 0x200 : 0);
+	if(magnitude >= 0x477FF000)
+		return sign | 0x7C00;
+	// Values below 2^-14 become subnormal, and those up to 2^-25 zero
+	if(magnitude < 0x38800000){
+		if(magnitude <= 0x33000000)
+			return sign;
+		uint32_t shift = 126 - (magnitude >> 23);
+		uint32_t mantissa = (magnitude & 0x7FFFFF) | 0x800000;
+		uint32_t half = mantissa >> shift;
+		uint32_t remainder = mantissa & ((1u << shift) - 1);
+		uint32_t halfway = 1u << (shift - 1);
+		if(remainder > halfway || (remainder == halfway && half & 1))
+			half++;
+		return sign | half;
+	}
+	// Rounding may carry into the exponent, as it should
+	uint32_t half = (magnitude - 0x38000000) >> 13;
+	uint32_t remainder = magnitude & 0x1FFF;
+	if(remainder > 0x1000 || (remainder == 0x1000 && half & 1))
+		half++;
+	return sign | half;
+}
+
+double getDoubleFromHalf(uint16_t half){
+	uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+	uint32_t exponent = half >> 10 & 0x1F;
+	uint32_t mantissa = half & 0x3FF;
+	if(exponent == 0){
+		double value = mantissa * 0x1p-24;
+		return sign ? -value : value;
+	}
+	uint32_t bits =
+		exponent == 0x1F ?
+		sign | 0x7F800000 | mantissa << 13 :
+		sign | (exponent + 112) << 23 | mantissa << 13;
+	float value;
+	memcpy(&value, &bits, sizeof(float));
+	return value;
+}
+
+// Round a double to the nearest bfloat16 value, the upper half of a float,
+// with ties to even
+uint16_t getBfloat16FromDouble(double value){
+	float narrowValue = (float)value;
+	uint32_t bits;
+	memcpy(&bits, &narrowValue, sizeof(uint32_t));
+	if((bits & 0x7FFFFFFF) > 0x7F800000)
+		return bits >> 16 | 0x40;
+	bits += 0x7FFF + (bits >> 16 & 1);
+	return bits >> 16;
+}
+
+double getDoubleFromBfloat16(uint16_t bfloat16){
+	uint32_t bits = (uint32_t)bfloat16 << 16;
+	float value;
+	memcpy(&value, &bits, sizeof(float));
+	return value;
+}
+
+// Read weight weightNum of an array of weights in a given format
+double widenWeight(
+		const uint8_t *weights,
+		uint8_t weightFormat,
+		uintmax_t weightNum
+		){
+	if(weightFormat == WEIGHTS_DOUBLE)
+		return ((const double *)weights)[weightNum];
+	if(weightFormat == WEIGHTS_FLOAT)
+		return ((const float *)weights)[weightNum];
+	uint16_t narrowWeight = ((const uint16_t *)weights)[weightNum];
+	if(weightFormat == WEIGHTS_HALF)
+		return getDoubleFromHalf(narrowWeight);
+	return getDoubleFromBfloat16(narrowWeight);
+}
+
+// Write weight weightNum of an array of weights in a given format
+void narrowWeight(
+		double weight,
+		uint8_t weightFormat,
+		uint8_t *weights,
+		uintmax_t weightNum
+		){
+	if(weightFormat == WEIGHTS_DOUBLE)
+		((double *)weights)[weightNum] = weight;
+	else if(weightFormat == WEIGHTS_FLOAT)
+		((float *)weights)[weightNum] = (float)weight;
+	else if(weightFormat == WEIGHTS_HALF)
+		((uint16_t *)weights)[weightNum] = getHalfFromDouble(weight);
+	else
+		((uint16_t *)weights)[weightNum] =
+			getBfloat16FromDouble(weight);
+}
+
+// Kernels of the channel stage for one number of bytes per pixel, each
+// taking the same arguments whether or not the number is built in
+typedef struct {
+	void (*getLuminanceBytes)(
+			const uint8_t *,
+			uint16_t,
+			uintmax_t,
+			uint8_t *
+			);
+	void (*selectChannels)(uint8_t *, uint16_t, uintmax_t, uint8_t);
+} ChannelKernels;
+
+// Contents of an SVM file
+//
+// NSVM files hold vectors over the normalized pixel bytes. NSV2 files
+// additionally hold a table of feature stages that transform the normalized
+// pixel bytes before they reach the vectors, the last of which may hold the
+// vectors themselves in sparse form.
+typedef struct {
+	uint32_t width;
+	int32_t height;
+	uint16_t bitsPerPixel;
+	uint64_t numClasses;
+	char **classNames;
+
+	// Bytes of each decoded pixel kept as features, before any other stage
+	uint8_t channelMode;
+	uint8_t channelMask;
+	// Chosen for bitsPerPixel when the model is loaded
+	const ChannelKernels *channelKernels;
+
+	// Bitmap of the pixels kept as features, top row first, if pixelMask
+	// isn't NULL
+	uint8_t *pixelMask;
+	uintmax_t numKeptPixels;
+
+	// Rows of the projection onto principal components if numComponents
+	// isn't 0
+	uint32_t numComponents;
+	double *components;
+
+	// Vectors separating each pair of classes, numDims doubles each
+	uintmax_t numDims;
+	double *vectors;
+
+	// The same vectors after pruning, used in their place if not NULL
+	SparseVectors *sparseVectors;
+
+	// Weights in formats other than double are held in packedWeights, in
+	// place of vectors or the weights of sparseVectors
+	uint8_t weightFormat;
+	uint8_t *packedWeights;
+} SvmModel;
+
+// Number of bytes kept of each pixel by the channel stage
+uint16_t getNumChannels(const SvmModel *model){
+	if(model->channelMode == CHANNELS_LUMINANCE)
+		return 1;
+	if(model->channelMode == CHANNELS_SELECTED)
+		return __builtin_popcount(model->channelMask);
+	return model->bitsPerPixel >> 3;
+}
+
+// Number of pixels of each decoded sample, before any are masked
+uintmax_t getNumImagePixels(const SvmModel *model){
+	return (uintmax_t)model->width * (uintmax_t)imaxabs(model->height);
+}
+
+// Number of bytes of a sample after the channel and mask stages
+uintmax_t getNumPixelBytes(const SvmModel *model){
+	uintmax_t numPixels =
+		model->pixelMask ?
+		model->numKeptPixels :
+		getNumImagePixels(model);
+	return numPixels * getNumChannels(model);
+}
+
+// Integer BT.601 luminance of BGR bytes, with weights summing to 256
+#define LUMINANCE_BLUE 29
+#define LUMINANCE_GREEN 150
+#define LUMINANCE_RED 77
+
+static inline __attribute__((always_inline))
+void getLuminanceBytesKernel(
+		const uint8_t *pixelBytes,
+		uint16_t bytesPerPixel,
+		uintmax_t numPixels,
+		uint8_t *luminanceBytes
+		){
+	for(uintmax_t pixelNum = 0; pixelNum < numPixels; pixelNum++){
+		const uint8_t *pixel = pixelBytes + pixelNum * bytesPerPixel;
+		luminanceBytes[pixelNum] =
+			(
+			 LUMINANCE_BLUE * pixel[0] +
+			 LUMINANCE_GREEN * pixel[1] +
+			 LUMINANCE_RED * pixel[2] +
+			 128
+			) >> 8;
+	}
+}
+
+// Keep the bytes of each pixel whose bits are set in channelMask, in place
+static inline __attribute__((always_inline))
+void selectChannelsKernel(
+		uint8_t *pixelBytes,
+		uint16_t bytesPerPixel,
+		uintmax_t numPixels,
+		uint8_t channelMask
+		){
+	uintmax_t numKept = 0;
+	for(uintmax_t pixelNum = 0; pixelNum < numPixels; pixelNum++){
+		const uint8_t *pixel = pixelBytes + pixelNum * bytesPerPixel;
+		for(uint16_t byteNum = 0; byteNum < bytesPerPixel; byteNum++){
+			if(channelMask >> byteNum & 1)
+				pixelBytes[numKept++] = pixel[byteNum];
+		}
+	}
+}
+
+// Define the channel kernels with the given suffix, passing bytes as the
+// number of bytes per pixel so that a constant lets the compiler unroll the
+// loop over the bytes of each pixel, in which case bytesPerPixel is unused
+#define DEFINE_CHANNEL_KERNELS(suffix, bytes) \
+	void getLuminanceBytes##suffix( \
+			const uint8_t *pixelBytes, \
+			uint16_t bytesPerPixel, \
+			uintmax_t numPixels, \
+			uint8_t *luminanceBytes \
+			){ \
+		(void)bytesPerPixel; \
+		getLuminanceBytesKernel( \
+			pixelBytes, \
+			bytes, \
+			numPixels, \
+			luminanceBytes \
+			); \
+	} \
+	void selectChannels##suffix( \
+			uint8_t *pixelBytes, \
+			uint16_t bytesPerPixel, \
+			uintmax_t numPixels, \
+			uint8_t channelMask \
+			){ \
+		(void)bytesPerPixel; \
+		selectChannelsKernel( \
+			pixelBytes, \
+			bytes, \
+			numPixels, \
+			channelMask \
+			); \
+	}
+
+DEFINE_CHANNEL_KERNELS(, bytesPerPixel)
+DEFINE_CHANNEL_KERNELS(3, 3)
+DEFINE_CHANNEL_KERNELS(4, 4)
+
+// Channel kernels for any number of bytes per pixel, then for 1 to 4, where
+// 1 and 2 bytes have no color channels to convert or select
+const ChannelKernels channelKernels[] = {
+	{getLuminanceBytes, selectChannels},
+	{NULL, NULL},
+	{NULL, NULL},
+	{getLuminanceBytes3, selectChannels3},
+	{getLuminanceBytes4, selectChannels4}
+};
+
+const ChannelKernels *getChannelKernels(uint16_t bitsPerPixel){
+	uint16_t bytesPerPixel = bitsPerPixel >> 3;
+	if(bytesPerPixel > 4 || !channelKernels[bytesPerPixel].selectChannels)
+		return channelKernels;
+	return channelKernels + bytesPerPixel;
+}
+
+#if X86_SIMD
+// Converts 8 pixels at a time by spreading the BGR bytes of each pixel into
+// 16 bit lanes, so that one multiply-add per pair of lanes and a horizontal
+// add give the weighted sum. Luminance bytes may overwrite the pixel bytes,
+// as each group of pixels is read before it is written.
+__attribute__((target("avx2")))
+void getLuminanceBytesAvx2(
+		const uint8_t *pixelBytes,
+		uint16_t bytesPerPixel,
+		uintmax_t numPixels,
+		uint8_t *luminanceBytes
+		){
+	// Byte indices of pixels 0 and 1, then 2 and 3, within each lane,
+	// with -1 giving 0
+	int8_t b = bytesPerPixel;
+	__m256i firstPairBytes =
+		_mm256_setr_epi8(
+			0, -1, 1, -1, 2, -1, -1, -1,
+			b, -1, b + 1, -1, b + 2, -1, -1, -1,
+			0, -1, 1, -1, 2, -1, -1, -1,
+			b, -1, b + 1, -1, b + 2, -1, -1, -1
+			);
+	__m256i secondPairBytes =
+		_mm256_setr_epi8(
+			2 * b, -1, 2 * b + 1, -1, 2 * b + 2, -1, -1, -1,
+			3 * b, -1, 3 * b + 1, -1, 3 * b + 2, -1, -1, -1,
+			2 * b, -1, 2 * b + 1, -1, 2 * b + 2, -1, -1, -1,
+			3 * b, -1, 3 * b + 1, -1, 3 * b + 2, -1, -1, -1
+			);
+	__m256i weights =
+		_mm256_setr_epi16(
+			LUMINANCE_BLUE, LUMINANCE_GREEN, LUMINANCE_RED, 0,
+			LUMINANCE_BLUE, LUMINANCE_GREEN, LUMINANCE_RED, 0,
+			LUMINANCE_BLUE, LUMINANCE_GREEN, LUMINANCE_RED, 0,
+			LUMINANCE_BLUE, LUMINANCE_GREEN, LUMINANCE_RED, 0
+			);
+	__m256i rounding = _mm256_set1_epi32(128);
+	uintmax_t numBytes = numPixels * bytesPerPixel;
+	uintmax_t pixelNum = 0;
+	// Each lane loads 16 bytes, of which 4 pixels are used
+	for(
+		;
+		(pixelNum + 4) * bytesPerPixel + 16 <= numBytes;
+		pixelNum += 8
+	   ){
+		const uint8_t *pixels = pixelBytes + pixelNum * bytesPerPixel;
+		__m256i bytes =
+			_mm256_setr_m128i(
+				_mm_loadu_si128((const __m128i *)pixels),
+				_mm_loadu_si128(
+					(const __m128i *)
+					(pixels + 4 * bytesPerPixel)
+					)
+				);
+		__m256i firstPair =
+			_mm256_madd_epi16(
+				_mm256_shuffle_epi8(bytes, firstPairBytes),
+				weights
+				);
+		__m256i secondPair =
+			_mm256_madd_epi16(
+				_mm256_shuffle_epi8(bytes, secondPairBytes),
+				weights
+				);
+		__m256i sums =
+			_mm256_add_epi32(
+				_mm256_hadd_epi32(firstPair, secondPair),
+				rounding
+				);
+		sums = _mm256_srli_epi32(sums, 8);
+		__m256i packed =
+			_mm256_packus_epi16(
+				_mm256_packus_epi32(sums, sums),
+				_mm256_setzero_si256()
+				);
+		uint32_t firstFour = _mm256_extract_epi32(packed, 0);
+		uint32_t secondFour = _mm256_extract_epi32(packed, 4);
+		memcpy(luminanceBytes + pixelNum, &firstFour, 4);
+		memcpy(luminanceBytes + pixelNum + 4, &secondFour, 4);
+	}
+	getLuminanceBytes(
+		pixelBytes + pixelNum * bytesPerPixel,
+		bytesPerPixel,
+		numPixels - pixelNum,
+		luminanceBytes + pixelNum
+		);
+}
+#endif
+
+// Keep the bytes of each of numPixels decoded pixels selected by the model's
+// channel mode, in place
+void applyChannelStage(
+		const SvmModel *model,
+		uint8_t *pixelBytes,
+		uintmax_t numPixels
+		){
+	uint16_t bytesPerPixel = model->bitsPerPixel >> 3;
+	if(model->channelMode == CHANNELS_LUMINANCE){
+#if X86_SIMD
+		if(__builtin_cpu_supports("avx2")){
+			getLuminanceBytesAvx2(
+				pixelBytes,
+				bytesPerPixel,
+				numPixels,
+				pixelBytes
+				);
+			return;
+		}
+#endif
+		model->channelKernels->getLuminanceBytes(
+			pixelBytes,
+			bytesPerPixel,
+			numPixels,
+			pixelBytes
+			);
+		return;
+	}
+	if(model->channelMode != CHANNELS_SELECTED)
+		return;
+	model->channelKernels->selectChannels(
+		pixelBytes,
+		bytesPerPixel,
+		numPixels,
+		model->channelMask
+		);
+}
+
+// Keep the bytes of the pixels in the model's pixel mask, in place, after
+// the channel stage
+void applyPixelMask(const SvmModel *model, uint8_t *pixelBytes){
+	if(!model->pixelMask)
+		return;
+	uint16_t numChannels = getNumChannels(model);
+	uintmax_t numPixels = getNumImagePixels(model);
+	uintmax_t numKept = 0;
+	for(uintmax_t pixelNum = 0; pixelNum < numPixels; pixelNum++){
+		if(!(model->pixelMask[pixelNum >> 3] >> (pixelNum & 7) & 1))
+			continue;
+		memmove(
+			pixelBytes + numKept,
+			pixelBytes + pixelNum * numChannels,
+			numChannels
+		       );
+		numKept += numChannels;
+	}
+}
+
+// Apply the stages that select bytes of decoded pixels, in place
+void applyDecodeStages(const SvmModel *model, uint8_t *pixelBytes){
+	applyChannelStage(model, pixelBytes, getNumImagePixels(model));
+	applyPixelMask(model, pixelBytes);
+}
+
+// Resample decoded pixel bytes to the dimensions of a model, freeing the
+// original bytes
+uint8_t *resampleToModel(
+		uint8_t *pixelBytes,
+		uint32_t width,
+		int32_t height,
+		uint16_t bitsPerPixel,
+		const SvmModel *model,
+		uint8_t mode
+		){
+	uint8_t *resampledBytes =
+		resamplePixelBytes(
+			pixelBytes,
+			width,
+			imaxabs(height),
+			bitsPerPixel >> 3,
+			model->width,
+			imaxabs(model->height),
+			model->bitsPerPixel >> 3,
+			mode
+			);
+	free(pixelBytes);
+	return resampledBytes;
+}
+
+void freeSvmModel(SvmModel *model){
+	if(model->classNames)
+		freeClassNames(model->classNames, model->numClasses);
+	model->classNames = NULL;
+	free(model->pixelMask);
+	model->pixelMask = NULL;
+	free(model->components);
+	model->components = NULL;
+	free(model->vectors);
+	model->vectors = NULL;
+	freeSparseVectors(model->sparseVectors);
+	model->sparseVectors = NULL;
+	free(model->packedWeights);
+	model->packedWeights = NULL;
+}
+
+// Number of weights held by the vectors of a model
+uintmax_t getNumWeights(const SvmModel *model){
+	uintmax_t numPairs = getNumPairs(model->numClasses);
+	if(model->sparseVectors)
+		return model->sparseVectors->weightOffsets[numPairs];
+	return numPairs * model->numDims;
+}
+
+// Convert the weights of a model's vectors from another format to double
+bool widenVectors(SvmModel *model){
+	if(model->weightFormat == WEIGHTS_DOUBLE)
+		return true;
+	uintmax_t numWeights = getNumWeights(model);
+	double *weights = (double *)malloc((numWeights + 1) * sizeof(double));
+	if(!weights){
+		fprintf(
+			stderr,
+			"Error allocating memory for vectors\n"
+		       );
+		return false;
+	}
+	for(uintmax_t weightNum = 0; weightNum < numWeights; weightNum++)
+		weights[weightNum] =
+			widenWeight(
+				model->packedWeights,
+				model->weightFormat,
+				weightNum
+				);
+	if(model->sparseVectors){
+		free(model->sparseVectors->weights);
+		model->sparseVectors->weights = weights;
+	}else{
+		free(model->vectors);
+		model->vectors = weights;
+	}
+	free(model->packedWeights);
+	model->packedWeights = NULL;
+	model->weightFormat = WEIGHTS_DOUBLE;
+	return true;
+}
+
+// Convert the weights of a model's vectors from double to another format,
+// keeping the double weights until the model is freed
+bool narrowVectors(SvmModel *model, uint8_t weightFormat){
+	if(weightFormat == WEIGHTS_DOUBLE)
+		return true;
+	uintmax_t numWeights = getNumWeights(model);
+	model->packedWeights =
+		(uint8_t *)
+		malloc((numWeights + 1) * getWeightSize(weightFormat));
+	if(!model->packedWeights){
+		fprintf(
+			stderr,
+			"Error allocating memory for vectors\n"
+		       );
+		return false;
+	}
+	double *weights =
+		model->sparseVectors ?
+		model->sparseVectors->weights :
+		model->vectors;
+	for(uintmax_t weightNum = 0; weightNum < numWeights; weightNum++)
+		narrowWeight(
+			weights[weightNum],
+			weightFormat,
+			model->packedWeights,
+			weightNum
+			);
+	model->weightFormat = weightFormat;
+	return true;
+}
+
+// Set the channel stage of a model, checking that it suits the model's
+// pixels
+bool setChannelMode(SvmModel *model, uint8_t channelMode, uint8_t channelMask){
+	uint16_t bytesPerPixel = model->bitsPerPixel >> 3;
+	model->channelMode = channelMode;
+	model->channelMask = 0;
+	if(channelMode == CHANNELS_ALL)
+		return true;
+	if(channelMode == CHANNELS_LUMINANCE){
+		if(bytesPerPixel == 3 || bytesPerPixel == 4)
+			return true;
+		fprintf(
+			stderr,
+			"Error: Luminance requires 24 or 32 bits per pixel, "
+			"not %" PRIu16 "\n",
+			model->bitsPerPixel
+		       );
+		return false;
+	}
+	if(channelMode == CHANNELS_SELECTED){
+		model->channelMask = channelMask;
+		if(channelMask && !(channelMask >> bytesPerPixel))
+			return true;
+		fprintf(
+			stderr,
+			"Error: Channel mask 0x%" PRIx8 " doesn't select bytes "
+			"of %" PRIu16 " bit pixels\n",
+			channelMask,
+			model->bitsPerPixel
+		       );
+		return false;
+	}
+	fprintf(
+		stderr,
+		"Error: Unknown channel mode %d\n",
+		channelMode
+	       );
+	return false;
+}
+
+// Set the mask stage of a model, taking ownership of a bitmap of the pixels
+// to keep. A mask that keeps every pixel is dropped.
+bool setPixelMask(SvmModel *model, uint8_t *pixelMask){
+	uintmax_t numPixels = getNumImagePixels(model);
+	uintmax_t numKeptPixels = 0;
+	for(uintmax_t pixelNum = 0; pixelNum < numPixels; pixelNum++)
+		numKeptPixels += pixelMask[pixelNum >> 3] >> (pixelNum & 7) & 1;
+	free(model->pixelMask);
+	model->pixelMask = NULL;
+	model->numKeptPixels = 0;
+	if(numKeptPixels == numPixels){
+		free(pixelMask);
+		return true;
+	}
+	if(!numKeptPixels){
+		fprintf(
+			stderr,
+			"Error: Pixel mask doesn't keep any pixels\n"
+		       );
+		free(pixelMask);
+		return false;
+	}
+	model->pixelMask = pixelMask;
+	model->numKeptPixels = numKeptPixels;
+	return true;
+}
+
+// Build a pixel mask from the nonzero pixels of a BMP file with the same
+// width and height as the model
+uint8_t *readPixelMask(char *pathToMask, const SvmModel *model){
+	uint32_t width;
+	int32_t height;
+	uint16_t bitsPerPixel;
+	uint8_t *maskBytes =
+		decodeBmp(pathToMask, &width, &height, &bitsPerPixel);
+	if(!maskBytes)
+		return NULL;
+	if(
+		width != model->width ||
+		imaxabs(height) != imaxabs(model->height)
+	  ){
+		fprintf(
+			stderr,
+			"Error: Mask %s is %" PRIu32 "x%" PRId32 " pixels, but "
+			"samples are %" PRIu32 "x%" PRId32 " pixels\n",
+			pathToMask,
+			width,
+			(int32_t)imaxabs(height),
+			model->width,
+			(int32_t)imaxabs(model->height)
+		       );
+		free(maskBytes);
+		return NULL;
+	}
+	uintmax_t numPixels = getNumImagePixels(model);
+	uint8_t *pixelMask = (uint8_t *)calloc((numPixels + 7) / 8, 1);
+	if(!pixelMask){
+		fprintf(
+			stderr,
+			"Error allocating memory for pixel mask\n"
+		       );
+		free(maskBytes);
+		return NULL;
+	}
+	uint16_t bytesPerPixel = bitsPerPixel >> 3;
+	for(uintmax_t pixelNum = 0; pixelNum < numPixels; pixelNum++){
+		for(uint16_t byteNum = 0; byteNum < bytesPerPixel; byteNum++){
+			if(maskBytes[pixelNum * bytesPerPixel + byteNum]){
+				pixelMask[pixelNum >> 3] |= 1 << (pixelNum & 7);
+				break;
+			}
+		}
+	}
+	free(maskBytes);
+	return pixelMask;
+}
+
+// Build a pixel mask from rectangles of left, top, width and height, clipped
+// to the model's dimensions
+uint8_t *getRectanglePixelMask(
+		const uint32_t *rectangles,
+		uint8_t numRectangles,
+		const SvmModel *model
+		){
+	uint32_t numRows = imaxabs(model->height);
+	uint8_t *pixelMask =
+		(uint8_t *)calloc((getNumImagePixels(model) + 7) / 8, 1);
+	if(!pixelMask){
+		fprintf(
+			stderr,
+			"Error allocating memory for pixel mask\n"
+		       );
+		return NULL;
+	}
+	for(uint8_t rectNum = 0; rectNum < numRectangles; rectNum++){
+		const uint32_t *rectangle = rectangles + 4 * rectNum;
+		uint64_t right = (uint64_t)rectangle[0] + rectangle[2];
+		uint64_t bottom = (uint64_t)rectangle[1] + rectangle[3];
+		if(right > model->width)
+			right = model->width;
+		if(bottom > numRows)
+			bottom = numRows;
+		for(uint64_t rowNum = rectangle[1]; rowNum < bottom; rowNum++){
+			for(
+				uint64_t columnNum = rectangle[0];
+				columnNum < right;
+				columnNum++
+			   ){
+				uintmax_t pixelNum =
+					rowNum * model->width + columnNum;
+				pixelMask[pixelNum >> 3] |= 1 << (pixelNum & 7);
+			}
+		}
+	}
+	return pixelMask;
+}
+
+// Scan the input directory for class subdirectories whose BMP files share
+// dimensions, establishing the dimensions and class names of the model
+bool initializeSvmModel(
+		char *pathToInputDir,
+		SvmModel *model
+		){
+	model->numClasses = 0;
+	model->classNames = NULL;
+	model->channelMode = CHANNELS_ALL;
+	model->channelMask = 0;
+	model->channelKernels = channelKernels;
+	model->pixelMask = NULL;
+	model->numKeptPixels = 0;
+	model->numComponents = 0;
+	model->components = NULL;
+	model->numDims = 0;
+	model->vectors = NULL;
+	model->sparseVectors = NULL;
+	model->weightFormat = WEIGHTS_DOUBLE;
+	model->packedWeights = NULL;
+	uint64_t classCapacity = 0;
+
+	struct dirent *firstLevelDirEntry;
+	DIR *firstLevelDir = opendir(pathToInputDir);
+	if(!firstLevelDir){
+		fprintf(
+			stderr,
+			"Error opening directory %s\n",
+			pathToInputDir
+		       );
+		return false;
+	}
+	while(firstLevelDirEntry = readdir(firstLevelDir)){
+		// Disregard hidden entries and anything that isn't a directory
+		if(firstLevelDirEntry->d_name[0] == '.')
+			continue;
+		char *pathToFirstLevelDir =
+			getPathInDir(
+				pathToInputDir,
+				firstLevelDirEntry->d_name
+				);
+		if(!pathToFirstLevelDir){
+			closedir(firstLevelDir);
+			freeSvmModel(model);
+			return false;
+		}
+
+		struct stat direntStatus;
+		if(stat(pathToFirstLevelDir, &direntStatus) != 0){
+			fprintf(
+				stderr,
+				"Error getting status of %s\n",
+				pathToFirstLevelDir
+			       );
+			free(pathToFirstLevelDir);
+			closedir(firstLevelDir);
+			freeSvmModel(model);
+			return false;
+		}
+		if(!S_ISDIR(direntStatus.st_mode)){
+			free(pathToFirstLevelDir);
+			continue;
+		}
+
+		// Class names are stored with a one byte run length
+		if(strlen(firstLevelDirEntry->d_name) > UINT8_MAX){
+			fprintf(
+				stderr,
+				"Disregarding %s: Name is longer than %d "
+				"characters\n",
+				pathToFirstLevelDir,
+				UINT8_MAX
+			       );
+			free(pathToFirstLevelDir);
+			continue;
+		}
+
+		// Disregard directories with regular files that don't all
+		// match the established dimensions
+		uint32_t dirWidth;
+		int32_t dirHeight;
+		uint16_t dirBitsPerPixel;
+		if(
+			!allFilesSameDims(
+				pathToFirstLevelDir,
+				&dirWidth,
+				&dirHeight,
+				&dirBitsPerPixel,
+				RESAMPLE != RESAMPLE_OFF
+				) ||
+			// Currently only whole bytes per pixel supported
+			dirBitsPerPixel & 7 ||
+			dirBitsPerPixel == 0
+		  ){
+			free(pathToFirstLevelDir);
+			continue;
+		}else if (model->numClasses != 0){
+			if(
+				RESAMPLE == RESAMPLE_OFF &&
+				(
+				 dirWidth != model->width ||
+				 dirHeight != model->height ||
+				 dirBitsPerPixel != model->bitsPerPixel
+				)
+			  ){
+				free(pathToFirstLevelDir);
+				continue;
+			}
+		// Establish dimensions on first valid directory
+		}else{
+			model->width = dirWidth;
+			model->height = dirHeight;
+			model->bitsPerPixel = dirBitsPerPixel;
+		}
+		free(pathToFirstLevelDir);
+
+		if(model->numClasses == classCapacity){
+			classCapacity = classCapacity ? 2 * classCapacity : 8;
+			char **classNames =
+				(char **)
+				realloc(
+					model->classNames,
+					classCapacity * sizeof(char *)
+				       );
+			if(!classNames){
+				fprintf(
+					stderr,
+					"Error allocating memory for class "
+					"names\n"
+				       );
+				closedir(firstLevelDir);
+				freeSvmModel(model);
+				return false;
+			}
+			model->classNames = classNames;
+		}
+		model->classNames[model->numClasses] =
+			strdup(firstLevelDirEntry->d_name);
+		if(!model->classNames[model->numClasses]){
+			fprintf(
+				stderr,
+				"Error allocating memory for class name\n"
+			       );
+			closedir(firstLevelDir);
+			freeSvmModel(model);
+			return false;
+		}
+		model->numClasses++;
+	}
+	if(closedir(firstLevelDir) != 0){
+		fprintf(
+			stderr,
+			"Error closing %s\n",
+			pathToInputDir
+		       );
+		freeSvmModel(model);
+		return false;
+	}
+	if(model->numClasses < 2){
+		fprintf(
+			stderr,
+			"Error: fewer than 2 valid class directories\n"
+		       );
+		freeSvmModel(model);
+		return false;
+	}
+	if(RESAMPLE != RESAMPLE_OFF){
+		if(RESAMPLE_WIDTH)
+			model->width = RESAMPLE_WIDTH;
+		if(RESAMPLE_HEIGHT)
+			model->height = RESAMPLE_HEIGHT;
+		if(RESAMPLE_BITS_PER_PIXEL)
+			model->bitsPerPixel = RESAMPLE_BITS_PER_PIXEL;
+	}
+	if(!setChannelMode(model, CHANNEL_MODE, CHANNEL_MASK)){
+		freeSvmModel(model);
+		return false;
+	}
+	model->channelKernels = getChannelKernels(model->bitsPerPixel);
+	model->numDims = getNumPixelBytes(model);
+	return true;
+}
+
+// Size in bytes of the stage holding a model's sparse vectors
+uint64_t getSparseStageSize(const SvmModel *model){
+	const SparseVectors *sparse = model->sparseVectors;
+	return
+		sizeof(uint32_t) +
+		(uint64_t)sparse->numIndexLists * sizeof(uint64_t) +
+		sparse->listOffsets[sparse->numIndexLists] * sizeof(uint32_t) +
+		getNumPairs(model->numClasses) * sizeof(uint32_t) +
+		getNumWeights(model) * getWeightSize(model->weightFormat);
+}
+
+// Write the stage holding sparse vectors: the number of index lists, the
+// length of each, their indices, the list of each pair and the weights of
+// each pair
+bool writeSparseVectors(FILE *output, const SvmModel *model){
+	const SparseVectors *sparse = model->sparseVectors;
+	uintmax_t numPairs = getNumPairs(model->numClasses);
+	uint8_t stageType = STAGE_SPARSE_VECTORS;
+	uint64_t stageSize = getSparseStageSize(model);
+	if(
+		!fwrite(&stageType, sizeof(uint8_t), 1, output) ||
+		!fwrite(&stageSize, sizeof(uint64_t), 1, output) ||
+		!fwrite(&sparse->numIndexLists, sizeof(uint32_t), 1, output)
+	  )
+		return false;
+	for(uint32_t listNum = 0; listNum < sparse->numIndexLists; listNum++){
+		uint64_t listLength =
+			sparse->listOffsets[listNum + 1] -
+			sparse->listOffsets[listNum];
+		if(!fwrite(&listLength, sizeof(uint64_t), 1, output))
+			return false;
+	}
+	uintmax_t numIndices = sparse->listOffsets[sparse->numIndexLists];
+	uintmax_t numWeights = getNumWeights(model);
+	uint8_t weightSize = getWeightSize(model->weightFormat);
+	return
+		fwrite(
+			sparse->indices,
+			sizeof(uint32_t),
+			numIndices,
+			output
+		      ) == numIndices &&
+		fwrite(
+			sparse->pairLists,
+			sizeof(uint32_t),
+			numPairs,
+			output
+		      ) == numPairs &&
+		fwrite(
+			model->weightFormat == WEIGHTS_DOUBLE ?
+			(const void *)sparse->weights :
+			(const void *)model->packedWeights,
+			weightSize,
+			numWeights,
+			output
+		      ) == numWeights;
+}
+
+// Write each class name of a model preceeded by its run length
+bool writeClassNames(
+		FILE *output,
+		const SvmModel *model,
+		char *pathToOutputFile
+		){
+	for(uint64_t classNum = 0; classNum < model->numClasses; classNum++){
+		uint8_t classNameLength = strlen(model->classNames[classNum]);
+		if(
+			!fwrite(
+				&classNameLength,
+				sizeof(uint8_t),
+				1,
+				output
+			       ) ||
+			fwrite(
+				model->classNames[classNum],
+				sizeof(char),
+				classNameLength,
+				output
+			      ) != classNameLength
+		  ){
+			fprintf(
+				stderr,
+				"Error writing class name and run length of "
+				"%s to %s\n",
+				model->classNames[classNum],
+				pathToOutputFile
+			       );
+			return false;
+		}
+	}
+	return true;
+}
+
+bool writeSvmModel(
+		char *pathToOutputFile,
+		SvmModel *model
+		){
+	if(access(pathToOutputFile, F_OK) == 0){
+		if(access(pathToOutputFile, W_OK) != 0){
+			fprintf(
+				stderr,
+				"Insufficient permission to overwrite %s\n",
+				pathToOutputFile
+			       );
+			return false;
+		}
+	}
+
+	FILE *output = fopen(pathToOutputFile, "wb");
+	if(!output){
+		fprintf(
+			stderr,
+			"Error opening %s for writing\n",
+			pathToOutputFile
+		       );
+		return false;
+	}
+
+	// Files without feature stages remain readable by older versions
+	uint8_t numStages =
+		(model->channelMode != CHANNELS_ALL) +
+		(model->pixelMask != NULL) +
+		(model->numComponents != 0) +
+		(model->sparseVectors != NULL);
+	char *svmMagicNumber = numStages ? "NSV2" : "NSVM";
+	uint8_t weightFormatCode = weightFormatCodes[model->weightFormat];
+	if(
+		fwrite(svmMagicNumber, 1, 4, output) != 4 ||
+		!fwrite(&weightFormatCode, sizeof(uint8_t), 1, output) ||
+		!fwrite(&model->width, sizeof(uint32_t), 1, output) ||
+		!fwrite(&model->height, sizeof(int32_t), 1, output) ||
+		!fwrite(&model->bitsPerPixel, sizeof(uint16_t), 1, output) ||
+		!fwrite(&model->numClasses, sizeof(uint64_t), 1, output)
+	  ){
+		fprintf(
+			stderr,
+			"Error writing metadata to %s\n",
+			pathToOutputFile
+		       );
+		fclose(output);
+		return false;
+	}
+
+	if(!writeClassNames(output, model, pathToOutputFile)){
+		fclose(output);
+		return false;
+	}
+
+	// Write feature stages in the order they are applied, each preceeded
+	// by its type and size in bytes
+	if(numStages && !fwrite(&numStages, sizeof(uint8_t), 1, output)){
+		fprintf(
+			stderr,
+			"Error writing feature stages to %s\n",
+			pathToOutputFile
+		       );
+		fclose(output);
+		return false;
+	}
+	if(model->channelMode != CHANNELS_ALL){
+		uint8_t stageType = STAGE_CHANNELS;
+		uint64_t stageSize = 2 * sizeof(uint8_t);
+		if(
+			!fwrite(&stageType, sizeof(uint8_t), 1, output) ||
+			!fwrite(&stageSize, sizeof(uint64_t), 1, output) ||
+			!fwrite(
+				&model->channelMode,
+				sizeof(uint8_t),
+				1,
+				output
+			       ) ||
+			!fwrite(
+				&model->channelMask,
+				sizeof(uint8_t),
+				1,
+				output
+			       )
+		  ){
+			fprintf(
+				stderr,
+				"Error writing feature stages to %s\n",
+				pathToOutputFile
+			       );
+			fclose(output);
+			return false;
+		}
+	}
+	if(model->pixelMask){
+		uint8_t stageType = STAGE_MASK;
+		uint64_t stageSize = (getNumImagePixels(model) + 7) / 8;
+		if(
+			!fwrite(&stageType, sizeof(uint8_t), 1, output) ||
+			!fwrite(&stageSize, sizeof(uint64_t), 1, output) ||
+			fwrite(
+				model->pixelMask,
+				sizeof(uint8_t),
+				stageSize,
+				output
+			      ) != stageSize
+		  ){
+			fprintf(
+				stderr,
+				"Error writing feature stages to %s\n",
+				pathToOutputFile
+			       );
+			fclose(output);
+			return false;
+		}
+	}
+	if(model->numComponents){
+		uint8_t stageType = STAGE_PCA;
+		uintmax_t numComponentValues =
+			(uintmax_t)model->numComponents *
+			getNumPixelBytes(model);
+		uint64_t stageSize =
+			sizeof(uint32_t) +
+			numComponentValues * sizeof(double);
+		if(
+			!fwrite(&stageType, sizeof(uint8_t), 1, output) ||
+			!fwrite(&stageSize, sizeof(uint64_t), 1, output) ||
+			!fwrite(
+				&model->numComponents,
+				sizeof(uint32_t),
+				1,
+				output
+			       ) ||
+			fwrite(
+				model->components,
+				sizeof(double),
+				numComponentValues,
+				output
+			      ) != numComponentValues
+		  ){
+			fprintf(
+				stderr,
+				"Error writing feature stages to %s\n",
+				pathToOutputFile
+			       );
+			fclose(output);
+			return false;
+		}
+	}
+
+	// Sparse vectors, as the last stage, replace the dense ones
+	uintmax_t numWeights = getNumWeights(model);
+	if(
+		model->sparseVectors ?
+		!writeSparseVectors(output, model) :
+		fwrite(
+			model->weightFormat == WEIGHTS_DOUBLE ?
+			(const void *)model->vectors :
+			(const void *)model->packedWeights,
+			getWeightSize(model->weightFormat),
+			numWeights,
+			output
+		      ) != numWeights
+	  ){
+		fprintf(
+			stderr,
+			"Error writing vectors to %s\n",
+			pathToOutputFile
+		       );
+		fclose(output);
+		return false;
+	}
+
+	if(fclose(output) != 0){
+		fprintf(
+			stderr,
+			"Error closing %s\n",
+			pathToOutputFile
+		       );
+		return false;
+	}
+	return true;
+}
+
+// Copy the next numBytes of a file held in memory, failing rather than
+// reading past its end
+bool readFromBuffer(
+		const uint8_t *buffer,
+		uintmax_t bufferSize,
+		uintmax_t *position,
+		void *destination,
+		uintmax_t numBytes
+		){
+	if(numBytes > bufferSize - *position)
+		return false;
+	memcpy(destination, buffer + *position, numBytes);
+	*position += numBytes;
+	return true;
+}
+
+// Parse the stage holding sparse vectors, which ends at stageEnd, leaving
+// their weights in the file's format in weightBytes
+bool parseSparseVectors(
+		const uint8_t *buffer,
+		uintmax_t stageEnd,
+		uintmax_t *position,
+		uintmax_t numPairs,
+		uintmax_t numDims,
+		uint8_t weightSize,
+		SparseVectors **sparseVectors,
+		uint8_t **weightBytes
+		){
+	uint32_t numIndexLists;
+	if(
+		!readFromBuffer(
+			buffer,
+			stageEnd,
+			position,
+			&numIndexLists,
+			sizeof(uint32_t)
+			) ||
+		numIndexLists == 0 ||
+		numIndexLists > (stageEnd - *position) / sizeof(uint64_t)
+	  )
+		return false;
+	SparseVectors *sparse =
+		(SparseVectors *)calloc(1, sizeof(SparseVectors));
+	if(sparse){
+		sparse->numIndexLists = numIndexLists;
+		sparse->listOffsets =
+			(uintmax_t *)
+			malloc((numIndexLists + 1) * sizeof(uintmax_t));
+		sparse->pairLists =
+			(uint32_t *)malloc((numPairs + 1) * sizeof(uint32_t));
+		sparse->weightOffsets =
+			(uintmax_t *)malloc((numPairs + 1) * sizeof(uintmax_t));
+	}
+	if(
+		!sparse ||
+		!sparse->listOffsets ||
+		!sparse->pairLists ||
+		!sparse->weightOffsets
+	  ){
+		fprintf(
+			stderr,
+			"Error allocating memory for sparse vectors\n"
+		       );
+		freeSparseVectors(sparse);
+		return false;
+	}
+
+	sparse->listOffsets[0] = 0;
+	for(uint32_t listNum = 0; listNum < numIndexLists; listNum++){
+		uint64_t listLength;
+		if(
+			!readFromBuffer(
+				buffer,
+				stageEnd,
+				position,
+				&listLength,
+				sizeof(uint64_t)
+				) ||
+			listLength > numDims
+		  ){
+			freeSparseVectors(sparse);
+			return false;
+		}
+		sparse->listOffsets[listNum + 1] =
+			sparse->listOffsets[listNum] + listLength;
+	}
+	uintmax_t numIndices = sparse->listOffsets[numIndexLists];
+	if(numIndices > (stageEnd - *position) / sizeof(uint32_t)){
+		freeSparseVectors(sparse);
+		return false;
+	}
+	sparse->indices =
+		(uint32_t *)malloc((numIndices + 1) * sizeof(uint32_t));
+	if(!sparse->indices){
+		fprintf(
+			stderr,
+			"Error allocating memory for sparse vectors\n"
+		       );
+		freeSparseVectors(sparse);
+		return false;
+	}
+	readFromBuffer(
+		buffer,
+		stageEnd,
+		position,
+		sparse->indices,
+		numIndices * sizeof(uint32_t)
+		);
+	// Indices increase along each list and are gathered as signed 32 bit
+	// offsets
+	for(uint32_t listNum = 0; listNum < numIndexLists; listNum++){
+		for(
+			uintmax_t indexNum = sparse->listOffsets[listNum];
+			indexNum < sparse->listOffsets[listNum + 1];
+			indexNum++
+		   ){
+			if(
+				sparse->indices[indexNum] >= numDims ||
+				sparse->indices[indexNum] > INT32_MAX ||
+				(
+				 indexNum > sparse->listOffsets[listNum] &&
+				 sparse->indices[indexNum] <=
+					sparse->indices[indexNum - 1]
+				)
+			  ){
+				freeSparseVectors(sparse);
+				return false;
+			}
+		}
+	}
+
+	// Each pair has one weight for every index of its list
+	if(
+		!readFromBuffer(
+			buffer,
+			stageEnd,
+			position,
+			sparse->pairLists,
+			numPairs * sizeof(uint32_t)
+			)
+	  ){
+		freeSparseVectors(sparse);
+		return false;
+	}
+	sparse->weightOffsets[0] = 0;
+	for(uintmax_t pairNum = 0; pairNum < numPairs; pairNum++){
+		uint32_t listNum = sparse->pairLists[pairNum];
+		if(listNum >= numIndexLists){
+			freeSparseVectors(sparse);
+			return false;
+		}
+		sparse->weightOffsets[pairNum + 1] =
+			sparse->weightOffsets[pairNum] +
+			sparse->listOffsets[listNum + 1] -
+			sparse->listOffsets[listNum];
+	}
+	uintmax_t numWeights = sparse->weightOffsets[numPairs];
+	if(stageEnd - *position != numWeights * weightSize){
+		freeSparseVectors(sparse);
+		return false;
+	}
+	*weightBytes = (uint8_t *)malloc((numWeights + 1) * weightSize);
+	if(!*weightBytes){
+		fprintf(
+			stderr,
+			"Error allocating memory for sparse vectors\n"
+		       );
+		freeSparseVectors(sparse);
+		return false;
+	}
+	readFromBuffer(
+		buffer,
+		stageEnd,
+		position,
+		*weightBytes,
+		numWeights * weightSize
+		);
+	*sparseVectors = sparse;
+	return true;
+}
+
+// Parse an SVM file that has been read into memory
+bool parseSvmModel(
+		const uint8_t *buffer,
+		uintmax_t bufferSize,
+		char *pathToSvmFile,
+		SvmModel *model
+		){
+	model->classNames = NULL;
+	model->channelMode = CHANNELS_ALL;
+	model->channelMask = 0;
+	model->channelKernels = channelKernels;
+	model->pixelMask = NULL;
+	model->numKeptPixels = 0;
+	model->numComponents = 0;
+	model->components = NULL;
+	model->vectors = NULL;
+	model->sparseVectors = NULL;
+	model->weightFormat = WEIGHTS_DOUBLE;
+	model->packedWeights = NULL;
+	uintmax_t position = 0;
+
+	char svmMagicNumber[4];
+	if(!readFromBuffer(buffer, bufferSize, &position, svmMagicNumber, 4)){
+		fprintf(
+			stderr,
+			"Error reading magic number from %s\n",
+			pathToSvmFile
+		       );
+		return false;
+	}
+	bool hasStages = strncmp(svmMagicNumber, "NSV2", 4) == 0;
+	if(!hasStages && strncmp(svmMagicNumber, "NSVM", 4) != 0){
+		fprintf(
+			stderr,
+			"%s does not have the expected magic number\n",
+			pathToSvmFile
+		       );
+		return false;
+	}
+	uint8_t weightFormatCode;
+	if(
+		!readFromBuffer(
+			buffer,
+			bufferSize,
+			&position,
+			&weightFormatCode,
+			1
+			)
+	  ){
+		fprintf(
+			stderr,
+			"Error reading weight format from %s\n",
+			pathToSvmFile
+		       );
+		return false;
+	}
+	while(
+		model->weightFormat < NUM_WEIGHT_FORMATS &&
+		weightFormatCodes[model->weightFormat] != weightFormatCode
+	)
+		model->weightFormat++;
+	if(model->weightFormat == NUM_WEIGHT_FORMATS){
+		fprintf(
+			stderr,
+			"Error: %s has the unrecognised weight format code "
+			"%" PRIu8 "\n",
+			pathToSvmFile,
+			weightFormatCode
+		       );
+		return false;
+	}
+	if(
+		!readFromBuffer(
+			buffer,
+			bufferSize,
+			&position,
+			&model->width,
+			sizeof(uint32_t)
+			) ||
+		!readFromBuffer(
+			buffer,
+			bufferSize,
+			&position,
+			&model->height,
+			sizeof(int32_t)
+			) ||
+		!readFromBuffer(
+			buffer,
+			bufferSize,
+			&position,
+			&model->bitsPerPixel,
+			sizeof(uint16_t)
+			) ||
+		!readFromBuffer(
+			buffer,
+			bufferSize,
+			&position,
+			&model->numClasses,
+			sizeof(uint64_t)
+			)
+	  ){
+		fprintf(
+			stderr,
+			"Error reading training dimensions from %s\n",
+			pathToSvmFile
+		       );
+		return false;
+	}
+	if(
+		model->numClasses < 2 ||
+		model->numClasses > bufferSize ||
+		model->width == 0 ||
+		model->height == 0 ||
+		model->bitsPerPixel & 7 ||
+		model->bitsPerPixel == 0
+	  ){
+		fprintf(
+			stderr,
+			"%s is improperly formatted. %s reports being trained "
+			"on %ju classes of %" PRIu32 "x%" PRId32 " images with "
+			"%" PRIu16 " bits per pixel\n",
+			pathToSvmFile,
+			pathToSvmFile,
+			(uintmax_t)model->numClasses,
+			model->width,
+			model->height,
+			model->bitsPerPixel
+		       );
+		return false;
+	}
+	model->channelKernels = getChannelKernels(model->bitsPerPixel);
+
+	model->classNames =
+		(char **)
+		calloc(
+			model->numClasses,
+			sizeof(char *)
+		      );
+	if(!model->classNames){
+		fprintf(
+			stderr,
+			"Error allocating memory for class name pointers\n"
+		       );
+		return false;
+	}
+	for(uint64_t classNum = 0; classNum < model->numClasses; classNum++){
+		uint8_t nameRunLength;
+		if(
+			!readFromBuffer(
+				buffer,
+				bufferSize,
+				&position,
+				&nameRunLength,
+				1
+				)
+		  ){
+			fprintf(
+				stderr,
+				"Error reading run length of class %ju of %ju "
+				"from %s\n",
+				(uintmax_t)classNum + 1,
+				(uintmax_t)model->numClasses,
+				pathToSvmFile
+			       );
+			freeSvmModel(model);
+			return false;
+		}
+		model->classNames[classNum] =
+			(char *)
+			malloc(
+				sizeof(char) *
+				nameRunLength +
+				1
+			      );
+		if(!model->classNames[classNum]){
+			fprintf(
+				stderr,
+				"Error allocating memory for class name\n"
+			       );
+			freeSvmModel(model);
+			return false;
+		}
+		if(
+			!readFromBuffer(
+				buffer,
+				bufferSize,
+				&position,
+				model->classNames[classNum],
+				nameRunLength
+				)
+		  ){
+			fprintf(
+				stderr,
+				"Error reading class name from %s\n",
+				pathToSvmFile
+			       );
+			freeSvmModel(model);
+			return false;
+		}
+		model->classNames[classNum][nameRunLength] = '\0';
+	}
+
+	model->numDims = getNumPixelBytes(model);
+	uint8_t numStages = 0;
+	if(
+		hasStages &&
+		!readFromBuffer(buffer, bufferSize, &position, &numStages, 1)
+	  ){
+		fprintf(
+			stderr,
+			"Error reading number of feature stages from %s\n",
+			pathToSvmFile
+		       );
+		freeSvmModel(model);
+		return false;
+	}
+	for(uint8_t stageNum = 0; stageNum < numStages; stageNum++){
+		uint8_t stageType;
+		uint64_t stageSize;
+		if(
+			!readFromBuffer(
+				buffer,
+				bufferSize,
+				&position,
+				&stageType,
+				sizeof(uint8_t)
+				) ||
+			!readFromBuffer(
+				buffer,
+				bufferSize,
+				&position,
+				&stageSize,
+				sizeof(uint64_t)
+				) ||
+			stageSize > bufferSize - position
+		  ){
+			fprintf(
+				stderr,
+				"Error reading header of feature stage %d from "
+				"%s\n",
+				stageNum + 1,
+				pathToSvmFile
+			       );
+			freeSvmModel(model);
+			return false;
+		}
+		uintmax_t stageEnd = position + stageSize;
+		uintmax_t numPixelBytes = getNumPixelBytes(model);
+		// Channels are selected from decoded pixels, before any other
+		// stage
+		if(
+			stageType == STAGE_CHANNELS &&
+			stageNum == 0 &&
+			stageSize == 2 * sizeof(uint8_t)
+		  ){
+			uint8_t channelMode;
+			uint8_t channelMask;
+			readFromBuffer(
+				buffer,
+				bufferSize,
+				&position,
+				&channelMode,
+				sizeof(uint8_t)
+				);
+			readFromBuffer(
+				buffer,
+				bufferSize,
+				&position,
+				&channelMask,
+				sizeof(uint8_t)
+				);
+			if(!setChannelMode(model, channelMode, channelMask)){
+				fprintf(
+					stderr,
+					"Channel stage of %s is improperly "
+					"formatted\n",
+					pathToSvmFile
+				       );
+				freeSvmModel(model);
+				return false;
+			}
+			model->numDims = getNumPixelBytes(model);
+		}else if(
+			stageType == STAGE_MASK &&
+			!model->pixelMask &&
+			!model->components
+		  ){
+			// Pixels are masked after channels are selected and
+			// before any projection
+			if(stageSize != (getNumImagePixels(model) + 7) / 8){
+				fprintf(
+					stderr,
+					"Pixel mask of %s is improperly "
+					"formatted\n",
+					pathToSvmFile
+				       );
+				freeSvmModel(model);
+				return false;
+			}
+			uint8_t *pixelMask = (uint8_t *)malloc(stageSize);
+			if(!pixelMask){
+				fprintf(
+					stderr,
+					"Error allocating memory for pixel "
+					"mask\n"
+				       );
+				freeSvmModel(model);
+				return false;
+			}
+			readFromBuffer(
+				buffer,
+				bufferSize,
+				&position,
+				pixelMask,
+				stageSize
+				);
+			if(!setPixelMask(model, pixelMask)){
+				freeSvmModel(model);
+				return false;
+			}
+			model->numDims = getNumPixelBytes(model);
+		}else if(stageType == STAGE_PCA && !model->components){
+			if(
+				!readFromBuffer(
+					buffer,
+					bufferSize,
+					&position,
+					&model->numComponents,
+					sizeof(uint32_t)
+					) ||
+				model->numComponents == 0 ||
+				stageSize !=
+					sizeof(uint32_t) +
+					(uintmax_t)model->numComponents *
+					numPixelBytes *
+					sizeof(double)
+			  ){
+				fprintf(
+					stderr,
+					"Principal components in %s are "
+					"improperly formatted\n",
+					pathToSvmFile
+				       );
+				freeSvmModel(model);
+				return false;
+			}
+			uintmax_t numComponentValues =
+				(uintmax_t)model->numComponents * numPixelBytes;
+			model->components =
+				(double *)
+				malloc(numComponentValues * sizeof(double));
+			if(!model->components){
+				fprintf(
+					stderr,
+					"Error allocating memory for principal "
+					"components\n"
+				       );
+				freeSvmModel(model);
+				return false;
+			}
+			readFromBuffer(
+				buffer,
+				bufferSize,
+				&position,
+				model->components,
+				numComponentValues * sizeof(double)
+				);
+			model->numDims = model->numComponents;
+		}else if(
+			stageType == STAGE_SPARSE_VECTORS &&
+			stageNum == numStages - 1
+		  ){
+			uint8_t *weightBytes;
+			if(
+				!parseSparseVectors(
+					buffer,
+					stageEnd,
+					&position,
+					getNumPairs(model->numClasses),
+					model->numDims,
+					getWeightSize(model->weightFormat),
+					&model->sparseVectors,
+					&weightBytes
+					)
+			  ){
+				fprintf(
+					stderr,
+					"Sparse vectors in %s are improperly "
+					"formatted\n",
+					pathToSvmFile
+				       );
+				freeSvmModel(model);
+				return false;
+			}
+			if(model->weightFormat == WEIGHTS_DOUBLE)
+				model->sparseVectors->weights =
+					(double *)weightBytes;
+			else
+				model->packedWeights = weightBytes;
+		}else{
+			fprintf(
+				stderr,
+				"%s uses a feature stage of type %d, which is "
+				"not supported\n",
+				pathToSvmFile,
+				stageType
+			       );
+			freeSvmModel(model);
+			return false;
+		}
+		if(position != stageEnd){
+			fprintf(
+				stderr,
+				"Feature stage %d of %s has an unexpected "
+				"size\n",
+				stageNum + 1,
+				pathToSvmFile
+			       );
+			freeSvmModel(model);
+			return false;
+		}
+	}
+
+	// Sparse vectors replace the dense ones
+	uint8_t weightSize = getWeightSize(model->weightFormat);
+	uintmax_t numVectorValues =
+		model->sparseVectors ?
+		0 :
+		getNumPairs(model->numClasses) * model->numDims;
+	if(
+		(bufferSize - position) / weightSize != numVectorValues ||
+		(bufferSize - position) % weightSize != 0
+	  ){
+		fprintf(
+			stderr,
+			"%s does not contain the expected %ju vector "
+			"values\n",
+			pathToSvmFile,
+			numVectorValues
+		       );
+		freeSvmModel(model);
+		return false;
+	}
+	if(model->sparseVectors)
+		return true;
+	uint8_t *weightBytes = (uint8_t *)malloc(numVectorValues * weightSize);
+	if(!weightBytes){
+		fprintf(
+			stderr,
+			"Error allocating memory for vectors in %s\n",
+			pathToSvmFile
+		       );
+		freeSvmModel(model);
+		return false;
+	}
+	readFromBuffer(
+		buffer,
+		bufferSize,
+		&position,
+		weightBytes,
+		numVectorValues * weightSize
+		);
+	if(model->weightFormat == WEIGHTS_DOUBLE)
+		model->vectors = (double *)weightBytes;
+	else
+		model->packedWeights = weightBytes;
+	return true;
+}
+
+// Read a whole file into memory, checking that it's a readable regular
+// file
+uint8_t *readFileBytes(char *pathToFile, uintmax_t *fileSize){
+	if(access(pathToFile, F_OK) != 0){
 		fprintf(
 			stderr,
 			"%s doesn't exist\n",
+			pathToFile
+			);
+		return NULL;
+	}
+	if(access(pathToFile, R_OK) != 0){
+		fprintf(
+			stderr,
+			"Insufficient permission to read %s\n",
+			pathToFile
+			);
+		return NULL;
+	}
+	struct stat fileStatus;
+	if(stat(pathToFile, &fileStatus) != 0){
+		fprintf(
+			stderr,
+			"Error getting status of %s\n",
+			pathToFile
+		       );
+		return NULL;
+	}
+	if(!S_ISREG(fileStatus.st_mode)){
+		fprintf(
+			stderr,
+			"%s is not a regular file\n",
+			pathToFile
+		       );
+		return NULL;
+	}
+	uintmax_t bufferSize = fileStatus.st_size;
+	uint8_t *buffer = (uint8_t *)malloc(bufferSize ? bufferSize : 1);
+	if(!buffer){
+		fprintf(
+			stderr,
+			"Error allocating memory to read %s\n",
+			pathToFile
+		       );
+		return NULL;
+	}
+	FILE *file = fopen(pathToFile, "rb");
+	if(!file){
+		fprintf(
+			stderr,
+			"Error opening %s\n",
+			pathToFile
+		       );
+		free(buffer);
+		return NULL;
+	}
+	if(fread(buffer, 1, bufferSize, file) != bufferSize){
+		fprintf(
+			stderr,
+			"Error reading %s\n",
+			pathToFile
+		       );
+		free(buffer);
+		fclose(file);
+		return NULL;
+	}
+	fclose(file);
+	*fileSize = bufferSize;
+	return buffer;
+}
+
+// Map a whole file into memory read-only, checking that it's a readable
+// regular file, so that only the pages that are read are loaded
+const uint8_t *mapFile(char *pathToFile, uintmax_t *fileSize){
+	int fileDescriptor = open(pathToFile, O_RDONLY);
+	if(fileDescriptor < 0){
+		fprintf(
+			stderr,
+			"Error opening %s: %s\n",
+			pathToFile,
+			strerror(errno)
+		       );
+		return NULL;
+	}
+	struct stat fileStatus;
+	if(fstat(fileDescriptor, &fileStatus) != 0){
+		fprintf(
+			stderr,
+			"Error getting status of %s\n",
+			pathToFile
+		       );
+		close(fileDescriptor);
+		return NULL;
+	}
+	if(!S_ISREG(fileStatus.st_mode) || fileStatus.st_size == 0){
+		fprintf(
+			stderr,
+			"%s is not a nonempty regular file\n",
+			pathToFile
+		       );
+		close(fileDescriptor);
+		return NULL;
+	}
+	void *bytes =
+		mmap(
+			NULL,
+			fileStatus.st_size,
+			PROT_READ,
+			MAP_PRIVATE,
+			fileDescriptor,
+			0
+		    );
+	close(fileDescriptor);
+	if(bytes == MAP_FAILED){
+		fprintf(
+			stderr,
+			"Error mapping %s into memory\n",
+			pathToFile
+		       );
+		return NULL;
+	}
+	*fileSize = fileStatus.st_size;
+	return (const uint8_t *)bytes;
+}
+
+void unmapFile(const uint8_t *bytes, uintmax_t fileSize){
+	munmap((void *)bytes, fileSize);
+}
+
+// Read an SVM file into memory and parse it
+bool loadSvmModel(
+		char *pathToSvmFile,
+		SvmModel *model
+		){
+	uintmax_t bufferSize;
+	uint8_t *buffer = readFileBytes(pathToSvmFile, &bufferSize);
+	if(!buffer)
+		return false;
+	bool parsed = parseSvmModel(buffer, bufferSize, pathToSvmFile, model);
+	free(buffer);
+	return parsed;
+}
+
+// Map the pixel bytes of a sample to the values that the model's vectors
+// operate on by normalizing them and applying any feature stages
+void getSampleFeatures(
+		const SvmModel *model,
+		const uint8_t *pixelBytes,
+		double normDivisor,
+		double *features
+		){
+	uintmax_t numPixelBytes = getNumPixelBytes(model);
+	if(normDivisor == 0.0){
+		for(uintmax_t dimNum = 0; dimNum < model->numDims; dimNum++)
+			features[dimNum] = 0.0;
+		return;
+	}
+	if(!model->numComponents){
+		for(uintmax_t byteNum = 0; byteNum < numPixelBytes; byteNum++)
+			features[byteNum] = pixelBytes[byteNum] / normDivisor;
+		return;
+	}
+	for(
+		uint32_t componentNum = 0;
+		componentNum < model->numComponents;
+		componentNum++
+	   ){
+		const double *component =
+			model->components + componentNum * numPixelBytes;
+		double projection = 0.0;
+		for(uintmax_t byteNum = 0; byteNum < numPixelBytes; byteNum++)
+			projection += component[byteNum] * pixelBytes[byteNum];
+		features[componentNum] = projection / normDivisor;
+	}
+}
+
+// Dot product of the weights of a sparse vector with the features at their
+// indices
+double getSparseDotProduct(
+		const double *weights,
+		const uint32_t *indices,
+		uintmax_t numWeights,
+		const double *features
+		){
+	double dotProduct = 0.0;
+	for(uintmax_t weightNum = 0; weightNum < numWeights; weightNum++)
+		dotProduct += weights[weightNum] * features[indices[weightNum]];
+	return dotProduct;
+}
+
+#if X86_SIMD
+// AVX2 version of the above, gathering four features at a time
+__attribute__((target("avx2")))
+double getSparseDotProductAvx2(
+		const double *weights,
+		const uint32_t *indices,
+		uintmax_t numWeights,
+		const double *features
+		){
+	__m256d sums = _mm256_setzero_pd();
+	uintmax_t weightNum = 0;
+	for(; weightNum + 4 <= numWeights; weightNum += 4){
+		__m256d gathered =
+			_mm256_i32gather_pd(
+				features,
+				_mm_loadu_si128(
+					(const __m128i *)(indices + weightNum)
+					),
+				sizeof(double)
+				);
+		sums =
+			_mm256_add_pd(
+				sums,
+				_mm256_mul_pd(
+					_mm256_loadu_pd(weights + weightNum),
+					gathered
+					)
+				);
+	}
+	double partialSums[4];
+	_mm256_storeu_pd(partialSums, sums);
+	return
+		partialSums[0] + partialSums[1] +
+		partialSums[2] + partialSums[3] +
+		getSparseDotProduct(
+			weights + weightNum,
+			indices + weightNum,
+			numWeights - weightNum,
+			features
+			);
+}
+#endif
+
+// Dot product of weights in a format other than double with features,
+// which are at the weights' indices if indices isn't NULL
+double getPackedDotProduct(
+		const uint8_t *weights,
+		uint8_t weightFormat,
+		const uint32_t *indices,
+		uintmax_t numWeights,
+		const double *features
+		){
+	double dotProduct = 0.0;
+	for(uintmax_t weightNum = 0; weightNum < numWeights; weightNum++)
+		dotProduct +=
+			widenWeight(weights, weightFormat, weightNum) *
+			features[indices ? indices[weightNum] : weightNum];
+	return dotProduct;
+}
+
+#if X86_SIMD
+// AVX2 version of the above, widening four weights at a time in registers
+// with F16C
+__attribute__((target("avx2,f16c")))
+double getPackedDotProductAvx2(
+		const uint8_t *weights,
+		uint8_t weightFormat,
+		const uint32_t *indices,
+		uintmax_t numWeights,
+		const double *features
+		){
+	uint8_t weightSize = getWeightSize(weightFormat);
+	__m256d sums = _mm256_setzero_pd();
+	uintmax_t weightNum = 0;
+	for(; weightNum + 4 <= numWeights; weightNum += 4){
+		const uint8_t *packed = weights + weightNum * weightSize;
+		__m128 narrowWeights;
+		if(weightFormat == WEIGHTS_FLOAT)
+			narrowWeights = _mm_loadu_ps((const float *)packed);
+		else{
+			// Bfloat16 values are the upper halves of floats
+			__m128i halves =
+				_mm_loadl_epi64((const __m128i *)packed);
+			narrowWeights =
+				weightFormat == WEIGHTS_HALF ?
+				_mm_cvtph_ps(halves) :
+				_mm_castsi128_ps(
+					_mm_slli_epi32(
+						_mm_cvtepu16_epi32(halves),
+						16
+						)
+					);
+		}
+		__m256d featureValues =
+			indices ?
+			_mm256_i32gather_pd(
+				features,
+				_mm_loadu_si128(
+					(const __m128i *)(indices + weightNum)
+					),
+				sizeof(double)
+				) :
+			_mm256_loadu_pd(features + weightNum);
+		sums =
+			_mm256_add_pd(
+				sums,
+				_mm256_mul_pd(
+					_mm256_cvtps_pd(narrowWeights),
+					featureValues
+					)
+				);
+	}
+	double partialSums[4];
+	_mm256_storeu_pd(partialSums, sums);
+	return
+		partialSums[0] + partialSums[1] +
+		partialSums[2] + partialSums[3] +
+		getPackedDotProduct(
+			weights + weightNum * weightSize,
+			weightFormat,
+			indices ? indices + weightNum : NULL,
+			numWeights - weightNum,
+			features + (indices ? 0 : weightNum)
+			);
+}
+#endif
+
+// Dot product of the vector of a pair of classes with the features of a
+// sample
+double getPairDotProduct(
+		const SvmModel *model,
+		uintmax_t pairNum,
+		const double *features
+		){
+	const SparseVectors *sparse = model->sparseVectors;
+	if(model->weightFormat != WEIGHTS_DOUBLE){
+		uint8_t weightSize = getWeightSize(model->weightFormat);
+		const uint8_t *weights =
+			model->packedWeights +
+			(
+			 sparse ?
+			 sparse->weightOffsets[pairNum] :
+			 pairNum * model->numDims
+			) * weightSize;
+		const uint32_t *indices =
+			sparse ?
+			sparse->indices +
+			sparse->listOffsets[sparse->pairLists[pairNum]] :
+			NULL;
+		uintmax_t numWeights =
+			sparse ?
+			sparse->weightOffsets[pairNum + 1] -
+			sparse->weightOffsets[pairNum] :
+			model->numDims;
+#if X86_SIMD
+		if(
+			__builtin_cpu_supports("avx2") &&
+			__builtin_cpu_supports("f16c")
+		  )
+			return
+				getPackedDotProductAvx2(
+					weights,
+					model->weightFormat,
+					indices,
+					numWeights,
+					features
+					);
+#endif
+		return
+			getPackedDotProduct(
+				weights,
+				model->weightFormat,
+				indices,
+				numWeights,
+				features
+				);
+	}
+	if(!sparse){
+		const double *vector =
+			model->vectors + pairNum * model->numDims;
+		double dotProduct = 0.0;
+		for(uintmax_t dimNum = 0; dimNum < model->numDims; dimNum++)
+			dotProduct += vector[dimNum] * features[dimNum];
+		return dotProduct;
+	}
+	const double *weights =
+		sparse->weights + sparse->weightOffsets[pairNum];
+	const uint32_t *indices =
+		sparse->indices +
+		sparse->listOffsets[sparse->pairLists[pairNum]];
+	uintmax_t numWeights =
+		sparse->weightOffsets[pairNum + 1] -
+		sparse->weightOffsets[pairNum];
+#if X86_SIMD
+	if(__builtin_cpu_supports("avx2"))
+		return
+			getSparseDotProductAvx2(
+				weights,
+				indices,
+				numWeights,
+				features
+				);
+#endif
+	return getSparseDotProduct(weights, indices, numWeights, features);
+}
+
+// Count the votes of every pair's vector for the features of a sample,
+// returning the class with the most votes or numClasses if several tie
+//
+// Each pair's dot product is kept in dotProducts unless it's NULL.
+uint64_t getVotedClass(
+		const SvmModel *model,
+		const double *features,
+		uintmax_t *vectorsInFavor,
+		double *dotProducts
+		){
+	uint64_t numClasses = model->numClasses;
+	memset(vectorsInFavor, 0, numClasses * sizeof(uintmax_t));
+	uintmax_t pairNum = 0;
+	for(uint64_t posClass = 0; posClass < numClasses - 1; posClass++){
+		for(
+			uint64_t negClass = posClass + 1;
+			negClass < numClasses;
+			negClass++
+		   ){
+			double dotProduct =
+				getPairDotProduct(model, pairNum, features);
+			if(dotProducts)
+				dotProducts[pairNum] = dotProduct;
+			pairNum++;
+			if(dotProduct > 0.0)
+				vectorsInFavor[posClass]++;
+			else
+				vectorsInFavor[negClass]++;
+		}
+	}
+	uint64_t votedClass = 0;
+	bool isTie = false;
+	for(uint64_t classNum = 1; classNum < numClasses; classNum++){
+		if(vectorsInFavor[classNum] > vectorsInFavor[votedClass]){
+			votedClass = classNum;
+			isTie = false;
+		}else if(vectorsInFavor[classNum] == vectorsInFavor[votedClass])
+			isTie = true;
+	}
+	return isTie ? numClasses : votedClass;
+}
+
+// Smallest dot product of the pairs of a voted class, signed towards the
+// class, which is negative if it lost any of its pairs, or -INFINITY for a
+// tie
+double getVoteMargin(
+		const SvmModel *model,
+		const double *dotProducts,
+		uint64_t votedClass
+		){
+	if(votedClass >= model->numClasses)
+		return -INFINITY;
+	double margin = INFINITY;
+	for(
+		uint64_t otherClass = 0;
+		otherClass < model->numClasses;
+		otherClass++
+	   ){
+		if(otherClass == votedClass)
+			continue;
+		double signedProduct =
+			otherClass > votedClass ?
+			dotProducts[
+				getPairIndex(
+					votedClass,
+					otherClass,
+					model->numClasses
+					)
+			] :
+			-dotProducts[
+				getPairIndex(
+					otherClass,
+					votedClass,
+					model->numClasses
+					)
+			];
+		if(signedProduct < margin)
+			margin = signedProduct;
+	}
+	return margin;
+}
+
+// Decoded samples of every class, held in memory for the whole training run
+typedef struct {
+	uint64_t numClasses;
+	uintmax_t numSamples;
+	uintmax_t sampleBytes;
+	// Samples of class c occupy indices classOffsets[c] up to
+	// classOffsets[c + 1]
+	uintmax_t *classOffsets;
+	char **samplePaths;
+	uint8_t *pixelBytes;
+	double *normDivisors;
+	// Samples of a training split index the pixel bytes of the cache they
+	// are drawn from, which they share, in place of holding their own.
+	// Samples of other caches are stored in order, with this NULL.
+	uintmax_t *sampleNums;
+} SampleCache;
+
+// Pixel bytes of a sample of a cache
+static inline const uint8_t *getCachedSample(
+		const SampleCache *cache,
+		uintmax_t sampleNum
+		){
+	if(cache->sampleNums)
+		sampleNum = cache->sampleNums[sampleNum];
+	return cache->pixelBytes + sampleNum * cache->sampleBytes;
+}
+
+void freeSampleCache(SampleCache *cache){
+	if(cache->samplePaths){
+		for(
+			uintmax_t sampleNum = 0;
+			sampleNum < cache->numSamples;
+			sampleNum++
+		   )
+			free(cache->samplePaths[sampleNum]);
+	}
+	free(cache->samplePaths);
+	free(cache->classOffsets);
+	free(cache->pixelBytes);
+	free(cache->normDivisors);
+	cache->samplePaths = NULL;
+	cache->classOffsets = NULL;
+	cache->pixelBytes = NULL;
+	cache->normDivisors = NULL;
+}
+
+// Add a decoded sample to the cache, growing its storage as necessary
+bool appendToSampleCache(
+		SampleCache *cache,
+		uintmax_t *sampleCapacity,
+		char *pathToSample,
+		uint8_t *pixelBytes
+		){
+	if(cache->numSamples == *sampleCapacity){
+		uintmax_t newCapacity =
+			*sampleCapacity ? 2 * *sampleCapacity : 64;
+		char **samplePaths =
+			(char **)
+			realloc(
+				cache->samplePaths,
+				newCapacity * sizeof(char *)
+			       );
+		if(samplePaths)
+			cache->samplePaths = samplePaths;
+		double *normDivisors =
+			(double *)
+			realloc(
+				cache->normDivisors,
+				newCapacity * sizeof(double)
+			       );
+		if(normDivisors)
+			cache->normDivisors = normDivisors;
+		uint8_t *cachedBytes =
+			(uint8_t *)
+			realloc(
+				cache->pixelBytes,
+				newCapacity * cache->sampleBytes
+			       );
+		if(cachedBytes)
+			cache->pixelBytes = cachedBytes;
+		if(!samplePaths || !normDivisors || !cachedBytes){
+			fprintf(
+				stderr,
+				"Error allocating memory for %ju samples\n",
+				newCapacity
+			       );
+			return false;
+		}
+		*sampleCapacity = newCapacity;
+	}
+	memcpy(
+		cache->pixelBytes + cache->numSamples * cache->sampleBytes,
+		pixelBytes,
+		cache->sampleBytes
+	      );
+	cache->normDivisors[cache->numSamples] =
+		getNormDivisor(pixelBytes, cache->sampleBytes);
+	cache->samplePaths[cache->numSamples] = pathToSample;
+	cache->numSamples++;
+	return true;
+}
+
+// Decode every BMP file in the class directories of the model once, so that
+// training steps don't touch the file system
+bool loadSampleCache(
+		char *pathToInputDir,
+		const SvmModel *model,
+		SampleCache *cache
+		){
+	cache->numClasses = model->numClasses;
+	cache->numSamples = 0;
+	cache->sampleBytes = getNumPixelBytes(model);
+	cache->samplePaths = NULL;
+	cache->pixelBytes = NULL;
+	cache->normDivisors = NULL;
+	cache->sampleNums = NULL;
+	cache->classOffsets =
+		(uintmax_t *)
+		malloc((model->numClasses + 1) * sizeof(uintmax_t));
+	if(!cache->classOffsets){
+		fprintf(
+			stderr,
+			"Error allocating memory to hold number of samples in "
+			"each class\n"
+		       );
+		return false;
+	}
+	uintmax_t sampleCapacity = 0;
+
+	for(uint64_t classNum = 0; classNum < model->numClasses; classNum++){
+		cache->classOffsets[classNum] = cache->numSamples;
+		char *pathToClassDir =
+			getPathInDir(
+				pathToInputDir,
+				model->classNames[classNum]
+				);
+		if(!pathToClassDir){
+			freeSampleCache(cache);
+			return false;
+		}
+		DIR *classDir = opendir(pathToClassDir);
+		if(!classDir){
+			fprintf(
+				stderr,
+				"Error opening %s\n",
+				pathToClassDir
+			       );
+			free(pathToClassDir);
+			freeSampleCache(cache);
+			return false;
+		}
+
+		// Decode non-hidden regular files that have the BMP magic
+		// number
+		struct dirent *sample;
+		struct stat sampleStatus;
+		while((sample = readdir(classDir))){
+			if(sample->d_name[0] == '.')
+				continue;
+			char *pathToSample =
+				getPathInDir(
+					pathToClassDir,
+					sample->d_name
+					);
+			if(!pathToSample){
+				closedir(classDir);
+				free(pathToClassDir);
+				freeSampleCache(cache);
+				return false;
+			}
+			if(stat(pathToSample, &sampleStatus) != 0){
+				fprintf(
+					stderr,
+					"Error getting status of %s\n",
+					pathToSample
+				       );
+				free(pathToSample);
+				closedir(classDir);
+				free(pathToClassDir);
+				freeSampleCache(cache);
+				return false;
+			}
+			if(
+				!S_ISREG(sampleStatus.st_mode) ||
+				!hasBmpMagicNumber(pathToSample)
+			  ){
+				free(pathToSample);
+				continue;
+			}
+			uint32_t width;
+			int32_t height;
+			uint16_t bitsPerPixel;
+			uint8_t *pixelBytes =
+				decodeBmp(
+					pathToSample,
+					&width,
+					&height,
+					&bitsPerPixel
+					);
+			if(
+				pixelBytes &&
+				RESAMPLE != RESAMPLE_OFF &&
+				(
+				 width != model->width ||
+				 imaxabs(height) != imaxabs(model->height) ||
+				 bitsPerPixel != model->bitsPerPixel
+				)
+			  ){
+				if(DEBUG_LEVEL < 1){
+					fprintf(
+						stderr,
+						"\tDebug: Resampling %s\n",
+						pathToSample
+					       );
+				}
+				pixelBytes =
+					resampleToModel(
+						pixelBytes,
+						width,
+						height,
+						bitsPerPixel,
+						model,
+						RESAMPLE
+						);
+				width = model->width;
+				height = model->height;
+				bitsPerPixel = model->bitsPerPixel;
+			}
+			if(
+				!pixelBytes ||
+				width != model->width ||
+				imaxabs(height) != imaxabs(model->height) ||
+				bitsPerPixel != model->bitsPerPixel
+			  ){
+				fprintf(
+					stderr,
+					"Error decoding %s with the "
+					"dimensions of the model\n",
+					pathToSample
+				       );
+				free(pixelBytes);
+				free(pathToSample);
+				closedir(classDir);
+				free(pathToClassDir);
+				freeSampleCache(cache);
+				return false;
+			}
+			applyDecodeStages(model, pixelBytes);
+			if(
+				!appendToSampleCache(
+					cache,
+					&sampleCapacity,
+					pathToSample,
+					pixelBytes
+					)
+			  ){
+				free(pixelBytes);
+				free(pathToSample);
+				closedir(classDir);
+				free(pathToClassDir);
+				freeSampleCache(cache);
+				return false;
+			}
+			free(pixelBytes);
+		}
+		if(closedir(classDir) != 0){
+			fprintf(
+				stderr,
+				"Error closing %s\n",
+				pathToClassDir
+			       );
+			free(pathToClassDir);
+			freeSampleCache(cache);
+			return false;
+		}
+		if(cache->numSamples == cache->classOffsets[classNum]){
+			fprintf(
+				stderr,
+				"Error getting samples in %s: Unable to read "
+				"or directory is empty\n",
+				pathToClassDir
+			       );
+			free(pathToClassDir);
+			freeSampleCache(cache);
+			return false;
+		}
+		free(pathToClassDir);
+	}
+	cache->classOffsets[model->numClasses] = cache->numSamples;
+	return true;
+}
+
+// Build a pixel mask keeping the pixels whose bytes vary across the cached
+// samples by at least minVariance, summed over the bytes of each pixel
+uint8_t *learnPixelMask(
+		const SampleCache *cache,
+		const SvmModel *model,
+		double minVariance
+		){
+	uint16_t numChannels = getNumChannels(model);
+	uintmax_t numPixels = getNumImagePixels(model);
+	uint64_t *byteSums =
+		(uint64_t *)calloc(cache->sampleBytes, sizeof(uint64_t));
+	uint64_t *squareSums =
+		(uint64_t *)calloc(cache->sampleBytes, sizeof(uint64_t));
+	uint8_t *pixelMask = (uint8_t *)calloc((numPixels + 7) / 8, 1);
+	if(!byteSums || !squareSums || !pixelMask){
+		fprintf(
+			stderr,
+			"Error allocating memory for pixel mask\n"
+		       );
+		free(byteSums);
+		free(squareSums);
+		free(pixelMask);
+		return NULL;
+	}
+	for(
+		uintmax_t sampleNum = 0;
+		sampleNum < cache->numSamples;
+		sampleNum++
+	   ){
+		const uint8_t *sample = getCachedSample(cache, sampleNum);
+		for(
+			uintmax_t byteNum = 0;
+			byteNum < cache->sampleBytes;
+			byteNum++
+		   ){
+			byteSums[byteNum] += sample[byteNum];
+			squareSums[byteNum] +=
+				(uint64_t)sample[byteNum] * sample[byteNum];
+		}
+	}
+	double numSamples = cache->numSamples;
+	for(uintmax_t pixelNum = 0; pixelNum < numPixels; pixelNum++){
+		double variance = 0.0;
+		for(uint16_t byteNum = 0; byteNum < numChannels; byteNum++){
+			uintmax_t offset = pixelNum * numChannels + byteNum;
+			double mean = byteSums[offset] / numSamples;
+			variance +=
+				squareSums[offset] / numSamples - mean * mean;
+		}
+		if(variance >= minVariance)
+			pixelMask[pixelNum >> 3] |= 1 << (pixelNum & 7);
+	}
+	free(byteSums);
+	free(squareSums);
+	return pixelMask;
+}
+
+// Mask the samples of a cache loaded before the model's pixel mask was set,
+// in place
+void maskSampleCache(SampleCache *cache, const SvmModel *model){
+	uintmax_t sampleBytes = getNumPixelBytes(model);
+	for(
+		uintmax_t sampleNum = 0;
+		sampleNum < cache->numSamples;
+		sampleNum++
+	   ){
+		uint8_t *sample =
+			cache->pixelBytes + sampleNum * cache->sampleBytes;
+		applyPixelMask(model, sample);
+		memmove(
+			cache->pixelBytes + sampleNum * sampleBytes,
+			sample,
+			sampleBytes
+		       );
+		cache->normDivisors[sampleNum] =
+			getNormDivisor(
+				cache->pixelBytes + sampleNum * sampleBytes,
+				sampleBytes
+				);
+	}
+	cache->sampleBytes = sampleBytes;
+	uint8_t *pixelBytes =
+		(uint8_t *)
+		realloc(cache->pixelBytes, cache->numSamples * sampleBytes);
+	if(pixelBytes)
+		cache->pixelBytes = pixelBytes;
+}
+
+// Orthonormalize numCols columns of length colLength, stored one after
+// another, using modified Gram-Schmidt
+void orthonormalizeColumns(
+		double *columns,
+		uintmax_t colLength,
+		uintmax_t numCols
+		){
+	for(uintmax_t colNum = 0; colNum < numCols; colNum++){
+		double *column = columns + colNum * colLength;
+		for(
+			uintmax_t prevColNum = 0;
+			prevColNum < colNum;
+			prevColNum++
+		   ){
+			double *prevColumn = columns + prevColNum * colLength;
+			double overlap = 0.0;
+			for(uintmax_t rowNum = 0; rowNum < colLength; rowNum++)
+				overlap += column[rowNum] * prevColumn[rowNum];
+			for(uintmax_t rowNum = 0; rowNum < colLength; rowNum++)
+				column[rowNum] -= overlap * prevColumn[rowNum];
+		}
+		double magnitude = 0.0;
+		for(uintmax_t rowNum = 0; rowNum < colLength; rowNum++)
+			magnitude += column[rowNum] * column[rowNum];
+		magnitude = sqrt(magnitude);
+		// Columns that are linearly dependent on earlier ones are
+		// left at 0
+		for(uintmax_t rowNum = 0; rowNum < colLength; rowNum++)
+			column[rowNum] =
+				magnitude > 1e-12 ?
+				column[rowNum] / magnitude :
+				0.0;
+	}
+}
+
+// Find the eigenvalues and eigenvectors of a small symmetric matrix using
+// cyclic Jacobi rotations
+//
+// The eigenvalues replace the diagonal of matrix and the eigenvectors are
+// stored as the columns of eigenvectors
+void getSymmetricEigen(
+		double *matrix,
+		uintmax_t size,
+		double *eigenvectors
+		){
+	for(uintmax_t rowNum = 0; rowNum < size; rowNum++)
+		for(uintmax_t colNum = 0; colNum < size; colNum++)
+			eigenvectors[rowNum * size + colNum] =
+				rowNum == colNum ? 1.0 : 0.0;
+	for(int sweepNum = 0; sweepNum < 64; sweepNum++){
+		double offDiagonal = 0.0;
+		for(uintmax_t rowNum = 0; rowNum < size; rowNum++)
+			for(
+				uintmax_t colNum = rowNum + 1;
+				colNum < size;
+				colNum++
+			   )
+				offDiagonal +=
+					matrix[rowNum * size + colNum] *
+					matrix[rowNum * size + colNum];
+		if(offDiagonal < 1e-30)
+			return;
+		for(uintmax_t p = 0; p < size; p++){
+			for(uintmax_t q = p + 1; q < size; q++){
+				double apq = matrix[p * size + q];
+				if(fabs(apq) < 1e-300)
+					continue;
+				double theta =
+					(matrix[q * size + q] -
+					 matrix[p * size + p]) /
+					(2.0 * apq);
+				double tangent =
+					(theta >= 0.0 ? 1.0 : -1.0) /
+					(fabs(theta) +
+					 sqrt(theta * theta + 1.0));
+				double cosine =
+					1.0 / sqrt(tangent * tangent + 1.0);
+				double sine = tangent * cosine;
+				for(uintmax_t k = 0; k < size; k++){
+					double akp = matrix[k * size + p];
+					double akq = matrix[k * size + q];
+					matrix[k * size + p] =
+						cosine * akp - sine * akq;
+					matrix[k * size + q] =
+						sine * akp + cosine * akq;
+				}
+				for(uintmax_t k = 0; k < size; k++){
+					double apk = matrix[p * size + k];
+					double aqk = matrix[q * size + k];
+					matrix[p * size + k] =
+						cosine * apk - sine * aqk;
+					matrix[q * size + k] =
+						sine * apk + cosine * aqk;
+				}
+				for(uintmax_t k = 0; k < size; k++){
+					double vkp = eigenvectors[k * size + p];
+					double vkq = eigenvectors[k * size + q];
+					eigenvectors[k * size + p] =
+						cosine * vkp - sine * vkq;
+					eigenvectors[k * size + q] =
+						sine * vkp + cosine * vkq;
+				}
+			}
+		}
+	}
+}
+
+// Normalized bytes of a cached sample less the mean of all samples
+void getCenteredSample(
+		const SampleCache *cache,
+		uintmax_t sampleNum,
+		const double *mean,
+		double *centered
+		){
+	const uint8_t *pixelBytes = getCachedSample(cache, sampleNum);
+	double normDivisor = cache->normDivisors[sampleNum];
+	for(uintmax_t byteNum = 0; byteNum < cache->sampleBytes; byteNum++){
+		double value =
+			normDivisor > 0.0 ?
+			pixelBytes[byteNum] / normDivisor :
+			0.0;
+		centered[byteNum] = value - mean[byteNum];
+	}
+}
+
+// Find the top principal components of the normalized samples using a
+// randomized SVD
+//
+// The centered data matrix is never formed; each pass multiplying by it or
+// its transpose streams over the cached samples once, so memory scales with
+// (samples + pixel bytes) * (components + PCA_OVERSAMPLING).
+bool fitPrincipalComponents(
+		const SampleCache *cache,
+		uint32_t numComponents,
+		uint64_t *randomState,
+		double *components
+		){
+	uintmax_t numSamples = cache->numSamples;
+	uintmax_t numBytes = cache->sampleBytes;
+	uintmax_t maxRank = numSamples < numBytes ? numSamples : numBytes;
+	if(numComponents > maxRank){
+		fprintf(
+			stderr,
+			"Error: Cannot find %" PRIu32 " principal components "
+			"of %ju samples with %ju bytes each\n",
+			numComponents,
+			numSamples,
+			numBytes
+		       );
+		return false;
+	}
+	uintmax_t rangeSize = (uintmax_t)numComponents + PCA_OVERSAMPLING;
+	if(rangeSize > maxRank)
+		rangeSize = maxRank;
+
+	double *mean = (double *)calloc(numBytes, sizeof(double));
+	double *centered = (double *)malloc(numBytes * sizeof(double));
+	// Basis of the range of the data in sample space and its image in
+	// pixel space, each stored column after column
+	double *sampleBasis =
+		(double *)malloc(rangeSize * numSamples * sizeof(double));
+	double *pixelBasis =
+		(double *)malloc(rangeSize * numBytes * sizeof(double));
+	double *gram = (double *)malloc(rangeSize * rangeSize * sizeof(double));
+	double *eigenvectors =
+		(double *)malloc(rangeSize * rangeSize * sizeof(double));
+	if(
+		!mean ||
+		!centered ||
+		!sampleBasis ||
+		!pixelBasis ||
+		!gram ||
+		!eigenvectors
+	  ){
+		fprintf(
+			stderr,
+			"Error allocating memory for principal component "
+			"analysis\n"
+		       );
+		free(mean);
+		free(centered);
+		free(sampleBasis);
+		free(pixelBasis);
+		free(gram);
+		free(eigenvectors);
+		return false;
+	}
+
+	for(uintmax_t sampleNum = 0; sampleNum < numSamples; sampleNum++){
+		const uint8_t *pixelBytes = getCachedSample(cache, sampleNum);
+		double normDivisor = cache->normDivisors[sampleNum];
+		if(normDivisor == 0.0)
+			continue;
+		for(uintmax_t byteNum = 0; byteNum < numBytes; byteNum++)
+			mean[byteNum] += pixelBytes[byteNum] / normDivisor;
+	}
+	for(uintmax_t byteNum = 0; byteNum < numBytes; byteNum++)
+		mean[byteNum] /= numSamples;
+
+	// Start from random directions in pixel space
+	for(uintmax_t valueNum = 0; valueNum < rangeSize * numBytes; valueNum++)
+		pixelBasis[valueNum] = nextGaussian(randomState);
+
+	for(int passNum = 0; passNum <= PCA_POWER_ITERATIONS; passNum++){
+		// Multiply the centered data by the pixel space basis
+		for(
+			uintmax_t sampleNum = 0;
+			sampleNum < numSamples;
+			sampleNum++
+		   ){
+			getCenteredSample(cache, sampleNum, mean, centered);
+			for(uintmax_t colNum = 0; colNum < rangeSize; colNum++){
+				const double *column =
+					pixelBasis + colNum * numBytes;
+				double product = 0.0;
+				for(
+					uintmax_t byteNum = 0;
+					byteNum < numBytes;
+					byteNum++
+				   )
+					product +=
+						centered[byteNum] *
+						column[byteNum];
+				sampleBasis[colNum * numSamples + sampleNum] =
+					product;
+			}
+		}
+		orthonormalizeColumns(sampleBasis, numSamples, rangeSize);
+
+		// Multiply the transposed centered data by the sample space
+		// basis
+		for(
+			uintmax_t valueNum = 0;
+			valueNum < rangeSize * numBytes;
+			valueNum++
+		   )
+			pixelBasis[valueNum] = 0.0;
+		for(
+			uintmax_t sampleNum = 0;
+			sampleNum < numSamples;
+			sampleNum++
+		   ){
+			getCenteredSample(cache, sampleNum, mean, centered);
+			for(uintmax_t colNum = 0; colNum < rangeSize; colNum++){
+				double *column = pixelBasis + colNum * numBytes;
+				double weight =
+					sampleBasis[
+						colNum * numSamples + sampleNum
+					];
+				for(
+					uintmax_t byteNum = 0;
+					byteNum < numBytes;
+					byteNum++
+				   )
+					column[byteNum] +=
+						weight * centered[byteNum];
+			}
+		}
+		// The final product is kept as is, since its singular vectors
+		// are those of the data
+		if(passNum < PCA_POWER_ITERATIONS)
+			orthonormalizeColumns(pixelBasis, numBytes, rangeSize);
+	}
+
+	// The right singular vectors of the data are pixelBasis times the
+	// eigenvectors of its Gram matrix
+	for(uintmax_t rowNum = 0; rowNum < rangeSize; rowNum++){
+		for(uintmax_t colNum = 0; colNum < rangeSize; colNum++){
+			const double *rowBasis = pixelBasis + rowNum * numBytes;
+			const double *colBasis = pixelBasis + colNum * numBytes;
+			double product = 0.0;
+			for(
+				uintmax_t byteNum = 0;
+				byteNum < numBytes;
+				byteNum++
+			   )
+				product +=
+					rowBasis[byteNum] * colBasis[byteNum];
+			gram[rowNum * rangeSize + colNum] = product;
+		}
+	}
+	getSymmetricEigen(gram, rangeSize, eigenvectors);
+
+	for(
+		uint32_t componentNum = 0;
+		componentNum < numComponents;
+		componentNum++
+	   ){
+		// Select the largest eigenvalue not yet used
+		uintmax_t bestNum = 0;
+		for(uintmax_t eigenNum = 1; eigenNum < rangeSize; eigenNum++){
+			if(
+				gram[eigenNum * rangeSize + eigenNum] >
+				gram[bestNum * rangeSize + bestNum]
+			  )
+				bestNum = eigenNum;
+		}
+		double eigenvalue = gram[bestNum * rangeSize + bestNum];
+		gram[bestNum * rangeSize + bestNum] = -INFINITY;
+
+		double *component = components + componentNum * numBytes;
+		double magnitude = 0.0;
+		for(uintmax_t byteNum = 0; byteNum < numBytes; byteNum++){
+			component[byteNum] = 0.0;
+			for(uintmax_t colNum = 0; colNum < rangeSize; colNum++){
+				component[byteNum] +=
+					pixelBasis[
+						colNum * numBytes + byteNum
+					] *
+					eigenvectors[
+						colNum * rangeSize + bestNum
+					];
+			}
+			magnitude += component[byteNum] * component[byteNum];
+		}
+		magnitude = sqrt(magnitude);
+		for(uintmax_t byteNum = 0; byteNum < numBytes; byteNum++)
+			component[byteNum] =
+				magnitude > 1e-12 ?
+				component[byteNum] / magnitude :
+				0.0;
+		if(DEBUG_LEVEL < 1){
+			fprintf(
+				stderr,
+				"\tDebug: Component %" PRIu32 " explains a "
+				"variance of %lf\n",
+				componentNum + 1,
+				eigenvalue > 0.0 ? eigenvalue / numSamples : 0.0
+			       );
+		}
+	}
+
+	free(mean);
+	free(centered);
+	free(sampleBasis);
+	free(pixelBasis);
+	free(gram);
+	free(eigenvectors);
+	return true;
+}
+
+// Transform applied to the sample being trained with, drawn anew for each
+// sample so that augmented copies never need to be stored
+//
+// The sample is flipped horizontally if flip is set, then moved right by
+// shiftX and down by shiftY, leaving uncovered pixels at 0. byteValues
+// holds the value of each byte after brightness scaling and normalization.
+typedef struct {
+	uint32_t width;
+	uint32_t numRows;
+	uint16_t bytesPerPixel;
+	// Chosen for bytesPerPixel before training
+	const struct AugmentationKernels *kernels;
+	bool isActive;
+	bool flip;
+	int32_t shiftX;
+	int32_t shiftY;
+	double byteValues[256];
+} Augmentation;
+
+// Samples as seen by the trainer
+typedef struct {
+	uintmax_t numDims;
+	const SampleCache *cache;
+	// Features of each sample after the model's feature stages, or NULL
+	// to read normalized pixel bytes straight from the cache
+	double *values;
+	// Transform of the current sample when reading pixel bytes, or NULL
+	Augmentation *augmentation;
+} FeatureSet;
+
+// Kernels reading augmented samples for one number of bytes per pixel
+typedef struct AugmentationKernels {
+	double (*getDotProduct)(const FeatureSet *, uintmax_t, const double *);
+	void (*addScaledSample)(
+			const FeatureSet *,
+			uintmax_t,
+			double,
+			double *
+			);
+	void (*addAdaptiveSample)(
+			const FeatureSet *,
+			uintmax_t,
+			double,
+			float *,
+			double *
+			);
+} AugmentationKernels;
+
+bool buildFeatureSet(
+		const SvmModel *model,
+		const SampleCache *cache,
+		FeatureSet *features
+		){
+	features->numDims = model->numDims;
+	features->cache = cache;
+	features->values = NULL;
+	features->augmentation = NULL;
+	if(!model->numComponents)
+		return true;
+	features->values =
+		(double *)
+		malloc(cache->numSamples * model->numDims * sizeof(double));
+	if(!features->values){
+		fprintf(
+			stderr,
+			"Error allocating memory for sample features\n"
+		       );
+		return false;
+	}
+	for(
+		uintmax_t sampleNum = 0;
+		sampleNum < cache->numSamples;
+		sampleNum++
+	   ){
+		getSampleFeatures(
+			model,
+			getCachedSample(cache, sampleNum),
+			cache->normDivisors[sampleNum],
+			features->values + sampleNum * model->numDims
+			);
+	}
+	return true;
+}
+
+// Find the part of a row of the augmented sample covered by the original
+// sample, returning false if there is none
+//
+// The covered pixels start at vectorOffset in the augmented sample and at
+// sampleOffset in the original one, where they continue backwards if the
+// sample is flipped.
+bool getAugmentedRow(
+		const Augmentation *augmentation,
+		uint32_t rowNum,
+		uintmax_t *vectorOffset,
+		uintmax_t *sampleOffset,
+		uint32_t *numPixels
+		){
+	int64_t sampleRow = (int64_t)rowNum - augmentation->shiftY;
+	if(sampleRow < 0 || sampleRow >= augmentation->numRows)
+		return false;
+	int64_t width = augmentation->width;
+	int64_t firstPixel =
+		augmentation->shiftX > 0 ? augmentation->shiftX : 0;
+	int64_t lastPixel =
+		augmentation->shiftX < 0 ?
+		width + augmentation->shiftX :
+		width;
+	if(firstPixel >= lastPixel)
+		return false;
+	int64_t firstSamplePixel =
+		augmentation->flip ?
+		width - 1 - (firstPixel - augmentation->shiftX) :
+		firstPixel - augmentation->shiftX;
+	*vectorOffset =
+		((uintmax_t)rowNum * width + firstPixel) *
+		augmentation->bytesPerPixel;
+	*sampleOffset =
+		((uintmax_t)sampleRow * width + firstSamplePixel) *
+		augmentation->bytesPerPixel;
+	*numPixels = lastPixel - firstPixel;
+	return true;
+}
+
+static inline __attribute__((always_inline))
+double getAugmentedDotProductKernel(
+		const FeatureSet *features,
+		uintmax_t sampleNum,
+		const double *vector,
+		uint16_t bytesPerPixel
+		){
+	const Augmentation *augmentation = features->augmentation;
+	const uint8_t *pixelBytes = getCachedSample(features->cache, sampleNum);
+	intmax_t sampleStep =
+		augmentation->flip ? -(intmax_t)bytesPerPixel : bytesPerPixel;
+	const double *byteValues = augmentation->byteValues;
+	double dotProduct = 0.0;
+	for(uint32_t rowNum = 0; rowNum < augmentation->numRows; rowNum++){
+		uintmax_t vectorOffset;
+		uintmax_t sampleOffset;
+		uint32_t numPixels;
+		if(
+			!getAugmentedRow(
+				augmentation,
+				rowNum,
+				&vectorOffset,
+				&sampleOffset,
+				&numPixels
+				)
+		  )
+			continue;
+		const double *vectorPixel = vector + vectorOffset;
+		const uint8_t *samplePixel = pixelBytes + sampleOffset;
+		for(uint32_t pixelNum = 0; pixelNum < numPixels; pixelNum++){
+			for(
+				uint16_t byteNum = 0;
+				byteNum < bytesPerPixel;
+				byteNum++
+			   ){
+				dotProduct +=
+					vectorPixel[byteNum] *
+					byteValues[samplePixel[byteNum]];
+			}
+			vectorPixel += bytesPerPixel;
+			samplePixel += sampleStep;
+		}
+	}
+	return dotProduct;
+}
+
+double getSampleDotProduct(
+		const FeatureSet *features,
+		uintmax_t sampleNum,
+		const double *vector
+		){
+	double dotProduct = 0.0;
+	if(features->augmentation && features->augmentation->isActive)
+		return features->augmentation->kernels->getDotProduct(
+			features,
+			sampleNum,
+			vector
+			);
+	if(features->values){
+		const double *values =
+			features->values + sampleNum * features->numDims;
+		for(uintmax_t dimNum = 0; dimNum < features->numDims; dimNum++)
+			dotProduct += vector[dimNum] * values[dimNum];
+		return dotProduct;
+	}
+	const SampleCache *cache = features->cache;
+	const uint8_t *pixelBytes = getCachedSample(cache, sampleNum);
+	for(uintmax_t dimNum = 0; dimNum < features->numDims; dimNum++)
+		dotProduct += vector[dimNum] * pixelBytes[dimNum];
+	return dotProduct / cache->normDivisors[sampleNum];
+}
+
+#define MAX_COARSE_STAGES 8
+#define MAX_MASK_RECTANGLES 16
+
+#define SOLVER_SGD 0
+#define SOLVER_SAGA 1
+#define SOLVER_SVRG 2
+#define LOSS_SQUARED_HINGE 0
+#define LOSS_SMOOTHED_HINGE 1
+
+// Parameters of a training run, taken from the macros at the top of the
+// program
+typedef struct {
+	uintmax_t numSteps;
+	double lambda;
+	uint32_t pcaComponents;
+	uint8_t numCoarseStages;
+	uint32_t coarseFactors[MAX_COARSE_STAGES];
+	uintmax_t coarseSteps[MAX_COARSE_STAGES];
+	uint8_t solver;
+	uint8_t smoothLoss;
+	double hingeSmoothing;
+	bool adaGrad;
+	double adaGradRate;
+	bool importanceSampling;
+	bool activeSetShrinking;
+	double shrinkingMargin;
+	uintmax_t shrinkingRecheckInterval;
+	double replayRatio;
+	uint32_t replaySize;
+	bool augmentFlip;
+	uint32_t augmentMaxShift;
+	double augmentBrightness;
+	uint64_t randomSeed;
+	uint8_t maskMode;
+	char *maskPath;
+	uint8_t numMaskRectangles;
+	uint32_t maskRectangles[4 * MAX_MASK_RECTANGLES];
+	double maskMinVariance;
+} TrainingConfig;
+
+TrainingConfig getDefaultTrainingConfig(){
+	TrainingConfig config;
+	config.numSteps = NUM_STEPS;
+	config.lambda = LAMBDA;
+	config.pcaComponents = PCA_COMPONENTS;
+	config.solver = SOLVER;
+	config.smoothLoss = SMOOTH_LOSS;
+	config.hingeSmoothing = HINGE_SMOOTHING;
+	config.adaGrad = ADAGRAD;
+	config.adaGradRate = ADAGRAD_LEARN_RATE;
+	config.importanceSampling = IMPORTANCE_SAMPLING;
+	config.activeSetShrinking = ACTIVE_SET_SHRINKING;
+	config.shrinkingMargin = SHRINKING_MARGIN;
+	config.shrinkingRecheckInterval = SHRINKING_RECHECK_INTERVAL;
+	config.replayRatio = REPLAY_RATIO;
+	config.replaySize = REPLAY_BUFFER_SIZE;
+	config.augmentFlip = AUGMENT_FLIP;
+	config.augmentMaxShift = AUGMENT_MAX_SHIFT;
+	config.augmentBrightness = AUGMENT_BRIGHTNESS;
+	config.randomSeed = RANDOM_SEED;
+	config.maskMode = MASK_MODE;
+	config.maskPath = MASK_PATH;
+	config.maskMinVariance = MASK_MIN_VARIANCE;
+
+	// The list of coarse stages ends at the first factor of 0
+	uint32_t coarseFactors[] = COARSE_STAGE_FACTORS;
+	uintmax_t coarseSteps[] = COARSE_STAGE_STEPS;
+	config.numCoarseStages = 0;
+	while(
+		config.numCoarseStages < MAX_COARSE_STAGES &&
+		config.numCoarseStages <
+			sizeof(coarseFactors) / sizeof(coarseFactors[0]) &&
+		config.numCoarseStages <
+			sizeof(coarseSteps) / sizeof(coarseSteps[0]) &&
+		coarseFactors[config.numCoarseStages] != 0
+	){
+		config.coarseFactors[config.numCoarseStages] =
+			coarseFactors[config.numCoarseStages];
+		config.coarseSteps[config.numCoarseStages] =
+			coarseSteps[config.numCoarseStages];
+		config.numCoarseStages++;
+	}
+
+	// The list of mask rectangles ends at the first width of 0
+	uint32_t maskRectangles[] = MASK_RECTANGLES;
+	config.numMaskRectangles = 0;
+	while(
+		config.numMaskRectangles < MAX_MASK_RECTANGLES &&
+		4 * ((size_t)config.numMaskRectangles + 1) <=
+			sizeof(maskRectangles) / sizeof(maskRectangles[0]) &&
+		maskRectangles[4 * config.numMaskRectangles + 2] != 0
+	){
+		memcpy(
+			config.maskRectangles + 4 * config.numMaskRectangles,
+			maskRectangles + 4 * config.numMaskRectangles,
+			4 * sizeof(uint32_t)
+		      );
+		config.numMaskRectangles++;
+	}
+	return config;
+}
+
+// Number of steps across the coarse stages and the full resolution stage,
+// which share one learning rate schedule
+uintmax_t getTotalTrainingSteps(const TrainingConfig *config){
+	uintmax_t totalSteps = config->numSteps;
+	for(
+		uint8_t stageNum = 0;
+		stageNum < config->numCoarseStages;
+		stageNum++
+	   )
+		totalSteps += config->coarseSteps[stageNum];
+	return totalSteps;
+}
+
+// Number of values in a sample downsampled by averaging factor x factor
+// blocks of pixels, with partial blocks along the right and bottom edges
+uintmax_t getCoarseDims(const SvmModel *model, uint32_t factor){
+	uintmax_t coarseWidth = ((uintmax_t)model->width + factor - 1) / factor;
+	uintmax_t coarseHeight =
+		((uintmax_t)imaxabs(model->height) + factor - 1) / factor;
+	return coarseWidth * coarseHeight * getNumChannels(model);
+}
+
+// Index of the coarse value that a pixel byte is averaged into, along with
+// the number of pixels in its block
+uintmax_t getCoarseIndex(
+		const SvmModel *model,
+		uint32_t factor,
+		uintmax_t byteNum,
+		uint32_t *blockSize
+		){
+	uint16_t bytesPerPixel = getNumChannels(model);
+	uint64_t numRows = (uint64_t)imaxabs(model->height);
+	uintmax_t pixelNum = byteNum / bytesPerPixel;
+	uint64_t rowNum = pixelNum / model->width;
+	uint32_t colNum = pixelNum % model->width;
+	uintmax_t coarseWidth = ((uintmax_t)model->width + factor - 1) / factor;
+
+	uint32_t blockRows =
+		(rowNum / factor + 1) * factor > numRows ?
+		numRows % factor :
+		factor;
+	uint32_t blockCols =
+		((uintmax_t)colNum / factor + 1) * factor > model->width ?
+		model->width % factor :
+		factor;
+	*blockSize = blockRows * blockCols;
+	return
+		((rowNum / factor) * coarseWidth + colNum / factor) *
+		bytesPerPixel +
+		byteNum % bytesPerPixel;
+}
+
+// Average the normalized bytes of a sample over blocks of pixels,
+// separately for each byte of a pixel
+//
+// The sample's full resolution magnitude is used, so that the decision value
+// of a coarse vector equals that of its upsampled counterpart.
+void downsampleSample(
+		const SvmModel *model,
+		const SampleCache *cache,
+		uintmax_t sampleNum,
+		uint32_t factor,
+		double *coarseValues
+		){
+	uintmax_t coarseDims = getCoarseDims(model, factor);
+	for(uintmax_t coarseNum = 0; coarseNum < coarseDims; coarseNum++)
+		coarseValues[coarseNum] = 0.0;
+	double normDivisor = cache->normDivisors[sampleNum];
+	if(normDivisor <= 0.0)
+		return;
+	const uint8_t *pixelBytes = getCachedSample(cache, sampleNum);
+	for(uintmax_t byteNum = 0; byteNum < cache->sampleBytes; byteNum++){
+		uint32_t blockSize;
+		uintmax_t coarseNum =
+			getCoarseIndex(model, factor, byteNum, &blockSize);
+		coarseValues[coarseNum] +=
+			pixelBytes[byteNum] / (normDivisor * blockSize);
+	}
+}
+
+// Spread a coarse vector over full resolution pixel bytes using the adjoint
+// of downsampleSample
+void upsampleVector(
+		const SvmModel *model,
+		uint32_t factor,
+		const double *coarseVector,
+		double *vector
+		){
+	uintmax_t numPixelBytes = getNumPixelBytes(model);
+	for(uintmax_t byteNum = 0; byteNum < numPixelBytes; byteNum++){
+		uint32_t blockSize;
+		uintmax_t coarseNum =
+			getCoarseIndex(model, factor, byteNum, &blockSize);
+		vector[byteNum] = coarseVector[coarseNum] / blockSize;
+	}
+}
+
+// Find the coarse vector whose upsampled counterpart is closest to a full
+// resolution vector, which is the sum over each block
+void sumVectorBlocks(
+		const SvmModel *model,
+		uint32_t factor,
+		const double *vector,
+		double *coarseVector
+		){
+	uintmax_t coarseDims = getCoarseDims(model, factor);
+	for(uintmax_t coarseNum = 0; coarseNum < coarseDims; coarseNum++)
+		coarseVector[coarseNum] = 0.0;
+	uintmax_t numPixelBytes = getNumPixelBytes(model);
+	for(uintmax_t byteNum = 0; byteNum < numPixelBytes; byteNum++){
+		uint32_t blockSize;
+		uintmax_t coarseNum =
+			getCoarseIndex(model, factor, byteNum, &blockSize);
+		coarseVector[coarseNum] += vector[byteNum];
+	}
+}
+
+// Features of every sample downsampled by factor
+bool buildCoarseFeatureSet(
+		const SvmModel *model,
+		const SampleCache *cache,
+		uint32_t factor,
+		FeatureSet *features
+		){
+	features->numDims = getCoarseDims(model, factor);
+	features->cache = cache;
+	features->augmentation = NULL;
+	features->values =
+		(double *)
+		malloc(cache->numSamples * features->numDims * sizeof(double));
+	if(!features->values){
+		fprintf(
+			stderr,
+			"Error allocating memory for samples downsampled by "
+			"%" PRIu32 "\n",
+			factor
+		       );
+		return false;
+	}
+	for(
+		uintmax_t sampleNum = 0;
+		sampleNum < cache->numSamples;
+		sampleNum++
+	   ){
+		downsampleSample(
+			model,
+			cache,
+			sampleNum,
+			factor,
+			features->values + sampleNum * features->numDims
+			);
+	}
+	return true;
+}
+
+// Draw a transform for a sample, returning false if nothing of the sample
+// remains after it
+bool drawAugmentation(
+		const TrainingConfig *config,
+		const FeatureSet *features,
+		uintmax_t sampleNum,
+		uint64_t *randomState
+		){
+	Augmentation *augmentation = features->augmentation;
+	augmentation->flip =
+		config->augmentFlip && (nextRandom(randomState) >> 63);
+	int32_t numShifts = 2 * config->augmentMaxShift + 1;
+	augmentation->shiftX =
+		(int32_t)(nextRandom(randomState) % numShifts) -
+		(int32_t)config->augmentMaxShift;
+	augmentation->shiftY =
+		(int32_t)(nextRandom(randomState) % numShifts) -
+		(int32_t)config->augmentMaxShift;
+	double brightness =
+		1.0 +
+		config->augmentBrightness *
+		(2.0 * ((nextRandom(randomState) >> 11) * 0x1.0p-53) - 1.0);
+	for(uint16_t byteValue = 0; byteValue < 256; byteValue++){
+		double value = brightness * byteValue;
+		augmentation->byteValues[byteValue] =
+			value < 255.0 ? value : 255.0;
+	}
+
+	// Normalize by the magnitude of the covered part after brightness
+	// scaling, found from how often each byte value occurs in it
+	const SampleCache *cache = features->cache;
+	const uint8_t *pixelBytes = getCachedSample(cache, sampleNum);
+	uintmax_t byteCounts[256] = {0};
+	uint16_t bytesPerPixel = augmentation->bytesPerPixel;
+	for(uint32_t rowNum = 0; rowNum < augmentation->numRows; rowNum++){
+		uintmax_t vectorOffset;
+		uintmax_t sampleOffset;
+		uint32_t numPixels;
+		if(
+			!getAugmentedRow(
+				augmentation,
+				rowNum,
+				&vectorOffset,
+				&sampleOffset,
+				&numPixels
+				)
+		  )
+			continue;
+		// Flipping reorders pixels but not the bytes counted
+		const uint8_t *rowBytes = pixelBytes + sampleOffset;
+		if(augmentation->flip)
+			rowBytes -= (uintmax_t)(numPixels - 1) * bytesPerPixel;
+		for(
+			uintmax_t byteNum = 0;
+			byteNum < (uintmax_t)numPixels * bytesPerPixel;
+			byteNum++
+		   )
+			byteCounts[rowBytes[byteNum]]++;
+	}
+	double sumSquares = 0.0;
+	for(uint16_t byteValue = 0; byteValue < 256; byteValue++){
+		sumSquares +=
+			byteCounts[byteValue] *
+			augmentation->byteValues[byteValue] *
+			augmentation->byteValues[byteValue];
+	}
+	if(sumSquares <= 0.0)
+		return false;
+	double normDivisor = sqrt(sumSquares);
+	for(uint16_t byteValue = 0; byteValue < 256; byteValue++)
+		augmentation->byteValues[byteValue] /= normDivisor;
+	augmentation->isActive = true;
+	return true;
+}
+
+// Add scale times the augmented sample to a vector
+static inline __attribute__((always_inline))
+void addAugmentedSampleKernel(
+		const FeatureSet *features,
+		uintmax_t sampleNum,
+		double scale,
+		double *vector,
+		uint16_t bytesPerPixel
+		){
+	const Augmentation *augmentation = features->augmentation;
+	const uint8_t *pixelBytes = getCachedSample(features->cache, sampleNum);
+	intmax_t sampleStep =
+		augmentation->flip ? -(intmax_t)bytesPerPixel : bytesPerPixel;
+	const double *byteValues = augmentation->byteValues;
+	for(uint32_t rowNum = 0; rowNum < augmentation->numRows; rowNum++){
+		uintmax_t vectorOffset;
+		uintmax_t sampleOffset;
+		uint32_t numPixels;
+		if(
+			!getAugmentedRow(
+				augmentation,
+				rowNum,
+				&vectorOffset,
+				&sampleOffset,
+				&numPixels
+				)
+		  )
+			continue;
+		double *vectorPixel = vector + vectorOffset;
+		const uint8_t *samplePixel = pixelBytes + sampleOffset;
+		for(uint32_t pixelNum = 0; pixelNum < numPixels; pixelNum++){
+			for(
+				uint16_t byteNum = 0;
+				byteNum < bytesPerPixel;
+				byteNum++
+			   ){
+				vectorPixel[byteNum] +=
+					scale *
+					byteValues[samplePixel[byteNum]];
+			}
+			vectorPixel += bytesPerPixel;
+			samplePixel += sampleStep;
+		}
+	}
+}
+
+// Add a multiple of a sample's features to a vector
+void addScaledSample(
+		const FeatureSet *features,
+		uintmax_t sampleNum,
+		double scale,
+		double *vector
+		){
+	if(features->augmentation && features->augmentation->isActive){
+		features->augmentation->kernels->addScaledSample(
+			features,
+			sampleNum,
+			scale,
+			vector
+			);
+		return;
+	}
+	if(features->values){
+		const double *values =
+			features->values + sampleNum * features->numDims;
+		for(uintmax_t dimNum = 0; dimNum < features->numDims; dimNum++)
+			vector[dimNum] += scale * values[dimNum];
+		return;
+	}
+	const SampleCache *cache = features->cache;
+	const uint8_t *pixelBytes = getCachedSample(cache, sampleNum);
+	scale /= cache->normDivisors[sampleNum];
+	for(uintmax_t dimNum = 0; dimNum < features->numDims; dimNum++)
+		vector[dimNum] += scale * pixelBytes[dimNum];
+}
+
+// Add rate * sample / sqrt(accumulator) to each dimension of a vector after
+// adding the square of the sample to the dimension's accumulator
+//
+// Accumulators are kept at a floor so that dimensions where the sample is 0
+// are left unchanged rather than becoming NaN.
+#define ADAGRAD_FLOOR 1e-30f
+
+void addAdaptiveValues(
+		const double *values,
+		uintmax_t numDims,
+		double rate,
+		float *accumulators,
+		double *vector
+		){
+	for(uintmax_t dimNum = 0; dimNum < numDims; dimNum++){
+		float accumulator =
+			accumulators[dimNum] +
+			(float)values[dimNum] * (float)values[dimNum];
+		accumulators[dimNum] = accumulator;
+		if(accumulator < ADAGRAD_FLOOR)
+			accumulator = ADAGRAD_FLOOR;
+		vector[dimNum] += rate * values[dimNum] / sqrt(accumulator);
+	}
+}
+
+void addAdaptiveBytes(
+		const uint8_t *pixelBytes,
+		uintmax_t numDims,
+		double normDivisor,
+		double rate,
+		float *accumulators,
+		double *vector
+		){
+	for(uintmax_t dimNum = 0; dimNum < numDims; dimNum++){
+		double value = pixelBytes[dimNum] / normDivisor;
+		float accumulator =
+			accumulators[dimNum] + (float)value * (float)value;
+		accumulators[dimNum] = accumulator;
+		if(accumulator < ADAGRAD_FLOOR)
+			accumulator = ADAGRAD_FLOOR;
+		vector[dimNum] += rate * value / sqrt(accumulator);
+	}
+}
+
+#if X86_SIMD
+// AVX2 versions of the above, four dimensions at a time
+__attribute__((target("avx2")))
+void addAdaptiveValuesAvx2(
+		const double *values,
+		uintmax_t numDims,
+		double rate,
+		float *accumulators,
+		double *vector
+		){
+	__m256d rates = _mm256_set1_pd(rate);
+	__m128 floor = _mm_set1_ps(ADAGRAD_FLOOR);
+	uintmax_t dimNum = 0;
+	for(; dimNum + 4 <= numDims; dimNum += 4){
+		__m256d value = _mm256_loadu_pd(values + dimNum);
+		__m128 narrowValue = _mm256_cvtpd_ps(value);
+		__m128 accumulator =
+			_mm_add_ps(
+				_mm_loadu_ps(accumulators + dimNum),
+				_mm_mul_ps(narrowValue, narrowValue)
+				);
+		_mm_storeu_ps(accumulators + dimNum, accumulator);
+		__m256d divisor =
+			_mm256_sqrt_pd(
+				_mm256_cvtps_pd(_mm_max_ps(accumulator, floor))
+				);
+		_mm256_storeu_pd(
+			vector + dimNum,
+			_mm256_add_pd(
+				_mm256_loadu_pd(vector + dimNum),
+				_mm256_div_pd(
+					_mm256_mul_pd(rates, value),
+					divisor
+					)
+				)
+			);
+	}
+	addAdaptiveValues(
+		values + dimNum,
+		numDims - dimNum,
+		rate,
+		accumulators + dimNum,
+		vector + dimNum
+		);
+}
+
+__attribute__((target("avx2")))
+void addAdaptiveBytesAvx2(
+		const uint8_t *pixelBytes,
+		uintmax_t numDims,
+		double normDivisor,
+		double rate,
+		float *accumulators,
+		double *vector
+		){
+	__m256d rates = _mm256_set1_pd(rate);
+	__m256d inverseNorm = _mm256_set1_pd(1.0 / normDivisor);
+	__m128 floor = _mm_set1_ps(ADAGRAD_FLOOR);
+	uintmax_t dimNum = 0;
+	for(; dimNum + 4 <= numDims; dimNum += 4){
+		int32_t packedBytes;
+		memcpy(&packedBytes, pixelBytes + dimNum, sizeof(int32_t));
+		__m256d value =
+			_mm256_mul_pd(
+				_mm256_cvtepi32_pd(
+					_mm_cvtepu8_epi32(
+						_mm_cvtsi32_si128(packedBytes)
+						)
+					),
+				inverseNorm
+				);
+		__m128 narrowValue = _mm256_cvtpd_ps(value);
+		__m128 accumulator =
+			_mm_add_ps(
+				_mm_loadu_ps(accumulators + dimNum),
+				_mm_mul_ps(narrowValue, narrowValue)
+				);
+		_mm_storeu_ps(accumulators + dimNum, accumulator);
+		__m256d divisor =
+			_mm256_sqrt_pd(
+				_mm256_cvtps_pd(_mm_max_ps(accumulator, floor))
+				);
+		_mm256_storeu_pd(
+			vector + dimNum,
+			_mm256_add_pd(
+				_mm256_loadu_pd(vector + dimNum),
+				_mm256_div_pd(
+					_mm256_mul_pd(rates, value),
+					divisor
+					)
+				)
+			);
+	}
+	addAdaptiveBytes(
+		pixelBytes + dimNum,
+		numDims - dimNum,
+		normDivisor,
+		rate,
+		accumulators + dimNum,
+		vector + dimNum
+		);
+}
+#endif
+
+// Take an AdaGrad step with the augmented sample as addAdaptiveValues does
+static inline __attribute__((always_inline))
+void addAdaptiveAugmentedSampleKernel(
+		const FeatureSet *features,
+		uintmax_t sampleNum,
+		double rate,
+		float *accumulators,
+		double *vector,
+		uint16_t bytesPerPixel
+		){
+	const Augmentation *augmentation = features->augmentation;
+	const uint8_t *pixelBytes = getCachedSample(features->cache, sampleNum);
+	intmax_t sampleStep =
+		augmentation->flip ? -(intmax_t)bytesPerPixel : bytesPerPixel;
+	const double *byteValues = augmentation->byteValues;
+	for(uint32_t rowNum = 0; rowNum < augmentation->numRows; rowNum++){
+		uintmax_t vectorOffset;
+		uintmax_t sampleOffset;
+		uint32_t numPixels;
+		if(
+			!getAugmentedRow(
+				augmentation,
+				rowNum,
+				&vectorOffset,
+				&sampleOffset,
+				&numPixels
+				)
+		  )
+			continue;
+		double *vectorPixel = vector + vectorOffset;
+		float *accumulatorPixel = accumulators + vectorOffset;
+		const uint8_t *samplePixel = pixelBytes + sampleOffset;
+		for(uint32_t pixelNum = 0; pixelNum < numPixels; pixelNum++){
+			for(
+				uint16_t byteNum = 0;
+				byteNum < bytesPerPixel;
+				byteNum++
+			   ){
+				double value =
+					byteValues[samplePixel[byteNum]];
+				float accumulator =
+					accumulatorPixel[byteNum] +
+					(float)value * (float)value;
+				accumulatorPixel[byteNum] = accumulator;
+				if(accumulator < ADAGRAD_FLOOR)
+					accumulator = ADAGRAD_FLOOR;
+				vectorPixel[byteNum] +=
+					rate * value / sqrtf(accumulator);
+			}
+			vectorPixel += bytesPerPixel;
+			accumulatorPixel += bytesPerPixel;
+			samplePixel += sampleStep;
+		}
+	}
+}
+
+// Define the augmentation kernels with the given suffix, passing bytes as the
+// number of bytes per pixel as DEFINE_CHANNEL_KERNELS does
+#define DEFINE_AUGMENTATION_KERNELS(suffix, bytes) \
+	double getAugmentedDotProduct##suffix( \
+			const FeatureSet *features, \
+			uintmax_t sampleNum, \
+			const double *vector \
+			){ \
+		return getAugmentedDotProductKernel( \
+			features, \
+			sampleNum, \
+			vector, \
+			bytes \
+			); \
+	} \
+	void addAugmentedSample##suffix( \
+			const FeatureSet *features, \
+			uintmax_t sampleNum, \
+			double scale, \
+			double *vector \
+			){ \
+		addAugmentedSampleKernel( \
+			features, \
+			sampleNum, \
+			scale, \
+			vector, \
+			bytes \
+			); \
+	} \
+	void addAdaptiveAugmentedSample##suffix( \
+			const FeatureSet *features, \
+			uintmax_t sampleNum, \
+			double rate, \
+			float *accumulators, \
+			double *vector \
+			){ \
+		addAdaptiveAugmentedSampleKernel( \
+			features, \
+			sampleNum, \
+			rate, \
+			accumulators, \
+			vector, \
+			bytes \
+			); \
+	}
+
+DEFINE_AUGMENTATION_KERNELS(, features->augmentation->bytesPerPixel)
+DEFINE_AUGMENTATION_KERNELS(1, 1)
+DEFINE_AUGMENTATION_KERNELS(2, 2)
+DEFINE_AUGMENTATION_KERNELS(3, 3)
+DEFINE_AUGMENTATION_KERNELS(4, 4)
+
+// Augmentation kernels for any number of bytes per pixel, then for 1 to 4
+const AugmentationKernels augmentationKernels[] = {
+	{
+		getAugmentedDotProduct,
+		addAugmentedSample,
+		addAdaptiveAugmentedSample
+	},
+	{
+		getAugmentedDotProduct1,
+		addAugmentedSample1,
+		addAdaptiveAugmentedSample1
+	},
+	{
+		getAugmentedDotProduct2,
+		addAugmentedSample2,
+		addAdaptiveAugmentedSample2
+	},
+	{
+		getAugmentedDotProduct3,
+		addAugmentedSample3,
+		addAdaptiveAugmentedSample3
+	},
+	{
+		getAugmentedDotProduct4,
+		addAugmentedSample4,
+		addAdaptiveAugmentedSample4
+	}
+};
+
+const AugmentationKernels *getAugmentationKernels(uint16_t bytesPerPixel){
+	return augmentationKernels + (bytesPerPixel <= 4 ? bytesPerPixel : 0);
+}
+
+// Apply an AdaGrad step to the dimensions of a vector touched by a sample,
+// using the AVX2 kernels when the processor supports them
+void addAdaptiveSample(
+		const FeatureSet *features,
+		uintmax_t sampleNum,
+		double rate,
+		float *accumulators,
+		double *vector
+		){
+	if(features->augmentation && features->augmentation->isActive){
+		features->augmentation->kernels->addAdaptiveSample(
+			features,
+			sampleNum,
+			rate,
+			accumulators,
+			vector
+			);
+		return;
+	}
+#if X86_SIMD
+	bool useAvx2 = __builtin_cpu_supports("avx2");
+#endif
+	if(features->values){
+		const double *values =
+			features->values + sampleNum * features->numDims;
+#if X86_SIMD
+		if(useAvx2){
+			addAdaptiveValuesAvx2(
+				values,
+				features->numDims,
+				rate,
+				accumulators,
+				vector
+				);
+			return;
+		}
+#endif
+		addAdaptiveValues(
+			values,
+			features->numDims,
+			rate,
+			accumulators,
+			vector
+			);
+		return;
+	}
+	const SampleCache *cache = features->cache;
+	const uint8_t *pixelBytes = getCachedSample(cache, sampleNum);
+#if X86_SIMD
+	if(useAvx2){
+		addAdaptiveBytesAvx2(
+			pixelBytes,
+			features->numDims,
+			cache->normDivisors[sampleNum],
+			rate,
+			accumulators,
+			vector
+			);
+		return;
+	}
+#endif
+	addAdaptiveBytes(
+		pixelBytes,
+		features->numDims,
+		cache->normDivisors[sampleNum],
+		rate,
+		accumulators,
+		vector
+		);
+}
+
+// Shrink a vector stored as vectorScale times vector for one step of
+// regularization
+void regularizeVector(
+		double *vector,
+		double *vectorScale,
+		uintmax_t numDims,
+		double learnRate,
+		double lambda
+		){
+	double shrinkFactor = 1.0 - learnRate * lambda;
+	if(shrinkFactor > 0.0){
+		*vectorScale *= shrinkFactor;
+	}else{
+		for(uintmax_t dimNum = 0; dimNum < numDims; dimNum++)
+			vector[dimNum] *= *vectorScale * shrinkFactor;
+		*vectorScale = 1.0;
+	}
+	// Fold the scale back in before dividing by it loses precision
+	if(*vectorScale < 1e-6){
+		for(uintmax_t dimNum = 0; dimNum < numDims; dimNum++)
+			vector[dimNum] *= *vectorScale;
+		*vectorScale = 1.0;
+	}
+}
+
+// Take one subgradient step on a vector using a sample from one of the two
+// classes it separates
+//
+// The vector is stored as vectorScale times vector, so that shrinking it
+// for regularization only changes vectorScale and steps where the sample is
+// outside the margin cost no more than the dot product. With AdaGrad,
+// accumulators holds the sum of squared sample values of each dimension, and
+// only the sample's contribution is scaled by it; regularization follows
+// the global learning rate.
+//
+// The sample's contribution is also multiplied by sampleWeight, which
+// corrects for samples not being drawn uniformly. Returns the margin of the
+// sample before the step.
+double trainVectorWithSample(
+		double *vector,
+		double *vectorScale,
+		const FeatureSet *features,
+		uintmax_t sampleNum,
+		double learnRate,
+		double lambda,
+		float *accumulators,
+		double adaGradRate,
+		double sampleWeight,
+		bool isPositiveSample
+		){
+	double dotProduct =
+		*vectorScale * getSampleDotProduct(features, sampleNum, vector);
+	if(!isPositiveSample)
+		dotProduct = -dotProduct;
+
+	regularizeVector(
+		vector,
+		vectorScale,
+		features->numDims,
+		learnRate,
+		lambda
+		);
+	if(dotProduct < 1.0){
+		if(DEBUG_LEVEL < 1){
+			fprintf(
+				stderr,
+				"\t\t\tDot Product = %lf: Redirecting Vector\n",
+				isPositiveSample? dotProduct : -dotProduct
+			       );
+		}
+		double label = isPositiveSample ? 1.0 : -1.0;
+		if(accumulators){
+			addAdaptiveSample(
+				features,
+				sampleNum,
+				label *
+					sampleWeight *
+					adaGradRate /
+					*vectorScale,
+				accumulators,
+				vector
+				);
+		}else{
+			addScaledSample(
+				features,
+				sampleNum,
+				label * sampleWeight * learnRate / *vectorScale,
+				vector
+				);
+		}
+	}else{
+		if(DEBUG_LEVEL < 1){
+			fprintf(
+				stderr,
+				"\t\t\tDot Product = %lf: Shrinking Vector\n",
+				isPositiveSample ? dotProduct : -dotProduct
+			       );
+		}
+	}
+	return dotProduct;
+}
+
+// Bounded buffers of the samples most recently found inside the margin of
+// each vector, replayed alongside fresh draws
+//
+// The samples of each buffer are kept in cyclic order from the oldest, at
+// nextSlot, to the newest just before it
+typedef struct {
+	uint32_t capacity;
+	uintmax_t *samples;
+	uint32_t *numBuffered;
+	uint32_t *nextSlot;
+	uintmax_t numReplayed;
+	uintmax_t numViolating;
+	uintmax_t numRecorded;
+} ReplayBuffer;
+
+void freeReplayBuffer(ReplayBuffer *replay){
+	free(replay->samples);
+	free(replay->numBuffered);
+	free(replay->nextSlot);
+	replay->samples = NULL;
+	replay->numBuffered = NULL;
+	replay->nextSlot = NULL;
+}
+
+bool initReplayBuffer(
+		uint32_t capacity,
+		uint64_t numClasses,
+		ReplayBuffer *replay
+		){
+	uintmax_t numPairs = getNumPairs(numClasses);
+	replay->capacity = capacity;
+	replay->samples =
+		(uintmax_t *)malloc(numPairs * capacity * sizeof(uintmax_t));
+	replay->numBuffered = (uint32_t *)calloc(numPairs, sizeof(uint32_t));
+	replay->nextSlot = (uint32_t *)calloc(numPairs, sizeof(uint32_t));
+	if(!replay->samples || !replay->numBuffered || !replay->nextSlot){
+		fprintf(
+			stderr,
+			"Error allocating memory for replay buffers\n"
+		       );
+		freeReplayBuffer(replay);
+		return false;
+	}
+	replay->numReplayed = 0;
+	replay->numViolating = 0;
+	replay->numRecorded = 0;
+	return true;
+}
+
+// Add a sample found inside the margin of a vector to its buffer, replacing
+// the oldest one if the buffer is full
+void recordHardExample(
+		ReplayBuffer *replay,
+		uintmax_t pairNum,
+		uintmax_t sampleNum
+		){
+	uintmax_t *samples = replay->samples + pairNum * replay->capacity;
+	for(
+		uint32_t slotNum = 0;
+		slotNum < replay->numBuffered[pairNum];
+		slotNum++
+	   ){
+		if(samples[slotNum] == sampleNum)
+			return;
+	}
+	uint32_t nextSlot = replay->nextSlot[pairNum];
+	if(replay->numBuffered[pairNum] < replay->capacity){
+		if(nextSlot){
+			memmove(
+				samples + nextSlot + 1,
+				samples + nextSlot,
+				(replay->numBuffered[pairNum] - nextSlot) *
+				sizeof(uintmax_t)
+			       );
+			samples[nextSlot] = sampleNum;
+			replay->nextSlot[pairNum]++;
+		}else{
+			samples[replay->numBuffered[pairNum]] = sampleNum;
+		}
+		replay->numBuffered[pairNum]++;
+	}else{
+		samples[nextSlot] = sampleNum;
+		replay->nextSlot[pairNum] = (nextSlot + 1) % replay->capacity;
+	}
+	replay->numRecorded++;
+}
+
+// Train every vector separating the sample's class from another class,
+// returning the number of vectors whose margin the sample was inside
+//
+// With active-set shrinking, lastMargins holds the margin the sample had for
+// each other class when last checked. Vectors where it was beyond
+// shrinkMargin are only regularized, without taking the dot product, and
+// counted in numSkipped. Samples found inside the margin of a vector are
+// recorded in replay, if given.
+uint64_t trainVectorsWithSample(
+		double *vectors,
+		double *vectorScales,
+		const FeatureSet *features,
+		uintmax_t sampleNum,
+		uint64_t classNum,
+		uint64_t numClasses,
+		double learnRate,
+		double lambda,
+		float *accumulators,
+		double adaGradRate,
+		double sampleWeight,
+		float *lastMargins,
+		double shrinkMargin,
+		uintmax_t *numSkipped,
+		ReplayBuffer *replay
+		){
+	uint64_t numViolations = 0;
+	for(uint64_t otherClass = 0; otherClass < numClasses; otherClass++){
+		if(otherClass == classNum)
+			continue;
+		float *lastMargin = NULL;
+		if(lastMargins){
+			lastMargin =
+				lastMargins +
+				(otherClass < classNum ?
+				 otherClass :
+				 otherClass - 1);
+		}
+		bool isPositiveSample = classNum < otherClass;
+		uintmax_t pairNum =
+			isPositiveSample ?
+			getPairIndex(classNum, otherClass, numClasses) :
+			getPairIndex(otherClass, classNum, numClasses);
+		if(DEBUG_LEVEL < 1){
+			fprintf(
+				stderr,
+				"\t\tInfo: Training %s sample with %ju vectors "
+				"offset\n",
+				isPositiveSample ? "positive" : "negative",
+				pairNum
+			       );
+		}
+		if(lastMargin && *lastMargin > shrinkMargin){
+			regularizeVector(
+				vectors + pairNum * features->numDims,
+				vectorScales + pairNum,
+				features->numDims,
+				learnRate,
+				lambda
+				);
+			(*numSkipped)++;
+			continue;
+		}
+		double margin =
+			trainVectorWithSample(
+				vectors + pairNum * features->numDims,
+				vectorScales + pairNum,
+				features,
+				sampleNum,
+				learnRate,
+				lambda,
+				accumulators ?
+					accumulators +
+					pairNum * features->numDims :
+					NULL,
+				adaGradRate,
+				sampleWeight,
+				isPositiveSample
+				);
+		if(lastMargin)
+			*lastMargin = margin;
+		if(margin < 1.0){
+			numViolations++;
+			if(replay)
+				recordHardExample(replay, pairNum, sampleNum);
+		}
+	}
+	return numViolations;
+}
+
+// Replay a random buffered sample on a vector, re-scoring it first so that
+// samples since moved outside the margin are dropped instead of trained on
+void replayHardExample(
+		ReplayBuffer *replay,
+		double *vector,
+		double vectorScale,
+		const FeatureSet *features,
+		uintmax_t pairNum,
+		uint64_t posClass,
+		double learnRate,
+		float *accumulators,
+		double adaGradRate,
+		uint64_t *randomState
+		){
+	uint32_t numBuffered = replay->numBuffered[pairNum];
+	if(!numBuffered)
+		return;
+	uintmax_t *samples = replay->samples + pairNum * replay->capacity;
+	uint32_t slotNum = nextRandom(randomState) % numBuffered;
+	uintmax_t sampleNum = samples[slotNum];
+	const SampleCache *cache = features->cache;
+	bool isPositiveSample =
+		sampleNum >= cache->classOffsets[posClass] &&
+		sampleNum < cache->classOffsets[posClass + 1];
+	double label = isPositiveSample ? 1.0 : -1.0;
+	double margin =
+		label *
+		vectorScale *
+		getSampleDotProduct(features, sampleNum, vector);
+	replay->numReplayed++;
+	if(margin >= 1.0){
+		// Keep the remaining samples in order
+		memmove(
+			samples + slotNum,
+			samples + slotNum + 1,
+			(numBuffered - slotNum - 1) * sizeof(uintmax_t)
+		       );
+		replay->numBuffered[pairNum]--;
+		if(replay->nextSlot[pairNum] > slotNum)
+			replay->nextSlot[pairNum]--;
+		if(replay->nextSlot[pairNum] >= replay->numBuffered[pairNum])
+			replay->nextSlot[pairNum] = 0;
+		return;
+	}
+	replay->numViolating++;
+	if(accumulators){
+		addAdaptiveSample(
+			features,
+			sampleNum,
+			label * adaGradRate / vectorScale,
+			accumulators,
+			vector
+			);
+	}else{
+		addScaledSample(
+			features,
+			sampleNum,
+			label * learnRate / vectorScale,
+			vector
+			);
+	}
+}
+
+// Derivative of the loss minimized by SAGA and SVRG with respect to the
+// margin of a sample
+double getSmoothLossDerivative(
+		const TrainingConfig *config,
+		double margin
+		){
+	if(margin >= 1.0)
+		return 0.0;
+	if(config->smoothLoss == LOSS_SQUARED_HINGE)
+		return -2.0 * (1.0 - margin);
+	if(margin > 1.0 - config->hingeSmoothing)
+		return -(1.0 - margin) / config->hingeSmoothing;
+	return -1.0;
+}
+
+// State of SAGA and SVRG
+//
+// Since the gradient of a sample's loss is a multiple of the sample, only
+// that multiple is remembered for each pair of the sample.
+typedef struct {
+	double stepSize;
+	// Loss derivative times label of each sample against each other
+	// class, in class order skipping the sample's own class
+	float *sampleCoefficients;
+	// Average of the remembered gradients of each pair, weighted by the
+	// probability of drawing each sample
+	double *averageGradients;
+	// Steps between the full gradients of SVRG
+	uintmax_t snapshotInterval;
+} VarianceReduction;
+
+bool initVarianceReduction(
+		const TrainingConfig *config,
+		const FeatureSet *features,
+		VarianceReduction *reduction
+		){
+	const SampleCache *cache = features->cache;
+
+	// Normalized samples have a magnitude of at most 1, which bounds the
+	// curvature of the loss
+	double smoothness =
+		config->smoothLoss == LOSS_SQUARED_HINGE ?
+		2.0 :
+		1.0 / config->hingeSmoothing;
+	reduction->stepSize = 1.0 / (3.0 * (smoothness + config->lambda));
+
+	// Take a full gradient about once per pass over the largest class
+	reduction->snapshotInterval = 1;
+	for(uint64_t classNum = 0; classNum < cache->numClasses; classNum++){
+		uintmax_t numClassSamples =
+			cache->classOffsets[classNum + 1] -
+			cache->classOffsets[classNum];
+		if(numClassSamples > reduction->snapshotInterval)
+			reduction->snapshotInterval = numClassSamples;
+	}
+
+	reduction->sampleCoefficients =
+		(float *)
+		calloc(
+			cache->numSamples * (cache->numClasses - 1),
+			sizeof(float)
+		      );
+	reduction->averageGradients =
+		(double *)
+		calloc(
+			getNumPairs(cache->numClasses) * features->numDims,
+			sizeof(double)
+		      );
+	if(!reduction->sampleCoefficients || !reduction->averageGradients){
+		fprintf(
+			stderr,
+			"Error allocating memory for gradients of %s\n",
+			config->solver == SOLVER_SAGA ? "SAGA" : "SVRG"
+		       );
+		free(reduction->sampleCoefficients);
+		free(reduction->averageGradients);
+		return false;
+	}
+	return true;
+}
+
+void freeVarianceReduction(VarianceReduction *reduction){
+	free(reduction->sampleCoefficients);
+	free(reduction->averageGradients);
+	reduction->sampleCoefficients = NULL;
+	reduction->averageGradients = NULL;
+}
+
+// Probability of drawing a sample when a sample of its class is drawn for
+// one of the class's pairs, each of whose two classes are drawn once per step
+double getDrawProbability(
+		const SampleCache *cache,
+		uint64_t classNum
+		){
+	return
+		0.5 /
+		(cache->classOffsets[classNum + 1] -
+		 cache->classOffsets[classNum]);
+}
+
+// Compute the full gradient of the loss of every pair for SVRG, remembering
+// the gradient of each sample at the current vectors
+void takeSvrgSnapshot(
+		const TrainingConfig *config,
+		const FeatureSet *features,
+		const double *vectors,
+		VarianceReduction *reduction
+		){
+	const SampleCache *cache = features->cache;
+	uint64_t numClasses = cache->numClasses;
+	for(
+		uintmax_t valueNum = 0;
+		valueNum < getNumPairs(numClasses) * features->numDims;
+		valueNum++
+	   )
+		reduction->averageGradients[valueNum] = 0.0;
+	for(uint64_t classNum = 0; classNum < numClasses; classNum++){
+		double drawProbability = getDrawProbability(cache, classNum);
+		for(
+			uintmax_t sampleNum = cache->classOffsets[classNum];
+			sampleNum < cache->classOffsets[classNum + 1];
+			sampleNum++
+		   ){
+			if(cache->normDivisors[sampleNum] <= 0.0)
+				continue;
+			float *coefficients =
+				reduction->sampleCoefficients +
+				sampleNum * (numClasses - 1);
+			for(
+				uint64_t otherClass = 0;
+				otherClass < numClasses;
+				otherClass++
+			   ){
+				if(otherClass == classNum)
+					continue;
+				bool isPositiveSample = classNum < otherClass;
+				uintmax_t pairNum =
+					isPositiveSample ?
+					getPairIndex(
+						classNum,
+						otherClass,
+						numClasses
+						) :
+					getPairIndex(
+						otherClass,
+						classNum,
+						numClasses
+						);
+				double label = isPositiveSample ? 1.0 : -1.0;
+				double margin =
+					label *
+					getSampleDotProduct(
+						features,
+						sampleNum,
+						vectors +
+						pairNum * features->numDims
+						);
+				float coefficient =
+					label *
+					getSmoothLossDerivative(config, margin);
+				coefficients[
+					otherClass < classNum ?
+					otherClass :
+					otherClass - 1
+					] = coefficient;
+				addScaledSample(
+					features,
+					sampleNum,
+					drawProbability * coefficient,
+					reduction->averageGradients +
+						pairNum * features->numDims
+					);
+			}
+		}
+	}
+}
+
+// Take one variance-reduced step on every vector separating the sample's
+// class from another class
+//
+// The remembered gradient of the sample is replaced by its current gradient,
+// which also updates the average gradient for SAGA. SVRG keeps both until
+// its next snapshot.
+void trainVectorsVarianceReduced(
+		const TrainingConfig *config,
+		double *vectors,
+		const FeatureSet *features,
+		VarianceReduction *reduction,
+		uintmax_t sampleNum,
+		uint64_t classNum
+		){
+	const SampleCache *cache = features->cache;
+	uint64_t numClasses = cache->numClasses;
+	uintmax_t numDims = features->numDims;
+	double stepSize = reduction->stepSize;
+	double shrinkFactor = 1.0 - stepSize * config->lambda;
+	double drawProbability = getDrawProbability(cache, classNum);
+	float *coefficients =
+		reduction->sampleCoefficients + sampleNum * (numClasses - 1);
+	for(uint64_t otherClass = 0; otherClass < numClasses; otherClass++){
+		if(otherClass == classNum)
+			continue;
+		bool isPositiveSample = classNum < otherClass;
+		uintmax_t pairNum =
+			isPositiveSample ?
+			getPairIndex(classNum, otherClass, numClasses) :
+			getPairIndex(otherClass, classNum, numClasses);
+		double *vector = vectors + pairNum * numDims;
+		double *averageGradient =
+			reduction->averageGradients + pairNum * numDims;
+		float *coefficient =
+			coefficients +
+			(otherClass < classNum ? otherClass : otherClass - 1);
+
+		double label = isPositiveSample ? 1.0 : -1.0;
+		double margin =
+			label *
+			getSampleDotProduct(features, sampleNum, vector);
+		float newCoefficient =
+			label * getSmoothLossDerivative(config, margin);
+		double coefficientChange =
+			(double)newCoefficient - *coefficient;
+		if(DEBUG_LEVEL < 1){
+			fprintf(
+				stderr,
+				"\t\t\tDot Product = %lf: Gradient "
+				"coefficient %f -> %f\n",
+				label * margin,
+				*coefficient,
+				newCoefficient
+			       );
+		}
+
+		// Step along the variance-reduced gradient
+		// lambda * vector + change * sample + average
+		for(uintmax_t dimNum = 0; dimNum < numDims; dimNum++)
+			vector[dimNum] =
+				shrinkFactor * vector[dimNum] -
+				stepSize * averageGradient[dimNum];
+		if(coefficientChange != 0.0){
+			addScaledSample(
+				features,
+				sampleNum,
+				-stepSize * coefficientChange,
+				vector
+				);
+			if(config->solver == SOLVER_SAGA){
+				addScaledSample(
+					features,
+					sampleNum,
+					drawProbability * coefficientChange,
+					averageGradient
+					);
+			}
+		}
+		if(config->solver == SOLVER_SAGA)
+			*coefficient = newCoefficient;
+	}
+}
+
+// Importance sampling of the samples within each class
+//
+// Each class has a Walker alias table drawing its samples in proportion to
+// their importance in O(1). Importances are updated as samples are drawn
+// and a class's table is rebuilt once enough of them have changed.
+#define IMPORTANCE_REBUILD_DIVISOR 16
+
+typedef struct {
+	const SampleCache *cache;
+	// Importance of each sample, found from its margins when last drawn
+	float *importances;
+	// Probability of keeping the drawn entry rather than its alias, and
+	// the alias, of each entry of the class tables
+	double *acceptProbabilities;
+	uintmax_t *aliases;
+	// Probability of each sample being drawn from its class's table
+	double *drawProbabilities;
+	uintmax_t *updatesSinceRebuild;
+	uintmax_t *smallEntries;
+	uintmax_t *largeEntries;
+} ImportanceSampler;
+
+void freeImportanceSampler(ImportanceSampler *sampler){
+	free(sampler->importances);
+	free(sampler->acceptProbabilities);
+	free(sampler->aliases);
+	free(sampler->drawProbabilities);
+	free(sampler->updatesSinceRebuild);
+	free(sampler->smallEntries);
+	free(sampler->largeEntries);
+	sampler->importances = NULL;
+	sampler->acceptProbabilities = NULL;
+	sampler->aliases = NULL;
+	sampler->drawProbabilities = NULL;
+	sampler->updatesSinceRebuild = NULL;
+	sampler->smallEntries = NULL;
+	sampler->largeEntries = NULL;
+}
+
+// Rebuild the alias table of a class from the current importances using
+// Vose's method
+void buildClassAliasTable(
+		ImportanceSampler *sampler,
+		uint64_t classNum
+		){
+	const SampleCache *cache = sampler->cache;
+	uintmax_t firstSample = cache->classOffsets[classNum];
+	uintmax_t numClassSamples =
+		cache->classOffsets[classNum + 1] - firstSample;
+	double totalImportance = 0.0;
+	for(
+		uintmax_t sampleNum = firstSample;
+		sampleNum < firstSample + numClassSamples;
+		sampleNum++
+	   )
+		totalImportance += sampler->importances[sampleNum];
+
+	// Scale importances so that they average 1, sorting them by whether
+	// they fill their entry of the table
+	uintmax_t numSmall = 0;
+	uintmax_t numLarge = 0;
+	for(
+		uintmax_t sampleNum = firstSample;
+		sampleNum < firstSample + numClassSamples;
+		sampleNum++
+	   ){
+		sampler->drawProbabilities[sampleNum] =
+			sampler->importances[sampleNum] / totalImportance;
+		sampler->acceptProbabilities[sampleNum] =
+			sampler->drawProbabilities[sampleNum] * numClassSamples;
+		sampler->aliases[sampleNum] = sampleNum;
+		if(sampler->acceptProbabilities[sampleNum] < 1.0)
+			sampler->smallEntries[numSmall++] = sampleNum;
+		else
+			sampler->largeEntries[numLarge++] = sampleNum;
+	}
+
+	// Fill the remainder of each small entry with part of a large one
+	while(numSmall && numLarge){
+		uintmax_t smallEntry = sampler->smallEntries[--numSmall];
+		uintmax_t largeEntry = sampler->largeEntries[numLarge - 1];
+		sampler->aliases[smallEntry] = largeEntry;
+		sampler->acceptProbabilities[largeEntry] -=
+			1.0 - sampler->acceptProbabilities[smallEntry];
+		if(sampler->acceptProbabilities[largeEntry] < 1.0){
+			numLarge--;
+			sampler->smallEntries[numSmall++] = largeEntry;
+		}
+	}
+	// Entries left over only differ from 1 by rounding
+	while(numLarge){
+		uintmax_t largeEntry = sampler->largeEntries[--numLarge];
+		sampler->acceptProbabilities[largeEntry] = 1.0;
+	}
+	while(numSmall){
+		uintmax_t smallEntry = sampler->smallEntries[--numSmall];
+		sampler->acceptProbabilities[smallEntry] = 1.0;
+	}
+	sampler->updatesSinceRebuild[classNum] = 0;
+}
+
+bool initImportanceSampler(
+		const SampleCache *cache,
+		ImportanceSampler *sampler
+		){
+	sampler->cache = cache;
+	uintmax_t maxClassSamples = 0;
+	for(uint64_t classNum = 0; classNum < cache->numClasses; classNum++){
+		uintmax_t numClassSamples =
+			cache->classOffsets[classNum + 1] -
+			cache->classOffsets[classNum];
+		if(numClassSamples > maxClassSamples)
+			maxClassSamples = numClassSamples;
+	}
+	sampler->importances =
+		(float *)malloc(cache->numSamples * sizeof(float));
+	sampler->acceptProbabilities =
+		(double *)malloc(cache->numSamples * sizeof(double));
+	sampler->aliases =
+		(uintmax_t *)malloc(cache->numSamples * sizeof(uintmax_t));
+	sampler->drawProbabilities =
+		(double *)malloc(cache->numSamples * sizeof(double));
+	sampler->updatesSinceRebuild =
+		(uintmax_t *)malloc(cache->numClasses * sizeof(uintmax_t));
+	sampler->smallEntries =
+		(uintmax_t *)malloc(maxClassSamples * sizeof(uintmax_t));
+	sampler->largeEntries =
+		(uintmax_t *)malloc(maxClassSamples * sizeof(uintmax_t));
+	if(
+		!sampler->importances ||
+		!sampler->acceptProbabilities ||
+		!sampler->aliases ||
+		!sampler->drawProbabilities ||
+		!sampler->updatesSinceRebuild ||
+		!sampler->smallEntries ||
+		!sampler->largeEntries
+	  ){
+		fprintf(
+			stderr,
+			"Error allocating memory for importance sampling\n"
+		       );
+		freeImportanceSampler(sampler);
+		return false;
+	}
+
+	// Every margin starts at 0, inside the margin of every vector
+	for(uintmax_t sampleNum = 0; sampleNum < cache->numSamples; sampleNum++)
+		sampler->importances[sampleNum] = 1.0 + IMPORTANCE_FLOOR;
+	for(uint64_t classNum = 0; classNum < cache->numClasses; classNum++)
+		buildClassAliasTable(sampler, classNum);
+	return true;
+}
+
+// Draw a sample of a class from its alias table, along with the weight that
+// makes its contribution unbiased relative to a uniform draw
+uintmax_t drawImportanceSample(
+		const ImportanceSampler *sampler,
+		uint64_t classNum,
+		uint64_t *randomState,
+		double *sampleWeight
+		){
+	const SampleCache *cache = sampler->cache;
+	uintmax_t numClassSamples =
+		cache->classOffsets[classNum + 1] -
+		cache->classOffsets[classNum];
+	uintmax_t entryNum =
+		cache->classOffsets[classNum] +
+		nextRandom(randomState) % numClassSamples;
+	double uniform = (nextRandom(randomState) >> 11) * 0x1.0p-53;
+	uintmax_t sampleNum =
+		uniform < sampler->acceptProbabilities[entryNum] ?
+		entryNum :
+		sampler->aliases[entryNum];
+	*sampleWeight =
+		1.0 /
+		(numClassSamples * sampler->drawProbabilities[sampleNum]);
+	return sampleNum;
+}
+
+// Set the importance of a drawn sample to the fraction of its vectors whose
+// margin it is inside, rebuilding its class's table if enough importances
+// have changed
+void updateImportance(
+		ImportanceSampler *sampler,
+		uint64_t classNum,
+		uintmax_t sampleNum,
+		uint64_t numViolations
+		){
+	const SampleCache *cache = sampler->cache;
+	sampler->importances[sampleNum] =
+		IMPORTANCE_FLOOR +
+		(double)numViolations / (cache->numClasses - 1);
+	uintmax_t numClassSamples =
+		cache->classOffsets[classNum + 1] -
+		cache->classOffsets[classNum];
+	if(
+		++sampler->updatesSinceRebuild[classNum] >
+		numClassSamples / IMPORTANCE_REBUILD_DIVISOR
+	  )
+		buildClassAliasTable(sampler, classNum);
+}
+
+// State a solver keeps between the steps of a training run, so that the run
+// can be trained in several calls that together take the same steps as one
+typedef struct {
+	VarianceReduction reduction;
+	// Scale of each vector of subgradient descent, folded into its values
+	// when the run finishes
+	double *vectorScales;
+	float *accumulators;
+	float *lastMargins;
+	uintmax_t numSkipped;
+	ReplayBuffer replay;
+	bool useReplay;
+	ImportanceSampler sampler;
+	bool useImportance;
+	// Step the run began at, from which SVRG snapshots and shrinking
+	// rechecks are counted, and the step the next call continues from
+	uintmax_t firstStep;
+	uintmax_t nextStep;
+} SolverState;
+
+void freeSolverState(const TrainingConfig *config, SolverState *state){
+	if(config->solver != SOLVER_SGD)
+		freeVarianceReduction(&state->reduction);
+	free(state->vectorScales);
+	free(state->accumulators);
+	free(state->lastMargins);
+	if(state->useImportance)
+		freeImportanceSampler(&state->sampler);
+	if(state->useReplay)
+		freeReplayBuffer(&state->replay);
+}
+
+// Set up the state of the configured solver for a training run beginning at
+// firstStep
+bool initSolverState(
+		const TrainingConfig *config,
+		const FeatureSet *features,
+		uintmax_t firstStep,
+		SolverState *state
+		){
+	const SampleCache *cache = features->cache;
+	uintmax_t numPairs = getNumPairs(cache->numClasses);
+	state->vectorScales = NULL;
+	state->accumulators = NULL;
+	state->lastMargins = NULL;
+	state->numSkipped = 0;
+	state->firstStep = firstStep;
+	state->nextStep = firstStep;
+	state->useReplay =
+		config->replayRatio > 0.0 && config->solver == SOLVER_SGD;
+	state->useImportance =
+		config->importanceSampling && config->solver == SOLVER_SGD;
+	if(
+		state->useImportance &&
+		!initImportanceSampler(cache, &state->sampler)
+	  )
+		return false;
+	if(
+		state->useReplay &&
+		!initReplayBuffer(
+			config->replaySize,
+			cache->numClasses,
+			&state->replay
+			)
+	  ){
+		if(state->useImportance)
+			freeImportanceSampler(&state->sampler);
+		return false;
+	}
+	if(config->solver != SOLVER_SGD){
+		if(!initVarianceReduction(config, features, &state->reduction)){
+			if(state->useImportance)
+				freeImportanceSampler(&state->sampler);
+			if(state->useReplay)
+				freeReplayBuffer(&state->replay);
+			return false;
+		}
+		return true;
+	}
+	state->vectorScales = (double *)malloc(numPairs * sizeof(double));
+	if(config->adaGrad){
+		state->accumulators =
+			(float *)
+			calloc(numPairs * features->numDims, sizeof(float));
+	}
+	// Margins start at 0 so that every sample is checked first
+	if(config->activeSetShrinking){
+		state->lastMargins =
+			(float *)
+			calloc(
+				cache->numSamples * (cache->numClasses - 1),
+				sizeof(float)
+			      );
+	}
+	if(
+		!state->vectorScales ||
+		(config->adaGrad && !state->accumulators) ||
+		(config->activeSetShrinking && !state->lastMargins)
+	  ){
+		fprintf(
+			stderr,
+			"Error allocating memory for subgradient descent\n"
+		       );
+		freeSolverState(config, state);
+		return false;
+	}
+	for(uintmax_t pairNum = 0; pairNum < numPairs; pairNum++)
+		state->vectorScales[pairNum] = 1.0;
+	return true;
+}
+
+// Train the vectors with the configured solver for numSteps more steps of a
+// training run, drawing a random sample of every class at each step
+//
+// Steps are numbered on from the run's first step so that stages continuing
+// from earlier ones keep decreasing the learning rate of subgradient
+// descent. Vectors of subgradient descent are left unscaled until the run
+// finishes.
+void trainSolverSteps(
+		const TrainingConfig *config,
+		const FeatureSet *features,
+		SolverState *state,
+		double *vectors,
+		uintmax_t numSteps,
+		uint64_t *randomState
+		){
+	const SampleCache *cache = features->cache;
+	uintmax_t totalSteps = getTotalTrainingSteps(config);
+	uintmax_t firstStep = state->firstStep;
+	uintmax_t lastStep = state->nextStep + numSteps;
+	VarianceReduction *reduction = &state->reduction;
+	double *vectorScales = state->vectorScales;
+	float *accumulators = state->accumulators;
+	float *lastMargins = state->lastMargins;
+	ReplayBuffer *replay = &state->replay;
+	bool useReplay = state->useReplay;
+	ImportanceSampler *sampler = &state->sampler;
+	bool useImportance = state->useImportance;
+	for(
+		uintmax_t stepNum = state->nextStep;
+		stepNum < lastStep;
+		stepNum++
+	   ){
+		//Set variable training parameters
+		double learnRate =
+			config->solver == SOLVER_SGD ?
+			1.0 / sqrt(stepNum + 1) :
+			reduction->stepSize;
+		if(
+			config->solver == SOLVER_SVRG &&
+			(stepNum - firstStep) % reduction->snapshotInterval == 0
+		  ){
+			if(DEBUG_LEVEL < 1){
+				fprintf(
+					stderr,
+					"\tDebug: Taking full gradient\n"
+				       );
+			}
+			takeSvrgSnapshot(config, features, vectors, reduction);
+		}
+		// Bring every shrunk sample back to be checked again
+		if(
+			lastMargins &&
+			stepNum > firstStep &&
+			(stepNum - firstStep) %
+				config->shrinkingRecheckInterval == 0
+		  ){
+			if(DEBUG_LEVEL < 1){
+				fprintf(
+					stderr,
+					"\tDebug: Rechecking shrunk samples\n"
+				       );
+			}
+			memset(
+				lastMargins,
+				0,
+				cache->numSamples *
+				(cache->numClasses - 1) *
+				sizeof(float)
+			      );
+		}
+
+		if(DEBUG_LEVEL < 2){
+			if(
+				DEBUG_LEVEL < 1 ||
+				stepNum % STEP_REPORT_INTERVAL == 0
+			){
+				fprintf(
+					stderr,
+					"Info: Step %ju of %ju in progress\n",
+					stepNum,
+					totalSteps
+				       );
+				if(useReplay){
+					fprintf(
+						stderr,
+						"Info: %ju hard samples "
+						"recorded, %ju of %ju replayed "
+						"still inside the margin\n",
+						replay->numRecorded,
+						replay->numViolating,
+						replay->numReplayed
+					       );
+				}
+			}
+		}
+		if(DEBUG_LEVEL < 1){
+			fprintf(
+				stderr,
+				"\tDebug: learn rate = %lf\n",
+				learnRate
+			       );
+		}
+		for(
+			uint64_t classNum = 0;
+			classNum < cache->numClasses;
+			classNum++
+		   ){
+			if(DEBUG_LEVEL < 1){
+				fprintf(
+					stderr,
+					"\tDebug: Class %ju of %ju in "
+					"progress\n",
+					(uintmax_t)classNum,
+					(uintmax_t)cache->numClasses
+				       );
+			}
+
+			// Select a random sample for the class and train all
+			// relevant vectors
+			uintmax_t numClassSamples =
+				cache->classOffsets[classNum + 1] -
+				cache->classOffsets[classNum];
+			uintmax_t sampleNum;
+			double sampleWeight = 1.0;
+			if(useImportance){
+				sampleNum =
+					drawImportanceSample(
+						sampler,
+						classNum,
+						randomState,
+						&sampleWeight
+						);
+			}else{
+				sampleNum =
+					cache->classOffsets[classNum] +
+					nextRandom(randomState) %
+					numClassSamples;
+			}
+			if(DEBUG_LEVEL < 1){
+				fprintf(
+					stderr,
+					"\tDebug: Using %s for training\n",
+					cache->samplePaths[sampleNum]
+				       );
+				fprintf(
+					stderr,
+					"\tDebug: Sample Magnitude = %lf\n",
+					cache->normDivisors[sampleNum]
+				       );
+			}
+
+			// Vectors remain unchanged if all bytes equal 0
+			if(cache->normDivisors[sampleNum] <= 0.0){
+				if(useImportance)
+					updateImportance(
+						sampler,
+						classNum,
+						sampleNum,
+						0
+						);
+				continue;
+			}
+			if(
+				features->augmentation &&
+				!drawAugmentation(
+					config,
+					features,
+					sampleNum,
+					randomState
+					)
+			  ){
+				if(useImportance)
+					updateImportance(
+						sampler,
+						classNum,
+						sampleNum,
+						0
+						);
+				continue;
+			}
+			if(config->solver == SOLVER_SGD){
+				uint64_t numViolations =
+					trainVectorsWithSample(
+						vectors,
+						vectorScales,
+						features,
+						sampleNum,
+						classNum,
+						cache->numClasses,
+						learnRate,
+						config->lambda,
+						accumulators,
+						config->adaGradRate,
+						sampleWeight,
+						lastMargins ?
+						lastMargins +
+						sampleNum *
+						(cache->numClasses - 1) :
+						NULL,
+						config->shrinkingMargin,
+						&state->numSkipped,
+						useReplay ? replay : NULL
+						);
+				if(useImportance)
+					updateImportance(
+						sampler,
+						classNum,
+						sampleNum,
+						numViolations
+						);
+			}else{
+				trainVectorsVarianceReduced(
+					config,
+					vectors,
+					features,
+					reduction,
+					sampleNum,
+					classNum
+					);
+			}
+		}
+		if(features->augmentation)
+			features->augmentation->isActive = false;
+		if(!useReplay)
+			continue;
+
+		// Every vector takes two fresh samples per step, and replays
+		// replayRatio buffered samples for each of them on average
+		for(
+			uint64_t posClass = 0;
+			posClass < cache->numClasses - 1;
+			posClass++
+		   ){
+			for(
+				uint64_t negClass = posClass + 1;
+				negClass < cache->numClasses;
+				negClass++
+			   ){
+				uintmax_t pairNum =
+					getPairIndex(
+						posClass,
+						negClass,
+						cache->numClasses
+						);
+				double numReplays = 2.0 * config->replayRatio;
+				double uniform =
+					(nextRandom(randomState) >> 11) *
+					0x1.0p-53;
+				for(
+					;
+					numReplays >= 1.0 ||
+					uniform < numReplays;
+					numReplays -= 1.0
+				   ){
+					replayHardExample(
+						replay,
+						vectors +
+						pairNum * features->numDims,
+						vectorScales[pairNum],
+						features,
+						pairNum,
+						posClass,
+						learnRate,
+						accumulators ?
+							accumulators +
+							pairNum *
+							features->numDims :
+							NULL,
+						config->adaGradRate,
+						randomState
+						);
+				}
+			}
+		}
+	}
+	state->nextStep = lastStep;
+}
+
+// Fold the scales of the vectors of subgradient descent into their values,
+// as trained vectors are used, without ending the training run
+void getTrainedVectors(
+		const FeatureSet *features,
+		const SolverState *state,
+		const double *vectors,
+		double *trainedVectors
+		){
+	uintmax_t numPairs = getNumPairs(features->cache->numClasses);
+	for(uintmax_t pairNum = 0; pairNum < numPairs; pairNum++){
+		const double *vector = vectors + pairNum * features->numDims;
+		double *trainedVector =
+			trainedVectors + pairNum * features->numDims;
+		double vectorScale =
+			state->vectorScales ?
+			state->vectorScales[pairNum] :
+			1.0;
+		for(uintmax_t dimNum = 0; dimNum < features->numDims; dimNum++)
+			trainedVector[dimNum] = vector[dimNum] * vectorScale;
+	}
+}
+
+// End a training run, leaving the trained vectors in place
+void finishSolverState(
+		const TrainingConfig *config,
+		const FeatureSet *features,
+		SolverState *state,
+		double *vectors
+		){
+	if(config->solver != SOLVER_SGD){
+		freeSolverState(config, state);
+		return;
+	}
+
+	// Fold the scale of each vector back into its values
+	uintmax_t numPairs = getNumPairs(features->cache->numClasses);
+	for(uintmax_t pairNum = 0; pairNum < numPairs; pairNum++){
+		double *vector = vectors + pairNum * features->numDims;
+		for(uintmax_t dimNum = 0; dimNum < features->numDims; dimNum++)
+			vector[dimNum] *= state->vectorScales[pairNum];
+	}
+	if(state->lastMargins && DEBUG_LEVEL < 2){
+		fprintf(
+			stderr,
+			"Info: Shrinking skipped %ju of %ju dot products\n",
+			state->numSkipped,
+			(state->nextStep - state->firstStep) * numPairs * 2
+		       );
+	}
+	freeSolverState(config, state);
+}
+
+// Train the vectors with the configured solver for a whole training run of
+// numSteps steps numbered from firstStep
+bool trainSvmVectors(
+		const TrainingConfig *config,
+		const FeatureSet *features,
+		double *vectors,
+		uintmax_t firstStep,
+		uintmax_t numSteps,
+		uint64_t *randomState
+		){
+	SolverState state;
+	if(!initSolverState(config, features, firstStep, &state))
+		return false;
+	trainSolverSteps(
+		config,
+		features,
+		&state,
+		vectors,
+		numSteps,
+		randomState
+		);
+	finishSolverState(config, features, &state, vectors);
+	return true;
+}
+
+// Train the coarse stages of the configuration in order, warm starting each
+// from the previous one, and leave the result upsampled to full resolution
+// pixel bytes in pixelVectors
+bool trainCoarseStages(
+		const TrainingConfig *config,
+		const SvmModel *model,
+		const SampleCache *cache,
+		double *pixelVectors,
+		uint64_t *randomState
+		){
+	uintmax_t numPairs = getNumPairs(model->numClasses);
+	uintmax_t numPixelBytes = getNumPixelBytes(model);
+	uintmax_t stepNum = 0;
+	for(
+		uint8_t stageNum = 0;
+		stageNum < config->numCoarseStages;
+		stageNum++
+	   ){
+		uint32_t factor = config->coarseFactors[stageNum];
+		FeatureSet features;
+		if(!buildCoarseFeatureSet(model, cache, factor, &features))
+			return false;
+		double *coarseVectors =
+			(double *)
+			malloc(numPairs * features.numDims * sizeof(double));
+		if(!coarseVectors){
+			fprintf(
+				stderr,
+				"Error allocating memory for vectors "
+				"downsampled by %" PRIu32 "\n",
+				factor
+			       );
+			free(features.values);
+			return false;
+		}
+		for(uintmax_t pairNum = 0; pairNum < numPairs; pairNum++){
+			sumVectorBlocks(
+				model,
+				factor,
+				pixelVectors + pairNum * numPixelBytes,
+				coarseVectors + pairNum * features.numDims
+				);
+		}
+		if(DEBUG_LEVEL < 2){
+			fprintf(
+				stderr,
+				"Info: Training %ju steps on samples "
+				"downsampled by %" PRIu32 " to %ju bytes\n",
+				config->coarseSteps[stageNum],
+				factor,
+				features.numDims
+			       );
+		}
+		bool trained =
+			trainSvmVectors(
+				config,
+				&features,
+				coarseVectors,
+				stepNum,
+				config->coarseSteps[stageNum],
+				randomState
+				);
+		for(uintmax_t pairNum = 0; pairNum < numPairs; pairNum++){
+			upsampleVector(
+				model,
+				factor,
+				coarseVectors + pairNum * features.numDims,
+				pixelVectors + pairNum * numPixelBytes
+				);
+		}
+		free(coarseVectors);
+		free(features.values);
+		if(!trained)
+			return false;
+		stepNum += config->coarseSteps[stageNum];
+	}
+	return true;
+}
+
+// Establish the classes, dimensions and pixel mask of a model from a
+// training directory and decode its samples, adjusting config to the mask
+bool loadTrainingSamples(
+		char *pathToInputDir,
+		TrainingConfig *config,
+		SvmModel *model,
+		SampleCache *cache,
+		uint64_t *randomState
+		){
+	// Establish class names and dimensions from the directory
+	if(!initializeSvmModel(pathToInputDir, model)){
+		fprintf(
+			stderr,
+			"Error finding classes in %s\n",
+			pathToInputDir
+		       );
+		return false;
+	}
+
+	if(DEBUG_LEVEL < 1){
+		for(
+			uint64_t classNum = 0;
+			classNum < model->numClasses;
+			classNum++
+		   ){
+			fprintf(
+				stderr,
+				"Class Number %ju: %s\n",
+				(uintmax_t)classNum,
+				model->classNames[classNum]
+			       );
+		}
+	}
+
+	// Masks given ahead of time are applied as samples are decoded
+	if(
+		config->maskMode == MASK_BMP ||
+		config->maskMode == MASK_RECTANGLE_LIST
+	  ){
+		uint8_t *pixelMask =
+			config->maskMode == MASK_BMP ?
+			readPixelMask(config->maskPath, model) :
+			getRectanglePixelMask(
+				config->maskRectangles,
+				config->numMaskRectangles,
+				model
+				);
+		if(!pixelMask || !setPixelMask(model, pixelMask)){
+			fprintf(
+				stderr,
+				"Error building pixel mask\n"
+			       );
+			freeSvmModel(model);
+			return false;
+		}
+		model->numDims = getNumPixelBytes(model);
+	}else if(
+		config->maskMode != MASK_NONE &&
+		config->maskMode != MASK_VARIANCE
+	  ){
+		fprintf(
+			stderr,
+			"Error: Unknown mask mode %d\n",
+			config->maskMode
+		       );
+		freeSvmModel(model);
+		return false;
+	}
+
+	if(!loadSampleCache(pathToInputDir, model, cache)){
+		fprintf(
+			stderr,
+			"Error loading samples from %s\n",
+			pathToInputDir
+		       );
+		freeSvmModel(model);
+		return false;
+	}
+	if(DEBUG_LEVEL < 2){
+		fprintf(
+			stderr,
+			"Info: Decoded %ju samples\n",
+			cache->numSamples
+		       );
+	}
+
+	// Learned masks need every sample, so the cache is masked afterwards
+	if(config->maskMode == MASK_VARIANCE){
+		uint8_t *pixelMask =
+			learnPixelMask(cache, model, config->maskMinVariance);
+		if(!pixelMask || !setPixelMask(model, pixelMask)){
+			fprintf(
+				stderr,
+				"Error building pixel mask\n"
+			       );
+			freeSampleCache(cache);
+			freeSvmModel(model);
+			return false;
+		}
+		maskSampleCache(cache, model);
+		model->numDims = getNumPixelBytes(model);
+	}
+	if(model->pixelMask){
+		if(DEBUG_LEVEL < 2){
+			fprintf(
+				stderr,
+				"Info: Pixel mask keeps %ju of %ju pixels\n",
+				model->numKeptPixels,
+				getNumImagePixels(model)
+			       );
+		}
+		// Coarse stages and augmentation work on the whole pixel grid
+		if(
+			DEBUG_LEVEL < 2 &&
+			(
+			 config->numCoarseStages ||
+			 config->augmentFlip ||
+			 config->augmentMaxShift ||
+			 config->augmentBrightness > 0.0
+			)
+		  ){
+			fprintf(
+				stderr,
+				"Info: Skipping coarse stages and "
+				"augmentation, which don't apply to masked "
+				"samples\n"
+			       );
+		}
+		config->numCoarseStages = 0;
+		config->augmentFlip = false;
+		config->augmentMaxShift = 0;
+		config->augmentBrightness = 0.0;
+	}
+
+	*randomState = config->randomSeed;
+	if(!*randomState && !seedRandomState(randomState)){
+		freeSampleCache(cache);
+		freeSvmModel(model);
+		return false;
+	}
+	return true;
+}
+
+// Fit the feature stages learned from samples to a sample cache and
+// allocate the vectors of a model, warm starting them from any coarse
+// stages, after which their training continues from firstStep
+bool fitSvmStages(
+		const TrainingConfig *config,
+		SvmModel *model,
+		const SampleCache *cache,
+		uint64_t *randomState,
+		char *pathToInputDir,
+		uintmax_t *firstStep
+		){
+	// Fit the projection onto principal components, if used
+	if(config->pcaComponents){
+		model->components =
+			(double *)
+			malloc(
+				(uintmax_t)config->pcaComponents *
+				cache->sampleBytes *
+				sizeof(double)
+			      );
+		if(
+			!model->components ||
+			!fitPrincipalComponents(
+				cache,
+				config->pcaComponents,
+				randomState,
+				model->components
+				)
+		  ){
+			fprintf(
+				stderr,
+				"Error finding principal components of the "
+				"samples in %s\n",
+				pathToInputDir
+			       );
+			return false;
+		}
+		model->numComponents = config->pcaComponents;
+		model->numDims = config->pcaComponents;
+		if(DEBUG_LEVEL < 2){
+			fprintf(
+				stderr,
+				"Info: Projecting %ju bytes per sample onto "
+				"%" PRIu32 " principal components\n",
+				cache->sampleBytes,
+				model->numComponents
+			       );
+		}
+	}
+
+	model->vectors =
+		(double *)
+		calloc(
+			getNumPairs(model->numClasses) * model->numDims,
+			sizeof(double)
+		      );
+	if(!model->vectors){
+		fprintf(
+			stderr,
+			"Error allocating memory for training\n"
+		       );
+		return false;
+	}
+
+	// Commence training
+	if(DEBUG_LEVEL < 2){
+		fprintf(
+			stderr,
+			"Info: Beginning training with %ju classes\n",
+			(uintmax_t)model->numClasses
+		       );
+	}
+
+	// Warm start from the coarse stages, if any
+	*firstStep = 0;
+	if(config->numCoarseStages){
+		uintmax_t numPairs = getNumPairs(model->numClasses);
+		double *pixelVectors =
+			(double *)
+			calloc(numPairs * cache->sampleBytes, sizeof(double));
+		if(
+			!pixelVectors ||
+			!trainCoarseStages(
+				config,
+				model,
+				cache,
+				pixelVectors,
+				randomState
+				)
+		  ){
+			fprintf(
+				stderr,
+				"Error training coarse stages\n"
+			       );
+			free(pixelVectors);
+			return false;
+		}
+		// Principal components are orthonormal, so projecting onto
+		// them gives the closest vector in the reduced space
+		for(uintmax_t pairNum = 0; pairNum < numPairs; pairNum++){
+			double *pixelVector =
+				pixelVectors + pairNum * cache->sampleBytes;
+			double *vector =
+				model->vectors + pairNum * model->numDims;
+			if(!model->numComponents){
+				memcpy(
+					vector,
+					pixelVector,
+					cache->sampleBytes * sizeof(double)
+				      );
+				continue;
+			}
+			for(
+				uint32_t componentNum = 0;
+				componentNum < model->numComponents;
+				componentNum++
+			   ){
+				const double *component =
+					model->components +
+					componentNum * cache->sampleBytes;
+				vector[componentNum] = 0.0;
+				for(
+					uintmax_t byteNum = 0;
+					byteNum < cache->sampleBytes;
+					byteNum++
+				   )
+					vector[componentNum] +=
+						component[byteNum] *
+						pixelVector[byteNum];
+			}
+		}
+		free(pixelVectors);
+		*firstStep = getTotalTrainingSteps(config) - config->numSteps;
+	}
+	return true;
+}
+
+// Training of the vectors of a model with fitted stages, which may take its
+// steps over several calls
+//
+// The feature set points at the run's augmentation, so a run stays where it
+// began until it ends.
+typedef struct {
+	FeatureSet features;
+	Augmentation augmentation;
+	SolverState solver;
+} TrainingRun;
+
+// Begin a training run of a model with fitted stages from firstStep
+bool beginTrainingRun(
+		const TrainingConfig *config,
+		const SvmModel *model,
+		const SampleCache *cache,
+		uintmax_t firstStep,
+		TrainingRun *run
+		){
+	FeatureSet *features = &run->features;
+	if(!buildFeatureSet(model, cache, features)){
+		fprintf(
+			stderr,
+			"Error allocating memory for training\n"
+		       );
+		return false;
+	}
+
+	// Augment pixel bytes as they are read, if configured
+	if(
+		!features->values &&
+		config->solver == SOLVER_SGD &&
+		(
+		 config->augmentFlip ||
+		 config->augmentMaxShift ||
+		 config->augmentBrightness > 0.0
+		)
+	  ){
+		Augmentation *augmentation = &run->augmentation;
+		augmentation->width = model->width;
+		augmentation->numRows = imaxabs(model->height);
+		augmentation->bytesPerPixel = getNumChannels(model);
+		augmentation->kernels =
+			getAugmentationKernels(augmentation->bytesPerPixel);
+		augmentation->isActive = false;
+		features->augmentation = augmentation;
+	}
+	if(!initSolverState(config, features, firstStep, &run->solver)){
+		free(features->values);
+		return false;
+	}
+	return true;
+}
+
+// End a training run, leaving the trained vectors in the model
+void endTrainingRun(
+		const TrainingConfig *config,
+		SvmModel *model,
+		TrainingRun *run
+		){
+	finishSolverState(config, &run->features, &run->solver, model->vectors);
+	free(run->features.values);
+}
+
+// Abandon a training run whose vectors are no longer needed
+void freeTrainingRun(const TrainingConfig *config, TrainingRun *run){
+	freeSolverState(config, &run->solver);
+	free(run->features.values);
+}
+
+// Train the vectors of a model with fitted stages for numSteps steps from
+// firstStep
+bool trainSvmSteps(
+		const TrainingConfig *config,
+		SvmModel *model,
+		const SampleCache *cache,
+		uintmax_t firstStep,
+		uintmax_t numSteps,
+		uint64_t *randomState
+		){
+	TrainingRun run;
+	if(!beginTrainingRun(config, model, cache, firstStep, &run))
+		return false;
+	trainSolverSteps(
+		config,
+		&run.features,
+		&run.solver,
+		model->vectors,
+		numSteps,
+		randomState
+		);
+	endTrainingRun(config, model, &run);
+	return true;
+}
+
+// Fit the feature stages learned from samples and train the vectors of a
+// model on a sample cache, leaving them in the model
+bool trainSvmModel(
+		const TrainingConfig *config,
+		SvmModel *model,
+		const SampleCache *cache,
+		uint64_t *randomState,
+		char *pathToInputDir
+		){
+	uintmax_t firstStep;
+	return
+		fitSvmStages(
+			config,
+			model,
+			cache,
+			randomState,
+			pathToInputDir,
+			&firstStep
+			) &&
+		trainSvmSteps(
+			config,
+			model,
+			cache,
+			firstStep,
+			config->numSteps,
+			randomState
+			);
+}
+
+// Use the contents of the directory to make the output SVM file
+bool createSvmFromDir(
+		char *pathToInputDir,
+		char *pathToOutputFile
+		){
+	if(access(pathToOutputFile, F_OK) == 0){
+		if(access(pathToOutputFile, W_OK) != 0){
+			fprintf(
+				stderr,
+				"Insufficient permission to overwrite %s\n",
+				pathToOutputFile
+			       );
+			return false;
+		}
+	}
+	TrainingConfig config = getDefaultTrainingConfig();
+	SvmModel model;
+	SampleCache cache;
+	uint64_t randomState;
+	if(
+		!loadTrainingSamples(
+			pathToInputDir,
+			&config,
+			&model,
+			&cache,
+			&randomState
+			)
+	  )
+		return false;
+	bool trained =
+		trainSvmModel(
+			&config,
+			&model,
+			&cache,
+			&randomState,
+			pathToInputDir
+			);
+	freeSampleCache(&cache);
+	if(
+		!trained ||
+		!narrowVectors(&model, WEIGHT_FORMAT) ||
+		!writeSvmModel(pathToOutputFile, &model)
+	  ){
+		fprintf(
+			stderr,
+			"Error writing trained vectors to %s\n",
+			pathToOutputFile
+		       );
+		freeSvmModel(&model);
+		return false;
+	}
+	freeSvmModel(&model);
+	return true;
+}
+
+// Samples of each class shuffled and dealt into folds in turn, as indices
+// into a sample cache
+typedef struct {
+	uint32_t numFolds;
+	uint64_t numClasses;
+	// Samples of class c in fold f occupy indices offsets[f * numClasses +
+	// c] up to the next offset
+	uintmax_t *offsets;
+	uintmax_t *sampleNums;
+} Folds;
+
+void freeFolds(Folds *folds){
+	free(folds->offsets);
+	free(folds->sampleNums);
+}
+
+// Split the samples of a cache into stratified folds
+//
+// Each class is dealt starting from the fold after the one the previous
+// class ended on, so that folds differ in size by at most one sample.
+bool buildStratifiedFolds(
+		const SampleCache *cache,
+		uint32_t numFolds,
+		uint64_t *randomState,
+		Folds *folds
+		){
+	uint64_t numClasses = cache->numClasses;
+	uintmax_t numSamples = cache->numSamples;
+	uintmax_t numBuckets = (uintmax_t)numFolds * numClasses;
+	folds->numFolds = numFolds;
+	folds->numClasses = numClasses;
+	folds->offsets =
+		(uintmax_t *)calloc(numBuckets + 1, sizeof(uintmax_t));
+	folds->sampleNums =
+		(uintmax_t *)malloc(numSamples * sizeof(uintmax_t));
+	uintmax_t *shuffled =
+		(uintmax_t *)malloc(numSamples * sizeof(uintmax_t));
+	if(!folds->offsets || !folds->sampleNums || !shuffled){
+		fprintf(
+			stderr,
+			"Error allocating memory for %" PRIu32 " folds\n",
+			numFolds
+		       );
+		freeFolds(folds);
+		free(shuffled);
+		return false;
+	}
+
+	// The sample at each position of a class goes to the fold of the
+	// position's remainder
+	for(uint64_t classNum = 0; classNum < numClasses; classNum++){
+		for(
+			uintmax_t sampleNum = cache->classOffsets[classNum];
+			sampleNum < cache->classOffsets[classNum + 1];
+			sampleNum++
+		   ){
+			uint32_t foldNum = sampleNum % numFolds;
+			folds->offsets[foldNum * numClasses + classNum + 1]++;
+		}
+	}
+	for(uintmax_t bucketNum = 0; bucketNum < numBuckets; bucketNum++)
+		folds->offsets[bucketNum + 1] += folds->offsets[bucketNum];
+	for(uint64_t classNum = 0; classNum < numClasses; classNum++){
+		uintmax_t firstSample = cache->classOffsets[classNum];
+		uintmax_t endSample = cache->classOffsets[classNum + 1];
+		for(
+			uintmax_t sampleNum = firstSample;
+			sampleNum < endSample;
+			sampleNum++
+		   ){
+			uintmax_t swapNum =
+				firstSample +
+				nextRandom(randomState) %
+				(sampleNum - firstSample + 1);
+			if(swapNum != sampleNum)
+				shuffled[sampleNum] = shuffled[swapNum];
+			shuffled[swapNum] = sampleNum;
+		}
+		for(uint32_t foldNum = 0; foldNum < numFolds; foldNum++){
+			uintmax_t position =
+				folds->offsets[foldNum * numClasses + classNum];
+			for(
+				uintmax_t sampleNum = firstSample;
+				sampleNum < endSample;
+				sampleNum++
+			   ){
+				if(sampleNum % numFolds != foldNum)
+					continue;
+				folds->sampleNums[position] =
+					shuffled[sampleNum];
+				position++;
+			}
+		}
+	}
+	free(shuffled);
+	return true;
+}
+
+// Free a training split of a sample cache, whose pixel bytes and paths are
+// borrowed
+void freeTrainingFolds(SampleCache *training){
+	free(training->classOffsets);
+	free(training->samplePaths);
+	free(training->normDivisors);
+	free(training->sampleNums);
+}
+
+// Gather the samples of every fold but one from a sample cache into a
+// training split, grouped by class as training expects
+//
+// The split indexes the pixel bytes of the cache rather than copying them,
+// so that folds trained in parallel share one copy. Only the norm divisors
+// and paths, which are small, are gathered.
+bool gatherTrainingFolds(
+		const SampleCache *cache,
+		const Folds *folds,
+		uint32_t heldOutFold,
+		SampleCache *training
+		){
+	uint64_t numClasses = folds->numClasses;
+	uintmax_t numTraining =
+		cache->numSamples -
+		(folds->offsets[(heldOutFold + 1) * numClasses] -
+		 folds->offsets[heldOutFold * numClasses]);
+	training->numClasses = numClasses;
+	training->numSamples = 0;
+	training->sampleBytes = cache->sampleBytes;
+	training->pixelBytes = cache->pixelBytes;
+	training->classOffsets =
+		(uintmax_t *)malloc((numClasses + 1) * sizeof(uintmax_t));
+	training->samplePaths =
+		(char **)malloc(numTraining * sizeof(char *));
+	training->normDivisors =
+		(double *)malloc(numTraining * sizeof(double));
+	training->sampleNums =
+		(uintmax_t *)malloc(numTraining * sizeof(uintmax_t));
+	if(
+		!training->classOffsets ||
+		!training->samplePaths ||
+		!training->normDivisors ||
+		!training->sampleNums
+	  ){
+		fprintf(
+			stderr,
+			"Error allocating memory for %ju training samples\n",
+			numTraining
+		       );
+		freeTrainingFolds(training);
+		return false;
+	}
+	for(uint64_t classNum = 0; classNum < numClasses; classNum++){
+		training->classOffsets[classNum] = training->numSamples;
+		for(
+			uint32_t foldNum = 0;
+			foldNum < folds->numFolds;
+			foldNum++
+		   ){
+			if(foldNum == heldOutFold)
+				continue;
+			uintmax_t bucketNum = foldNum * numClasses + classNum;
+			for(
+				uintmax_t position = folds->offsets[bucketNum];
+				position < folds->offsets[bucketNum + 1];
+				position++
+			   ){
+				uintmax_t sampleNum =
+					folds->sampleNums[position];
+				uintmax_t trainingNum = training->numSamples;
+				training->sampleNums[trainingNum] = sampleNum;
+				training->normDivisors[trainingNum] =
+					cache->normDivisors[sampleNum];
+				training->samplePaths[trainingNum] =
+					cache->samplePaths[sampleNum];
+				training->numSamples++;
+			}
+		}
+	}
+	training->classOffsets[numClasses] = training->numSamples;
+	return true;
+}
+
+// Count the samples of a fold that a model classifies correctly, with ties
+// counting as incorrect
+bool countCorrectInFold(
+		const SvmModel *model,
+		const SampleCache *cache,
+		const Folds *folds,
+		uint32_t foldNum,
+		uintmax_t *numCorrect
+		){
+	uint64_t numClasses = folds->numClasses;
+	double *features = (double *)malloc(model->numDims * sizeof(double));
+	uintmax_t *vectorsInFavor =
+		(uintmax_t *)malloc(numClasses * sizeof(uintmax_t));
+	if(!features || !vectorsInFavor){
+		fprintf(
+			stderr,
+			"Error allocating memory required for voting "
+			"mechanism\n"
+		       );
+		free(features);
+		free(vectorsInFavor);
+		return false;
+	}
+	*numCorrect = 0;
+	for(uint64_t classNum = 0; classNum < numClasses; classNum++){
+		uintmax_t bucketNum = foldNum * numClasses + classNum;
+		for(
+			uintmax_t position = folds->offsets[bucketNum];
+			position < folds->offsets[bucketNum + 1];
+			position++
+		   ){
+			uintmax_t sampleNum = folds->sampleNums[position];
+			getSampleFeatures(
+				model,
+				cache->pixelBytes +
+				sampleNum * cache->sampleBytes,
+				cache->normDivisors[sampleNum],
+				features
+				);
+			*numCorrect +=
+				getVotedClass(
+					model,
+					features,
+					vectorsInFavor,
+					NULL
+					) == classNum;
+		}
+	}
+	free(features);
+	free(vectorsInFavor);
+	return true;
+}
+
+// Samples of a training directory split into folds, each of which is
+// scored by a model trained on the others
+typedef struct {
+	const TrainingConfig *config;
+	const SvmModel *model;
+	const SampleCache *cache;
+	const Folds *folds;
+	const uint64_t *foldSeeds;
+	char *pathToInputDir;
+	uintmax_t *numCorrect;
+} CrossValidation;
+
+// Train a model on every fold but one and count the samples of that fold
+// it classifies correctly
+//
+// The samples of the other folds are gathered from the shared cache into
+// one of the fold's own, as training reads samples straight from it.
+bool crossValidateFold(void *context, uintmax_t foldNum, uint32_t threadNum){
+	// Each fold allocates its own buffers, so none are kept per thread
+	(void)threadNum;
+	CrossValidation *validation = (CrossValidation *)context;
+	SampleCache training;
+	if(
+		!gatherTrainingFolds(
+			validation->cache,
+			validation->folds,
+			foldNum,
+			&training
+			)
+	  )
+		return false;
+
+	// The fold's model shares the classes and pixel mask of the one
+	// loaded, and has its own components and vectors
+	SvmModel model = *validation->model;
+	uint64_t randomState = validation->foldSeeds[foldNum];
+	bool isTrained =
+		trainSvmModel(
+			validation->config,
+			&model,
+			&training,
+			&randomState,
+			validation->pathToInputDir
+			);
+	freeTrainingFolds(&training);
+	if(!isTrained){
+		fprintf(
+			stderr,
+			"Error training fold %ju of %s\n",
+			foldNum + 1,
+			validation->pathToInputDir
+		       );
+	}
+	bool isScored =
+		isTrained &&
+		countCorrectInFold(
+			&model,
+			validation->cache,
+			validation->folds,
+			foldNum,
+			validation->numCorrect + foldNum
+			);
+	free(model.components);
+	free(model.vectors);
+	return isScored;
+}
+
+// Estimate the accuracy of training on a directory by stratified k-fold
+// cross-validation, with CROSS_VALIDATION_FOLDS folds trained in parallel,
+// reporting each fold's accuracy and their mean and spread
+//
+// The directory is decoded once, and the folds are lists of indices into
+// the decoded samples. Pixel masks learned from variance are learned once
+// from every sample.
+bool crossValidateDir(char *pathToInputDir){
+	uint32_t numFolds = CROSS_VALIDATION_FOLDS;
+	if(numFolds < 2){
+		fprintf(
+			stderr,
+			"Cross-validation needs at least 2 folds\n"
+		       );
+		return false;
+	}
+	TrainingConfig config = getDefaultTrainingConfig();
+	SvmModel model;
+	SampleCache cache;
+	uint64_t randomState;
+	if(
+		!loadTrainingSamples(
+			pathToInputDir,
+			&config,
+			&model,
+			&cache,
+			&randomState
+			)
+	  )
+		return false;
+	for(uint64_t classNum = 0; classNum < model.numClasses; classNum++){
+		uintmax_t numClassSamples =
+			cache.classOffsets[classNum + 1] -
+			cache.classOffsets[classNum];
+		if(numClassSamples < numFolds){
+			fprintf(
+				stderr,
+				"%s has %ju samples of %s, fewer than the %"
+				PRIu32 " folds\n",
+				pathToInputDir,
+				numClassSamples,
+				model.classNames[classNum],
+				numFolds
+			       );
+			freeSampleCache(&cache);
+			freeSvmModel(&model);
+			return false;
+		}
+	}
+	Folds folds;
+	if(!buildStratifiedFolds(&cache, numFolds, &randomState, &folds)){
+		freeSampleCache(&cache);
+		freeSvmModel(&model);
+		return false;
+	}
+	uint64_t *foldSeeds = (uint64_t *)malloc(numFolds * sizeof(uint64_t));
+	uintmax_t *numCorrect =
+		(uintmax_t *)malloc(numFolds * sizeof(uintmax_t));
+	if(!foldSeeds || !numCorrect){
+		fprintf(
+			stderr,
+			"Error allocating memory for %" PRIu32 " folds\n",
+			numFolds
+		       );
+		free(foldSeeds);
+		free(numCorrect);
+		freeFolds(&folds);
+		freeSampleCache(&cache);
+		freeSvmModel(&model);
+		return false;
+	}
+
+	// Each fold draws from its own random state, which can't be 0
+	for(uint32_t foldNum = 0; foldNum < numFolds; foldNum++){
+		do
+			foldSeeds[foldNum] = nextRandom(&randomState);
+		while(!foldSeeds[foldNum]);
+	}
+	uint32_t numThreads = getNumThreads();
+	if(numThreads > numFolds)
+		numThreads = numFolds;
+	if(DEBUG_LEVEL < 2){
+		fprintf(
+			stderr,
+			"Info: Training %" PRIu32 " folds on %" PRIu32
+			" threads\n",
+			numFolds,
+			numThreads
+		       );
+	}
+	CrossValidation validation;
+	validation.config = &config;
+	validation.model = &model;
+	validation.cache = &cache;
+	validation.folds = &folds;
+	validation.foldSeeds = foldSeeds;
+	validation.pathToInputDir = pathToInputDir;
+	validation.numCorrect = numCorrect;
+	bool isValidated =
+		runJobsInParallel(
+			numFolds,
+			numThreads,
+			crossValidateFold,
+			&validation
+			);
+	if(isValidated){
+		uint64_t numClasses = model.numClasses;
+		double sum = 0.0;
+		double sumOfSquares = 0.0;
+		double lowest = INFINITY;
+		double highest = -INFINITY;
+		for(uint32_t foldNum = 0; foldNum < numFolds; foldNum++){
+			uintmax_t numHeldOut =
+				folds.offsets[(foldNum + 1) * numClasses] -
+				folds.offsets[foldNum * numClasses];
+			double accuracy =
+				(double)numCorrect[foldNum] / numHeldOut * 100;
+			fprintf(
+				stdout,
+				"Accuracy of fold %" PRIu32 ": %lf%% (%ju of "
+				"%ju)\n",
+				foldNum + 1,
+				accuracy,
+				numCorrect[foldNum],
+				numHeldOut
+			       );
+			sum += accuracy;
+			sumOfSquares += accuracy * accuracy;
+			lowest = accuracy < lowest ? accuracy : lowest;
+			highest = accuracy > highest ? accuracy : highest;
+		}
+		double mean = sum / numFolds;
+		double variance =
+			(sumOfSquares - sum * mean) / (numFolds - 1);
+		fprintf(
+			stdout,
+			"Mean accuracy: %lf%%, with a standard deviation of "
+			"%lf percentage points, ranging from %lf%% to %lf%%\n",
+			mean,
+			variance > 0.0 ? sqrt(variance) : 0.0,
+			lowest,
+			highest
+		       );
+	}
+	free(foldSeeds);
+	free(numCorrect);
+	freeFolds(&folds);
+	freeSampleCache(&cache);
+	freeSvmModel(&model);
+	return isValidated;
+}
+
+// A configuration tried by the search command and the model trained with
+// it, which keeps training from where it stopped in each round it survives
+typedef struct {
+	TrainingConfig config;
+	SvmModel model;
+	uint64_t randomState;
+	// Training of the model, begun in the candidate's first round and kept
+	// with its solver's state between rounds until it has taken all of
+	// config.numSteps
+	TrainingRun run;
+	bool isTraining;
+	uintmax_t stepsTaken;
+	uint32_t numRounds;
+	uintmax_t numCorrect;
+} SearchCandidate;
+
+// Candidates of the search command sharing one decoded training split and
+// the fold held out from it
+typedef struct {
+	// Candidates still trained in the current round, best first after it
+	SearchCandidate **active;
+	uint32_t roundNum;
+	uint32_t numRounds;
+	const SampleCache *cache;
+	const SampleCache *training;
+	const Folds *folds;
+	char *pathToInputDir;
+} Search;
+
+// Train a candidate of the search command up to its share of its steps for
+// the current round, then score it on the held out fold
+bool trainSearchCandidate(void *context, uintmax_t jobNum, uint32_t threadNum){
+	// Candidates differ in dimensions, so none of their buffers are kept
+	// per thread
+	(void)threadNum;
+	Search *search = (Search *)context;
+	SearchCandidate *candidate = search->active[jobNum];
+	const TrainingConfig *config = &candidate->config;
+	SvmModel *model = &candidate->model;
+	if(!candidate->numRounds){
+		uintmax_t firstStep;
+		if(
+			!fitSvmStages(
+				config,
+				model,
+				search->training,
+				&candidate->randomState,
+				search->pathToInputDir,
+				&firstStep
+				) ||
+			!beginTrainingRun(
+				config,
+				model,
+				search->training,
+				firstStep,
+				&candidate->run
+				)
+		  )
+			return false;
+		candidate->isTraining = true;
+	}
+
+	// Each round before the last takes 1 in SEARCH_HALVING_FACTOR of the
+	// steps of the round after it
+	uintmax_t roundSteps = config->numSteps;
+	for(
+		uint32_t roundNum = search->roundNum + 1;
+		roundNum < search->numRounds;
+		roundNum++
+	   )
+		roundSteps /= SEARCH_HALVING_FACTOR;
+	if(roundSteps > candidate->stepsTaken){
+		trainSolverSteps(
+			config,
+			&candidate->run.features,
+			&candidate->run.solver,
+			model->vectors,
+			roundSteps - candidate->stepsTaken,
+			&candidate->randomState
+			);
+		candidate->stepsTaken = roundSteps;
+	}
+	candidate->numRounds = search->roundNum + 1;
+	if(candidate->isTraining && candidate->stepsTaken == config->numSteps){
+		endTrainingRun(config, model, &candidate->run);
+		candidate->isTraining = false;
+	}
+	if(!candidate->isTraining){
+		return
+			countCorrectInFold(
+				model,
+				search->cache,
+				search->folds,
+				0,
+				&candidate->numCorrect
+				);
+	}
+
+	// A run still training is scored on the vectors it would leave if it
+	// ended now
+	SvmModel scored = *model;
+	scored.vectors =
+		(double *)
+		malloc(
+			getNumPairs(model->numClasses) *
+			model->numDims *
+			sizeof(double)
+		      );
+	if(!scored.vectors){
+		fprintf(
+			stderr,
+			"Error allocating memory for vectors\n"
+		       );
+		return false;
+	}
+	getTrainedVectors(
+		&candidate->run.features,
+		&candidate->run.solver,
+		model->vectors,
+		scored.vectors
+		);
+	bool isScored =
+		countCorrectInFold(
+			&scored,
+			search->cache,
+			search->folds,
+			0,
+			&candidate->numCorrect
+			);
+	free(scored.vectors);
+	return isScored;
+}
+
+// Stop training a candidate of the search command, freeing its training run
+// and vectors
+void stopSearchCandidate(SearchCandidate *candidate){
+	if(candidate->isTraining)
+		freeTrainingRun(&candidate->config, &candidate->run);
+	candidate->isTraining = false;
+	free(candidate->model.components);
+	free(candidate->model.vectors);
+	candidate->model.components = NULL;
+	candidate->model.vectors = NULL;
+}
+
+// Order candidates by the most rounds survived, then the most correct
+// samples, then the order they were made in
+int compareSearchCandidates(const void *candidateA, const void *candidateB){
+	const SearchCandidate *a = *(const SearchCandidate **)candidateA;
+	const SearchCandidate *b = *(const SearchCandidate **)candidateB;
+	if(a->numRounds != b->numRounds)
+		return a->numRounds < b->numRounds ? 1 : -1;
+	if(a->numCorrect != b->numCorrect)
+		return a->numCorrect < b->numCorrect ? 1 : -1;
+	return (a > b) - (a < b);
+}
+
+// Order candidates by the most steps in their configuration, so that the
+// longest jobs of a round start first
+int compareSearchCandidateSteps(const void *candidateA, const void *candidateB){
+	const SearchCandidate *a = *(const SearchCandidate **)candidateA;
+	const SearchCandidate *b = *(const SearchCandidate **)candidateB;
+	if(a->config.numSteps != b->config.numSteps)
+		return a->config.numSteps < b->config.numSteps ? 1 : -1;
+	return (a > b) - (a < b);
+}
+
+void freeSearchCandidates(SearchCandidate *candidates, uint32_t numCandidates){
+	for(
+		uint32_t candidateNum = 0;
+		candidateNum < numCandidates;
+		candidateNum++
+	   ){
+		stopSearchCandidate(candidates + candidateNum);
+		free(candidates[candidateNum].model.packedWeights);
+	}
+	free(candidates);
+}
+
+// Search the configurations of SEARCH_LAMBDAS, SEARCH_NUM_STEPS,
+// SEARCH_PCA_COMPONENTS and SEARCH_SOLVERS for the most accurate on a
+// directory, reporting them ranked and writing the best model
+//
+// The directory is decoded once and a stratified fold of it is held out
+// for validation, the rest being trained on by every configuration in
+// parallel. Successive halving trains every configuration for a fraction of
+// its steps, and only the best 1 in SEARCH_HALVING_FACTOR of them continue
+// from there for a larger fraction, until one has taken all its steps.
+bool searchDir(char *pathToInputDir, char *pathToOutputFile){
+	if(access(pathToOutputFile, F_OK) == 0){
+		if(access(pathToOutputFile, W_OK) != 0){
+			fprintf(
+				stderr,
+				"Insufficient permission to overwrite %s\n",
+				pathToOutputFile
+			       );
+			return false;
+		}
+	}
+	uint32_t numFolds = CROSS_VALIDATION_FOLDS;
+	if(numFolds < 2 || SEARCH_HALVING_FACTOR < 2){
+		fprintf(
+			stderr,
+			"Searching needs at least 2 folds and a halving factor "
+			"of at least 2\n"
+		       );
+		return false;
+	}
+	double lambdas[] = SEARCH_LAMBDAS;
+	uintmax_t stepCounts[] = SEARCH_NUM_STEPS;
+	uint32_t componentCounts[] = SEARCH_PCA_COMPONENTS;
+	uint8_t solvers[] = SEARCH_SOLVERS;
+	uint32_t numLambdas = sizeof(lambdas) / sizeof(lambdas[0]);
+	uint32_t numStepCounts = sizeof(stepCounts) / sizeof(stepCounts[0]);
+	uint32_t numComponentCounts =
+		sizeof(componentCounts) / sizeof(componentCounts[0]);
+	uint32_t numSolvers = sizeof(solvers) / sizeof(solvers[0]);
+	uint32_t numCombinations =
+		numLambdas * numStepCounts * numComponentCounts * numSolvers;
+	uint32_t numCandidates = numCombinations;
+	if(SEARCH_RANDOM_CONFIGS && SEARCH_RANDOM_CONFIGS < numCombinations)
+		numCandidates = SEARCH_RANDOM_CONFIGS;
+
+	TrainingConfig config = getDefaultTrainingConfig();
+	SvmModel model;
+	SampleCache cache;
+	uint64_t randomState;
+	if(
+		!loadTrainingSamples(
+			pathToInputDir,
+			&config,
+			&model,
+			&cache,
+			&randomState
+			)
+	  )
+		return false;
+	for(uint64_t classNum = 0; classNum < model.numClasses; classNum++){
+		uintmax_t numClassSamples =
+			cache.classOffsets[classNum + 1] -
+			cache.classOffsets[classNum];
+		if(numClassSamples < numFolds){
+			fprintf(
+				stderr,
+				"%s has %ju samples of %s, fewer than the %"
+				PRIu32 " folds\n",
+				pathToInputDir,
+				numClassSamples,
+				model.classNames[classNum],
+				numFolds
+			       );
+			freeSampleCache(&cache);
+			freeSvmModel(&model);
+			return false;
+		}
+	}
+	Folds folds;
+	if(!buildStratifiedFolds(&cache, numFolds, &randomState, &folds)){
+		freeSampleCache(&cache);
+		freeSvmModel(&model);
+		return false;
+	}
+	SampleCache training;
+	if(!gatherTrainingFolds(&cache, &folds, 0, &training)){
+		freeFolds(&folds);
+		freeSampleCache(&cache);
+		freeSvmModel(&model);
+		return false;
+	}
+	uint32_t *combinationNums =
+		(uint32_t *)malloc(numCombinations * sizeof(uint32_t));
+	SearchCandidate *candidates =
+		(SearchCandidate *)
+		calloc(numCandidates, sizeof(SearchCandidate));
+	SearchCandidate **active =
+		(SearchCandidate **)
+		malloc(numCandidates * sizeof(SearchCandidate *));
+	if(!combinationNums || !candidates || !active){
+		fprintf(
+			stderr,
+			"Error allocating memory for %" PRIu32
+			" configurations\n",
+			numCandidates
+		       );
+		free(combinationNums);
+		free(candidates);
+		free(active);
+		freeTrainingFolds(&training);
+		freeFolds(&folds);
+		freeSampleCache(&cache);
+		freeSvmModel(&model);
+		return false;
+	}
+
+	// A random search takes the first combinations of a partial shuffle
+	for(uint32_t drawNum = 0; drawNum < numCombinations; drawNum++)
+		combinationNums[drawNum] = drawNum;
+	if(numCandidates < numCombinations){
+		for(uint32_t drawNum = 0; drawNum < numCandidates; drawNum++){
+			uint32_t swapNum =
+				drawNum +
+				nextRandom(&randomState) %
+				(numCombinations - drawNum);
+			uint32_t combinationNum = combinationNums[swapNum];
+			combinationNums[swapNum] = combinationNums[drawNum];
+			combinationNums[drawNum] = combinationNum;
+		}
+	}
+
+	// Each candidate shares the classes and pixel mask of the model loaded
+	// and draws from its own random state, which can't be 0
+	for(
+		uint32_t candidateNum = 0;
+		candidateNum < numCandidates;
+		candidateNum++
+	   ){
+		SearchCandidate *candidate = candidates + candidateNum;
+		uint32_t combinationNum = combinationNums[candidateNum];
+		candidate->config = config;
+		candidate->config.lambda = lambdas[combinationNum % numLambdas];
+		combinationNum /= numLambdas;
+		candidate->config.numSteps =
+			stepCounts[combinationNum % numStepCounts];
+		combinationNum /= numStepCounts;
+		candidate->config.pcaComponents =
+			componentCounts[combinationNum % numComponentCounts];
+		combinationNum /= numComponentCounts;
+		candidate->config.solver = solvers[combinationNum];
+		candidate->model = model;
+		do
+			candidate->randomState = nextRandom(&randomState);
+		while(!candidate->randomState);
+		active[candidateNum] = candidate;
+	}
+	free(combinationNums);
+
+	// Rounds continue until a round trains only one candidate
+	uint32_t numRounds = 1;
+	for(
+		uint32_t numActive = numCandidates;
+		numActive > 1;
+		numActive =
+			(numActive + SEARCH_HALVING_FACTOR - 1) /
+			SEARCH_HALVING_FACTOR
+	   )
+		numRounds++;
+	Search search;
+	search.active = active;
+	search.numRounds = numRounds;
+	search.cache = &cache;
+	search.training = &training;
+	search.folds = &folds;
+	search.pathToInputDir = pathToInputDir;
+	uint32_t numActive = numCandidates;
+	bool isSearched = true;
+	for(
+		search.roundNum = 0;
+		isSearched && search.roundNum < numRounds;
+		search.roundNum++
+	   ){
+		uint32_t numThreads = getNumThreads();
+		if(numThreads > numActive)
+			numThreads = numActive;
+		if(DEBUG_LEVEL < 2){
+			fprintf(
+				stderr,
+				"Info: Round %" PRIu32 " of %" PRIu32
+				" training %" PRIu32 " configurations on %"
+				PRIu32 " threads\n",
+				search.roundNum + 1,
+				numRounds,
+				numActive,
+				numThreads
+			       );
+		}
+		qsort(
+			active,
+			numActive,
+			sizeof(SearchCandidate *),
+			compareSearchCandidateSteps
+		     );
+		isSearched =
+			runJobsInParallel(
+				numActive,
+				numThreads,
+				trainSearchCandidate,
+				&search
+				);
+		qsort(
+			active,
+			numActive,
+			sizeof(SearchCandidate *),
+			compareSearchCandidates
+		     );
+
+		// Candidates that stop no longer need their training state
+		uint32_t numSurvivors =
+			(numActive + SEARCH_HALVING_FACTOR - 1) /
+			SEARCH_HALVING_FACTOR;
+		for(
+			uint32_t activeNum = numSurvivors;
+			activeNum < numActive;
+			activeNum++
+		   )
+			stopSearchCandidate(active[activeNum]);
+		numActive = numSurvivors;
+	}
+
+	if(isSearched){
+		for(
+			uint32_t candidateNum = 0;
+			candidateNum < numCandidates;
+			candidateNum++
+		   )
+			active[candidateNum] = candidates + candidateNum;
+		qsort(
+			active,
+			numCandidates,
+			sizeof(SearchCandidate *),
+			compareSearchCandidates
+		     );
+		uintmax_t numHeldOut = folds.offsets[model.numClasses];
+		fprintf(
+			stdout,
+			"Rank\tLambda\tSteps\tComponents\tSolver\tRounds\t"
+			"Steps trained\tAccuracy\n"
+		       );
+		for(
+			uint32_t candidateNum = 0;
+			candidateNum < numCandidates;
+			candidateNum++
+		   ){
+			const SearchCandidate *candidate = active[candidateNum];
+			uint8_t solver = candidate->config.solver;
+			fprintf(
+				stdout,
+				"%" PRIu32 "\t%g\t%ju\t%" PRIu32 "\t%s\t%"
+				PRIu32 "\t%ju\t%lf%%\n",
+				candidateNum + 1,
+				candidate->config.lambda,
+				candidate->config.numSteps,
+				candidate->config.pcaComponents,
+				solver == SOLVER_SGD ? "SGD" :
+				solver == SOLVER_SAGA ? "SAGA" : "SVRG",
+				candidate->numRounds,
+				candidate->stepsTaken,
+				(double)candidate->numCorrect / numHeldOut * 100
+			       );
+		}
+		SvmModel *best = &active[0]->model;
+		if(
+			!narrowVectors(best, WEIGHT_FORMAT) ||
+			!writeSvmModel(pathToOutputFile, best)
+		  ){
+			fprintf(
+				stderr,
+				"Error writing trained vectors to %s\n",
+				pathToOutputFile
+			       );
+			isSearched = false;
+		}
+	}
+	free(active);
+	freeSearchCandidates(candidates, numCandidates);
+	freeTrainingFolds(&training);
+	freeFolds(&folds);
+	freeSampleCache(&cache);
+	freeSvmModel(&model);
+	return isSearched;
+}
+
+// Features of decoded pixel bytes for a model, freeing the bytes
+//
+// Bytes of other dimensions than the model's are resampled to them with
+// resampleMode, or rejected if it's RESAMPLE_OFF.
+double *getFeaturesForModel(
+		uint8_t *pixelBytes,
+		uint32_t width,
+		int32_t height,
+		uint16_t bitsPerPixel,
+		const SvmModel *model,
+		uint8_t resampleMode,
+		char *pathToInputFile,
+		char *pathToSvmFile
+		){
+	if(
+		resampleMode != RESAMPLE_OFF &&
+		(
+		 model->width != width ||
+		 imaxabs(model->height) != imaxabs(height) ||
+		 model->bitsPerPixel != bitsPerPixel
+		)
+	  ){
+		pixelBytes =
+			resampleToModel(
+				pixelBytes,
+				width,
+				height,
+				bitsPerPixel,
+				model,
+				resampleMode
+				);
+		if(!pixelBytes){
+			fprintf(
+				stderr,
+				"Error resampling %s to the dimensions of %s\n",
+				pathToInputFile,
+				pathToSvmFile
+			       );
+			return NULL;
+		}
+	}else if(
+		model->width != width ||
+		imaxabs(model->height) != imaxabs(height) ||
+		model->bitsPerPixel != bitsPerPixel
+	  ){
+		if(model->width != width)
+			fprintf(
+				stderr,
+				"%s was trained on files with a width of %"
+				PRIu32 " pixels. %s has a width of %" PRIu32
+				" pixels.\n",
+				pathToSvmFile,
+				model->width,
+				pathToInputFile,
+				width
+			       );
+		if(imaxabs(model->height) != imaxabs(height))
+			fprintf(
+				stderr,
+				"%s was trained on files with a height of %"
+				PRId32 " pixels. %s has a height of %" PRId32
+				" pixels.\n",
+				pathToSvmFile,
+				model->height,
+				pathToInputFile,
+				height
+			       );
+		if(model->bitsPerPixel != bitsPerPixel)
+			fprintf(
+				stderr,
+				"%s was trained on files with a %" PRIu16
+				" bits per pixel. %s has %" PRIu16 " bits per "
+				"pixel.\n",
+				pathToSvmFile,
+				model->bitsPerPixel,
+				pathToInputFile,
+				bitsPerPixel
+			       );
+		free(pixelBytes);
+		return NULL;
+	}
+
+	// Get relevant values for the sample
+	applyDecodeStages(model, pixelBytes);
+	double normDivisor =
+		getNormDivisor(pixelBytes, getNumPixelBytes(model));
+	double *features = (double *)malloc(model->numDims * sizeof(double));
+	if(!features){
+		fprintf(
+			stderr,
+			"Error allocating memory for the features of %s\n",
+			pathToInputFile
+		       );
+		free(pixelBytes);
+		return NULL;
+	}
+	getSampleFeatures(model, pixelBytes, normDivisor, features);
+	free(pixelBytes);
+	return features;
+}
+
+// Report the classes with the most votes from a model's pairs for a file
+bool reportVotes(
+		const SvmModel *model,
+		const uintmax_t *vectorsInFavor,
+		const double *dotProducts,
+		char *pathToInputFile
+		){
+	uint64_t numClasses = model->numClasses;
+	if(DEBUG_LEVEL < 1){
+		uintmax_t totalVectors = 0;
+		for(
+			uint64_t posClass = 0;
+			posClass < numClasses - 1;
+			posClass++
+		   ){
+			for(
+				uint64_t negClass = posClass + 1;
+				negClass < numClasses;
+				negClass++
+			   ){
+				double dotProduct = dotProducts[totalVectors];
+				totalVectors++;
+				fprintf(
+					stderr,
+					"Vector %ju:\n"
+					"\tDot Product = %lf\n"
+					"\tClass = %s\n",
+					totalVectors,
+					dotProduct,
+					model->classNames
+						[
+						dotProduct > 0.0 ?
+						posClass :
+						negClass
+						]
+				       );
+			}
+		}
+	}
+
+	// Find out and display results
+	uint64_t numClassesFavorite = 0;
+	uint64_t numVectorsFavor = vectorsInFavor[0];
+	uint64_t *favoriteClasses =
+		(uint64_t *)malloc(numClasses * sizeof(uint64_t));
+	if(!favoriteClasses){
+		fprintf(
+			stderr,
+			"Error allocating memory for results\n"
+		       );
+		return false;
+	}
+	for(uint64_t classNum = 0; classNum < numClasses; classNum++){
+		if(vectorsInFavor[classNum] > numVectorsFavor){
+			numClassesFavorite = 1;
+			numVectorsFavor = vectorsInFavor[classNum];
+			favoriteClasses[0] = classNum;
+		}else if(vectorsInFavor[classNum] == numVectorsFavor){
+			favoriteClasses[numClassesFavorite] = classNum;
+			numClassesFavorite++;
+		}
+	}
+	uintmax_t totalVectorsFavor = numClassesFavorite * numVectorsFavor;
+	uintmax_t totalVectorsRelevant =
+		(uintmax_t)numClassesFavorite *
+		(numClasses - 1);
+	fprintf(
+		stdout,
+		"%lf%% (%ju of %ju) of relevant vectors point to %s belonging "
+		"to one of the following classes:\n",
+		(double)totalVectorsFavor / totalVectorsRelevant * 100,
+		totalVectorsFavor,
+		totalVectorsRelevant,
+		pathToInputFile
+	       );
+	for(
+		uint64_t favVectorNum = 0;
+		favVectorNum < numClassesFavorite;
+		favVectorNum++
+	){
+		fprintf(
+			stdout,
+			"\t%s\n",
+			model->classNames[favoriteClasses[favVectorNum]]
+		       );
+	}
+	free(favoriteClasses);
+	return true;
+}
+
+// Bundle files start with their magic number, the number of SVM and
+// cascade files they hold and the class table those files share, followed
+// by a table of contents giving each file's image dimensions, offset and
+// size. Each file starts on a BUNDLE_ALIGNMENT boundary, so that it can be
+// mapped on its own.
+#define BUNDLE_ALIGNMENT 4096
+typedef struct {
+	uint32_t width;
+	int32_t height;
+	uint16_t bitsPerPixel;
+	uint64_t offset;
+	uint64_t size;
+} BundleEntry;
+
+// Read the table of contents of a bundle up to its entries, leaving position
+// at the first entry
+bool readBundleHeader(
+		const uint8_t *buffer,
+		uintmax_t bufferSize,
+		char *pathToBundleFile,
+		uintmax_t *position,
+		uint32_t *numEntries
+		){
+	*position = 4;
+	uint64_t numClasses;
+	if(
+		!readFromBuffer(
+			buffer,
+			bufferSize,
+			position,
+			numEntries,
+			sizeof(uint32_t)
+			) ||
+		!readFromBuffer(
+			buffer,
+			bufferSize,
+			position,
+			&numClasses,
+			sizeof(uint64_t)
+			)
+	  ){
+		fprintf(
+			stderr,
+			"Error reading the table of contents of %s\n",
+			pathToBundleFile
+		       );
+		return false;
+	}
+	for(uint64_t classNum = 0; classNum < numClasses; classNum++){
+		uint8_t nameRunLength;
+		if(
+			!readFromBuffer(
+				buffer,
+				bufferSize,
+				position,
+				&nameRunLength,
+				1
+				) ||
+			nameRunLength > bufferSize - *position
+		  ){
+			fprintf(
+				stderr,
+				"Error reading the class table of %s\n",
+				pathToBundleFile
+			       );
+			return false;
+		}
+		*position += nameRunLength;
+	}
+	return true;
+}
+
+bool readBundleEntry(
+		const uint8_t *buffer,
+		uintmax_t bufferSize,
+		char *pathToBundleFile,
+		uintmax_t *position,
+		BundleEntry *entry
+		){
+	if(
+		!readFromBuffer(
+			buffer,
+			bufferSize,
+			position,
+			&entry->width,
+			sizeof(uint32_t)
+			) ||
+		!readFromBuffer(
+			buffer,
+			bufferSize,
+			position,
+			&entry->height,
+			sizeof(int32_t)
+			) ||
+		!readFromBuffer(
+			buffer,
+			bufferSize,
+			position,
+			&entry->bitsPerPixel,
+			sizeof(uint16_t)
+			) ||
+		!readFromBuffer(
+			buffer,
+			bufferSize,
+			position,
+			&entry->offset,
+			sizeof(uint64_t)
+			) ||
+		!readFromBuffer(
+			buffer,
+			bufferSize,
+			position,
+			&entry->size,
+			sizeof(uint64_t)
+			) ||
+		entry->offset > bufferSize ||
+		entry->size > bufferSize - entry->offset
+	  ){
+		fprintf(
+			stderr,
+			"Error reading the table of contents of %s\n",
+			pathToBundleFile
+		       );
+		return false;
+	}
+	return true;
+}
+
+// Whether a model has the classes of a bundle's class table, which
+// readBundleHeader has found to fit in the buffer
+bool hasBundleClasses(const uint8_t *buffer, const SvmModel *model){
+	uintmax_t position = 4 + sizeof(uint32_t);
+	uint64_t numClasses;
+	memcpy(&numClasses, buffer + position, sizeof(uint64_t));
+	position += sizeof(uint64_t);
+	if(numClasses != model->numClasses)
+		return false;
+	for(uint64_t classNum = 0; classNum < numClasses; classNum++){
+		uint8_t nameRunLength = buffer[position++];
+		if(
+			strlen(model->classNames[classNum]) != nameRunLength ||
+			memcmp(
+				buffer + position,
+				model->classNames[classNum],
+				nameRunLength
+			      ) != 0
+		  )
+			return false;
+		position += nameRunLength;
+	}
+	return true;
+}
+
+// Pick the file of a bundle to classify an image with: the one made for
+// the image's dimensions, or if there is none and RESAMPLE isn't 0, the one
+// closest to it in number of pixels
+bool selectBundleEntry(
+		const uint8_t *buffer,
+		uintmax_t bufferSize,
+		char *pathToBundleFile,
+		uint32_t width,
+		int32_t height,
+		uint16_t bitsPerPixel,
+		BundleEntry *entry
+		){
+	uintmax_t position;
+	uint32_t numEntries;
+	if(
+		!readBundleHeader(
+			buffer,
+			bufferSize,
+			pathToBundleFile,
+			&position,
+			&numEntries
+			)
+	  )
+		return false;
+	double imagePixels = (double)width * imaxabs(height);
+	double bestDistance = INFINITY;
+	for(uint32_t entryNum = 0; entryNum < numEntries; entryNum++){
+		BundleEntry candidate;
+		if(
+			!readBundleEntry(
+				buffer,
+				bufferSize,
+				pathToBundleFile,
+				&position,
+				&candidate
+				)
+		  )
+			return false;
+		if(
+			candidate.width == width &&
+			imaxabs(candidate.height) == imaxabs(height) &&
+			candidate.bitsPerPixel == bitsPerPixel
+		  ){
+			*entry = candidate;
+			return true;
+		}
+		double distance =
+			fabs(
+				log(
+					(double)candidate.width *
+					imaxabs(candidate.height) /
+					imagePixels
+				   )
+			    );
+		if(distance < bestDistance){
+			*entry = candidate;
+			bestDistance = distance;
+		}
+	}
+	if(RESAMPLE != RESAMPLE_OFF && bestDistance < INFINITY){
+		if(DEBUG_LEVEL < 2){
+			fprintf(
+				stderr,
+				"Info: No file of %s is made for %" PRIu32
+				"x%jd images, so the %" PRIu32 "x%jd one is "
+				"used\n",
+				pathToBundleFile,
+				width,
+				imaxabs(height),
+				entry->width,
+				imaxabs(entry->height)
+			       );
+		}
+		return true;
+	}
+	fprintf(
+		stderr,
+		"%s holds no file made for %" PRIu32 "x%jd images with %"
+		PRIu16 " bits per pixel\n",
+		pathToBundleFile,
+		width,
+		imaxabs(height),
+		bitsPerPixel
+	       );
+	return false;
+}
+
+// Whether two models are trained on the same classes in the same order
+bool hasSameClasses(const SvmModel *modelA, const SvmModel *modelB){
+	if(modelA->numClasses != modelB->numClasses)
+		return false;
+	for(uint64_t classNum = 0; classNum < modelA->numClasses; classNum++){
+		if(
+			strcmp(
+				modelA->classNames[classNum],
+				modelB->classNames[classNum]
+			      ) != 0
+		  )
+			return false;
+	}
+	return true;
+}
+
+// Cascade files start with their magic number, the margin above which the
+// gate's classes are reported and the size of the gate's SVM file, followed
+// by the gate's SVM file and then the full model's
+bool parseCascade(
+		const uint8_t *buffer,
+		uintmax_t bufferSize,
+		char *pathToCascadeFile,
+		SvmModel *gate,
+		SvmModel *model,
+		double *gateThreshold
+		){
+	uintmax_t position = 4;
+	uint64_t gateSize;
+	if(
+		!readFromBuffer(
+			buffer,
+			bufferSize,
+			&position,
+			gateThreshold,
+			sizeof(double)
+			) ||
+		!readFromBuffer(
+			buffer,
+			bufferSize,
+			&position,
+			&gateSize,
+			sizeof(uint64_t)
+			) ||
+		gateSize > bufferSize - position
+	  ){
+		fprintf(
+			stderr,
+			"Error reading the gate of %s\n",
+			pathToCascadeFile
+		       );
+		return false;
+	}
+	if(!parseSvmModel(buffer + position, gateSize, pathToCascadeFile, gate))
+		return false;
+	position += gateSize;
+	if(
+		!parseSvmModel(
+			buffer + position,
+			bufferSize - position,
+			pathToCascadeFile,
+			model
+			)
+	  ){
+		freeSvmModel(gate);
+		return false;
+	}
+	if(!hasSameClasses(gate, model)){
+		fprintf(
+			stderr,
+			"The gate and full model of %s aren't trained on the "
+			"same classes\n",
+			pathToCascadeFile
+		       );
+		freeSvmModel(gate);
+		freeSvmModel(model);
+		return false;
+	}
+	return true;
+}
+
+// Score decoded pixel bytes with the gate of a cascade, leaving its votes in
+// vectorsInFavor and dotProducts and setting isDecided if its margin is
+// above the threshold
+//
+// The bytes are resampled to the gate's dimensions by area unless
+// RESAMPLE picks another method, as gates are usually trained on smaller
+// images than the full model.
+bool classifyWithGate(
+		const SvmModel *gate,
+		double gateThreshold,
+		const uint8_t *pixelBytes,
+		uint32_t width,
+		int32_t height,
+		uint16_t bitsPerPixel,
+		char *pathToInputFile,
+		char *pathToSvmFile,
+		uintmax_t *vectorsInFavor,
+		double *dotProducts,
+		bool *isDecided
+		){
+	uintmax_t numBytes =
+		(uintmax_t)width * imaxabs(height) * (bitsPerPixel >> 3);
+	uint8_t *gateBytes = (uint8_t *)malloc(numBytes);
+	if(!gateBytes){
+		fprintf(
+			stderr,
+			"Error allocating memory for the gate of %s\n",
+			pathToSvmFile
+		       );
+		return false;
+	}
+	memcpy(gateBytes, pixelBytes, numBytes);
+	double *features =
+		getFeaturesForModel(
+			gateBytes,
+			width,
+			height,
+			bitsPerPixel,
+			gate,
+			RESAMPLE != RESAMPLE_OFF ? RESAMPLE : RESAMPLE_AREA,
+			pathToInputFile,
 			pathToSvmFile
 			);
-		return NULL;
+	if(!features)
+		return false;
+	uint64_t votedClass =
+		getVotedClass(gate, features, vectorsInFavor, dotProducts);
+	free(features);
+	double margin = getVoteMargin(gate, dotProducts, votedClass);
+	*isDecided = margin > gateThreshold;
+	if(DEBUG_LEVEL < 2){
+		fprintf(
+			stderr,
+			"Info: Gate margin of %lf is %s the threshold of %lf\n",
+			margin,
+			*isDecided ? "above" : "not above",
+			gateThreshold
+		       );
+	}
+	return true;
+}
+
+// Check that an input path exists, is readable and is a regular file
+bool isReadableFile(char *pathToInputFile){
+	if(access(pathToInputFile, F_OK) == 0){
+		if(access(pathToInputFile, R_OK) != 0){
+			fprintf(
+				stderr,
+				"Insufficient permission to read %s\n",
+				pathToInputFile
+			       );
+			return false;
+		}
+	}else{
+		fprintf(
+			stderr,
+			"%s does not exist\n",
+			pathToInputFile
+		       );
+		return false;
 	}
-	if(access(pathToSvmFile, R_OK) != 0){
+	struct stat fileStatus;
+	if(stat(pathToInputFile, &fileStatus) != 0){
 		fprintf(
 			stderr,
-			"Insufficient permission to read %s\n",
-			pathToSvmFile
+			"Error getting status of %s\n",
+			pathToInputFile
+		       );
+		return false;
+	}
+	if(!S_ISREG(fileStatus.st_mode)){
+		fprintf(
+			stderr,
+			"%s is not a regular file\n",
+			pathToInputFile
+		       );
+		return false;
+	}
+	return true;
+}
+
+static inline uint64_t mixHashWord(uint64_t hash, uint64_t word){
+	word *= 0x87C37B91114253D5;
+	word = word << 31 | word >> 33;
+	word *= 0x4CF5AD432745937F;
+	hash ^= word;
+	return (hash << 27 | hash >> 37) * 5 + 0x52DCE729;
+}
+
+// Fast non-cryptographic hash of bytes, mixing in eight at a time
+uint64_t hashBytes(const uint8_t *bytes, uintmax_t numBytes, uint64_t seed){
+	uint64_t hash = seed ^ numBytes * 0x9E3779B97F4A7C15;
+	uintmax_t byteNum = 0;
+	for(; numBytes - byteNum >= 8; byteNum += 8){
+		uint64_t word;
+		memcpy(&word, bytes + byteNum, 8);
+		hash = mixHashWord(hash, word);
+	}
+	if(byteNum < numBytes){
+		uint64_t word = 0;
+		memcpy(&word, bytes + byteNum, numBytes - byteNum);
+		hash = mixHashWord(hash, word);
+	}
+
+	// Spread each bit of the state over the whole hash
+	hash ^= hash >> 33;
+	hash *= 0xFF51AFD7ED558CCD;
+	hash ^= hash >> 33;
+	hash *= 0xC4CEB9FE1A85EC53;
+	hash ^= hash >> 33;
+	return hash;
+}
+
+// Votes of classified files kept under the hash of their decoded pixels and
+// the offset of the file of the bundle that scored them, which identifies
+// the model used, up to a capacity past which the least recently used
+// results are replaced
+#define NO_CACHED_RESULT UINT32_MAX
+typedef struct {
+	uint32_t capacity;
+	uint32_t numResults;
+	uint64_t numClasses;
+	uint64_t *pixelHashes;
+	uint64_t *entryOffsets;
+	uintmax_t *votes;
+	double *dotProducts;
+
+	// Chains of the results in each bucket of a hash table
+	uint32_t bucketMask;
+	uint32_t *buckets;
+	uint32_t *nextInBucket;
+
+	// List of the results from most to least recently used
+	uint32_t *newer;
+	uint32_t *older;
+	uint32_t newest;
+	uint32_t oldest;
+
+	uintmax_t numLookups;
+	uintmax_t numHits;
+	uintmax_t numEvictions;
+} ResultCache;
+
+void freeResultCache(ResultCache *cache){
+	free(cache->pixelHashes);
+	free(cache->entryOffsets);
+	free(cache->votes);
+	free(cache->dotProducts);
+	free(cache->buckets);
+	free(cache->nextInBucket);
+	free(cache->newer);
+	free(cache->older);
+}
+
+bool initResultCache(
+		ResultCache *cache,
+		uint32_t capacity,
+		uint64_t numClasses
+		){
+	uint32_t numBuckets = 1;
+	while(numBuckets < capacity)
+		numBuckets <<= 1;
+	cache->capacity = capacity;
+	cache->numResults = 0;
+	cache->numClasses = numClasses;
+	cache->pixelHashes = (uint64_t *)malloc(capacity * sizeof(uint64_t));
+	cache->entryOffsets = (uint64_t *)malloc(capacity * sizeof(uint64_t));
+	cache->votes =
+		(uintmax_t *)
+		malloc((uintmax_t)capacity * numClasses * sizeof(uintmax_t));
+	cache->dotProducts =
+		(double *)
+		malloc(
+			(uintmax_t)capacity * getNumPairs(numClasses) *
+			sizeof(double)
+		      );
+	cache->bucketMask = numBuckets - 1;
+	cache->buckets = (uint32_t *)malloc(numBuckets * sizeof(uint32_t));
+	cache->nextInBucket = (uint32_t *)malloc(capacity * sizeof(uint32_t));
+	cache->newer = (uint32_t *)malloc(capacity * sizeof(uint32_t));
+	cache->older = (uint32_t *)malloc(capacity * sizeof(uint32_t));
+	cache->newest = NO_CACHED_RESULT;
+	cache->oldest = NO_CACHED_RESULT;
+	cache->numLookups = 0;
+	cache->numHits = 0;
+	cache->numEvictions = 0;
+	if(
+		!cache->pixelHashes ||
+		!cache->entryOffsets ||
+		!cache->votes ||
+		!cache->dotProducts ||
+		!cache->buckets ||
+		!cache->nextInBucket ||
+		!cache->newer ||
+		!cache->older
+	  ){
+		fprintf(
+			stderr,
+			"Error allocating memory for the result cache\n"
+		       );
+		freeResultCache(cache);
+		return false;
+	}
+	memset(cache->buckets, 0xFF, numBuckets * sizeof(uint32_t));
+	return true;
+}
+
+uint32_t *getResultBucket(
+		ResultCache *cache,
+		uint64_t pixelHash,
+		uint64_t entryOffset
+		){
+	return
+		cache->buckets +
+		((pixelHash ^ entryOffset * 0x9E3779B97F4A7C15) &
+		 cache->bucketMask);
+}
+
+void unlinkRecentResult(ResultCache *cache, uint32_t resultNum){
+	uint32_t newer = cache->newer[resultNum];
+	uint32_t older = cache->older[resultNum];
+	if(newer == NO_CACHED_RESULT)
+		cache->newest = older;
+	else
+		cache->older[newer] = older;
+	if(older == NO_CACHED_RESULT)
+		cache->oldest = newer;
+	else
+		cache->newer[older] = newer;
+}
+
+void linkRecentResult(ResultCache *cache, uint32_t resultNum){
+	cache->newer[resultNum] = NO_CACHED_RESULT;
+	cache->older[resultNum] = cache->newest;
+	if(cache->newest == NO_CACHED_RESULT)
+		cache->oldest = resultNum;
+	else
+		cache->newer[cache->newest] = resultNum;
+	cache->newest = resultNum;
+}
+
+// Find the result kept for a file, marking it as the most recently used,
+// or return NO_CACHED_RESULT
+uint32_t findCachedResult(
+		ResultCache *cache,
+		uint64_t pixelHash,
+		uint64_t entryOffset
+		){
+	cache->numLookups++;
+	uint32_t resultNum = *getResultBucket(cache, pixelHash, entryOffset);
+	while(
+		resultNum != NO_CACHED_RESULT &&
+		(
+		 cache->pixelHashes[resultNum] != pixelHash ||
+		 cache->entryOffsets[resultNum] != entryOffset
+		)
+	     )
+		resultNum = cache->nextInBucket[resultNum];
+	if(resultNum == NO_CACHED_RESULT)
+		return NO_CACHED_RESULT;
+	cache->numHits++;
+	unlinkRecentResult(cache, resultNum);
+	linkRecentResult(cache, resultNum);
+	return resultNum;
+}
+
+// Keep the result of a file, replacing the least recently used if full
+void storeCachedResult(
+		ResultCache *cache,
+		uint64_t pixelHash,
+		uint64_t entryOffset,
+		const uintmax_t *vectorsInFavor,
+		const double *dotProducts
+		){
+	uint32_t resultNum;
+	if(cache->numResults < cache->capacity){
+		resultNum = cache->numResults;
+		cache->numResults++;
+	}else{
+		resultNum = cache->oldest;
+		unlinkRecentResult(cache, resultNum);
+		uint32_t *link =
+			getResultBucket(
+				cache,
+				cache->pixelHashes[resultNum],
+				cache->entryOffsets[resultNum]
+				);
+		while(*link != resultNum)
+			link = cache->nextInBucket + *link;
+		*link = cache->nextInBucket[resultNum];
+		cache->numEvictions++;
+	}
+	uint64_t numClasses = cache->numClasses;
+	uintmax_t numPairs = getNumPairs(numClasses);
+	cache->pixelHashes[resultNum] = pixelHash;
+	cache->entryOffsets[resultNum] = entryOffset;
+	memcpy(
+		cache->votes + resultNum * numClasses,
+		vectorsInFavor,
+		numClasses * sizeof(uintmax_t)
+	      );
+	memcpy(
+		cache->dotProducts + resultNum * numPairs,
+		dotProducts,
+		numPairs * sizeof(double)
+	      );
+	uint32_t *bucket = getResultBucket(cache, pixelHash, entryOffset);
+	cache->nextInBucket[resultNum] = *bucket;
+	*bucket = resultNum;
+	linkRecentResult(cache, resultNum);
+}
+
+// An SVM or cascade file held in a bundle at offset, or making up the whole
+// file if offset is 0, parsed when the first file is classified with it
+typedef struct {
+	uint64_t offset;
+	bool isCascade;
+	SvmModel gate;
+	SvmModel model;
+	double gateThreshold;
+} ParsedEntry;
+
+// State of the classify command kept across its input files
+typedef struct {
+	char *pathToSvmFile;
+	const uint8_t *svmFileBytes;
+	uintmax_t svmFileSize;
+	bool isBundle;
+	ParsedEntry *entries;
+	uint32_t numParsed;
+	uintmax_t *vectorsInFavor;
+	double *dotProducts;
+	bool isCached;
+	bool hasCache;
+	ResultCache cache;
+} ClassifyBatch;
+
+// Find the parsed entry of an SVM, cascade or bundle file to classify an
+// image of the given dimensions with, parsing it if no file has used it yet
+ParsedEntry *getParsedEntry(
+		ClassifyBatch *batch,
+		uint32_t width,
+		int32_t height,
+		uint16_t bitsPerPixel
+		){
+	// Of a bundle, only the file picked for the input file is parsed
+	const uint8_t *entryBytes = batch->svmFileBytes;
+	uintmax_t entrySize = batch->svmFileSize;
+	uint64_t offset = 0;
+	if(batch->isBundle){
+		BundleEntry entry;
+		if(
+			!selectBundleEntry(
+				batch->svmFileBytes,
+				batch->svmFileSize,
+				batch->pathToSvmFile,
+				width,
+				height,
+				bitsPerPixel,
+				&entry
+				)
+		  )
+			return NULL;
+		entryBytes = batch->svmFileBytes + entry.offset;
+		entrySize = entry.size;
+		offset = entry.offset;
+	}
+	for(uint32_t entryNum = 0; entryNum < batch->numParsed; entryNum++){
+		if(batch->entries[entryNum].offset == offset)
+			return batch->entries + entryNum;
+	}
+	ParsedEntry *parsed = batch->entries + batch->numParsed;
+	parsed->offset = offset;
+	parsed->isCascade =
+		entrySize >= 4 && memcmp(entryBytes, "NSVC", 4) == 0;
+	bool isParsed =
+		parsed->isCascade ?
+		parseCascade(
+			entryBytes,
+			entrySize,
+			batch->pathToSvmFile,
+			&parsed->gate,
+			&parsed->model,
+			&parsed->gateThreshold
+			) :
+		parseSvmModel(
+			entryBytes,
+			entrySize,
+			batch->pathToSvmFile,
+			&parsed->model
 			);
+	if(!isParsed){
+		fprintf(
+			stderr,
+			"Error loading %s\n",
+			batch->pathToSvmFile
+		       );
 		return NULL;
 	}
-	FILE *svmFile = fopen(pathToSvmFile, "rb");
-	if(!svmFile){
+	if(
+		batch->isBundle &&
+		!hasBundleClasses(batch->svmFileBytes, &parsed->model)
+	  ){
 		fprintf(
 			stderr,
-			"Error opening %s\n",
-			pathToSvmFile
+			"The file of %s at offset %ju doesn't have the classes "
+			"of its class table\n",
+			batch->pathToSvmFile,
+			(uintmax_t)offset
 		       );
+		if(parsed->isCascade)
+			freeSvmModel(&parsed->gate);
+		freeSvmModel(&parsed->model);
 		return NULL;
 	}
+	batch->numParsed++;
+
+	// Every file of a bundle has the classes of its class table, so the
+	// buffers for votes fit them all
+	if(!batch->vectorsInFavor){
+		uint64_t numClasses = parsed->model.numClasses;
+		batch->vectorsInFavor =
+			(uintmax_t *)malloc(numClasses * sizeof(uintmax_t));
+		batch->dotProducts =
+			(double *)
+			malloc(getNumPairs(numClasses) * sizeof(double));
+		if(!batch->vectorsInFavor || !batch->dotProducts){
+			fprintf(
+				stderr,
+				"Error allocating memory required for voting "
+				"mechanism\n"
+			       );
+			return NULL;
+		}
+		if(batch->isCached){
+			batch->hasCache =
+				initResultCache(
+					&batch->cache,
+					batch->cache.capacity,
+					numClasses
+					);
+			if(!batch->hasCache)
+				return NULL;
+		}
+	}
+	return parsed;
+}
+
+// Score decoded pixel bytes with a parsed SVM or cascade file, leaving the
+// votes to report in the batch's buffers and freeing the bytes
+bool scorePixelBytes(
+		ClassifyBatch *batch,
+		const ParsedEntry *parsed,
+		uint8_t *pixelBytes,
+		uint32_t width,
+		int32_t height,
+		uint16_t bitsPerPixel,
+		char *pathToInputFile
+		){
+	// The full model of a cascade only scores files the gate isn't sure of
+	if(parsed->isCascade){
+		bool isDecided;
+		bool isGated =
+			classifyWithGate(
+				&parsed->gate,
+				parsed->gateThreshold,
+				pixelBytes,
+				width,
+				height,
+				bitsPerPixel,
+				pathToInputFile,
+				batch->pathToSvmFile,
+				batch->vectorsInFavor,
+				batch->dotProducts,
+				&isDecided
+				);
+		if(!isGated || isDecided){
+			free(pixelBytes);
+			return isGated;
+		}
+	}
+
+	// Verify that the input file matches the dimensions the model was
+	// trained on, unless it's resampled to them
+	double *features =
+		getFeaturesForModel(
+			pixelBytes,
+			width,
+			height,
+			bitsPerPixel,
+			&parsed->model,
+			RESAMPLE,
+			pathToInputFile,
+			batch->pathToSvmFile
+			);
+	if(!features)
+		return false;
+
+	// Use support vectors to determine class
+	getVotedClass(
+		&parsed->model,
+		features,
+		batch->vectorsInFavor,
+		batch->dotProducts
+		);
+	free(features);
+	return true;
+}
+
+// Classify one input file of the classify command
+bool classifyBatchFile(ClassifyBatch *batch, char *pathToInputFile){
+	if(!isReadableFile(pathToInputFile))
+		return false;
+	uint32_t width;
+	int32_t height;
+	uint16_t bitsPerPixel;
+	uint8_t *pixelBytes =
+		decodeBmp(
+			pathToInputFile,
+			&width,
+			&height,
+			&bitsPerPixel
+			);
+	if(!pixelBytes){
+		fprintf(
+			stderr,
+			"Error decoding %s\n",
+			pathToInputFile
+		       );
+		return false;
+	}
+	ParsedEntry *parsed =
+		getParsedEntry(batch, width, height, bitsPerPixel);
+	if(!parsed){
+		free(pixelBytes);
+		return false;
+	}
+
+	// Files decoding to the same pixels as an earlier file are reported
+	// without being scored
+	if(!batch->isCached){
+		return
+			scorePixelBytes(
+				batch,
+				parsed,
+				pixelBytes,
+				width,
+				height,
+				bitsPerPixel,
+				pathToInputFile
+				) &&
+			reportVotes(
+				&parsed->model,
+				batch->vectorsInFavor,
+				batch->dotProducts,
+				pathToInputFile
+				);
+	}
+	uint64_t pixelHash =
+		hashBytes(
+			pixelBytes,
+			(uintmax_t)width * imaxabs(height) *
+			(bitsPerPixel >> 3),
+			(uint64_t)width << 32 ^
+			(uint64_t)imaxabs(height) << 16 ^
+			bitsPerPixel
+			);
+	uint32_t resultNum =
+		findCachedResult(&batch->cache, pixelHash, parsed->offset);
+	if(resultNum != NO_CACHED_RESULT){
+		free(pixelBytes);
+		uint64_t numClasses = batch->cache.numClasses;
+		return
+			reportVotes(
+				&parsed->model,
+				batch->cache.votes + resultNum * numClasses,
+				batch->cache.dotProducts +
+				resultNum * getNumPairs(numClasses),
+				pathToInputFile
+				);
+	}
 	if(
-		fseek(
-			svmFile,
-			4 * sizeof(char) + 
-			sizeof(uint8_t) +
-			sizeof(uint32_t) + 
-			sizeof(int32_t) + 
-			sizeof(uint16_t),
-			SEEK_SET
-		     ) != 0
-	  ){
+		!scorePixelBytes(
+			batch,
+			parsed,
+			pixelBytes,
+			width,
+			height,
+			bitsPerPixel,
+			pathToInputFile
+			)
+	  )
+		return false;
+	storeCachedResult(
+		&batch->cache,
+		pixelHash,
+		parsed->offset,
+		batch->vectorsInFavor,
+		batch->dotProducts
+		);
+	return
+		reportVotes(
+			&parsed->model,
+			batch->vectorsInFavor,
+			batch->dotProducts,
+			pathToInputFile
+			);
+}
+
+// Classify files using a premade SVM, cascade or bundle file, which is
+// mapped once and of which each SVM or cascade file is parsed once
+//
+// When several files are classified, the result of each is kept in a cache
+// of RESULT_CACHE_SIZE results under a hash of its decoded pixels.
+bool classifyFilesFromSvm(
+		char *pathToSvmFile,
+		uint32_t numInputs,
+		char **pathsToInputFiles
+		){
+	ClassifyBatch batch;
+	batch.pathToSvmFile = pathToSvmFile;
+	batch.svmFileBytes = mapFile(pathToSvmFile, &batch.svmFileSize);
+	if(!batch.svmFileBytes){
 		fprintf(
 			stderr,
-			"Error seeking class count field in %s\n",
+			"Error loading %s\n",
 			pathToSvmFile
 		       );
-		fclose(svmFile);
-		return NULL;
+		return false;
 	}
+	batch.isBundle =
+		batch.svmFileSize >= 4 &&
+		memcmp(batch.svmFileBytes, "NSVB", 4) == 0;
+	uint32_t numEntries = 1;
+	uintmax_t position;
 	if(
-		!fread(
-			classCount,
-			sizeof(uint64_t),
-			1,
-			svmFile
-		      )
+		batch.isBundle &&
+		!readBundleHeader(
+			batch.svmFileBytes,
+			batch.svmFileSize,
+			pathToSvmFile,
+			&position,
+			&numEntries
+			)
 	  ){
+		unmapFile(batch.svmFileBytes, batch.svmFileSize);
+		return false;
+	}
+	batch.entries =
+		(ParsedEntry *)malloc(numEntries * sizeof(ParsedEntry));
+	batch.numParsed = 0;
+	batch.vectorsInFavor = NULL;
+	batch.dotProducts = NULL;
+	batch.isCached = numInputs > 1 && RESULT_CACHE_SIZE > 0;
+	batch.hasCache = false;
+	batch.cache.capacity =
+		numInputs < RESULT_CACHE_SIZE ? numInputs : RESULT_CACHE_SIZE;
+	if(!batch.entries){
 		fprintf(
 			stderr,
-			"Error reading class count from %s\n",
+			"Error allocating memory for the files of %s\n",
 			pathToSvmFile
 		       );
-		fclose(svmFile);
-		return NULL;
+		unmapFile(batch.svmFileBytes, batch.svmFileSize);
+		return false;
 	}
-	char **classNames =
-		(char **)
-		malloc(
-			sizeof(char *) *
-			*classCount
-		      );
-	if(!classNames){
+	bool isClassified = true;
+	for(
+		uint32_t inputNum = 0;
+		inputNum < numInputs && isClassified;
+		inputNum++
+	   ){
+		isClassified =
+			classifyBatchFile(&batch, pathsToInputFiles[inputNum]);
+	}
+	if(batch.hasCache && DEBUG_LEVEL < 2){
 		fprintf(
 			stderr,
-			"Error allocating memory for class name pointers\n"
+			"Info: %ju of %ju files were reported from the "
+			"result cache, which replaced %ju results\n",
+			batch.cache.numHits,
+			batch.cache.numLookups,
+			batch.cache.numEvictions
 		       );
-		fclose(svmFile);
-		return NULL;
 	}
+	for(uint32_t entryNum = 0; entryNum < batch.numParsed; entryNum++){
+		if(batch.entries[entryNum].isCascade)
+			freeSvmModel(&batch.entries[entryNum].gate);
+		freeSvmModel(&batch.entries[entryNum].model);
+	}
+	if(batch.hasCache)
+		freeResultCache(&batch.cache);
+	free(batch.entries);
+	free(batch.vectorsInFavor);
+	free(batch.dotProducts);
+	unmapFile(batch.svmFileBytes, batch.svmFileSize);
+	return isClassified;
+}
 
-	for(uint64_t classNum = 0; classNum < *classCount; classNum++){
-		uint8_t nameRunLength;
-		if(
-			!fread(
-				&nameRunLength,
-				sizeof(uint8_t),
-				1,
-				svmFile
-			      )
-		  ){
+#define ENSEMBLE_VOTES 0
+#define ENSEMBLE_MARGINS 1
+
+// Whether two models derive the same features from the same decoded bytes,
+// so that an ensemble only needs to compute them once
+bool haveSameFeatureStages(const SvmModel *modelA, const SvmModel *modelB){
+	if(
+		modelA->width != modelB->width ||
+		imaxabs(modelA->height) != imaxabs(modelB->height) ||
+		modelA->bitsPerPixel != modelB->bitsPerPixel ||
+		modelA->channelMode != modelB->channelMode ||
+		modelA->channelMask != modelB->channelMask ||
+		!modelA->pixelMask != !modelB->pixelMask ||
+		modelA->numComponents != modelB->numComponents
+	  )
+		return false;
+	if(
+		modelA->pixelMask &&
+		memcmp(
+			modelA->pixelMask,
+			modelB->pixelMask,
+			(getNumImagePixels(modelA) + 7) / 8
+		      ) != 0
+	  )
+		return false;
+	return
+		!modelA->numComponents ||
+		memcmp(
+			modelA->components,
+			modelB->components,
+			modelA->numComponents * getNumPixelBytes(modelA) *
+			sizeof(double)
+		      ) == 0;
+}
+
+// Add the mean dot product of each class's pairs, signed towards the class,
+// to classMargins
+void addClassMargins(
+		const SvmModel *model,
+		const double *dotProducts,
+		double *classMargins
+		){
+	uint64_t numClasses = model->numClasses;
+	uintmax_t pairNum = 0;
+	for(uint64_t posClass = 0; posClass < numClasses - 1; posClass++){
+		for(
+			uint64_t negClass = posClass + 1;
+			negClass < numClasses;
+			negClass++
+		   ){
+			double share = dotProducts[pairNum] / (numClasses - 1);
+			classMargins[posClass] += share;
+			classMargins[negClass] -= share;
+			pairNum++;
+		}
+	}
+}
+
+// Classify a file with several SVM files trained on the same classes,
+// combining their results as picked by ENSEMBLE_COMBINATION
+//
+// The file is decoded once, and SVM files with the same dimensions and
+// feature stages share one set of features, scored by each of them in turn
+// while it's still in cache.
+bool classifyFileWithEnsemble(
+		char *pathToInputFile,
+		uint32_t numModels,
+		char **pathsToSvmFiles
+		){
+	SvmModel *models = (SvmModel *)calloc(numModels, sizeof(SvmModel));
+	double **features = (double **)calloc(numModels, sizeof(double *));
+	bool *isFeatureOwner = (bool *)calloc(numModels, sizeof(bool));
+	if(!models || !features || !isFeatureOwner){
+		fprintf(
+			stderr,
+			"Error allocating memory for the ensemble\n"
+		       );
+		free(models);
+		free(features);
+		free(isFeatureOwner);
+		return false;
+	}
+
+	// Load each SVM file, all of which must share the first one's classes
+	uint32_t numLoaded = 0;
+	bool isValid = true;
+	while(numLoaded < numModels && isValid){
+		char *pathToSvmFile = pathsToSvmFiles[numLoaded];
+		if(!loadSvmModel(pathToSvmFile, models + numLoaded)){
 			fprintf(
 				stderr,
-				"Error reading run length of class %d of %d "
-				"from %s\n",
-				classNum + 1,
-				classCount,
+				"Error loading %s\n",
 				pathToSvmFile
 			       );
-			fclose(svmFile);
-			for(
-				uint64_t prevClassNum = 0;
-				prevClassNum < classNum;
-				prevClassNum++
-			   )
-				free(classNames[prevClassNum]);
-			free(classNames);
-			return NULL;
+			isValid = false;
+			break;
 		}
-		classNames[classNum] = 
-			(char *)
-			malloc(
-				sizeof(char) *
-				nameRunLength +
-				1
-			      );
-		if(!classNames[classNum]){
-			fprintf(
-				stderr,
-				"Error allocating memory for class name\n"
-			       );
-			fclose(svmFile);
-			for(
-				uint64_t prevClassNum = 0;
-				prevClassNum < classNum;
-				prevClassNum++
-			   )
-				free(classNames[prevClassNum]);
-			free(classNames);
-			return NULL;
+		const SvmModel *model = models + numLoaded;
+		numLoaded++;
+		isValid = model->numClasses == models[0].numClasses;
+		for(
+			uint64_t classNum = 0;
+			classNum < model->numClasses && isValid;
+			classNum++
+		   ){
+			isValid =
+				strcmp(
+					model->classNames[classNum],
+					models[0].classNames[classNum]
+				      ) == 0;
 		}
-		if(
-			fread(
-				classNames[classNum],
-				sizeof(char),
-				nameRunLength,
-				svmFile
-			     ) != nameRunLength
-		  ){
+		if(!isValid){
 			fprintf(
 				stderr,
-				"Error reading class name from %s\n",
-				pathToSvmFile
+				"%s must be trained on the same classes as "
+				"%s\n",
+				pathToSvmFile,
+				pathsToSvmFiles[0]
 			       );
-			fclose(svmFile);
-			for(
-				uint64_t prevClassNum = 0;
-				prevClassNum < classNum;
-				prevClassNum++
-			   )
-				free(classNames[prevClassNum]);
-			free(classNames);
-			return NULL;
 		}
-		classNames[classNum][nameRunLength] = '\0';
 	}
-	return classNames;
-}
-
-uintmax_t getNumSamples(char *pathToClassDir){
-	DIR *classDir = opendir(pathToClassDir);
-	if(!classDir){
+	uint64_t numClasses = isValid ? models[0].numClasses : 0;
+	uint32_t width;
+	int32_t height;
+	uint16_t bitsPerPixel;
+	uint8_t *pixelBytes =
+		isValid ?
+		decodeBmp(pathToInputFile, &width, &height, &bitsPerPixel) :
+		NULL;
+	if(isValid && !pixelBytes){
 		fprintf(
 			stderr,
-			"Error opening %s\n",
-			pathToClassDir
+			"Error decoding %s\n",
+			pathToInputFile
+		       );
+		isValid = false;
+	}
+	uintmax_t *vectorsInFavor =
+		(uintmax_t *)malloc(numClasses * sizeof(uintmax_t));
+	double *dotProducts =
+		(double *)malloc(getNumPairs(numClasses) * sizeof(double));
+	double *combinedResults = (double *)calloc(numClasses, sizeof(double));
+	if(isValid && (!vectorsInFavor || !dotProducts || !combinedResults)){
+		fprintf(
+			stderr,
+			"Error allocating memory required for voting "
+			"mechanism\n"
 		       );
-		return 0;
+		isValid = false;
 	}
-	struct dirent *sample;
-	struct stat sampleStatus;
 
-	// Count number of non-hidden regular files that have the BMP magic 
-	// number
-	uintmax_t numSamples = 0;
-	while(sample = readdir(classDir)){
-		if(sample->d_name[0] == '.')
-			continue;
-		char *pathToSample = 
-			(char *)
-			malloc(
-				strlen(pathToClassDir) +
-				strlen(sample->d_name) +
-				2
-			      );
-		if(!pathToSample){
+	// Features are derived by the first SVM file with their stages
+	uintmax_t numBytes =
+		isValid ?
+		(uintmax_t)width * imaxabs(height) * (bitsPerPixel >> 3) :
+		0;
+	uint32_t numFeatureSets = 0;
+	for(uint32_t modelNum = 0; modelNum < numModels && isValid; modelNum++){
+		for(uint32_t ownerNum = 0; ownerNum < modelNum; ownerNum++){
+			if(
+				isFeatureOwner[ownerNum] &&
+				haveSameFeatureStages(
+					models + ownerNum,
+					models + modelNum
+					)
+			  ){
+				features[modelNum] = features[ownerNum];
+				break;
+			}
+		}
+		if(!features[modelNum]){
+			uint8_t *modelBytes = (uint8_t *)malloc(numBytes);
+			if(!modelBytes){
+				fprintf(
+					stderr,
+					"Error allocating memory for the "
+					"features of %s\n",
+					pathToInputFile
+				       );
+				isValid = false;
+				break;
+			}
+			memcpy(modelBytes, pixelBytes, numBytes);
+			features[modelNum] =
+				getFeaturesForModel(
+					modelBytes,
+					width,
+					height,
+					bitsPerPixel,
+					models + modelNum,
+					RESAMPLE,
+					pathToInputFile,
+					pathsToSvmFiles[modelNum]
+					);
+			if(!features[modelNum]){
+				isValid = false;
+				break;
+			}
+			isFeatureOwner[modelNum] = true;
+			numFeatureSets++;
+		}
+
+		// Combine the result of each SVM file
+		uint64_t votedClass =
+			getVotedClass(
+				models + modelNum,
+				features[modelNum],
+				vectorsInFavor,
+				dotProducts
+				);
+		if(ENSEMBLE_COMBINATION == ENSEMBLE_MARGINS)
+			addClassMargins(
+				models + modelNum,
+				dotProducts,
+				combinedResults
+				);
+		else if(votedClass < numClasses)
+			combinedResults[votedClass]++;
+		if(DEBUG_LEVEL < 2){
 			fprintf(
 				stderr,
-				"Error allocating memory for path to sample "
-				"in %s\n",
-				pathToClassDir
+				"Info: %s votes for %s\n",
+				pathsToSvmFiles[modelNum],
+				votedClass < numClasses ?
+				models[0].classNames[votedClass] :
+				"a tie"
 			       );
-			closedir(classDir);
-			return 0;
 		}
-		strcpy(pathToSample, pathToClassDir);
-		strcat(pathToSample, "/");
-		strcat(pathToSample, sample->d_name);
-		if(stat(pathToSample, &sampleStatus) != 0){
+	}
+	if(isValid && DEBUG_LEVEL < 2){
+		fprintf(
+			stderr,
+			"Info: Decoded %s once for %" PRIu32 " SVM files "
+			"sharing %" PRIu32 " sets of features\n",
+			pathToInputFile,
+			numModels,
+			numFeatureSets
+		       );
+	}
+
+	// Find out and display results
+	if(isValid){
+		double bestResult = -INFINITY;
+		uint64_t numClassesFavorite = 0;
+		for(uint64_t classNum = 0; classNum < numClasses; classNum++){
+			if(combinedResults[classNum] > bestResult){
+				bestResult = combinedResults[classNum];
+				numClassesFavorite = 1;
+			}else if(combinedResults[classNum] == bestResult)
+				numClassesFavorite++;
+		}
+		if(ENSEMBLE_COMBINATION == ENSEMBLE_MARGINS){
 			fprintf(
-				stderr,
-				"Error getting status of %s\n",
-				pathToSample
+				stdout,
+				"Summed margins of %" PRIu32 " SVM files of "
+				"%lf point to %s belonging to one of the "
+				"following classes:\n",
+				numModels,
+				bestResult,
+				pathToInputFile
+			       );
+		}else{
+			fprintf(
+				stdout,
+				"%lf%% (%.0lf of %" PRIu32 ") of SVM files "
+				"point to %s belonging to one of the "
+				"following classes:\n",
+				numClassesFavorite * bestResult / numModels *
+				100,
+				numClassesFavorite * bestResult,
+				numModels,
+				pathToInputFile
 			       );
-			closedir(classDir);
-			free(pathToSample);
-			return 0;
 		}
-		if(
-			!S_ISREG(sampleStatus.st_mode) ||
-			!hasBmpMagicNumber(pathToSample)
-		  ){
-			free(pathToSample);
-			continue;
+		for(uint64_t classNum = 0; classNum < numClasses; classNum++){
+			if(combinedResults[classNum] == bestResult){
+				fprintf(
+					stdout,
+					"\t%s\n",
+					models[0].classNames[classNum]
+				       );
+			}
 		}
-		free(pathToSample);
-		numSamples++;
+	}
+	for(uint32_t modelNum = 0; modelNum < numModels; modelNum++){
+		if(isFeatureOwner[modelNum])
+			free(features[modelNum]);
+	}
+	for(uint32_t modelNum = 0; modelNum < numLoaded; modelNum++)
+		freeSvmModel(models + modelNum);
+	free(pixelBytes);
+	free(vectorsInFavor);
+	free(dotProducts);
+	free(combinedResults);
+	free(models);
+	free(features);
+	free(isFeatureOwner);
+	return isValid;
+}
 
+// Seconds on a monotonic clock, for measuring throughput
+double getMonotonicSeconds(){
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// Write a string as a JSON string
+void writeJsonString(FILE *file, const char *string){
+	fputc('"', file);
+	for(const unsigned char *c = (const unsigned char *)string; *c; c++){
+		if(*c == '"' || *c == '\\')
+			fprintf(file, "\\%c", *c);
+		else if(*c < 0x20)
+			fprintf(file, "\\u%04x", *c);
+		else
+			fputc(*c, file);
 	}
-	return numSamples;
+	fputc('"', file);
 }
 
-char *getPathToRandomSample(char *pathToClassDir, uintmax_t numSamples){
-	DIR *classDir = opendir(pathToClassDir);
-	if(!classDir){
+// Samples scored by each job of the evaluate command
+#define EVALUATE_JOB_SAMPLES 256
+
+// Scratch space of a thread of the evaluate command, and the files it has
+// scored of each class, by voted class, with ties in the last column
+typedef struct {
+	double *features;
+	uintmax_t *vectorsInFavor;
+	uintmax_t *confusion;
+} EvaluateThread;
+
+typedef struct {
+	const SvmModel *model;
+	const SampleCache *cache;
+	EvaluateThread *threads;
+} Evaluation;
+
+bool evaluateSamples(void *context, uintmax_t jobNum, uint32_t threadNum){
+	Evaluation *evaluation = (Evaluation *)context;
+	const SvmModel *model = evaluation->model;
+	const SampleCache *cache = evaluation->cache;
+	EvaluateThread *thread = evaluation->threads + threadNum;
+	uintmax_t firstSample = jobNum * EVALUATE_JOB_SAMPLES;
+	uintmax_t endSample =
+		cache->numSamples - firstSample > EVALUATE_JOB_SAMPLES ?
+		firstSample + EVALUATE_JOB_SAMPLES :
+		cache->numSamples;
+	uint64_t classNum = 0;
+	for(
+		uintmax_t sampleNum = firstSample;
+		sampleNum < endSample;
+		sampleNum++
+	   ){
+		while(cache->classOffsets[classNum + 1] <= sampleNum)
+			classNum++;
+		getSampleFeatures(
+			model,
+			getCachedSample(cache, sampleNum),
+			cache->normDivisors[sampleNum],
+			thread->features
+			);
+		uint64_t votedClass =
+			getVotedClass(
+				model,
+				thread->features,
+				thread->vectorsInFavor,
+				NULL
+				);
+		uintmax_t *row =
+			thread->confusion + classNum * (model->numClasses + 1);
+		row[votedClass]++;
+	}
+	return true;
+}
+
+void freeEvaluateThreads(EvaluateThread *threads, uint32_t numThreads){
+	for(uint32_t threadNum = 0; threadNum < numThreads; threadNum++){
+		free(threads[threadNum].features);
+		free(threads[threadNum].vectorsInFavor);
+		free(threads[threadNum].confusion);
+	}
+	free(threads);
+}
+
+// Write the results of the evaluate command as JSON
+bool writeEvaluation(
+		const SvmModel *model,
+		const uintmax_t *confusion,
+		uintmax_t numSamples,
+		uint32_t numThreads,
+		double seconds,
+		char *pathToOutputFile
+		){
+	FILE *outputFile = fopen(pathToOutputFile, "w");
+	if(!outputFile){
 		fprintf(
 			stderr,
-			"Error opening %s\n",
-			pathToClassDir
+			"Error opening %s for writing\n",
+			pathToOutputFile
 		       );
-		return NULL;
+		return false;
 	}
-	uintmax_t sampleNum;
-	FILE *randPipe = fopen("/dev/urandom", "rb");
-	if(!randPipe){
+	uint64_t numClasses = model->numClasses;
+	uintmax_t numCorrect = 0;
+	uintmax_t numTies = 0;
+	for(uint64_t classNum = 0; classNum < numClasses; classNum++){
+		numCorrect += confusion[classNum * (numClasses + 1) + classNum];
+		numTies += confusion[classNum * (numClasses + 1) + numClasses];
+	}
+	fprintf(
+		outputFile,
+		"{\n"
+		"\t\"numFiles\": %ju,\n"
+		"\t\"numCorrect\": %ju,\n"
+		"\t\"accuracy\": %.17g,\n"
+		"\t\"numTies\": %ju,\n"
+		"\t\"tieRate\": %.17g,\n"
+		"\t\"numThreads\": %" PRIu32 ",\n"
+		"\t\"seconds\": %.17g,\n"
+		"\t\"filesPerSecond\": %.17g,\n"
+		"\t\"classes\": [\n",
+		numSamples,
+		numCorrect,
+		(double)numCorrect / numSamples,
+		numTies,
+		(double)numTies / numSamples,
+		numThreads,
+		seconds,
+		seconds > 0.0 ? numSamples / seconds : 0.0
+	       );
+	for(uint64_t classNum = 0; classNum < numClasses; classNum++){
+		const uintmax_t *row = confusion + classNum * (numClasses + 1);
+		uintmax_t numFiles = 0;
+		for(uint64_t votedNum = 0; votedNum <= numClasses; votedNum++)
+			numFiles += row[votedNum];
+		fprintf(outputFile, "\t\t{\"name\": ");
+		writeJsonString(outputFile, model->classNames[classNum]);
 		fprintf(
-			stderr,
-			"Error opening /dev/urandom\n"
+			outputFile,
+			", \"numFiles\": %ju, \"numCorrect\": %ju, "
+			"\"accuracy\": %.17g, \"votes\": [",
+			numFiles,
+			row[classNum],
+			(double)row[classNum] / numFiles
 		       );
-		closedir(classDir);
-		return NULL;
-	}
-	if(
-		!fread(
-			&sampleNum,
-			sizeof(uintmax_t),
-			1,
-			randPipe
-		      )
-	  ){
+		for(uint64_t votedNum = 0; votedNum < numClasses; votedNum++){
+			fprintf(
+				outputFile,
+				"%s%ju",
+				votedNum ? ", " : "",
+				row[votedNum]
+			       );
+		}
 		fprintf(
-			stderr,
-			"Error reading a uintmax_t from /dev/urandom\n"
+			outputFile,
+			"], \"numTies\": %ju}%s\n",
+			row[numClasses],
+			classNum + 1 < numClasses ? "," : ""
 		       );
-		fclose(randPipe);
-		closedir(classDir);
-		return NULL;
 	}
-	if(fclose(randPipe) != 0){
+	fprintf(outputFile, "\t]\n}\n");
+	if(fclose(outputFile) != 0){
 		fprintf(
 			stderr,
-			"Error closing /dev/urandom\n"
+			"Error writing %s\n",
+			pathToOutputFile
 		       );
-		closedir(classDir);
-		return NULL;
+		return false;
 	}
-	sampleNum %= numSamples;
-	// Ensure at least one sample is read
-	// Should be fine since empty directories are not considered
-	sampleNum++;
-	struct dirent *sample;
-	struct stat sampleStatus;
-	while(sampleNum > 0){
-		sample = readdir(classDir);
-		if(!sample){
+	return true;
+}
+
+// Classify every file of a directory laid out like the training directory
+// with a premade SVM file, reporting the accuracy over all files and of
+// each class, the confusion matrix, the rate of ties and the throughput,
+// and writing them as JSON if an output path is given
+//
+// Files are decoded once into a sample cache, and blocks of them are scored
+// in parallel, each thread counting its own results.
+bool evaluateSvmModel(
+		char *pathToSvmFile,
+		char *pathToValidationDir,
+		char *pathToOutputFile
+		){
+	if(pathToOutputFile && access(pathToOutputFile, F_OK) == 0){
+		if(access(pathToOutputFile, W_OK) != 0){
 			fprintf(
 				stderr,
-				"Error reading entry from %s\n",
-				pathToClassDir
+				"Insufficient permission to overwrite %s\n",
+				pathToOutputFile
 			       );
-			closedir(classDir);
-			return NULL;
+			return false;
 		}
-		if(sample->d_name[0] == '.')
-			continue;
-		char *pathToSample = 
-			(char *)
-			malloc(
-				strlen(pathToClassDir) +
-				strlen(sample->d_name) +
-				2
+	}
+	SvmModel model;
+	if(!loadSvmModel(pathToSvmFile, &model)){
+		fprintf(
+			stderr,
+			"Error loading %s\n",
+			pathToSvmFile
+		       );
+		return false;
+	}
+	double decodeStart = getMonotonicSeconds();
+	SampleCache cache;
+	if(!loadSampleCache(pathToValidationDir, &model, &cache)){
+		fprintf(
+			stderr,
+			"Error loading samples from %s\n",
+			pathToValidationDir
+		       );
+		freeSvmModel(&model);
+		return false;
+	}
+	double decodeSeconds = getMonotonicSeconds() - decodeStart;
+	uint64_t numClasses = model.numClasses;
+	uintmax_t numJobs =
+		(cache.numSamples + EVALUATE_JOB_SAMPLES - 1) /
+		EVALUATE_JOB_SAMPLES;
+	uint32_t numThreads = getNumThreads();
+	if(numThreads > numJobs)
+		numThreads = numJobs;
+	EvaluateThread *threads =
+		(EvaluateThread *)calloc(numThreads, sizeof(EvaluateThread));
+	bool isAllocated = threads;
+	for(
+		uint32_t threadNum = 0;
+		threadNum < numThreads && isAllocated;
+		threadNum++
+	   ){
+		EvaluateThread *thread = threads + threadNum;
+		thread->features =
+			(double *)malloc(model.numDims * sizeof(double));
+		thread->vectorsInFavor =
+			(uintmax_t *)malloc(numClasses * sizeof(uintmax_t));
+		thread->confusion =
+			(uintmax_t *)
+			calloc(
+				numClasses * (numClasses + 1),
+				sizeof(uintmax_t)
 			      );
-		if(!pathToSample){
-			fprintf(
-				stderr,
-				"Error allocating space for path to sample\n"
-			       );
-			closedir(classDir);
-			return NULL;
-		}
-		strcpy(pathToSample, pathToClassDir);
-		strcat(pathToSample, "/");
-		strcat(pathToSample, sample->d_name);
+		isAllocated =
+			thread->features &&
+			thread->vectorsInFavor &&
+			thread->confusion;
+	}
+	if(!isAllocated){
+		fprintf(
+			stderr,
+			"Error allocating memory required for voting "
+			"mechanism\n"
+		       );
+		if(threads)
+			freeEvaluateThreads(threads, numThreads);
+		freeSampleCache(&cache);
+		freeSvmModel(&model);
+		return false;
+	}
+	Evaluation evaluation;
+	evaluation.model = &model;
+	evaluation.cache = &cache;
+	evaluation.threads = threads;
+	double scoreStart = getMonotonicSeconds();
+	bool isScored =
+		runJobsInParallel(
+			numJobs,
+			numThreads,
+			evaluateSamples,
+			&evaluation
+			);
+	double scoreSeconds = getMonotonicSeconds() - scoreStart;
+	if(!isScored){
+		freeEvaluateThreads(threads, numThreads);
+		freeSampleCache(&cache);
+		freeSvmModel(&model);
+		return false;
+	}
 
-		if(stat(pathToSample, &sampleStatus) != 0){
-			fprintf(
-				stderr,
-				"Error getting status of %s\n",
-				pathToSample
-			       );
-			closedir(classDir);
-			return NULL;
-		}
-		if(
-			!S_ISREG(sampleStatus.st_mode) ||
-			!hasBmpMagicNumber(pathToSample)
-		  ){
-			free(pathToSample);
-			continue;
-		}
-		free(pathToSample);
-		sampleNum--;
+	// Sum the counts of every thread into the first's
+	uintmax_t *confusion = threads[0].confusion;
+	uintmax_t numCells = numClasses * (numClasses + 1);
+	for(uint32_t threadNum = 1; threadNum < numThreads; threadNum++){
+		const uintmax_t *threadConfusion = threads[threadNum].confusion;
+		for(uintmax_t cellNum = 0; cellNum < numCells; cellNum++)
+			confusion[cellNum] += threadConfusion[cellNum];
 	}
-	char *pathToRandomSample =
-		(char *)
-		malloc(
-			strlen(pathToClassDir) +
-			strlen(sample->d_name) + 
-			2
-		      );
-	if(!pathToRandomSample){
+
+	// Ties count as incorrect
+	uintmax_t numSamples = cache.numSamples;
+	uintmax_t numCorrect = 0;
+	uintmax_t numTies = 0;
+	for(uint64_t classNum = 0; classNum < numClasses; classNum++){
+		numCorrect += confusion[classNum * (numClasses + 1) + classNum];
+		numTies += confusion[classNum * (numClasses + 1) + numClasses];
+	}
+	fprintf(
+		stdout,
+		"Accuracy: %lf%% (%ju of %ju)\n"
+		"Ties: %lf%% (%ju of %ju)\n",
+		(double)numCorrect / numSamples * 100,
+		numCorrect,
+		numSamples,
+		(double)numTies / numSamples * 100,
+		numTies,
+		numSamples
+	       );
+	for(uint64_t classNum = 0; classNum < numClasses; classNum++){
+		uintmax_t numClassSamples =
+			cache.classOffsets[classNum + 1] -
+			cache.classOffsets[classNum];
+		uintmax_t numClassCorrect =
+			confusion[classNum * (numClasses + 1) + classNum];
+		fprintf(
+			stdout,
+			"Accuracy of %s: %lf%% (%ju of %ju)\n",
+			model.classNames[classNum],
+			(double)numClassCorrect / numClassSamples * 100,
+			numClassCorrect,
+			numClassSamples
+		       );
+	}
+	fprintf(
+		stdout,
+		"Files of each class by voted class:\n"
+	       );
+	for(uint64_t classNum = 0; classNum < numClasses; classNum++)
+		fprintf(stdout, "\t%s", model.classNames[classNum]);
+	fprintf(stdout, "\tTie\n");
+	for(uint64_t classNum = 0; classNum < numClasses; classNum++){
+		const uintmax_t *row = confusion + classNum * (numClasses + 1);
+		fprintf(stdout, "%s", model.classNames[classNum]);
+		for(uint64_t votedNum = 0; votedNum <= numClasses; votedNum++)
+			fprintf(stdout, "\t%ju", row[votedNum]);
+		fprintf(stdout, "\n");
+	}
+	fprintf(
+		stdout,
+		"Decoded %ju files in %lf seconds and scored them in %lf "
+		"seconds on %" PRIu32 " threads, %lf files per second\n",
+		numSamples,
+		decodeSeconds,
+		scoreSeconds,
+		numThreads,
+		scoreSeconds > 0.0 ? numSamples / scoreSeconds : 0.0
+	       );
+	bool isWritten =
+		!pathToOutputFile ||
+		writeEvaluation(
+			&model,
+			confusion,
+			numSamples,
+			numThreads,
+			scoreSeconds,
+			pathToOutputFile
+			);
+	freeEvaluateThreads(threads, numThreads);
+	freeSampleCache(&cache);
+	freeSvmModel(&model);
+	return isWritten;
+}
+
+// Order magnitudes from largest to smallest
+int compareMagnitudesDescending(const void *magnitudeA, const void *magnitudeB){
+	double a = *(const double *)magnitudeA;
+	double b = *(const double *)magnitudeB;
+	return (a < b) - (a > b);
+}
+
+// Score below which weights are pruned, where each score is a magnitude
+// relative to the largest compared, or a negative value on failure
+double getPruneCutoff(const double *scores, uintmax_t numScores){
+	if(PRUNE_DENSITY <= 0.0)
+		return PRUNE_THRESHOLD;
+	uintmax_t numKept = ceil(PRUNE_DENSITY * numScores);
+	if(numKept == 0)
+		numKept = 1;
+	if(numKept >= numScores)
+		return 0.0;
+	double *sortedScores = (double *)malloc(numScores * sizeof(double));
+	if(!sortedScores){
 		fprintf(
 			stderr,
-			"Error allocating memory for path to random sample\n"
+			"Error allocating memory to rank weights\n"
 		       );
-		closedir(classDir);
-		return NULL;
+		return -1.0;
 	}
-	strcpy(pathToRandomSample, pathToClassDir);
-	strcat(pathToRandomSample, "/");
-	strcat(pathToRandomSample, sample->d_name);
-	if(closedir(classDir) != 0){
+	memcpy(sortedScores, scores, numScores * sizeof(double));
+	qsort(
+		sortedScores,
+		numScores,
+		sizeof(double),
+		compareMagnitudesDescending
+	     );
+	double cutoff = sortedScores[numKept - 1];
+	free(sortedScores);
+	return cutoff;
+}
+
+// Gather the kept weights of each vector, sharing index lists between pairs
+// that keep the same dimensions
+SparseVectors *buildSparseVectors(
+		const double *vectors,
+		const uint8_t *kept,
+		uintmax_t numPairs,
+		uintmax_t numDims
+		){
+	uintmax_t numWeights = numPairs * numDims;
+	uintmax_t numKept = 0;
+	for(uintmax_t weightNum = 0; weightNum < numWeights; weightNum++)
+		numKept += kept[weightNum];
+	SparseVectors *sparse =
+		(SparseVectors *)calloc(1, sizeof(SparseVectors));
+	if(sparse){
+		sparse->listOffsets =
+			(uintmax_t *)malloc((numPairs + 1) * sizeof(uintmax_t));
+		sparse->indices =
+			(uint32_t *)malloc((numKept + 1) * sizeof(uint32_t));
+		sparse->pairLists =
+			(uint32_t *)malloc((numPairs + 1) * sizeof(uint32_t));
+		sparse->weightOffsets =
+			(uintmax_t *)malloc((numPairs + 1) * sizeof(uintmax_t));
+		sparse->weights =
+			(double *)malloc((numKept + 1) * sizeof(double));
+	}
+	if(
+		!sparse ||
+		!sparse->listOffsets ||
+		!sparse->indices ||
+		!sparse->pairLists ||
+		!sparse->weightOffsets ||
+		!sparse->weights
+	  ){
 		fprintf(
 			stderr,
-			"Error closing %s\n",
-			pathToClassDir
+			"Error allocating memory for sparse vectors\n"
 		       );
+		freeSparseVectors(sparse);
 		return NULL;
 	}
-	return pathToRandomSample;
+	sparse->listOffsets[0] = 0;
+	sparse->weightOffsets[0] = 0;
+	for(uintmax_t pairNum = 0; pairNum < numPairs; pairNum++){
+		// Write the pair's list after the others, keeping it only if
+		// no earlier list matches
+		uint32_t *indices =
+			sparse->indices +
+			sparse->listOffsets[sparse->numIndexLists];
+		double *weights =
+			sparse->weights + sparse->weightOffsets[pairNum];
+		uintmax_t listLength = 0;
+		const double *vector = vectors + pairNum * numDims;
+		const uint8_t *pairKept = kept + pairNum * numDims;
+		for(uintmax_t dimNum = 0; dimNum < numDims; dimNum++){
+			if(!pairKept[dimNum])
+				continue;
+			indices[listLength] = dimNum;
+			weights[listLength] = vector[dimNum];
+			listLength++;
+		}
+		uint32_t listNum = 0;
+		while(
+			listNum < sparse->numIndexLists &&
+			(
+			 sparse->listOffsets[listNum + 1] -
+			 sparse->listOffsets[listNum] != listLength ||
+			 memcmp(
+				sparse->indices + sparse->listOffsets[listNum],
+				indices,
+				listLength * sizeof(uint32_t)
+			       ) != 0
+			)
+		)
+			listNum++;
+		if(listNum == sparse->numIndexLists){
+			sparse->numIndexLists++;
+			sparse->listOffsets[sparse->numIndexLists] =
+				sparse->listOffsets[listNum] + listLength;
+		}
+		sparse->pairLists[pairNum] = listNum;
+		sparse->weightOffsets[pairNum + 1] =
+			sparse->weightOffsets[pairNum] + listLength;
+	}
+	return sparse;
 }
 
-double getNormDivisor(
-	char *pathToSample
-	){
-	if(access(pathToSample, F_OK) != 0){
+// Drop the weights of a model's vectors that are small compared with
+// others, according to PRUNE_SCOPE, and store the rest sparsely
+SparseVectors *pruneVectors(const SvmModel *model){
+	uintmax_t numPairs = getNumPairs(model->numClasses);
+	uintmax_t numDims = model->numDims;
+	uintmax_t numWeights = numPairs * numDims;
+	double *scores = (double *)malloc(numWeights * sizeof(double));
+	double *dimScores = (double *)calloc(numDims, sizeof(double));
+	uint8_t *kept = (uint8_t *)calloc(numWeights, sizeof(uint8_t));
+	if(!scores || !dimScores || !kept){
 		fprintf(
 			stderr,
-			"Error accessing %s: File does not exist\n",
-			pathToSample
+			"Error allocating memory to prune vectors\n"
 		       );
-		return -1.0;
+		free(scores);
+		free(dimScores);
+		free(kept);
+		return NULL;
 	}
-	if(access(pathToSample, R_OK) != 0){
-		fprintf(
-			stderr,
-			"Error accessing %s for reading\n",
-			pathToSample
-		       );
-		return -1.0;
+
+	// Score each weight by its magnitude relative to the largest of its
+	// vector, or of all vectors when they are compared together
+	double largestMagnitude = 0.0;
+	for(uintmax_t pairNum = 0; pairNum < numPairs; pairNum++){
+		const double *vector = model->vectors + pairNum * numDims;
+		double *vectorScores = scores + pairNum * numDims;
+		double vectorMagnitude = 0.0;
+		for(uintmax_t dimNum = 0; dimNum < numDims; dimNum++){
+			vectorScores[dimNum] = fabs(vector[dimNum]);
+			if(vectorScores[dimNum] > vectorMagnitude)
+				vectorMagnitude = vectorScores[dimNum];
+		}
+		if(vectorMagnitude > largestMagnitude)
+			largestMagnitude = vectorMagnitude;
+		if(PRUNE_SCOPE == PRUNE_ALL_VECTORS || vectorMagnitude == 0.0)
+			continue;
+		for(uintmax_t dimNum = 0; dimNum < numDims; dimNum++){
+			vectorScores[dimNum] /= vectorMagnitude;
+			if(vectorScores[dimNum] > dimScores[dimNum])
+				dimScores[dimNum] = vectorScores[dimNum];
+		}
 	}
-	struct stat sampleStatus;
-	if(stat(pathToSample, &sampleStatus) != 0){
-		fprintf(
-			stderr,
-			"Error getting status of %s\n",
-			pathToSample
-		       );
-		return -1.0;
+	if(PRUNE_SCOPE == PRUNE_ALL_VECTORS && largestMagnitude > 0.0){
+		for(
+			uintmax_t weightNum = 0;
+			weightNum < numWeights;
+			weightNum++
+		   )
+			scores[weightNum] /= largestMagnitude;
+	}
+
+	// Whole dimensions are kept for every vector or none, so that all
+	// pairs share one index list
+	bool cutoffFound = true;
+	if(PRUNE_SCOPE == PRUNE_DIMENSIONS){
+		double cutoff = getPruneCutoff(dimScores, numDims);
+		cutoffFound = cutoff >= 0.0;
+		for(uintmax_t dimNum = 0; dimNum < numDims; dimNum++){
+			if(
+				dimScores[dimNum] <= 0.0 ||
+				dimScores[dimNum] < cutoff
+			  )
+				continue;
+			for(
+				uintmax_t pairNum = 0;
+				pairNum < numPairs;
+				pairNum++
+			   )
+				kept[pairNum * numDims + dimNum] = 1;
+		}
+	}else if(PRUNE_SCOPE == PRUNE_ALL_VECTORS){
+		double cutoff = getPruneCutoff(scores, numWeights);
+		cutoffFound = cutoff >= 0.0;
+		for(
+			uintmax_t weightNum = 0;
+			weightNum < numWeights;
+			weightNum++
+		   )
+			kept[weightNum] =
+				scores[weightNum] > 0.0 &&
+				scores[weightNum] >= cutoff;
+	}else{
+		for(
+			uintmax_t pairNum = 0;
+			pairNum < numPairs && cutoffFound;
+			pairNum++
+		   ){
+			const double *vectorScores = scores + pairNum * numDims;
+			double cutoff = getPruneCutoff(vectorScores, numDims);
+			cutoffFound = cutoff >= 0.0;
+			for(uintmax_t dimNum = 0; dimNum < numDims; dimNum++)
+				kept[pairNum * numDims + dimNum] =
+					vectorScores[dimNum] > 0.0 &&
+					vectorScores[dimNum] >= cutoff;
+		}
 	}
-	if(!S_ISREG(sampleStatus.st_mode)){
+	free(scores);
+	free(dimScores);
+	SparseVectors *sparse =
+		cutoffFound ?
+		buildSparseVectors(model->vectors, kept, numPairs, numDims) :
+		NULL;
+	free(kept);
+	return sparse;
+}
+
+// Report the accuracy of a model and a changed version of it, which share
+// their feature stages, on the samples of a directory laid out like the
+// training directory
+bool reportAccuracyChange(
+		const SvmModel *original,
+		const SvmModel *changed,
+		const char *changeName,
+		char *pathToValidationDir
+		){
+	SampleCache cache;
+	if(!loadSampleCache(pathToValidationDir, original, &cache)){
 		fprintf(
 			stderr,
-			"%s is not a regular file\n",
-			pathToSample
+			"Error loading samples from %s\n",
+			pathToValidationDir
 		       );
-		return -1.0;
+		return false;
 	}
-	if(!hasBmpMagicNumber(pathToSample)){
+	double *features =
+		(double *)malloc(original->numDims * sizeof(double));
+	uintmax_t *vectorsInFavor =
+		(uintmax_t *)malloc(original->numClasses * sizeof(uintmax_t));
+	if(!features || !vectorsInFavor){
 		fprintf(
 			stderr,
-			"Could not identify %s as a BMP file\n",
-			pathToSample
+			"Error allocating memory required for voting "
+			"mechanism\n"
 		       );
-		return -1.0;
+		free(features);
+		free(vectorsInFavor);
+		freeSampleCache(&cache);
+		return false;
 	}
 
-	uint32_t width;
-	int32_t height;
-	uint16_t bitsPerPixel;
+	// Ties count as incorrect
+	uintmax_t numOriginalCorrect = 0;
+	uintmax_t numChangedCorrect = 0;
+	uintmax_t numAgreeing = 0;
+	for(uint64_t classNum = 0; classNum < cache.numClasses; classNum++){
+		for(
+			uintmax_t sampleNum = cache.classOffsets[classNum];
+			sampleNum < cache.classOffsets[classNum + 1];
+			sampleNum++
+		   ){
+			const uint8_t *sample =
+				cache.pixelBytes +
+				sampleNum * cache.sampleBytes;
+			getSampleFeatures(
+				original,
+				sample,
+				cache.normDivisors[sampleNum],
+				features
+				);
+			uint64_t originalClass =
+				getVotedClass(
+					original,
+					features,
+					vectorsInFavor,
+					NULL
+					);
+			uint64_t changedClass =
+				getVotedClass(
+					changed,
+					features,
+					vectorsInFavor,
+					NULL
+					);
+			numOriginalCorrect += originalClass == classNum;
+			numChangedCorrect += changedClass == classNum;
+			numAgreeing += originalClass == changedClass;
+		}
+	}
+	double originalAccuracy =
+		(double)numOriginalCorrect / cache.numSamples * 100;
+	double changedAccuracy =
+		(double)numChangedCorrect / cache.numSamples * 100;
+	fprintf(
+		stdout,
+		"Original accuracy: %lf%% (%ju of %ju)\n"
+		"%s accuracy: %lf%% (%ju of %ju)\n"
+		"Accuracy change: %+lf percentage points\n"
+		"Predictions agree on %ju of %ju samples\n",
+		originalAccuracy,
+		numOriginalCorrect,
+		cache.numSamples,
+		changeName,
+		changedAccuracy,
+		numChangedCorrect,
+		cache.numSamples,
+		changedAccuracy - originalAccuracy,
+		numAgreeing,
+		cache.numSamples
+	       );
+	free(features);
+	free(vectorsInFavor);
+	freeSampleCache(&cache);
+	return true;
+}
 
-	if(
-		!getBmpDims(
-			pathToSample,
-			&width,
-			&height,
-			&bitsPerPixel
-			)
-	  ){
+// Prune the vectors of a premade SVM file into a sparse SVM file, reporting
+// the accuracy lost on a validation directory if one is given
+bool pruneSvmModel(
+		char *pathToInputFile,
+		char *pathToOutputFile,
+		char *pathToValidationDir
+		){
+	if(access(pathToOutputFile, F_OK) == 0){
+		if(access(pathToOutputFile, W_OK) != 0){
+			fprintf(
+				stderr,
+				"Insufficient permission to overwrite %s\n",
+				pathToOutputFile
+			       );
+			return false;
+		}
+	}
+	SvmModel model;
+	if(!loadSvmModel(pathToInputFile, &model)){
 		fprintf(
 			stderr,
-			"Could not get dimensions of %s\n",
-			pathToSample
+			"Error loading %s\n",
+			pathToInputFile
 		       );
-		return -1.0;
+		return false;
 	}
-
-	FILE *sample = fopen(pathToSample, "rb");
-	if(!sample){
+	if(model.sparseVectors){
 		fprintf(
 			stderr,
-			"Error opening %s for reading\n",
-			pathToSample
+			"%s has already been pruned\n",
+			pathToInputFile
 		       );
-		return -1.0;
+		freeSvmModel(&model);
+		return false;
 	}
-	if(fseek(sample, 10, SEEK_SET) != 0){
+	// Sparse indices are 32 bit
+	if(model.numDims > (uintmax_t)INT32_MAX + 1){
 		fprintf(
 			stderr,
-			"Error seeking to offset to data in %s\n",
-			pathToSample
+			"%s has too many dimensions to prune\n",
+			pathToInputFile
 		       );
-		fclose(sample);
-		return -1.0;
+		freeSvmModel(&model);
+		return false;
 	}
 
-	uint32_t offsetBytes;
-	if(fread(&offsetBytes, 4, 1, sample) == 0){\
-		fprintf(
-			stderr,
-			"Error reading offset to data from %s\n",
-			pathToSample
-		       );
-		fclose(sample);
-		return -1.0;
+	// Weights are pruned as doubles and stored in their original format
+	uint8_t weightFormat = model.weightFormat;
+	if(!widenVectors(&model)){
+		freeSvmModel(&model);
+		return false;
 	}
-	if(fseek(sample, offsetBytes, SEEK_SET) != 0){
+	SvmModel denseModel = model;
+	model.sparseVectors = pruneVectors(&model);
+	if(!model.sparseVectors || !narrowVectors(&model, weightFormat)){
 		fprintf(
 			stderr,
-			"Error seeking to data in %s\n",
-			pathToSample
+			"Error pruning vectors of %s\n",
+			pathToInputFile
 		       );
-		fclose(sample);
-		return -1.0;
+		freeSvmModel(&model);
+		return false;
 	}
-	uintmax_t sumSquareByteValues = 0;
-	uint64_t numRows = imaxabs(height);
-	uint8_t rowPadding = (4 - width % 4) % 4;
-	for(intmax_t rowNum = 0; rowNum < numRows; rowNum++){
-		for(uint32_t colNum = 0; colNum < width; colNum ++){
-			uint8_t pixVal;
-			if(fread(&pixVal, 1, 1, sample) == 0){
-				fprintf(
-					stderr,
-					"Could not get pixel value in %s\n",
-					pathToSample
-				       );
-				fclose(sample);
-				return -1.0;
-			}
-			sumSquareByteValues += (uint16_t)pixVal * pixVal;
-		}
-		if(fseek(sample, rowPadding, SEEK_CUR) != 0){
-			fprintf(
-				stderr,
-				"Could not seek to next row in %s\n",
-				pathToSample
-			       );
-			fclose(sample);
-			return -1.0;
-		}
+
+	uintmax_t numWeights = getNumWeights(&denseModel);
+	uintmax_t numKept = getNumWeights(&model);
+	fprintf(
+		stdout,
+		"Kept %ju of %ju weights (%lf%%) using %" PRIu32 " index "
+		"lists\n"
+		"Vectors take %ju bytes instead of %ju\n",
+		numKept,
+		numWeights,
+		(double)numKept / numWeights * 100,
+		model.sparseVectors->numIndexLists,
+		(uintmax_t)getSparseStageSize(&model),
+		numWeights * getWeightSize(weightFormat)
+	       );
+	if(
+		pathToValidationDir &&
+		!reportAccuracyChange(
+			&denseModel,
+			&model,
+			"Pruned",
+			pathToValidationDir
+			)
+	  ){
+		freeSvmModel(&model);
+		return false;
 	}
-	if(fclose(sample) != 0){
+	if(!writeSvmModel(pathToOutputFile, &model)){
 		fprintf(
 			stderr,
-			"Error closing %s\n",
-			pathToSample
+			"Error writing pruned vectors to %s\n",
+			pathToOutputFile
 		       );
-		return -1.0;
+		freeSvmModel(&model);
+		return false;
 	}
-	return sqrt((double)sumSquareByteValues);
+	freeSvmModel(&model);
+	return true;
 }
 
-bool trainVectorWithSample(
+// Convert the weights of a premade SVM file to WEIGHT_FORMAT, reporting the
+// accuracy lost on a validation directory if one is given
+bool convertSvmModel(
+		char *pathToInputFile,
 		char *pathToOutputFile,
-		char *pathToSample,
-		uintmax_t offsetVectors,
-		uintmax_t offsetToVectors,
-		double normDivisor,
-		double learnRate,
-		bool isPositiveSample
+		char *pathToValidationDir
 		){
-
-	if(DEBUG_LEVEL < 1){
-		// Print information about current vector
-		fprintf(
-			stderr,
-			"\t\tInfo: Training %s sample with %d vectors offset\n",
-			isPositiveSample ? "positive" : "negative",
-			offsetVectors
-		       );
-	}
-
-	// Ensure read/write permissions with output file
 	if(access(pathToOutputFile, F_OK) == 0){
-		if(access(pathToOutputFile, R_OK) != 0){
-			fprintf(
-				stderr,
-				"Lacking read permissions for %s\n",
-				pathToOutputFile
-			       );
-			return false;
-		}
 		if(access(pathToOutputFile, W_OK) != 0){
 			fprintf(
 				stderr,
-				"Lacking write permissions for %s\n",
+				"Insufficient permission to overwrite %s\n",
 				pathToOutputFile
 			       );
 			return false;
 		}
-	}else{
+	}
+	SvmModel model;
+	if(!loadSvmModel(pathToInputFile, &model)){
 		fprintf(
 			stderr,
-			"%s does not exist\n",
-			pathToOutputFile
+			"Error loading %s\n",
+			pathToInputFile
 		       );
 		return false;
 	}
-	if(access(pathToSample, F_OK) == 0){
-		if(access(pathToSample, R_OK) != 0){
-			fprintf(
-				stderr,
-				"Insufficient permission to read %s\n",
-				pathToSample
-			       );
-			return false;
-		}
-	}else{
-		fprintf(
-			stderr,
-			"%s does not exist\n",
-			pathToSample
-		       );
+	// Widening is exact, so the widened weights stand in for the original
+	// ones
+	uint8_t originalFormat = model.weightFormat;
+	if(!widenVectors(&model)){
+		freeSvmModel(&model);
 		return false;
 	}
-	struct stat fileStatus;
-	if(stat(pathToOutputFile, &fileStatus) != 0){
-		fprintf(
-			stderr,
-			"Error getting status of %s\n",
-			pathToOutputFile
-		       );
+	SvmModel originalModel = model;
+	if(!narrowVectors(&model, WEIGHT_FORMAT)){
+		freeSvmModel(&model);
 		return false;
 	}
-	if(!S_ISREG(fileStatus.st_mode)){
+
+	uintmax_t numWeights = getNumWeights(&model);
+	fprintf(
+		stdout,
+		"Converted %ju weights from %s to %s\n"
+		"Weights take %ju bytes instead of %ju\n",
+		numWeights,
+		weightFormatNames[originalFormat],
+		weightFormatNames[model.weightFormat],
+		numWeights * getWeightSize(model.weightFormat),
+		numWeights * getWeightSize(originalFormat)
+	       );
+	if(
+		pathToValidationDir &&
+		!reportAccuracyChange(
+			&originalModel,
+			&model,
+			"Converted",
+			pathToValidationDir
+			)
+	  ){
+		freeSvmModel(&model);
+		return false;
+	}
+	if(!writeSvmModel(pathToOutputFile, &model)){
 		fprintf(
 			stderr,
-			"%s is not a regular file\n",
+			"Error writing converted vectors to %s\n",
 			pathToOutputFile
 		       );
+		freeSvmModel(&model);
 		return false;
 	}
-	if(stat(pathToSample, &fileStatus) != 0){
+	freeSvmModel(&model);
+	return true;
+}
+
+// Copy the vectors of a model into numDims doubles per pair, widening the
+// model's weights and restoring pruned weights as zeros
+double *getDenseVectors(SvmModel *model){
+	uintmax_t numPairs = getNumPairs(model->numClasses);
+	double *vectors =
+		(double *)calloc(numPairs * model->numDims, sizeof(double));
+	if(!vectors || !widenVectors(model)){
 		fprintf(
 			stderr,
-			"Error getting status of %s\n",
-			pathToSample
+			"Error allocating memory for vectors\n"
 		       );
-		return false;
+		free(vectors);
+		return NULL;
 	}
-	if(!S_ISREG(fileStatus.st_mode)){
+	const SparseVectors *sparse = model->sparseVectors;
+	for(uintmax_t pairNum = 0; pairNum < numPairs; pairNum++){
+		double *vector = vectors + pairNum * model->numDims;
+		if(!sparse){
+			memcpy(
+				vector,
+				model->vectors + pairNum * model->numDims,
+				model->numDims * sizeof(double)
+			      );
+			continue;
+		}
+		const uint32_t *indices =
+			sparse->indices +
+			sparse->listOffsets[sparse->pairLists[pairNum]];
+		const double *weights =
+			sparse->weights + sparse->weightOffsets[pairNum];
+		uintmax_t numWeights =
+			sparse->weightOffsets[pairNum + 1] -
+			sparse->weightOffsets[pairNum];
+		for(
+			uintmax_t weightNum = 0;
+			weightNum < numWeights;
+			weightNum++
+		   )
+			vector[indices[weightNum]] = weights[weightNum];
+	}
+	return vectors;
+}
+
+// Write values as the body of a C initializer, four to a line
+void writeCValues(
+		FILE *output,
+		const double *values,
+		uintmax_t numValues,
+		bool asFloats,
+		const char *indent
+		){
+	for(uintmax_t valueNum = 0; valueNum < numValues; valueNum++){
+		if(valueNum % 4 == 0)
+			fprintf(output, "%s", indent);
+		// The # flag keeps the decimal point of integral values, as 0f
+		// and 1f aren't float literals
+		if(asFloats)
+			fprintf(output, "%#.9gf", values[valueNum]);
+		else
+			fprintf(output, "%.17g", values[valueNum]);
 		fprintf(
-			stderr,
-			"%s is not a regular file\n",
-			pathToSample
+			output,
+			valueNum + 1 == numValues ?
+			"\n" :
+			valueNum % 4 == 3 ?
+			",\n" :
+			", "
 		       );
-		return false;
 	}
+}
 
-	uint32_t width;
-	int32_t height;
-	uint16_t bitsPerPixel;
+// Whether values can be written as C literals, which have no infinities or
+// NaNs
+bool hasFiniteValues(const double *values, uintmax_t numValues){
+	for(uintmax_t valueNum = 0; valueNum < numValues; valueNum++){
+		if(!isfinite(values[valueNum]))
+			return false;
+	}
+	return true;
+}
 
-	if(
-		!getBmpDims(
-			pathToSample,
-			&width,
-			&height,
-			&bitsPerPixel
-			)
-	  ){
+// Write the code of a generated classifier that maps decoded pixel bytes to
+// the features its vectors operate on, following the model's stages
+void writeCFeatureStages(FILE *output, const SvmModel *model){
+	fprintf(
+		output,
+		"// Map decoded pixel bytes to the features the vectors "
+		"operate on\n"
+		"static void getFeatures(const uint8_t *pixelBytes, "
+		"double *features){\n"
+		"\tfor(uint32_t pixelNum = 0; pixelNum < NUM_IMAGE_PIXELS; "
+		"pixelNum++){\n"
+		"\t\tconst uint8_t *pixel = pixelBytes + pixelNum * "
+		"BYTES_PER_PIXEL;\n"
+		"\t\tuint8_t *channels = channelBytes + pixelNum * "
+		"NUM_CHANNELS;\n"
+	       );
+	if(model->channelMode == CHANNELS_LUMINANCE){
+		fprintf(
+			output,
+			"\t\tchannels[0] =\n"
+			"\t\t\t(%d * pixel[0] + %d * pixel[1] + %d * pixel[2] "
+			"+ 128) >> 8;\n",
+			LUMINANCE_BLUE,
+			LUMINANCE_GREEN,
+			LUMINANCE_RED
+		       );
+	}else{
+		uint16_t numChannels = 0;
+		for(
+			uint16_t byteNum = 0;
+			byteNum < model->bitsPerPixel >> 3;
+			byteNum++
+		   ){
+			if(
+				model->channelMode == CHANNELS_SELECTED &&
+				!(model->channelMask >> byteNum & 1)
+			  )
+				continue;
+			fprintf(
+				output,
+				"\t\tchannels[%" PRIu16 "] = pixel[%" PRIu16
+				"];\n",
+				numChannels++,
+				byteNum
+			       );
+		}
+	}
+	fprintf(
+		output,
+		"\t}\n"
+	       );
+	if(model->pixelMask){
+		fprintf(
+			output,
+			"\tfor(uint32_t pixelNum = 0; pixelNum < NUM_PIXELS; "
+			"pixelNum++){\n"
+			"\t\tfor(uint32_t byteNum = 0; byteNum < NUM_CHANNELS; "
+			"byteNum++)\n"
+			"\t\t\tkeptBytes[pixelNum * NUM_CHANNELS + byteNum] =\n"
+			"\t\t\t\tchannelBytes[\n"
+			"\t\t\t\t\tkeptPixels[pixelNum] * NUM_CHANNELS +\n"
+			"\t\t\t\t\tbyteNum\n"
+			"\t\t\t\t\t];\n"
+			"\t}\n"
+		       );
+	}
+	fprintf(
+		output,
+		"\tuint64_t sumSquareByteValues = 0;\n"
+		"\tfor(uint32_t byteNum = 0; byteNum < NUM_PIXEL_BYTES; "
+		"byteNum++)\n"
+		"\t\tsumSquareByteValues +=\n"
+		"\t\t\t(uint16_t)keptBytes[byteNum] * keptBytes[byteNum];\n"
+		"\tdouble normDivisor = sqrt((double)sumSquareByteValues);\n"
+		"\tif(normDivisor == 0.0){\n"
+		"\t\tmemset(features, 0, NUM_DIMS * sizeof(double));\n"
+		"\t\treturn;\n"
+		"\t}\n"
+	       );
+	if(!model->numComponents){
+		fprintf(
+			output,
+			"\tfor(uint32_t byteNum = 0; byteNum < "
+			"NUM_PIXEL_BYTES; byteNum++)\n"
+			"\t\tfeatures[byteNum] = keptBytes[byteNum] / "
+			"normDivisor;\n"
+			"}\n\n"
+		       );
+		return;
+	}
+	fprintf(
+		output,
+		"\tfor(uint32_t componentNum = 0; componentNum < "
+		"NUM_COMPONENTS; componentNum++){\n"
+		"\t\tdouble projection = 0.0;\n"
+		"\t\tfor(uint32_t byteNum = 0; byteNum < NUM_PIXEL_BYTES; "
+		"byteNum++)\n"
+		"\t\t\tprojection +=\n"
+		"\t\t\t\tcomponents[componentNum][byteNum] *\n"
+		"\t\t\t\tkeptBytes[byteNum];\n"
+		"\t\tfeatures[componentNum] = projection / normDivisor;\n"
+		"\t}\n"
+		"}\n\n"
+	       );
+}
+
+// Generate the C source of a standalone classifier with the dimensions,
+// feature stages and vectors of a premade SVM file built in
+bool exportSvmModel(
+		char *pathToSvmFile,
+		char *pathToOutputFile
+		){
+	if(access(pathToOutputFile, F_OK) == 0){
+		if(access(pathToOutputFile, W_OK) != 0){
+			fprintf(
+				stderr,
+				"Insufficient permission to overwrite %s\n",
+				pathToOutputFile
+			       );
+			return false;
+		}
+	}
+	SvmModel model;
+	if(!loadSvmModel(pathToSvmFile, &model)){
 		fprintf(
 			stderr,
-			"Error getting dimensions of %s\n",
-			pathToSample
+			"Error loading %s\n",
+			pathToSvmFile
 		       );
 		return false;
 	}
-	
-	if(bitsPerPixel & 7){
+
+	// Weights narrower than doubles are embedded as floats, which hold
+	// them exactly, and pruned weights are embedded with their zeros
+	bool asFloats = model.weightFormat != WEIGHTS_DOUBLE;
+	uintmax_t numPairs = getNumPairs(model.numClasses);
+	double *vectors = getDenseVectors(&model);
+	if(!vectors){
+		freeSvmModel(&model);
+		return false;
+	}
+	if(
+		!hasFiniteValues(vectors, numPairs * model.numDims) ||
+		(
+		 model.numComponents &&
+		 !hasFiniteValues(
+			model.components,
+			model.numComponents * getNumPixelBytes(&model)
+			)
+		)
+	  ){
 		fprintf(
 			stderr,
-			"Error: only whole number of bytes per pixel "
-			"supported\n"
+			"Error: %s has infinite or NaN weights, which can't be "
+			"exported\n",
+			pathToSvmFile
 		       );
+		free(vectors);
+		freeSvmModel(&model);
 		return false;
 	}
 
-	uint16_t bytesPerPixel = bitsPerPixel >> 3;
-
-	FILE *output = fopen(pathToOutputFile, "rb+");
+	FILE *output = fopen(pathToOutputFile, "w");
 	if(!output){
 		fprintf(
 			stderr,
-			"Error opening %s for reading and writing\n",
+			"Error opening %s for writing\n",
 			pathToOutputFile
 		       );
+		free(vectors);
+		freeSvmModel(&model);
 		return false;
 	}
-	if(fseek(output, offsetToVectors, SEEK_SET) != 0){
+	uintmax_t numImagePixels = getNumImagePixels(&model);
+	uintmax_t numPixels =
+		model.pixelMask ? model.numKeptPixels : numImagePixels;
+	fprintf(
+		output,
+		"// Classifier generated by nsvm from %s\n"
+		"//\n"
+		"// Build with: cc -O2 -o <classifier> <this file> -lm\n"
+		"#include <inttypes.h>\n"
+		"#include <math.h>\n"
+		"#include <stdint.h>\n"
+		"#include <stdio.h>\n"
+		"#include <stdlib.h>\n"
+		"#include <string.h>\n"
+		"\n"
+		"#define WIDTH %" PRIu32 "\n"
+		"#define HEIGHT %jd\n"
+		"#define BYTES_PER_PIXEL %" PRIu16 "\n"
+		"#define ROW_BYTES (WIDTH * BYTES_PER_PIXEL)\n"
+		"#define ROW_STRIDE ((ROW_BYTES + 3) & ~3)\n"
+		"#define NUM_IMAGE_PIXELS %ju\n"
+		"#define NUM_CHANNELS %" PRIu16 "\n"
+		"#define NUM_PIXELS %ju\n"
+		"#define NUM_PIXEL_BYTES (NUM_PIXELS * NUM_CHANNELS)\n"
+		"#define NUM_COMPONENTS %" PRIu32 "\n"
+		"#define NUM_DIMS %ju\n"
+		"#define NUM_CLASSES %ju\n"
+		"#define NUM_PAIRS %ju\n"
+		"\n"
+		"static const char *const classNames[NUM_CLASSES] = {\n",
+		pathToSvmFile,
+		model.width,
+		imaxabs(model.height),
+		model.bitsPerPixel >> 3,
+		numImagePixels,
+		getNumChannels(&model),
+		numPixels,
+		model.numComponents,
+		model.numDims,
+		(uintmax_t)model.numClasses,
+		numPairs
+	       );
+	for(uint64_t classNum = 0; classNum < model.numClasses; classNum++){
+		fprintf(output, "\t\"");
+		for(
+			const char *nameChar = model.classNames[classNum];
+			*nameChar;
+			nameChar++
+		   ){
+			if(*nameChar == '"' || *nameChar == '\\')
+				fprintf(output, "\\%c", *nameChar);
+			else if(isprint((unsigned char)*nameChar))
+				fprintf(output, "%c", *nameChar);
+			else
+				fprintf(
+					output,
+					"\\%03o",
+					(unsigned char)*nameChar
+				       );
+		}
+		fprintf(output, "\",\n");
+	}
+	fprintf(
+		output,
+		"};\n\n"
+		"static uint8_t pixelBytes[NUM_IMAGE_PIXELS * "
+		"BYTES_PER_PIXEL];\n"
+		"static uint8_t channelBytes[NUM_IMAGE_PIXELS * "
+		"NUM_CHANNELS];\n"
+	       );
+	if(model.pixelMask){
 		fprintf(
-			stderr,
-			"Error seeking to vectors in %s\n",
-			pathToOutputFile
+			output,
+			"static uint8_t keptBytes[NUM_PIXEL_BYTES];\n\n"
+			"static const uint32_t keptPixels[NUM_PIXELS] = {\n"
+		       );
+		uintmax_t numKept = 0;
+		for(
+			uintmax_t pixelNum = 0;
+			pixelNum < numImagePixels;
+			pixelNum++
+		   ){
+			if(!(
+				model.pixelMask[pixelNum >> 3] >>
+				(pixelNum & 7) &
+				1
+			    ))
+				continue;
+			fprintf(
+				output,
+				numKept % 8 == 0 ? "\t%ju" : " %ju",
+				pixelNum
+			       );
+			numKept++;
+			fprintf(
+				output,
+				numKept == numPixels ?
+				"\n" :
+				numKept % 8 == 0 ?
+				",\n" :
+				","
+			       );
+		}
+		fprintf(output, "};\n");
+	}else{
+		fprintf(
+			output,
+			"#define keptBytes channelBytes\n"
 		       );
-		fclose(output);
-		return false;
 	}
-
-	uint64_t numPixels = width * (uint64_t)imaxabs(height);
-	// Seek to the appropriate vector
-	for(
-		uintmax_t numVectors = 0;
-		numVectors < offsetVectors; 
-		numVectors++
-	){
+	if(model.numComponents){
+		uintmax_t numPixelBytes = getNumPixelBytes(&model);
+		fprintf(
+			output,
+			"\nstatic const double components[NUM_COMPONENTS]"
+			"[NUM_PIXEL_BYTES]\n"
+			"\t__attribute__((aligned(32))) = {\n"
+		       );
 		for(
-			uint64_t vectorDim = 0; 
-			vectorDim < numPixels;
-			vectorDim++
+			uint32_t componentNum = 0;
+			componentNum < model.numComponents;
+			componentNum++
 		   ){
-			for(
-				uint16_t pixelByte = 0;
-				pixelByte < bytesPerPixel;
-				pixelByte++
-			   ){
-				if(
-					fseek(
-						output, 
-						sizeof(double), 
-						SEEK_CUR
-					     ) != 0
-				){
-					fprintf(
-						stderr,
-						"Error seeking to start of "
-						"relevant vector in %s\n",
-						pathToOutputFile
-					       );
-					fclose(output);
-					return false;
-				}
-			}
+			fprintf(output, "\t{\n");
+			writeCValues(
+				output,
+				model.components + componentNum * numPixelBytes,
+				numPixelBytes,
+				false,
+				"\t\t"
+				);
+			fprintf(output, "\t},\n");
 		}
+		fprintf(output, "};\n");
+	}
+	fprintf(
+		output,
+		"\nstatic const %s vectors[NUM_PAIRS][NUM_DIMS]\n"
+		"\t__attribute__((aligned(32))) = {\n",
+		asFloats ? "float" : "double"
+	       );
+	for(uintmax_t pairNum = 0; pairNum < numPairs; pairNum++){
+		fprintf(output, "\t{\n");
+		writeCValues(
+			output,
+			vectors + pairNum * model.numDims,
+			model.numDims,
+			asFloats,
+			"\t\t"
+			);
+		fprintf(output, "\t},\n");
 	}
+	fprintf(output, "};\n\n");
+	free(vectors);
 
-	// Seek to first pixel in sample
-	FILE *sample = fopen(pathToSample, "rb");
-	if(!sample){
+	// Decoding and voting follow decodeBmp and classifyFilesFromSvm, with
+	// every dimension known at compile time
+	fprintf(
+		output,
+		"// Read the pixel data of a BMP file, top row first and "
+		"without row padding\n"
+		"static int decodeBmp(const char *pathToFile){\n"
+		"\tFILE *bmpFile = fopen(pathToFile, \"rb\");\n"
+		"\tif(!bmpFile){\n"
+		"\t\tfprintf(stderr, \"Error opening %%s for reading\\n\", "
+		"pathToFile);\n"
+		"\t\treturn 0;\n"
+		"\t}\n"
+		"\tuint8_t header[30];\n"
+		"\tuint32_t offsetToData;\n"
+		"\tuint32_t width;\n"
+		"\tint32_t height;\n"
+		"\tuint16_t bitsPerPixel;\n"
+		"\tif(\n"
+		"\t\tfread(header, 1, sizeof(header), bmpFile) != "
+		"sizeof(header) ||\n"
+		"\t\theader[0] != 'B' ||\n"
+		"\t\theader[1] != 'M'\n"
+		"\t  ){\n"
+		"\t\tfprintf(stderr, \"Could not identify %%s as a BMP "
+		"file\\n\", pathToFile);\n"
+		"\t\tfclose(bmpFile);\n"
+		"\t\treturn 0;\n"
+		"\t}\n"
+		"\tmemcpy(&offsetToData, header + 10, sizeof(uint32_t));\n"
+		"\tmemcpy(&width, header + 18, sizeof(uint32_t));\n"
+		"\tmemcpy(&height, header + 22, sizeof(int32_t));\n"
+		"\tmemcpy(&bitsPerPixel, header + 28, sizeof(uint16_t));\n"
+		"\tif(\n"
+		"\t\twidth != WIDTH ||\n"
+		"\t\t(height < 0 ? -(int64_t)height : height) != HEIGHT ||\n"
+		"\t\tbitsPerPixel != BYTES_PER_PIXEL * 8\n"
+		"\t  ){\n"
+		"\t\tfprintf(\n"
+		"\t\t\tstderr,\n"
+		"\t\t\t\"%%s is not %%dx%%d with %%d bits per pixel\\n\",\n"
+		"\t\t\tpathToFile,\n"
+		"\t\t\tWIDTH,\n"
+		"\t\t\tHEIGHT,\n"
+		"\t\t\tBYTES_PER_PIXEL * 8\n"
+		"\t\t       );\n"
+		"\t\tfclose(bmpFile);\n"
+		"\t\treturn 0;\n"
+		"\t}\n"
+		"\tif(fseek(bmpFile, offsetToData, SEEK_SET) != 0){\n"
+		"\t\tfprintf(stderr, \"Error seeking to data in %%s\\n\", "
+		"pathToFile);\n"
+		"\t\tfclose(bmpFile);\n"
+		"\t\treturn 0;\n"
+		"\t}\n"
+		"\t// Rows of BMP files with positive heights are stored "
+		"bottom-up\n"
+		"\tuint8_t rowBuffer[ROW_STRIDE];\n"
+		"\tfor(uint32_t rowNum = 0; rowNum < HEIGHT; rowNum++){\n"
+		"\t\tif(fread(rowBuffer, 1, ROW_STRIDE, bmpFile) != "
+		"ROW_STRIDE){\n"
+		"\t\t\tfprintf(stderr, \"Error reading row %%\" PRIu32 \" of "
+		"%%s\\n\", rowNum, pathToFile);\n"
+		"\t\t\tfclose(bmpFile);\n"
+		"\t\t\treturn 0;\n"
+		"\t\t}\n"
+		"\t\tuint32_t topRowNum = height > 0 ? HEIGHT - 1 - rowNum : "
+		"rowNum;\n"
+		"\t\tmemcpy(pixelBytes + topRowNum * ROW_BYTES, rowBuffer, "
+		"ROW_BYTES);\n"
+		"\t}\n"
+		"\tfclose(bmpFile);\n"
+		"\treturn 1;\n"
+		"}\n\n"
+	       );
+	writeCFeatureStages(output, &model);
+	fprintf(
+		output,
+		"int main(int argc, char **argv){\n"
+		"\tif(argc < 2){\n"
+		"\t\tprintf(\"Usage:\\t%%s <Path to BMP-formatted "
+		"file>...\\n\", argv[0]);\n"
+		"\t\treturn EXIT_FAILURE;\n"
+		"\t}\n"
+		"\tstatic double features[NUM_DIMS];\n"
+		"\tint status = EXIT_SUCCESS;\n"
+		"\tfor(int argNum = 1; argNum < argc; argNum++){\n"
+		"\t\tif(!decodeBmp(argv[argNum])){\n"
+		"\t\t\tstatus = EXIT_FAILURE;\n"
+		"\t\t\tcontinue;\n"
+		"\t\t}\n"
+		"\t\tgetFeatures(pixelBytes, features);\n"
+		"\n"
+		"\t\t// Use support vectors to determine class\n"
+		"\t\tuintmax_t vectorsInFavor[NUM_CLASSES] = {0};\n"
+		"\t\tuint32_t pairNum = 0;\n"
+		"\t\tfor(uint32_t posClass = 0; posClass < NUM_CLASSES - 1; "
+		"posClass++){\n"
+		"\t\t\tfor(uint32_t negClass = posClass + 1; negClass < "
+		"NUM_CLASSES; negClass++){\n"
+		"\t\t\t\tdouble dotProduct = 0.0;\n"
+		"\t\t\t\tfor(uint32_t dimNum = 0; dimNum < NUM_DIMS; "
+		"dimNum++)\n"
+		"\t\t\t\t\tdotProduct += vectors[pairNum][dimNum] * "
+		"features[dimNum];\n"
+		"\t\t\t\tvectorsInFavor[dotProduct > 0.0 ? posClass : "
+		"negClass]++;\n"
+		"\t\t\t\tpairNum++;\n"
+		"\t\t\t}\n"
+		"\t\t}\n"
+		"\n"
+		"\t\t// Find out and display results\n"
+		"\t\tuintmax_t numVectorsFavor = 0;\n"
+		"\t\tuintmax_t numClassesFavorite = 0;\n"
+		"\t\tfor(uint32_t classNum = 0; classNum < NUM_CLASSES; "
+		"classNum++){\n"
+		"\t\t\tif(vectorsInFavor[classNum] > numVectorsFavor){\n"
+		"\t\t\t\tnumVectorsFavor = vectorsInFavor[classNum];\n"
+		"\t\t\t\tnumClassesFavorite = 0;\n"
+		"\t\t\t}\n"
+		"\t\t\tnumClassesFavorite +=\n"
+		"\t\t\t\tvectorsInFavor[classNum] == numVectorsFavor;\n"
+		"\t\t}\n"
+		"\t\tuintmax_t totalVectorsFavor = numClassesFavorite * "
+		"numVectorsFavor;\n"
+		"\t\tuintmax_t totalVectorsRelevant = numClassesFavorite * "
+		"(NUM_CLASSES - 1);\n"
+		"\t\tprintf(\n"
+		"\t\t\t\"%%lf%%%% (%%ju of %%ju) of relevant vectors point to "
+		"%%s belonging \"\n"
+		"\t\t\t\"to one of the following classes:\\n\",\n"
+		"\t\t\t(double)totalVectorsFavor / totalVectorsRelevant * "
+		"100,\n"
+		"\t\t\ttotalVectorsFavor,\n"
+		"\t\t\ttotalVectorsRelevant,\n"
+		"\t\t\targv[argNum]\n"
+		"\t\t      );\n"
+		"\t\tfor(uint32_t classNum = 0; classNum < NUM_CLASSES; "
+		"classNum++){\n"
+		"\t\t\tif(vectorsInFavor[classNum] == numVectorsFavor)\n"
+		"\t\t\t\tprintf(\"\\t%%s\\n\", classNames[classNum]);\n"
+		"\t\t}\n"
+		"\t}\n"
+		"\treturn status;\n"
+		"}\n"
+	       );
+	freeSvmModel(&model);
+	if(ferror(output)){
 		fprintf(
 			stderr,
-			"Error opening %s for reading\n",
-			pathToSample
+			"Error writing classifier to %s\n",
+			pathToOutputFile
 		       );
 		fclose(output);
 		return false;
 	}
-	if(fseek(sample, 10, SEEK_SET) != 0){
+	if(fclose(output) != 0){
 		fprintf(
 			stderr,
-			"Error seeking to offset to data in %s\n",
-			pathToSample
+			"Error closing %s\n",
+			pathToOutputFile
 		       );
-		fclose(sample);
-		fclose(output);
 		return false;
 	}
-	uint32_t offsetToSampleData;
-	if(!fread(&offsetToSampleData, sizeof(uint32_t), 1, sample)){
+	return true;
+}
+
+#define SCORING_CHEAPER 0
+#define SCORING_DIRECT 1
+#define SCORING_FFT 2
+
+// Frame searched for windows containing trained classes, after the channel
+// stage, with its bytes and their squares as doubles, top row first
+typedef struct {
+	uint32_t width;
+	uint32_t height;
+	uint16_t numChannels;
+	double *byteValues;
+	double *squareValues;
+} DetectionFrame;
+
+void freeDetectionFrame(DetectionFrame *frame){
+	free(frame->byteValues);
+	free(frame->squareValues);
+	frame->byteValues = NULL;
+	frame->squareValues = NULL;
+}
+
+// Convert the bytes of a frame that has been through the channel stage
+bool initDetectionFrame(
+		const uint8_t *pixelBytes,
+		uint32_t width,
+		uint32_t height,
+		uint16_t numChannels,
+		DetectionFrame *frame
+		){
+	uintmax_t numBytes = (uintmax_t)width * height * numChannels;
+	frame->width = width;
+	frame->height = height;
+	frame->numChannels = numChannels;
+	frame->byteValues = (double *)malloc(numBytes * sizeof(double));
+	frame->squareValues = (double *)malloc(numBytes * sizeof(double));
+	if(!frame->byteValues || !frame->squareValues){
 		fprintf(
 			stderr,
-			"Error reading offset to data from %s\n",
-			pathToSample
+			"Error allocating memory for a %" PRIu32 "x%" PRIu32
+			" frame\n",
+			width,
+			height
 		       );
-		fclose(sample);
-		fclose(output);
+		freeDetectionFrame(frame);
 		return false;
 	}
-	if(fseek(sample, offsetToSampleData, SEEK_SET) != 0){
+	for(uintmax_t byteNum = 0; byteNum < numBytes; byteNum++){
+		frame->byteValues[byteNum] = pixelBytes[byteNum];
+		frame->squareValues[byteNum] =
+			(double)pixelBytes[byteNum] * pixelBytes[byteNum];
+	}
+	return true;
+}
+
+// Vectors of a model over every byte of a window, with its pixel mask and
+// principal components folded in, so that a window's dot products need no
+// copy of its bytes
+//
+// normWeights is 1 for each byte of the window counted in its norm and 0
+// for each byte dropped by the pixel mask.
+typedef struct {
+	uint32_t width;
+	uint32_t height;
+	uint16_t numChannels;
+	uintmax_t numBytes;
+	uintmax_t numPairs;
+	double *vectors;
+	bool isMasked;
+	double *normWeights;
+} WindowVectors;
+
+void freeWindowVectors(WindowVectors *window){
+	free(window->vectors);
+	free(window->normWeights);
+	window->vectors = NULL;
+	window->normWeights = NULL;
+}
+
+bool initWindowVectors(SvmModel *model, WindowVectors *window){
+	window->width = model->width;
+	window->height = imaxabs(model->height);
+	window->numChannels = getNumChannels(model);
+	window->numBytes =
+		(uintmax_t)window->width * window->height * window->numChannels;
+	window->numPairs = getNumPairs(model->numClasses);
+	window->isMasked = model->pixelMask != NULL;
+	uintmax_t numPixelBytes = getNumPixelBytes(model);
+	window->vectors =
+		(double *)
+		calloc(window->numPairs * window->numBytes, sizeof(double));
+	window->normWeights =
+		(double *)malloc(window->numBytes * sizeof(double));
+	double *keptVector = (double *)malloc(numPixelBytes * sizeof(double));
+	double *denseVectors = getDenseVectors(model);
+	if(
+		!window->vectors ||
+		!window->normWeights ||
+		!keptVector ||
+		!denseVectors
+	  ){
 		fprintf(
 			stderr,
-			"Error seeking to data in %s\n",
-			pathToSample
+			"Error allocating memory for window vectors\n"
 		       );
-		fclose(sample);
-		fclose(output);
+		free(keptVector);
+		free(denseVectors);
+		freeWindowVectors(window);
 		return false;
 	}
 
-	// Seek to top-left pixel
-	uint8_t rowPadding = (4 - width % 4) % 4;
-	uint64_t numRows = (uint64_t)imaxabs(height);
-	if(height > 0){
-		if(fseek(sample, -(width + rowPadding), SEEK_END) != 0){
-			fprintf(
-				stderr,
-				"Error seeking to top-left pixel in "
-				"%s\n",
-				pathToSample
-			       );
-			fclose(sample);
-			fclose(output);
-			return false;
-		}
-	}
-	double dotProduct = 0.0;
-
-	for(uint64_t rowNum = 0; rowNum < numRows; rowNum++){
-		for(uint32_t colNum = 0; colNum < width; colNum++){
+	uintmax_t numPixels = getNumImagePixels(model);
+	for(uintmax_t pixelNum = 0; pixelNum < numPixels; pixelNum++){
+		double isKept =
+			!model->pixelMask ||
+			model->pixelMask[pixelNum >> 3] >> (pixelNum & 7) & 1;
+		for(
+			uint16_t byteNum = 0;
+			byteNum < window->numChannels;
+			byteNum++
+		   )
+			window->normWeights[
+				pixelNum * window->numChannels + byteNum
+				] = isKept;
+	}
+	for(uintmax_t pairNum = 0; pairNum < window->numPairs; pairNum++){
+		// Weights of the bytes kept by the mask, projected back from
+		// the principal components if the model has them
+		const double *dense = denseVectors + pairNum * model->numDims;
+		if(model->numComponents){
+			for(
+				uintmax_t byteNum = 0;
+				byteNum < numPixelBytes;
+				byteNum++
+			   )
+				keptVector[byteNum] = 0.0;
 			for(
-				uint16_t pixelByte = 0;
-				pixelByte < bytesPerPixel;
-				pixelByte++
+				uint32_t componentNum = 0;
+				componentNum < model->numComponents;
+				componentNum++
 			   ){
-				double currentVectorDim;
-				if(
-					!fread(
-						&currentVectorDim,
-						sizeof(double),
-						1,
-						output
-					      )
-				  ){
-					fprintf(
-						stderr,
-						"Error reading double from "
-						"%s\n",
-						pathToOutputFile
-					       );
-					fclose(output);
-					fclose(sample);
-					return false;
-				}
-
-				uint8_t byteValue;
-				if(
-					!fread(
-						&byteValue,
-						1,
-						1,
-						sample
-					      )
-				  ){
-					fprintf(
-						stderr,
-						"Error reading byte from %s\n",
-						pathToSample
-					       );
-					fclose(output);
-					fclose(sample);
-					return false;
-				}
-				dotProduct += 
-					currentVectorDim *
-					byteValue /
-					normDivisor;
-			}
-		}
-		if(height > 0){
-			if(
-				rowNum != numRows - 1 &&
-				fseek(
-					sample, 
-					-(2 * width + rowPadding), 
-					SEEK_CUR
-				      ) != 0
-				){
-				fprintf(
-					stderr,
-					"Error seeking to next row in %s\n",
-					pathToSample
-				       );
-				fclose(output);
-				fclose(sample);
-				return false;
+				const double *component =
+					model->components +
+					componentNum * numPixelBytes;
+				for(
+					uintmax_t byteNum = 0;
+					byteNum < numPixelBytes;
+					byteNum++
+				   )
+					keptVector[byteNum] +=
+						dense[componentNum] *
+						component[byteNum];
 			}
 		}else{
-			if(
-				fseek(
-					sample,
-					rowPadding,
-					SEEK_CUR
-				     ) != 0
-			  ){
-				fprintf(
-					stderr,
-					"Error seeking to next row in %s\n",
-					pathToSample
-				       );
-				fclose(output);
-				fclose(sample);
-				return false;
-			}
+			memcpy(
+				keptVector,
+				dense,
+				numPixelBytes * sizeof(double)
+			      );
+		}
+		double *vector = window->vectors + pairNum * window->numBytes;
+		uintmax_t keptByteNum = 0;
+		for(
+			uintmax_t byteNum = 0;
+			byteNum < window->numBytes;
+			byteNum++
+		   ){
+			if(window->normWeights[byteNum] != 0.0)
+				vector[byteNum] = keptVector[keptByteNum++];
 		}
 	}
+	free(keptVector);
+	free(denseVectors);
+	return true;
+}
 
-	// Return back to beginning vector and sample
-	if(height > 0){
-		if(fseek(sample, -(width + rowPadding), SEEK_END) != 0){
-			fprintf(
-				stderr,
-				"Error seeking to top-left pixel in "
-				"%s\n",
-				pathToSample
-			       );
-			fclose(sample);
-			fclose(output);
-			return false;
-		}
-	}else{
-		if(fseek(sample, offsetToSampleData, SEEK_SET) != 0){
-			fprintf(
-				stderr,
-				"Error returning to start of %s\n",
-				pathToSample
-			       );
-			fclose(sample);
-			fclose(output);
-			return false;
-		}
+double getDenseDotProduct(
+		const double *valuesA,
+		const double *valuesB,
+		uintmax_t numValues
+		){
+	double dotProduct = 0.0;
+	for(uintmax_t valueNum = 0; valueNum < numValues; valueNum++)
+		dotProduct += valuesA[valueNum] * valuesB[valueNum];
+	return dotProduct;
+}
+
+#if X86_SIMD
+__attribute__((target("avx2")))
+double getDenseDotProductAvx2(
+		const double *valuesA,
+		const double *valuesB,
+		uintmax_t numValues
+		){
+	__m256d sums = _mm256_setzero_pd();
+	uintmax_t valueNum = 0;
+	for(; valueNum + 4 <= numValues; valueNum += 4){
+		sums =
+			_mm256_add_pd(
+				sums,
+				_mm256_mul_pd(
+					_mm256_loadu_pd(valuesA + valueNum),
+					_mm256_loadu_pd(valuesB + valueNum)
+					)
+				);
+	}
+	double partialSums[4];
+	_mm256_storeu_pd(partialSums, sums);
+	return
+		partialSums[0] +
+		partialSums[1] +
+		partialSums[2] +
+		partialSums[3] +
+		getDenseDotProduct(
+			valuesA + valueNum,
+			valuesB + valueNum,
+			numValues - valueNum
+			);
+}
+#endif
+
+// Raw dot products of every pair's window vector with the windows of a
+// frame whose top left pixels are stride pixels apart, and the norm divisor
+// of each window
+typedef struct {
+	uint32_t stride;
+	uint32_t numColumns;
+	uint32_t numRows;
+	uintmax_t numWindows;
+	// numWindows per pair, row of windows by row
+	double *dotProducts;
+	double *normDivisors;
+} WindowResponses;
+
+void freeWindowResponses(WindowResponses *responses){
+	free(responses->dotProducts);
+	free(responses->normDivisors);
+	responses->dotProducts = NULL;
+	responses->normDivisors = NULL;
+}
+
+bool initWindowResponses(
+		const DetectionFrame *frame,
+		const WindowVectors *window,
+		uint32_t stride,
+		WindowResponses *responses
+		){
+	responses->stride = stride;
+	responses->numColumns = (frame->width - window->width) / stride + 1;
+	responses->numRows = (frame->height - window->height) / stride + 1;
+	responses->numWindows =
+		(uintmax_t)responses->numColumns * responses->numRows;
+	responses->dotProducts =
+		(double *)
+		malloc(
+			window->numPairs *
+			responses->numWindows *
+			sizeof(double)
+		      );
+	responses->normDivisors =
+		(double *)malloc(responses->numWindows * sizeof(double));
+	if(!responses->dotProducts || !responses->normDivisors){
+		fprintf(
+			stderr,
+			"Error allocating memory for the scores of %ju "
+			"windows\n",
+			responses->numWindows
+		       );
+		freeWindowResponses(responses);
+		return false;
 	}
+	return true;
+}
+
+// Score every window by taking its dot products row by row straight from the
+// frame's bytes, along with its norm if the window vectors are masked
+void getWindowResponsesDirect(
+		const DetectionFrame *frame,
+		const WindowVectors *window,
+		WindowResponses *responses
+		){
+	double (*getDotProduct)(const double *, const double *, uintmax_t) =
+		getDenseDotProduct;
+#if X86_SIMD
+	if(__builtin_cpu_supports("avx2"))
+		getDotProduct = getDenseDotProductAvx2;
+#endif
+	uintmax_t frameRowBytes = (uintmax_t)frame->width * frame->numChannels;
+	uintmax_t windowRowBytes =
+		(uintmax_t)window->width * window->numChannels;
 	for(
-		uint64_t vectorDim = 0; 
-		vectorDim < numPixels;
-		vectorDim++
+		uintmax_t windowNum = 0;
+		windowNum < responses->numWindows;
+		windowNum++
 	   ){
+		uintmax_t firstByte =
+			(windowNum / responses->numColumns) *
+			responses->stride *
+			frameRowBytes +
+			(windowNum % responses->numColumns) *
+			responses->stride *
+			frame->numChannels;
+		if(window->isMasked){
+			double sumSquares = 0.0;
+			for(
+				uint32_t rowNum = 0;
+				rowNum < window->height;
+				rowNum++
+			   ){
+				sumSquares +=
+					getDotProduct(
+						window->normWeights +
+						rowNum * windowRowBytes,
+						frame->squareValues +
+						firstByte +
+						rowNum * frameRowBytes,
+						windowRowBytes
+						);
+			}
+			responses->normDivisors[windowNum] = sqrt(sumSquares);
+		}
 		for(
-			uint16_t pixelByte = 0;
-			pixelByte < bytesPerPixel;
-			pixelByte++
+			uintmax_t pairNum = 0;
+			pairNum < window->numPairs;
+			pairNum++
 		   ){
-			if(
-				fseek(
-					output, 
-					-sizeof(double), 
-					SEEK_CUR
-				     ) != 0
-			){
-				fprintf(
-					stderr,
-					"Error returning to start of vector "
-					"in %s\n",
-					pathToOutputFile
-				       );
-				fclose(output);
-				fclose(sample);
-				return false;
+			const double *vector =
+				window->vectors + pairNum * window->numBytes;
+			double dotProduct = 0.0;
+			for(
+				uint32_t rowNum = 0;
+				rowNum < window->height;
+				rowNum++
+			   ){
+				dotProduct +=
+					getDotProduct(
+						vector +
+						rowNum * windowRowBytes,
+						frame->byteValues +
+						firstByte +
+						rowNum * frameRowBytes,
+						windowRowBytes
+						);
 			}
+			responses->dotProducts[
+				pairNum * responses->numWindows + windowNum
+				] = dotProduct;
 		}
 	}
+}
 
-	if(!isPositiveSample)
-		dotProduct = -dotProduct;
-
-	if(dotProduct < 1.0){
-		if(DEBUG_LEVEL < 1){
-			fprintf(
-				stderr,
-				"\t\t\tDot Product = %lf: Redirecting Vector\n",
-				isPositiveSample? dotProduct : -dotProduct
-			       );
-		}
-		for(uint64_t rowNum = 0; rowNum < numRows; rowNum++){
-			for(uint32_t colNum = 0; colNum < width; colNum++){
-				for(
-					uint16_t pixelByte = 0;
-					pixelByte < bytesPerPixel;
-					pixelByte++
-				   ){
-					double vectorDim;
-					if(
-						!fread(
-							&vectorDim,
-							sizeof(double),
-							1,
-							output
-						     )
-					  ){
-						fprintf(
-							stderr,
-							"Error reading double "
-							"from %s\n",
-							pathToOutputFile
-						       );
-						fclose(output);
-						fclose(sample);
-						return false;
-					}
-					uint8_t byteValue;
-					if(
-						!fread(
-							&byteValue,
-							1,
-							1,
-							sample
-						     )
-					  ){
-						fprintf(
-							stderr,
-							"Error reading byte "
-							"from %s\n",
-							pathToSample
-						       );
-						fclose(output);
-						fclose(sample);
-						return false;
-					}
-					vectorDim -=
-						learnRate *
-						(
-						(LAMBDA * vectorDim) - 
-						(isPositiveSample ?
-						(byteValue / normDivisor) :
-						-(byteValue / normDivisor)
-						)
-						);
-					if(
-						fseek(
-							output,
-							-sizeof(double),
-							SEEK_CUR
-						     ) != 0 ||
-						!fwrite(
-							&vectorDim,
-							sizeof(double),
-							1,
-							output
-						      )
-					  ){
-						fprintf(
-							stderr,
-							"Error overwriting "
-							"double in %s\n",
-							pathToOutputFile
-						       );
-						fclose(output);
-						fclose(sample);
-						return false;
-					}
+// Precomputed bit reversal and twiddle factors of a radix-2 FFT of size
+// numPoints, a power of 2
+typedef struct {
+	uint32_t numPoints;
+	uint32_t *bitReversed;
+	double *cosines;
+	double *sines;
+} FftPlan;
 
-				}
-			}
-			if(height > 0){
-				if(
-					rowNum != numRows - 1 &&
-					fseek(
-						sample, 
-						-1 *
-						2 * 
-						width - 
-						rowPadding, 
-						SEEK_CUR
-					      ) != 0
-					){
-					fprintf(
-						stderr,
-						"Error seeking to "
-						"next row in %s\n",
-						pathToSample
-					       );
-					fclose(output);
-					fclose(sample);
-					return false;
-				}
-			}else{
-				if(
-					fseek(
-						sample,
-						rowPadding,
-						SEEK_CUR
-					     ) != 0
-				  ){
-					fprintf(
-						stderr,
-						"Error seeking to "
-						"next row in %s\n",
-						pathToSample
-					       );
-					fclose(output);
-					fclose(sample);
-					return false;
-				}
-			}
-		}
-	}else{
-		if(DEBUG_LEVEL < 1){
-			fprintf(
-				stderr,
-				"\t\t\tDot Product = %lf: Shrinking Vector\n",
-				isPositiveSample ? dotProduct : -dotProduct
-			       );
-		}
-		for(uint64_t rowNum = 0; rowNum < numRows; rowNum++){
-			for(uint32_t colNum = 0; colNum < width; colNum++){
-				for(
-					uint16_t pixelByte = 0;
-					pixelByte < bytesPerPixel;
-					pixelByte++
-				   ){
-					double vectorDim;
-					if(
-						!fread(
-							&vectorDim,
-							sizeof(double),
-							1,
-							output
-						     )
-					  ){
-						fprintf(
-							stderr,
-							"Error reading double "
-							"from %s\n",
-							pathToOutputFile
-						       );
-						fclose(output);
-						fclose(sample);
-						return false;
-					}
-					vectorDim -=
-						learnRate *
-						LAMBDA * 
-						vectorDim;
-					if(
-						fseek(
-							output,
-							-sizeof(double),
-							SEEK_CUR
-						     ) != 0 ||
-						!fwrite(
-							&vectorDim,
-							sizeof(double),
-							1,
-							output
-						      )
-					  ){
-						fprintf(
-							stderr,
-							"Error overwriting "
-							"double in %s\n",
-							pathToOutputFile
-						       );
-						fclose(output);
-						fclose(sample);
-						return false;
-					}
+void freeFftPlan(FftPlan *plan){
+	free(plan->bitReversed);
+	free(plan->cosines);
+	free(plan->sines);
+	plan->numPoints = 0;
+	plan->bitReversed = NULL;
+	plan->cosines = NULL;
+	plan->sines = NULL;
+}
 
-				}
-			}
-		}
-	}
-	if(fclose(sample) != 0){
+bool initFftPlan(FftPlan *plan, uint32_t numPoints){
+	plan->numPoints = numPoints;
+	plan->bitReversed = (uint32_t *)malloc(numPoints * sizeof(uint32_t));
+	plan->cosines = (double *)malloc((numPoints / 2 + 1) * sizeof(double));
+	plan->sines = (double *)malloc((numPoints / 2 + 1) * sizeof(double));
+	if(!plan->bitReversed || !plan->cosines || !plan->sines){
 		fprintf(
 			stderr,
-			"Error closing %s\n",
-			pathToSample
+			"Error allocating memory for an FFT of %" PRIu32
+			" points\n",
+			numPoints
 		       );
-		fclose(output);
+		freeFftPlan(plan);
 		return false;
 	}
-	if(fclose(output) != 0){
-		fprintf(
-			stderr,
-			"Error closing %s\n",
-			pathToOutputFile
-		       );
-		return false;
+	uint32_t numBits = __builtin_ctz(numPoints);
+	for(uint32_t pointNum = 0; pointNum < numPoints; pointNum++){
+		uint32_t reversed = 0;
+		for(uint32_t bitNum = 0; bitNum < numBits; bitNum++)
+			reversed = reversed << 1 | (pointNum >> bitNum & 1);
+		plan->bitReversed[pointNum] = reversed;
+	}
+	for(uint32_t pointNum = 0; pointNum <= numPoints / 2; pointNum++){
+		double angle = 2.0 * M_PI * pointNum / numPoints;
+		plan->cosines[pointNum] = cos(angle);
+		plan->sines[pointNum] = sin(angle);
 	}
 	return true;
 }
 
-bool trainVectorsWithSample(
-		char *pathToOutputFile,
-		char *pathToSample,
-		uintmax_t offsetToVectors,
-		uint64_t classNum,
-		uint64_t numClasses,
-		double learnRate
-		){
-	
-	//Get required information from sample
-	double normDivisor = getNormDivisor(pathToSample);
+// Transform numPoints complex values in place, without scaling the inverse
+void transformFft(
+		const FftPlan *plan,
+		double *real,
+		double *imag,
+		bool isInverse
+		){
+	uint32_t numPoints = plan->numPoints;
+	for(uint32_t pointNum = 0; pointNum < numPoints; pointNum++){
+		uint32_t reversed = plan->bitReversed[pointNum];
+		if(reversed <= pointNum)
+			continue;
+		double swap = real[pointNum];
+		real[pointNum] = real[reversed];
+		real[reversed] = swap;
+		swap = imag[pointNum];
+		imag[pointNum] = imag[reversed];
+		imag[reversed] = swap;
+	}
+	double sign = isInverse ? 1.0 : -1.0;
+	for(uint32_t length = 2; length <= numPoints; length <<= 1){
+		uint32_t half = length / 2;
+		uint32_t twiddleStep = numPoints / length;
+		for(uint32_t start = 0; start < numPoints; start += length){
+			for(uint32_t pointNum = 0; pointNum < half; pointNum++){
+				uint32_t twiddleNum = pointNum * twiddleStep;
+				double cosine = plan->cosines[twiddleNum];
+				double sine = sign * plan->sines[twiddleNum];
+				uint32_t a = start + pointNum;
+				uint32_t b = a + half;
+				double productReal =
+					cosine * real[b] - sine * imag[b];
+				double productImag =
+					cosine * imag[b] + sine * real[b];
+				real[b] = real[a] - productReal;
+				imag[b] = imag[a] - productImag;
+				real[a] += productReal;
+				imag[a] += productImag;
+			}
+		}
+	}
+}
+
+// Plans and buffers for correlating frames with window vectors by FFT, kept
+// between frames so that frames of the same padded size share them
+//
+// Each buffer holds numRows rows of numColumns complex values, as separate
+// real and imaginary parts, except the column buffers, which hold
+// FFT_COLUMN_BLOCK columns one after another.
+#define FFT_COLUMN_BLOCK 8
+typedef struct {
+	uint32_t numRows;
+	uint32_t numColumns;
+	FftPlan rowPlan;
+	FftPlan columnPlan;
+	uintmax_t capacity;
+	double *frameReal;
+	double *frameImag;
+	double *workReal;
+	double *workImag;
+	double *columnReal;
+	double *columnImag;
+} FftWorkspace;
 
-	if(DEBUG_LEVEL < 1){
-		fprintf(
-			stderr,
-			"\tDebug: Sample Magnitude = %lf\n",
-			normDivisor
-		       );
-	}
+void initFftWorkspace(FftWorkspace *workspace){
+	memset(workspace, 0, sizeof(FftWorkspace));
+}
 
-	if(normDivisor <= 0){
-		// Exit upon error
-		if(normDivisor < 0){
-			fprintf(
-				stderr,
-				"Error obtaining the norm divisor for %s\n",
-				pathToSample
-			       );
-			return false;
-		}
+void freeFftWorkspace(FftWorkspace *workspace){
+	freeFftPlan(&workspace->rowPlan);
+	freeFftPlan(&workspace->columnPlan);
+	free(workspace->frameReal);
+	free(workspace->frameImag);
+	free(workspace->workReal);
+	free(workspace->workImag);
+	free(workspace->columnReal);
+	free(workspace->columnImag);
+	initFftWorkspace(workspace);
+}
 
-		// Vectors remain unchanged if all bytes equal 0
-		return true;
-	}
+uint32_t getFftSize(uintmax_t minPoints){
+	uint32_t numPoints = 1;
+	while(numPoints < minPoints)
+		numPoints <<= 1;
+	return numPoints;
+}
 
-	uintmax_t offsetVectors = 0;
-	// Point offset to first negative vector and train
-	if(classNum != 0){
-		offsetVectors = classNum - 1;
-		if(
-			!trainVectorWithSample(
-				pathToOutputFile,
-				pathToSample,
-				offsetVectors,
-				offsetToVectors,
-				normDivisor,
-				learnRate,
-				false
-				)
-		  ){
-			fprintf(
-				stderr,
-				"Error training sample\n"
-			       );
+// Size a workspace for numRows rows of numColumns values, rebuilding plans
+// only when the padded size changes and buffers only when they grow
+bool prepareFftWorkspace(
+		FftWorkspace *workspace,
+		uint32_t numRows,
+		uint32_t numColumns
+		){
+	if(workspace->rowPlan.numPoints != numColumns){
+		freeFftPlan(&workspace->rowPlan);
+		if(!initFftPlan(&workspace->rowPlan, numColumns))
 			return false;
-		}
 	}
-
-	// Train the rest of the negative vectors
-	for(uintmax_t iterNum = 1; iterNum < classNum; iterNum++){
-		if(offsetVectors > offsetVectors + numClasses - 1 - iterNum){
-			fprintf(
-				stderr,
-				"Overflow occured during vector offset "
-				"calculation \n"
-			       );
-			return false;
-		}
-		offsetVectors += numClasses - 1 - iterNum;
+	if(workspace->columnPlan.numPoints != numRows){
+		freeFftPlan(&workspace->columnPlan);
+		free(workspace->columnReal);
+		free(workspace->columnImag);
+		workspace->columnReal =
+			(double *)
+			malloc(FFT_COLUMN_BLOCK * numRows * sizeof(double));
+		workspace->columnImag =
+			(double *)
+			malloc(FFT_COLUMN_BLOCK * numRows * sizeof(double));
 		if(
-			!trainVectorWithSample(
-				pathToOutputFile,
-				pathToSample,
-				offsetVectors,
-				offsetToVectors,
-				normDivisor,
-				learnRate,
-				false
-				)
+			!workspace->columnReal ||
+			!workspace->columnImag ||
+			!initFftPlan(&workspace->columnPlan, numRows)
 		  ){
 			fprintf(
 				stderr,
-				"Error training sample\n"
+				"Error allocating memory for FFT columns\n"
 			       );
+			freeFftWorkspace(workspace);
 			return false;
 		}
 	}
+	workspace->numRows = numRows;
+	workspace->numColumns = numColumns;
+	uintmax_t numValues = (uintmax_t)numRows * numColumns;
+	if(numValues <= workspace->capacity)
+		return true;
+	free(workspace->frameReal);
+	free(workspace->frameImag);
+	free(workspace->workReal);
+	free(workspace->workImag);
+	workspace->frameReal = (double *)malloc(numValues * sizeof(double));
+	workspace->frameImag = (double *)malloc(numValues * sizeof(double));
+	workspace->workReal = (double *)malloc(numValues * sizeof(double));
+	workspace->workImag = (double *)malloc(numValues * sizeof(double));
+	if(
+		!workspace->frameReal ||
+		!workspace->frameImag ||
+		!workspace->workReal ||
+		!workspace->workImag
+	  ){
+		fprintf(
+			stderr,
+			"Error allocating memory for FFTs of %" PRIu32 "x%"
+			PRIu32 " values\n",
+			numColumns,
+			numRows
+		       );
+		freeFftWorkspace(workspace);
+		return false;
+	}
+	workspace->capacity = numValues;
+	return true;
+}
 
-	// Find offset to first positive vector
-	if(classNum != 0){
-		if(offsetVectors > offsetVectors + (numClasses - classNum)){
-			fprintf(
-				stderr,
-				"Overflow occured seeking to first positive "
-				"vector\n"
-			       );
-			return false;
+// Transform a buffer of the workspace in two dimensions
+//
+// Forward transforms only take the first numRows rows through the row
+// pass, as later rows must be 0, and inverse transforms only take the first
+// numRows rows through it, as later rows aren't needed.
+void transformFft2d(
+		FftWorkspace *workspace,
+		double *real,
+		double *imag,
+		uint32_t numRows,
+		bool isInverse
+		){
+	uint32_t numColumns = workspace->numColumns;
+	if(!isInverse){
+		for(uint32_t rowNum = 0; rowNum < numRows; rowNum++){
+			transformFft(
+				&workspace->rowPlan,
+				real + (uintmax_t)rowNum * numColumns,
+				imag + (uintmax_t)rowNum * numColumns,
+				false
+				);
 		}
-		offsetVectors += numClasses - classNum;
 	}
-
-	// Train positive vectors
+	// Columns are gathered a block at a time, so that each row is read a
+	// cache line at a time rather than a value at a time
+	uint32_t blockWidth =
+		numColumns < FFT_COLUMN_BLOCK ? numColumns : FFT_COLUMN_BLOCK;
+	uint32_t columnSize = workspace->numRows;
+	double *blockReal = workspace->columnReal;
+	double *blockImag = workspace->columnImag;
 	for(
-		uintmax_t posVectorNum = 0; 
-		posVectorNum < numClasses - 1 - classNum; 
-		posVectorNum++){
-		if(
-			!trainVectorWithSample(
-				pathToOutputFile,
-				pathToSample,
-				offsetVectors,
-				offsetToVectors,
-				normDivisor,
-				learnRate,
+		uint32_t firstColumn = 0;
+		firstColumn < numColumns;
+		firstColumn += blockWidth
+	   ){
+		for(uint32_t rowNum = 0; rowNum < columnSize; rowNum++){
+			uintmax_t firstValue =
+				(uintmax_t)rowNum * numColumns + firstColumn;
+			for(uint32_t offset = 0; offset < blockWidth; offset++){
+				uintmax_t blockNum =
+					(uintmax_t)offset * columnSize + rowNum;
+				blockReal[blockNum] = real[firstValue + offset];
+				blockImag[blockNum] = imag[firstValue + offset];
+			}
+		}
+		for(uint32_t offset = 0; offset < blockWidth; offset++){
+			transformFft(
+				&workspace->columnPlan,
+				blockReal + (uintmax_t)offset * columnSize,
+				blockImag + (uintmax_t)offset * columnSize,
+				isInverse
+				);
+		}
+		for(uint32_t rowNum = 0; rowNum < columnSize; rowNum++){
+			uintmax_t firstValue =
+				(uintmax_t)rowNum * numColumns + firstColumn;
+			for(uint32_t offset = 0; offset < blockWidth; offset++){
+				uintmax_t blockNum =
+					(uintmax_t)offset * columnSize + rowNum;
+				real[firstValue + offset] = blockReal[blockNum];
+				imag[firstValue + offset] = blockImag[blockNum];
+			}
+		}
+	}
+	if(isInverse){
+		for(uint32_t rowNum = 0; rowNum < numRows; rowNum++){
+			transformFft(
+				&workspace->rowPlan,
+				real + (uintmax_t)rowNum * numColumns,
+				imag + (uintmax_t)rowNum * numColumns,
 				true
-				)
-		  ){
-			fprintf(
-				stderr,
-				"Error training positive sample\n"
-			       );
-			return false;
+				);
 		}
-		offsetVectors++;
 	}
-	return true;
 }
 
-// Function to clean up class stored class names
-void freeClassNames(char **classNames, uint64_t numClasses){
-	for(uint64_t classNum = 0; classNum < numClasses; classNum++){
-		if(classNames[classNum] != NULL){
-			free(classNames[classNum]);
-			classNames[classNum] = NULL;
+// Load numRows rows of rowLength values into the real part of a buffer, and
+// the same rows of another set of values, or zeros if NULL, into its
+// imaginary part, padding both with zeros
+void loadFftBuffer(
+		const FftWorkspace *workspace,
+		const double *realValues,
+		const double *imagValues,
+		uint32_t numRows,
+		uintmax_t rowLength,
+		uintmax_t rowStride,
+		double *real,
+		double *imag
+		){
+	uintmax_t numValues =
+		(uintmax_t)workspace->numRows * workspace->numColumns;
+	memset(real, 0, numValues * sizeof(double));
+	memset(imag, 0, numValues * sizeof(double));
+	for(uint32_t rowNum = 0; rowNum < numRows; rowNum++){
+		uintmax_t rowStart = (uintmax_t)rowNum * workspace->numColumns;
+		memcpy(
+			real + rowStart,
+			realValues + rowNum * rowStride,
+			rowLength * sizeof(double)
+		      );
+		if(imagValues){
+			memcpy(
+				imag + rowStart,
+				imagValues + rowNum * rowStride,
+				rowLength * sizeof(double)
+			      );
 		}
 	}
-	free(classNames);
-	classNames = NULL;
 }
 
-// Use the contents of the directory to make the output SVM file
-bool createSvmFromDir(
-		char *pathToInputDir,
-		char *pathToOutputFile
+// Multiply the transform of a real frame by the transform of a window
+// vector reversed in both dimensions, in place of the latter
+//
+// Reversing z turns its transform Z[k] into Z[-k], so that the inverse of
+// F[k] Z[-k] is the correlation of the frame with z. With z holding one
+// real vector in its real part and another in its imaginary part, the real
+// and imaginary parts of the correlation are those of each vector.
+void multiplyReversedSpectrum(
+		const FftWorkspace *workspace,
+		double *real,
+		double *imag
 		){
-
-
-	// Initialize output file with metadata and vectors of magnitude 0
-	if(!initializeOutputFile(pathToInputDir, pathToOutputFile)){
-		fprintf(
-			stderr,
-			"Error writing initial output file %s\n",
-			pathToOutputFile
-		       );
-		return false;
+	uint32_t numRows = workspace->numRows;
+	uint32_t numColumns = workspace->numColumns;
+	for(uint32_t rowNum = 0; rowNum < numRows; rowNum++){
+		uint32_t reversedRow = (numRows - rowNum) & (numRows - 1);
+		for(
+			uint32_t columnNum = 0;
+			columnNum < numColumns;
+			columnNum++
+		   ){
+			uint32_t reversedColumn =
+				(numColumns - columnNum) & (numColumns - 1);
+			uintmax_t a =
+				(uintmax_t)rowNum * numColumns + columnNum;
+			uintmax_t b =
+				(uintmax_t)reversedRow * numColumns +
+				reversedColumn;
+			// Each pair of values is handled once, from its
+			// first value
+			if(b < a)
+				continue;
+			double realA = real[a];
+			double imagA = imag[a];
+			double realB = real[b];
+			double imagB = imag[b];
+			real[a] =
+				workspace->frameReal[a] * realB -
+				workspace->frameImag[a] * imagB;
+			imag[a] =
+				workspace->frameReal[a] * imagB +
+				workspace->frameImag[a] * realB;
+			if(b == a)
+				continue;
+			real[b] =
+				workspace->frameReal[b] * realA -
+				workspace->frameImag[b] * imagA;
+			imag[b] =
+				workspace->frameReal[b] * imagA +
+				workspace->frameImag[b] * realA;
+		}
 	}
+}
 
-	// Get class names from initialized file
-	uint64_t numClasses;
-	char **classNames = 
-		getClassNamesFromFile
-		(
-			pathToOutputFile, 
-			&numClasses
-		);
-	if(!classNames){
+// Find the norm divisor of every window from a summed-area table of the
+// squares of the frame's bytes, where the window vectors keep every byte
+bool getWindowNormsFromTable(
+		const DetectionFrame *frame,
+		const WindowVectors *window,
+		WindowResponses *responses
+		){
+	uintmax_t tableWidth = (uintmax_t)frame->width + 1;
+	uint64_t *table =
+		(uint64_t *)
+		calloc(tableWidth * (frame->height + 1), sizeof(uint64_t));
+	if(!table){
 		fprintf(
 			stderr,
-			"Error reading classes from initialized output file "
-			"%s\n",
-			pathToOutputFile
+			"Error allocating memory for a summed-area table\n"
 		       );
 		return false;
 	}
-
-	if(DEBUG_LEVEL < 1){
-		for(uint64_t classNum = 0; classNum < numClasses; classNum++){
-			fprintf(
-				stderr,
-				"Class Number %d: %s\n",
-				classNum,
-				classNames[classNum]
-			       );
+	const double *squareValue = frame->squareValues;
+	for(uint32_t rowNum = 0; rowNum < frame->height; rowNum++){
+		uint64_t rowSum = 0;
+		for(
+			uint32_t columnNum = 0;
+			columnNum < frame->width;
+			columnNum++
+		   ){
+			for(
+				uint16_t byteNum = 0;
+				byteNum < frame->numChannels;
+				byteNum++
+			   )
+				rowSum += (uint64_t)*squareValue++;
+			table[(rowNum + 1) * tableWidth + columnNum + 1] =
+				table[rowNum * tableWidth + columnNum + 1] +
+				rowSum;
 		}
 	}
+	for(
+		uintmax_t windowNum = 0;
+		windowNum < responses->numWindows;
+		windowNum++
+	   ){
+		uintmax_t top =
+			(windowNum / responses->numColumns) * responses->stride;
+		uintmax_t left =
+			(windowNum % responses->numColumns) * responses->stride;
+		uintmax_t bottom = top + window->height;
+		uintmax_t right = left + window->width;
+		uint64_t sumSquares =
+			table[bottom * tableWidth + right] -
+			table[top * tableWidth + right] -
+			table[bottom * tableWidth + left] +
+			table[top * tableWidth + left];
+		responses->normDivisors[windowNum] = sqrt((double)sumSquares);
+	}
+	free(table);
+	return true;
+}
 
-	// Get number of samples in each directory
-	uintmax_t *filecounts = 
-		(uintmax_t *)
-		malloc(numClasses * sizeof(uintmax_t));
-	if(!filecounts){
-		fprintf(
-			stderr,
-			"Error allocating memory to hold number of samples in "
-			"each class\n"
-		       );
-		freeClassNames(classNames, numClasses);
+// Score every window by correlating the frame with the window vectors of two
+// pairs at a time, using one forward and one inverse transform for both
+bool getWindowResponsesFft(
+		const DetectionFrame *frame,
+		const WindowVectors *window,
+		FftWorkspace *workspace,
+		WindowResponses *responses
+		){
+	uintmax_t frameRowBytes = (uintmax_t)frame->width * frame->numChannels;
+	uintmax_t windowRowBytes =
+		(uintmax_t)window->width * window->numChannels;
+	if(
+		frameRowBytes > UINT32_MAX / 2 ||
+		!prepareFftWorkspace(
+			workspace,
+			getFftSize(frame->height),
+			getFftSize(frameRowBytes)
+			)
+	  )
 		return false;
-	}
-	for(uint64_t classNum = 0; classNum < numClasses; classNum++){
-		char *pathToClassDir = 
-			(char *)
-			malloc(
-				strlen(pathToInputDir) +
-				strlen(classNames[classNum]) +
-				2
-			      );
-		if(!pathToClassDir){
-			fprintf(
-				stderr,
-				"Error allocating memory for path to "
-				"class directory\n"
-			       );
-			freeClassNames(classNames, numClasses);
-			free(filecounts);
-			free(pathToClassDir);
-			return false;
-		}
+	uint32_t numOutputRows =
+		(responses->numRows - 1) * responses->stride + 1;
+	double scale =
+		1.0 / ((double)workspace->numRows * workspace->numColumns);
 
-		strcpy(pathToClassDir, pathToInputDir);
-		strcat(pathToClassDir, "/");
-		strcat(pathToClassDir, classNames[classNum]);
-
-		filecounts[classNum] = getNumSamples(pathToClassDir);
-		if(!filecounts[classNum]){
-			fprintf(
-				stderr,
-				"Error getting number of samples in %s: "
-				"Unable to read or directory is empty\n",
-				classNum
-			       );
-			free(filecounts);
-			free(pathToClassDir);
-			freeClassNames(classNames, numClasses);
-			return false;
+	// Sums of squares of the bytes kept by the pixel mask in each window,
+	// rounded to the integers they are
+	if(window->isMasked){
+		loadFftBuffer(
+			workspace,
+			frame->squareValues,
+			NULL,
+			frame->height,
+			frameRowBytes,
+			frameRowBytes,
+			workspace->frameReal,
+			workspace->frameImag
+			);
+		transformFft2d(
+			workspace,
+			workspace->frameReal,
+			workspace->frameImag,
+			frame->height,
+			false
+			);
+		loadFftBuffer(
+			workspace,
+			window->normWeights,
+			NULL,
+			window->height,
+			windowRowBytes,
+			windowRowBytes,
+			workspace->workReal,
+			workspace->workImag
+			);
+		transformFft2d(
+			workspace,
+			workspace->workReal,
+			workspace->workImag,
+			window->height,
+			false
+			);
+		multiplyReversedSpectrum(
+			workspace,
+			workspace->workReal,
+			workspace->workImag
+			);
+		transformFft2d(
+			workspace,
+			workspace->workReal,
+			workspace->workImag,
+			numOutputRows,
+			true
+			);
+		for(
+			uintmax_t windowNum = 0;
+			windowNum < responses->numWindows;
+			windowNum++
+		   ){
+			double sumSquares =
+				round(
+					workspace->workReal[
+						(windowNum /
+						 responses->numColumns) *
+						responses->stride *
+						workspace->numColumns +
+						(windowNum %
+						 responses->numColumns) *
+						responses->stride *
+						window->numChannels
+						] *
+					scale
+				     );
+			responses->normDivisors[windowNum] =
+				sumSquares > 0.0 ? sqrt(sumSquares) : 0.0;
 		}
-		free(pathToClassDir);
 	}
 
-	// Passing offset to avoid expensive syscalls
-	uintmax_t offsetToVectors = 
-		4 * sizeof(char) +
-		sizeof(uint8_t) +
-		sizeof(uint32_t) + 
-		sizeof(int32_t) + 
-		sizeof(uint16_t) + 
-		sizeof(uint64_t) +
-		numClasses;
-	for(uintmax_t classNum = 0; classNum < numClasses; classNum++){
-		offsetToVectors += strlen(classNames[classNum]);
+	loadFftBuffer(
+		workspace,
+		frame->byteValues,
+		NULL,
+		frame->height,
+		frameRowBytes,
+		frameRowBytes,
+		workspace->frameReal,
+		workspace->frameImag
+		);
+	transformFft2d(
+		workspace,
+		workspace->frameReal,
+		workspace->frameImag,
+		frame->height,
+		false
+		);
+	for(uintmax_t pairNum = 0; pairNum < window->numPairs; pairNum += 2){
+		bool hasSecondPair = pairNum + 1 < window->numPairs;
+		loadFftBuffer(
+			workspace,
+			window->vectors + pairNum * window->numBytes,
+			hasSecondPair ?
+			window->vectors + (pairNum + 1) * window->numBytes :
+			NULL,
+			window->height,
+			windowRowBytes,
+			windowRowBytes,
+			workspace->workReal,
+			workspace->workImag
+			);
+		transformFft2d(
+			workspace,
+			workspace->workReal,
+			workspace->workImag,
+			window->height,
+			false
+			);
+		multiplyReversedSpectrum(
+			workspace,
+			workspace->workReal,
+			workspace->workImag
+			);
+		transformFft2d(
+			workspace,
+			workspace->workReal,
+			workspace->workImag,
+			numOutputRows,
+			true
+			);
+		double *dotProducts =
+			responses->dotProducts +
+			pairNum * responses->numWindows;
+		for(
+			uintmax_t windowNum = 0;
+			windowNum < responses->numWindows;
+			windowNum++
+		   ){
+			uintmax_t valueNum =
+				(windowNum / responses->numColumns) *
+				responses->stride *
+				workspace->numColumns +
+				(windowNum % responses->numColumns) *
+				responses->stride *
+				window->numChannels;
+			dotProducts[windowNum] =
+				workspace->workReal[valueNum] * scale;
+			if(hasSecondPair)
+				dotProducts[responses->numWindows + windowNum] =
+					workspace->workImag[valueNum] * scale;
+		}
 	}
+	return true;
+}
 
-	// Commence training
-	if(DEBUG_LEVEL < 2){
+// Whether correlating by FFT is estimated to take less time than direct dot
+// products, counting 5 n log2(n) operations for a complex FFT of n points
+// and weighing each as 3 multiply-adds of a dot product, as the butterflies'
+// strided accesses vectorize far worse than the contiguous dot products
+bool isFftScoringCheaper(
+		const DetectionFrame *frame,
+		const WindowVectors *window,
+		const WindowResponses *responses
+		){
+	uintmax_t numChecks = window->numPairs + window->isMasked;
+	double directCost =
+		(double)responses->numWindows *
+		window->numBytes *
+		numChecks;
+	double numPoints =
+		(double)getFftSize(frame->height) *
+		getFftSize((uintmax_t)frame->width * frame->numChannels);
+	double numTransforms =
+		1 +
+		2 * ((window->numPairs + 1) / 2) +
+		3 * window->isMasked;
+	double numProducts = (window->numPairs + 1) / 2 + window->isMasked;
+	double fftCost =
+		3.0 * (
+			numTransforms * 5.0 * numPoints * log2(numPoints) +
+			6.0 * numPoints * numProducts
+		);
+	if(DEBUG_LEVEL < 1){
 		fprintf(
 			stderr,
-			"Info: Beginning training with %d classes\n",
-			numClasses
+			"\tDebug: Direct scoring costs about %.3g "
+			"multiply-adds, FFT scoring about %.3g\n",
+			directCost,
+			fftCost
 		       );
 	}
-	
-	for(intmax_t stepNum = 0; stepNum < NUM_STEPS; stepNum++){
-		//Set variable training parameters
-		//double learnRate = pow(1 + stepNum, -1);
-		double learnRate = 1.0 / sqrt(stepNum + 1);
-
-		if(DEBUG_LEVEL < 2){
-			if(
-				DEBUG_LEVEL < 1 || 
-				stepNum % STEP_REPORT_INTERVAL == 0
-			){
-				fprintf(
-					stderr,
-					"Info: Step %d of %d in progress\n",
-					stepNum,
-					NUM_STEPS
-				       );
-			}
-		}
-		if(DEBUG_LEVEL < 1){
-			fprintf(
-				stderr,
-				"\tDebug: learn rate = %lf\n",
-				learnRate
-			       );
-		}
-		for(uint64_t classNum = 0; classNum < numClasses; classNum++){
-			if(DEBUG_LEVEL < 1){
-				fprintf(
-					stderr,
-					"\tDebug: Class %d of %d in progress\n",
-					classNum,
-					numClasses
-				       );
-			}
-
-			// Select a random sample for the class and train all
-			// relevant vectors
-
-			char *pathToClassDir = 
-				(char *)
-				malloc(
-					strlen(pathToInputDir) +
-					strlen(classNames[classNum]) +
-					2
-				      );
-			if(!pathToClassDir){
-				fprintf(
-					stderr,
-					"Error allocating memory for path to "
-					"directory of class %s\n",
-					classNames[classNum]
-				       );
-				free(filecounts);
-				freeClassNames(classNames, numClasses);
-				return false;
-			}
-
-			strcpy(pathToClassDir, pathToInputDir);
-			strcat(pathToClassDir, "/");
-			strcat(pathToClassDir, classNames[classNum]);
-			char* pathToRandomSample =
-				getPathToRandomSample(
-					pathToClassDir,
-					filecounts[classNum]
-					);
-			if(!pathToRandomSample){
-				fprintf(
-					stderr,
-					"Error getting path to random sample "
-					"for class %s\n",
-					classNames[classNum]
-				       );
-				freeClassNames(classNames, numClasses);
-				free(filecounts);
-				free(pathToClassDir);
-				return false;
-			}
-			free(pathToClassDir);
-
-			if(DEBUG_LEVEL < 1){
-				fprintf(
-					stderr,
-					"\tDebug: Using %s for training\n",
-					pathToRandomSample
-				       );
-			}
-			if(
-				!trainVectorsWithSample(
-					pathToOutputFile,
-					pathToRandomSample,
-					offsetToVectors,
-					classNum,
-					numClasses,
-					learnRate
-					)
-			  ){
-				fprintf(
-					stderr,
-					"Error using %s for training\n",
-					pathToRandomSample
-				       );
-				free(filecounts);
-				free(pathToRandomSample);
-				freeClassNames(classNames, numClasses);
-				return false;
-			}
-			free(pathToRandomSample);
-		}
-	}
-	free(filecounts);
-	freeClassNames(classNames, numClasses);
-	return true;
+	return fftCost < directCost;
 }
 
-// Classify a file using a premade SVM file
-bool classifyFileFromSvm(
-		char *pathToInputFile,
-		char *pathToSvmFile
+// Window of a frame found to contain a class, in pixels of the frame
+typedef struct {
+	uint64_t classNum;
+	uint32_t left;
+	uint32_t top;
+	uint32_t width;
+	uint32_t height;
+	double margin;
+} Detection;
+
+// Find the windows whose votes all go to one class by a margin above the
+// threshold, appending them to detections
+//
+// A window's margin is the smallest of its normalized dot products with
+// the vectors of its class's pairs, signed towards its class.
+bool findDetections(
+		const SvmModel *model,
+		const WindowVectors *window,
+		const WindowResponses *responses,
+		double threshold,
+		Detection **detections,
+		uintmax_t *numDetections,
+		uintmax_t *detectionCapacity
 		){
+	uint64_t backgroundClass = model->numClasses;
+	for(uint64_t classNum = 0; classNum < model->numClasses; classNum++){
+		if(strcmp(model->classNames[classNum], DETECT_BACKGROUND) == 0)
+			backgroundClass = classNum;
+	}
+	for(
+		uintmax_t windowNum = 0;
+		windowNum < responses->numWindows;
+		windowNum++
+	   ){
+		double normDivisor = responses->normDivisors[windowNum];
+		if(normDivisor == 0.0)
+			continue;
 
-	// Get dot product between vector and normalized sample, given two open
-	// files with read permissions
-	//
-	// Reset to start of sample, but assume that we're pointing to the 
-	// correct vector
-	bool tryGetDotProduct(
-		FILE *svmFile,
-		FILE *sampleFile,
-		double normDivisor,
-		uint64_t numRows,
-		uint32_t offsetToData,
-		uint32_t width,
-		uint16_t bytesPerPixel,
-		uint8_t rowPadding,
-		bool heightIsPositive,
-		double *dotProduct
-		){
-		
-		// Seek to top-left pixel in sample
-		if(!heightIsPositive){
-			if(fseek(sampleFile, offsetToData, SEEK_SET) != 0){
-				fprintf(
-					stderr,
-					"Error seeking to top-left "
-					"pixel in %s\n",
-					pathToInputFile
-				       );
-				return false;
-			}
-		}else{
+		// Only the winner of a knockout between the classes can beat
+		// every other class, so its margin is the only one checked
+		uint64_t windowClass = 0;
+		for(
+			uint64_t otherClass = 1;
+			otherClass < model->numClasses;
+			otherClass++
+		   ){
+			uintmax_t pairNum =
+				getPairIndex(
+					windowClass,
+					otherClass,
+					model->numClasses
+					);
 			if(
-				fseek(
-					sampleFile,
-					-(width + rowPadding),
-					SEEK_END) != 0
-			){
+				responses->dotProducts[
+					pairNum * responses->numWindows +
+					windowNum
+					] <= 0.0
+			  )
+				windowClass = otherClass;
+		}
+		if(windowClass == backgroundClass)
+			continue;
+		double margin = INFINITY;
+		for(
+			uint64_t otherClass = 0;
+			otherClass < model->numClasses && margin > threshold;
+			otherClass++
+		   ){
+			if(otherClass == windowClass)
+				continue;
+			bool isPositive = windowClass < otherClass;
+			uintmax_t pairNum =
+				isPositive ?
+				getPairIndex(
+					windowClass,
+					otherClass,
+					model->numClasses
+					) :
+				getPairIndex(
+					otherClass,
+					windowClass,
+					model->numClasses
+					);
+			double pairMargin =
+				responses->dotProducts[
+					pairNum * responses->numWindows +
+					windowNum
+					] /
+				normDivisor;
+			if(!isPositive)
+				pairMargin = -pairMargin;
+			if(pairMargin < margin)
+				margin = pairMargin;
+		}
+		if(margin <= threshold)
+			continue;
+		if(*numDetections == *detectionCapacity){
+			uintmax_t newCapacity =
+				*detectionCapacity ?
+				2 * *detectionCapacity :
+				64;
+			Detection *newDetections =
+				(Detection *)
+				realloc(
+					*detections,
+					newCapacity * sizeof(Detection)
+				       );
+			if(!newDetections){
 				fprintf(
 					stderr,
-					"Error seeking to top-left "
-					"pixel in %s\n",
-					pathToInputFile
+					"Error allocating memory for %ju "
+					"detections\n",
+					newCapacity
 				       );
 				return false;
 			}
+			*detections = newDetections;
+			*detectionCapacity = newCapacity;
 		}
+		Detection *detection = *detections + *numDetections;
+		detection->classNum = windowClass;
+		detection->left =
+			(windowNum % responses->numColumns) * responses->stride;
+		detection->top =
+			(windowNum / responses->numColumns) * responses->stride;
+		detection->width = window->width;
+		detection->height = window->height;
+		detection->margin = margin;
+		(*numDetections)++;
+	}
+	return true;
+}
 
-		// Find dot product
-		*dotProduct = 0.0;
-		if(normDivisor == 0.0 || normDivisor == -0.0)
-			return true;
-
-		for(uint64_t rowNum = 0; rowNum < numRows; rowNum++){
-			for(
-				uint32_t colNum = 0;
-				colNum < width;
-				colNum++
-			   ){
-				for(
-					uint16_t byteNum = 0;
-					byteNum < bytesPerPixel;
-					byteNum++
-				   ){
-					double vectorDim;
-					if(
-						!fread(
-							&vectorDim,
-							sizeof(double),
-							1,
-							svmFile
-						      )
-					  ){
-						fprintf(
-							stderr,
-							"Error reading "
-							"support vector from "
-							"file\n"
-						       );
-						return false;
-					}
-					uint8_t sampleByteValue;
-					if(
-						!fread(
-							&sampleByteValue,
-							sizeof(uint8_t),
-							1,
-							sampleFile
-						      )
-					  ){
-						fprintf(
-							stderr,
-							"Error reading byte "
-							"from sample file\n"
-						       );
-						return false;
-					}
-					*dotProduct += 
-						vectorDim * 
-						sampleByteValue / 
-						normDivisor;
-				}
-			}
+// Order detections from largest to smallest margin, then from the top left
+int compareDetections(const void *detectionA, const void *detectionB){
+	const Detection *a = (const Detection *)detectionA;
+	const Detection *b = (const Detection *)detectionB;
+	if(a->margin != b->margin)
+		return (a->margin < b->margin) - (a->margin > b->margin);
+	if(a->top != b->top)
+		return (a->top > b->top) - (a->top < b->top);
+	return (a->left > b->left) - (a->left < b->left);
+}
 
-			// Seek to next row if not evaluated last row
-			if(rowNum != numRows - 1){
-				if(!heightIsPositive){
-					if(
-						fseek(
-							sampleFile,
-							rowPadding,
-							SEEK_CUR
-						) != 0
-					  ){
-						fprintf(
-							stderr,
-							"Error seeking past "
-							"row padding in "
-							"sample\n"
-						       );
-						return false;
-					}
-				}else{
-					if(
-						fseek(
-							sampleFile,
-							-1 *
-							2 *
-							(intmax_t)width -
-							rowPadding,
-							SEEK_CUR
-						) != 0
-					  ){
-						fprintf(
-							stderr,
-							"Error seeking to "
-							"next row in sample\n"
-						       );
-						return false;
-					}
-				}
-			}
+// Fraction of the union of two windows covered by both
+double getDetectionOverlap(const Detection *a, const Detection *b){
+	int64_t left = a->left > b->left ? a->left : b->left;
+	int64_t top = a->top > b->top ? a->top : b->top;
+	int64_t right =
+		a->left + a->width < b->left + b->width ?
+		a->left + a->width :
+		b->left + b->width;
+	int64_t bottom =
+		a->top + a->height < b->top + b->height ?
+		a->top + a->height :
+		b->top + b->height;
+	if(right <= left || bottom <= top)
+		return 0.0;
+	double intersection = (double)(right - left) * (bottom - top);
+	double areaA = (double)a->width * a->height;
+	double areaB = (double)b->width * b->height;
+	return intersection / (areaA + areaB - intersection);
+}
 
-		}
+// Drop each detection overlapping a detection of the same class with a
+// larger margin by more than maxOverlap, keeping the rest in order of margin
+//
+// Kept detections are filed in a grid by their top left corners, in cells
+// as large as the largest detection, so that each detection is only compared
+// with the kept ones in cells its window can reach.
+bool suppressDetections(
+		Detection *detections,
+		uintmax_t *numDetections,
+		double maxOverlap
+		){
+	if(*numDetections == 0)
 		return true;
-	}
-	// Check that the paths exist and that we have read permissions
-	if(access(pathToInputFile, F_OK) == 0){
-		if(access(pathToInputFile, R_OK) != 0){
-			fprintf(
-				stderr,
-				"Insufficient permission to read %s\n",
-				pathToInputFile
-			       );
-			return false;
-		}
-	}else{
+	qsort(detections, *numDetections, sizeof(Detection), compareDetections);
+	uint32_t cellWidth = 1;
+	uint32_t cellHeight = 1;
+	uint64_t right = 0;
+	uint64_t bottom = 0;
+	for(
+		uintmax_t detectionNum = 0;
+		detectionNum < *numDetections;
+		detectionNum++
+	   ){
+		const Detection *detection = detections + detectionNum;
+		if(detection->width > cellWidth)
+			cellWidth = detection->width;
+		if(detection->height > cellHeight)
+			cellHeight = detection->height;
+		if((uint64_t)detection->left + detection->width > right)
+			right = (uint64_t)detection->left + detection->width;
+		if((uint64_t)detection->top + detection->height > bottom)
+			bottom = (uint64_t)detection->top + detection->height;
+	}
+	uintmax_t numCellColumns = right / cellWidth + 1;
+	uintmax_t numCells = numCellColumns * (bottom / cellHeight + 1);
+	// Each cell's last kept detection, and each kept detection's previous
+	// one in the same cell, or UINTMAX_MAX
+	uintmax_t *lastInCells =
+		(uintmax_t *)malloc(numCells * sizeof(uintmax_t));
+	uintmax_t *previousInCells =
+		(uintmax_t *)malloc(*numDetections * sizeof(uintmax_t));
+	if(!lastInCells || !previousInCells){
 		fprintf(
 			stderr,
-			"%s does not exist\n",
-			pathToInputFile
+			"Error allocating memory to suppress %ju detections\n",
+			*numDetections
 		       );
+		free(lastInCells);
+		free(previousInCells);
 		return false;
 	}
-	if(access(pathToInputFile, F_OK) == 0){
-		if(access(pathToInputFile, R_OK) != 0){
-			fprintf(
-				stderr,
-				"Insufficient permission to read %s\n",
-				pathToSvmFile
-			       );
-			return false;
+	for(uintmax_t cellNum = 0; cellNum < numCells; cellNum++)
+		lastInCells[cellNum] = UINTMAX_MAX;
+	uintmax_t numKept = 0;
+	for(
+		uintmax_t detectionNum = 0;
+		detectionNum < *numDetections;
+		detectionNum++
+	   ){
+		const Detection *detection = detections + detectionNum;
+		uintmax_t firstColumn = detection->left / cellWidth;
+		uintmax_t firstRow = detection->top / cellHeight;
+		firstColumn -= firstColumn > 0;
+		firstRow -= firstRow > 0;
+		uintmax_t lastColumn =
+			((uint64_t)detection->left + detection->width - 1) /
+			cellWidth;
+		uintmax_t lastRow =
+			((uint64_t)detection->top + detection->height - 1) /
+			cellHeight;
+		bool isSuppressed = false;
+		for(
+			uintmax_t rowNum = firstRow;
+			rowNum <= lastRow && !isSuppressed;
+			rowNum++
+		   ){
+			for(
+				uintmax_t columnNum = firstColumn;
+				columnNum <= lastColumn && !isSuppressed;
+				columnNum++
+			   ){
+				uintmax_t keptNum =
+					lastInCells[
+						rowNum * numCellColumns +
+						columnNum
+					];
+				while(keptNum != UINTMAX_MAX && !isSuppressed){
+					isSuppressed =
+						detections[keptNum].classNum ==
+						detection->classNum &&
+						getDetectionOverlap(
+							detections + keptNum,
+							detection
+							) > maxOverlap;
+					keptNum = previousInCells[keptNum];
+				}
+			}
 		}
-	}else{
+		if(isSuppressed)
+			continue;
+		uintmax_t cellNum =
+			(detection->top / cellHeight) * numCellColumns +
+			detection->left / cellWidth;
+		detections[numKept] = *detection;
+		previousInCells[numKept] = lastInCells[cellNum];
+		lastInCells[cellNum] = numKept;
+		numKept++;
+	}
+	free(lastInCells);
+	free(previousInCells);
+	*numDetections = numKept;
+	return true;
+}
+
+// Level of the image pyramid searched by the detect command, and the windows
+// found in it, in pixels of the original frame
+typedef struct {
+	uint32_t width;
+	uint32_t height;
+	uintmax_t numWindows;
+	bool isScoredByFft;
+	Detection *detections;
+	uintmax_t numDetections;
+	uintmax_t detectionCapacity;
+} PyramidLevel;
+
+// Shared by the threads searching the levels of an image pyramid, which
+// each keep an FFT workspace across the levels they search
+typedef struct {
+	const SvmModel *model;
+	const WindowVectors *window;
+	// After the channel stage, top row first
+	const uint8_t *pixelBytes;
+	uint32_t width;
+	uint32_t height;
+	PyramidLevel *levels;
+	FftWorkspace *workspaces;
+} PyramidSearch;
+
+// Dimensions of each level of the image pyramid of a frame, largest first,
+// keeping the levels at least as large as the model's images
+PyramidLevel *initPyramidLevels(
+		uint32_t width,
+		uint32_t height,
+		const WindowVectors *window,
+		uint32_t *numLevels
+		){
+	// A limit of 0 searches every level that fits a window
+	uint32_t maxLevels = DETECT_MAX_LEVELS;
+	*numLevels = 0;
+	for(
+		double scale = 1.0;
+		(maxLevels == 0 || *numLevels < maxLevels) &&
+		floor(width / scale + 0.5) >= window->width &&
+		floor(height / scale + 0.5) >= window->height;
+		scale *= DETECT_SCALE_STEP
+	   ){
+		(*numLevels)++;
+		if(DETECT_SCALE_STEP <= 1.0)
+			break;
+	}
+	PyramidLevel *levels =
+		(PyramidLevel *)calloc(*numLevels, sizeof(PyramidLevel));
+	if(!levels){
 		fprintf(
 			stderr,
-			"%s does not exist\n",
-			pathToSvmFile
+			"Error allocating memory for %" PRIu32
+			" pyramid levels\n",
+			*numLevels
 		       );
-		return false;
+		return NULL;
 	}
+	double scale = 1.0;
+	for(uint32_t levelNum = 0; levelNum < *numLevels; levelNum++){
+		levels[levelNum].width = (uint32_t)floor(width / scale + 0.5);
+		levels[levelNum].height =
+			(uint32_t)floor(height / scale + 0.5);
+		scale *= DETECT_SCALE_STEP;
+	}
+	return levels;
+}
 
-	// Check that both paths point to regular files
-	struct stat fileStatus;
-	if(stat(pathToInputFile, &fileStatus) != 0){
-		fprintf(
-			stderr,
-			"Error getting status of %s\n",
-			pathToInputFile
-		       );
-		return false;
+void freePyramidLevels(PyramidLevel *levels, uint32_t numLevels){
+	for(uint32_t levelNum = 0; levelNum < numLevels; levelNum++)
+		free(levels[levelNum].detections);
+	free(levels);
+}
+
+// Score the windows of one level of an image pyramid, downscaling the frame
+// to it by area, and find the windows containing a class
+bool searchPyramidLevel(void *context, uintmax_t levelNum, uint32_t threadNum){
+	PyramidSearch *search = (PyramidSearch *)context;
+	const WindowVectors *window = search->window;
+	PyramidLevel *level = search->levels + levelNum;
+	uint8_t *levelBytes = NULL;
+	if(levelNum > 0){
+		levelBytes =
+			resamplePixelBytes(
+				search->pixelBytes,
+				search->width,
+				search->height,
+				window->numChannels,
+				level->width,
+				level->height,
+				window->numChannels,
+				RESAMPLE_AREA
+				);
+		if(!levelBytes)
+			return false;
 	}
-	if(!S_ISREG(fileStatus.st_mode)){
-		fprintf(
-			stderr,
-			"%s is not a regular file",
-			pathToInputFile
-		       );
+	DetectionFrame frame;
+	bool isFrameReady =
+		initDetectionFrame(
+			levelBytes ? levelBytes : search->pixelBytes,
+			level->width,
+			level->height,
+			window->numChannels,
+			&frame
+			);
+	free(levelBytes);
+	if(!isFrameReady)
 		return false;
-	}
-	if(stat(pathToSvmFile, &fileStatus) != 0){
-		fprintf(
-			stderr,
-			"Error getting status of %s\n",
-			pathToSvmFile
-		       );
+	WindowResponses responses;
+	if(!initWindowResponses(&frame, window, DETECT_STRIDE, &responses)){
+		freeDetectionFrame(&frame);
 		return false;
 	}
-	if(!S_ISREG(fileStatus.st_mode)){
-		fprintf(
-			stderr,
-			"%s is not a regular file",
-			pathToSvmFile
-		       );
+	bool useFft =
+		DETECT_SCORING == SCORING_FFT ||
+		(
+		 DETECT_SCORING == SCORING_CHEAPER &&
+		 isFftScoringCheaper(&frame, window, &responses)
+		);
+	if(
+		!window->isMasked &&
+		!getWindowNormsFromTable(&frame, window, &responses)
+	  ){
+		freeWindowResponses(&responses);
+		freeDetectionFrame(&frame);
 		return false;
 	}
+	if(useFft){
+		useFft =
+			getWindowResponsesFft(
+				&frame,
+				window,
+				search->workspaces + threadNum,
+				&responses
+				);
+		if(!useFft && DETECT_SCORING == SCORING_FFT){
+			freeWindowResponses(&responses);
+			freeDetectionFrame(&frame);
+			return false;
+		}
+	}
+	if(!useFft)
+		getWindowResponsesDirect(&frame, window, &responses);
+	freeDetectionFrame(&frame);
+	level->numWindows = responses.numWindows;
+	level->isScoredByFft = useFft;
+	bool isFound =
+		findDetections(
+			search->model,
+			window,
+			&responses,
+			DETECT_THRESHOLD,
+			&level->detections,
+			&level->numDetections,
+			&level->detectionCapacity
+			);
+	freeWindowResponses(&responses);
+	if(!isFound || levelNum == 0)
+		return isFound;
+	double scaleX = (double)search->width / level->width;
+	double scaleY = (double)search->height / level->height;
+	for(
+		uintmax_t detectionNum = 0;
+		detectionNum < level->numDetections;
+		detectionNum++
+	   ){
+		Detection *detection = level->detections + detectionNum;
+		detection->left =
+			(uint32_t)floor(detection->left * scaleX + 0.5);
+		detection->top =
+			(uint32_t)floor(detection->top * scaleY + 0.5);
+		detection->width =
+			(uint32_t)floor(detection->width * scaleX + 0.5);
+		detection->height =
+			(uint32_t)floor(detection->height * scaleY + 0.5);
+	}
+	return true;
+}
 
-	// Verify input file has the correct magic number and get dimensions
-	if(!hasBmpMagicNumber(
-		pathToInputFile
-		)){
+// Slide the window of a premade SVM file over a larger BMP file and over
+// its downscaled levels, reporting the windows found to contain one of its
+// classes
+bool detectInFileFromSvm(
+		char *pathToInputFile,
+		char *pathToSvmFile
+		){
+	SvmModel model;
+	if(!loadSvmModel(pathToSvmFile, &model)){
 		fprintf(
 			stderr,
-			"Could not identify %s as a BMP file\n",
-			pathToInputFile
+			"Error loading %s\n",
+			pathToSvmFile
 		       );
 		return false;
 	}
 	uint32_t width;
 	int32_t height;
 	uint16_t bitsPerPixel;
-	if(!getBmpDims(
+	uint8_t *pixelBytes =
+		decodeBmp(
 			pathToInputFile,
 			&width,
 			&height,
 			&bitsPerPixel
-		      )
-	  ){
+			);
+	if(!pixelBytes){
 		fprintf(
 			stderr,
-			"Error obtaining BMP dimensions from %s\n",
+			"Error decoding %s\n",
 			pathToInputFile
 		       );
+		freeSvmModel(&model);
 		return false;
 	}
-
-	// Verify that SVM file has the appropriate metadata
-	// Verify that Input and SVM files have matching dimensions
-	FILE *svm = fopen(pathToSvmFile, "rb");
-	if(!svm){
+	if(
+		bitsPerPixel != model.bitsPerPixel ||
+		width < model.width ||
+		imaxabs(height) < imaxabs(model.height)
+	  ){
 		fprintf(
 			stderr,
-			"Error opening %s for reading\n",
+			"%s must have %" PRIu16 " bits per pixel and be at "
+			"least %" PRIu32 "x%jd pixels to be searched with %s\n",
+			pathToInputFile,
+			model.bitsPerPixel,
+			model.width,
+			imaxabs(model.height),
 			pathToSvmFile
 		       );
+		free(pixelBytes);
+		freeSvmModel(&model);
 		return false;
 	}
-	char *svmMagicNumber = (char *)malloc(sizeof(char) * 4);
-	if(fread(svmMagicNumber, 1, 4, svm) != 4){
-		fprintf(
-			stderr,
-			"Error reading magic number from %s\n",
-			pathToSvmFile
-		       );
-		fclose(svm);
+	applyChannelStage(
+		&model,
+		pixelBytes,
+		(uintmax_t)width * imaxabs(height)
+		);
+	WindowVectors window;
+	if(!initWindowVectors(&model, &window)){
+		free(pixelBytes);
+		freeSvmModel(&model);
 		return false;
 	}
-	if(strncmp(svmMagicNumber, "NSVM", 4) != 0){
-		fprintf(
-			stderr,
-			"%s does not have the expected magic number",
-			pathToSvmFile
-		       );
-		fclose(svm);
+	uint32_t numLevels;
+	PyramidLevel *levels =
+		initPyramidLevels(width, imaxabs(height), &window, &numLevels);
+	uint32_t numThreads = getNumThreads();
+	if(numThreads > numLevels)
+		numThreads = numLevels;
+	FftWorkspace *workspaces =
+		(FftWorkspace *)malloc(numThreads * sizeof(FftWorkspace));
+	if(!levels || !workspaces){
+		if(!workspaces){
+			fprintf(
+				stderr,
+				"Error allocating memory for %" PRIu32
+				" FFT workspaces\n",
+				numThreads
+			       );
+		}
+		free(levels);
+		free(workspaces);
+		freeWindowVectors(&window);
+		free(pixelBytes);
+		freeSvmModel(&model);
 		return false;
 	}
-	uint8_t doubleSize;
-	if(!fread(&doubleSize, 1, 1, svm)){
-		fprintf(
-			stderr,
-			"Error reading training size of double from %s\n",
-			pathToSvmFile
-		       );
-		fclose(svm);
+	for(uint32_t threadNum = 0; threadNum < numThreads; threadNum++)
+		initFftWorkspace(workspaces + threadNum);
+	PyramidSearch search;
+	search.model = &model;
+	search.window = &window;
+	search.pixelBytes = pixelBytes;
+	search.width = width;
+	search.height = imaxabs(height);
+	search.levels = levels;
+	search.workspaces = workspaces;
+	bool isSearched =
+		runJobsInParallel(
+			numLevels,
+			numThreads,
+			searchPyramidLevel,
+			&search
+			);
+	for(uint32_t threadNum = 0; threadNum < numThreads; threadNum++)
+		freeFftWorkspace(workspaces + threadNum);
+	free(workspaces);
+	freeWindowVectors(&window);
+	free(pixelBytes);
+	if(!isSearched){
+		freePyramidLevels(levels, numLevels);
+		freeSvmModel(&model);
 		return false;
 	}
-	if(doubleSize != sizeof(double)){
+
+	// Windows of every level are suppressed together, so a class is
+	// reported once at the scale it fits best
+	uintmax_t numDetections = 0;
+	for(uint32_t levelNum = 0; levelNum < numLevels; levelNum++)
+		numDetections += levels[levelNum].numDetections;
+	Detection *detections =
+		(Detection *)malloc((numDetections + 1) * sizeof(Detection));
+	if(!detections){
 		fprintf(
 			stderr,
-			"Error: %s was trained on a machine that defines "
-			"a double with a size of %d chars. This machine uses "
-			"%d chars.\n",
-			pathToSvmFile,
-			doubleSize,
-			sizeof(double)
+			"Error allocating memory for %ju detections\n",
+			numDetections
 		       );
-		fclose(svm);
+		freePyramidLevels(levels, numLevels);
+		freeSvmModel(&model);
 		return false;
 	}
-	uint32_t svmWidth;
-	if(!fread(&svmWidth, sizeof(uint32_t), 1, svm)){
-		fprintf(
-			stderr,
-			"Error reading training width from %s\n",
-			pathToSvmFile
-		       );
-		fclose(svm);
-		return false;
+	numDetections = 0;
+	for(uint32_t levelNum = 0; levelNum < numLevels; levelNum++){
+		const PyramidLevel *level = levels + levelNum;
+		if(level->numDetections > 0){
+			memcpy(
+				detections + numDetections,
+				level->detections,
+				level->numDetections * sizeof(Detection)
+			      );
+		}
+		numDetections += level->numDetections;
+		if(DEBUG_LEVEL < 2){
+			fprintf(
+				stderr,
+				"Info: Scored %ju windows of %s at %" PRIu32
+				"x%" PRIu32 " %s\n",
+				level->numWindows,
+				pathToInputFile,
+				level->width,
+				level->height,
+				level->isScoredByFft ? "by FFT" : "directly"
+			       );
+		}
 	}
-	if(svmWidth != width){
-		fprintf(
-			stderr,
-			"%s was trained on files with a width of %d pixels. "
-			"%s has a width of %d pixels.",
-			pathToSvmFile,
-			svmWidth,
-			pathToInputFile,
-			width
-		       );
-		fclose(svm);
+	freePyramidLevels(levels, numLevels);
+	if(!suppressDetections(detections, &numDetections, DETECT_OVERLAP)){
+		free(detections);
+		freeSvmModel(&model);
 		return false;
 	}
-	int32_t svmHeight;
-	if(!fread(&svmHeight, sizeof(int32_t), 1, svm)){
+	fprintf(
+		stdout,
+		"%ju windows of %s contain one of the following classes:\n",
+		numDetections,
+		pathToInputFile
+	       );
+	for(
+		uintmax_t detectionNum = 0;
+		detectionNum < numDetections;
+		detectionNum++
+	   ){
+		const Detection *detection = detections + detectionNum;
 		fprintf(
-			stderr,
-			"Error reading training height from %s\n",
-			pathToSvmFile
+			stdout,
+			"\t%s at %" PRIu32 "x%" PRIu32 "+%" PRIu32 "+%" PRIu32
+			" with a margin of %lf\n",
+			model.classNames[detection->classNum],
+			detection->width,
+			detection->height,
+			detection->left,
+			detection->top,
+			detection->margin
 		       );
-		fclose(svm);
-		return false;
 	}
-	if(imaxabs(svmHeight) != imaxabs(height)){
+	free(detections);
+	freeSvmModel(&model);
+	return true;
+}
+
+// Gate margin of a validation sample, and whether the gate and the full
+// model of a cascade classify it correctly
+typedef struct {
+	double gateMargin;
+	bool isGateCorrect;
+	bool isModelCorrect;
+} CascadeOutcome;
+
+// Order outcomes from largest to smallest gate margin
+int compareCascadeOutcomes(const void *outcomeA, const void *outcomeB){
+	double a = ((const CascadeOutcome *)outcomeA)->gateMargin;
+	double b = ((const CascadeOutcome *)outcomeB)->gateMargin;
+	return (a < b) - (a > b);
+}
+
+// Multiply-adds taken to score a sample with a model, counting its
+// projection onto principal components
+uintmax_t getNumMultiplyAdds(const SvmModel *model){
+	return
+		getNumWeights(model) +
+		(uintmax_t)model->numComponents * getNumPixelBytes(model);
+}
+
+// Score every sample of a validation directory with both models of a
+// cascade, keeping each sample's outcome
+bool getCascadeOutcomes(
+		const SvmModel *gate,
+		const SvmModel *model,
+		char *pathToGateFile,
+		const SampleCache *cache,
+		CascadeOutcome *outcomes
+		){
+	double *features = (double *)malloc(model->numDims * sizeof(double));
+	uintmax_t *vectorsInFavor =
+		(uintmax_t *)malloc(model->numClasses * sizeof(uintmax_t));
+	double *dotProducts =
+		(double *)
+		malloc(getNumPairs(model->numClasses) * sizeof(double));
+	if(!features || !vectorsInFavor || !dotProducts){
 		fprintf(
 			stderr,
-			"%s was trained on files with a height of %d pixels. "
-			"%s has a height of %d pixels.",
-			pathToSvmFile,
-			svmHeight,
-			pathToInputFile,
-			height	
+			"Error allocating memory required for voting "
+			"mechanism\n"
 		       );
-		fclose(svm);
+		free(features);
+		free(vectorsInFavor);
+		free(dotProducts);
 		return false;
 	}
-	uint16_t svmBitsPerPixel;
-	if(!fread(&svmBitsPerPixel, sizeof(uint16_t), 1, svm)){
-		fprintf(
-			stderr,
-			"Error reading training bits per pixel from %s\n",
-			pathToSvmFile
-		       );
-		fclose(svm);
-		return false;
+	for(uint64_t classNum = 0; classNum < cache->numClasses; classNum++){
+		for(
+			uintmax_t sampleNum = cache->classOffsets[classNum];
+			sampleNum < cache->classOffsets[classNum + 1];
+			sampleNum++
+		   ){
+			CascadeOutcome *outcome = outcomes + sampleNum;
+			getSampleFeatures(
+				model,
+				cache->pixelBytes +
+				sampleNum * cache->sampleBytes,
+				cache->normDivisors[sampleNum],
+				features
+				);
+			outcome->isModelCorrect =
+				getVotedClass(
+					model,
+					features,
+					vectorsInFavor,
+					NULL
+					) == classNum;
+
+			// The cache holds samples after the full model's
+			// stages, so the gate decodes its own
+			char *pathToSample = cache->samplePaths[sampleNum];
+			uint32_t width;
+			int32_t height;
+			uint16_t bitsPerPixel;
+			uint8_t *pixelBytes =
+				decodeBmp(
+					pathToSample,
+					&width,
+					&height,
+					&bitsPerPixel
+					);
+			double *gateFeatures =
+				pixelBytes ?
+				getFeaturesForModel(
+					pixelBytes,
+					width,
+					height,
+					bitsPerPixel,
+					gate,
+					RESAMPLE != RESAMPLE_OFF ?
+					RESAMPLE :
+					RESAMPLE_AREA,
+					pathToSample,
+					pathToGateFile
+					) :
+				NULL;
+			if(!gateFeatures){
+				fprintf(
+					stderr,
+					"Error scoring %s with the gate\n",
+					pathToSample
+				       );
+				free(features);
+				free(vectorsInFavor);
+				free(dotProducts);
+				return false;
+			}
+			uint64_t gateClass =
+				getVotedClass(
+					gate,
+					gateFeatures,
+					vectorsInFavor,
+					dotProducts
+					);
+			free(gateFeatures);
+			outcome->isGateCorrect = gateClass == classNum;
+			outcome->gateMargin =
+				getVoteMargin(gate, dotProducts, gateClass);
+		}
 	}
-	if(svmBitsPerPixel != bitsPerPixel){
-		fprintf(
-			stderr,
-			"%s was trained on files with a %d bits per pixel. %s "
-			"has %d bits per pixel.\n",
-			pathToSvmFile,
-			svmBitsPerPixel,
-			pathToInputFile,
-			bitsPerPixel
-		       );
-		fclose(svm);
+	free(features);
+	free(vectorsInFavor);
+	free(dotProducts);
+	return true;
+}
+
+// Combine a gate SVM file, such as one trained on downsampled images or
+// heavily pruned, with a full SVM file of the same classes into a cascade
+// file, in which the full model only scores files that the gate classifies
+// by a margin below a threshold
+//
+// The threshold is calibrated on a validation directory to let the most
+// samples exit at the gate while losing at most CASCADE_MAX_ACCURACY_LOSS
+// percentage points of the full model's accuracy.
+bool createCascade(
+		char *pathToGateFile,
+		char *pathToModelFile,
+		char *pathToValidationDir,
+		char *pathToOutputFile
+		){
+	if(access(pathToOutputFile, F_OK) == 0){
+		if(access(pathToOutputFile, W_OK) != 0){
+			fprintf(
+				stderr,
+				"Insufficient permission to overwrite %s\n",
+				pathToOutputFile
+			       );
+			return false;
+		}
+	}
+	uintmax_t gateSize;
+	uintmax_t modelSize;
+	uint8_t *gateBytes = readFileBytes(pathToGateFile, &gateSize);
+	uint8_t *modelBytes = readFileBytes(pathToModelFile, &modelSize);
+	SvmModel gate;
+	SvmModel model;
+	if(
+		!gateBytes ||
+		!modelBytes ||
+		!parseSvmModel(gateBytes, gateSize, pathToGateFile, &gate)
+	  ){
+		free(gateBytes);
+		free(modelBytes);
 		return false;
 	}
-	uint64_t numClasses;
-	char **classNames = getClassNamesFromFile(pathToSvmFile, &numClasses);
-	if(!classNames){
-		fprintf(
-			stderr,
-			"Error obtaining class names from %s\n",
-			pathToSvmFile
-		       );
-		fclose(svm);
+	if(!parseSvmModel(modelBytes, modelSize, pathToModelFile, &model)){
+		freeSvmModel(&gate);
+		free(gateBytes);
+		free(modelBytes);
 		return false;
 	}
-	if(numClasses < 2){
-		fprintf(
-			stderr,
-			"%s is improperly formatted. %s reports being trained "
-			"on %d classes, while at least 2 are required",
-			pathToSvmFile,
-			pathToSvmFile,
-			numClasses
+	if(!hasSameClasses(&gate, &model)){
+		fprintf(
+			stderr,
+			"%s and %s must be trained on the same classes\n",
+			pathToGateFile,
+			pathToModelFile
 		       );
-		fclose(svm);
+		freeSvmModel(&gate);
+		freeSvmModel(&model);
+		free(gateBytes);
+		free(modelBytes);
 		return false;
 	}
 
-	// Seek to first vector
-	if(fseek(svm, sizeof(uint64_t), SEEK_CUR) != 0){
+	SampleCache cache;
+	if(!loadSampleCache(pathToValidationDir, &model, &cache)){
 		fprintf(
 			stderr,
-			"Error seeking past number of classes in %s\n",
-			pathToSvmFile
+			"Error loading samples from %s\n",
+			pathToValidationDir
 		       );
-		fclose(svm);
+		freeSvmModel(&gate);
+		freeSvmModel(&model);
+		free(gateBytes);
+		free(modelBytes);
 		return false;
 	}
-	for(uint64_t classNum = 0; classNum < numClasses; classNum++){
-		uint8_t classRunLength;
-		if(!fread(&classRunLength, 1, 1, svm)){
-			fprintf(
-				stderr,
-				"Error reading run length of class from %s\n",
-				pathToSvmFile
-			       );
-			fclose(svm);
-			return false;
-		}
-		if(fseek(svm, classRunLength, SEEK_CUR) != 0){
-			fprintf(
-				stderr,
-				"Error seeking past class name in %s\n",
-				pathToSvmFile
-			       );
-			fclose(svm);
-			return false;
-		}
-	}
-
-	// Use support vectors to determine class
-	uintmax_t *vectorsInFavor = 
-		(uintmax_t *)malloc(numClasses * sizeof(uintmax_t));
-	for(uintmax_t classNum = 0; classNum < numClasses; classNum++){
-		vectorsInFavor[classNum] = 0;
+	uintmax_t numSamples = cache.numSamples;
+	CascadeOutcome *outcomes =
+		(CascadeOutcome *)
+		malloc((numSamples + 1) * sizeof(CascadeOutcome));
+	if(!outcomes){
+		fprintf(
+			stderr,
+			"Error allocating memory for %ju outcomes\n",
+			numSamples
+		       );
 	}
-	if(!vectorsInFavor){
+	bool isScored =
+		outcomes &&
+		numSamples > 0 &&
+		getCascadeOutcomes(
+			&gate,
+			&model,
+			pathToGateFile,
+			&cache,
+			outcomes
+			);
+	if(outcomes && numSamples == 0){
 		fprintf(
 			stderr,
-			"Error allocating memory required for voting "
-			"mechanism\n"
+			"%s has no samples to calibrate the cascade with\n",
+			pathToValidationDir
 		       );
-		fclose(svm);
+	}
+	freeSampleCache(&cache);
+	uintmax_t gateCost = getNumMultiplyAdds(&gate);
+	uintmax_t modelCost = getNumMultiplyAdds(&model);
+	freeSvmModel(&gate);
+	freeSvmModel(&model);
+	if(!isScored){
+		free(outcomes);
+		free(gateBytes);
+		free(modelBytes);
 		return false;
 	}
 
-	// Open open sample and find offset to bitmap data
-	FILE *sample = fopen(pathToInputFile, "rb");
-	if(!sample){
+	// Letting samples exit at the gate from the largest margin down, keep
+	// the most exits for which the accuracy stays within the allowed loss.
+	// Samples of equal margins exit together, and ties never exit.
+	uintmax_t numGateCorrect = 0;
+	uintmax_t numModelCorrect = 0;
+	for(uintmax_t sampleNum = 0; sampleNum < numSamples; sampleNum++){
+		numGateCorrect += outcomes[sampleNum].isGateCorrect;
+		numModelCorrect += outcomes[sampleNum].isModelCorrect;
+	}
+	qsort(
+		outcomes,
+		numSamples,
+		sizeof(CascadeOutcome),
+		compareCascadeOutcomes
+	     );
+	double minCorrect =
+		numModelCorrect -
+		CASCADE_MAX_ACCURACY_LOSS / 100.0 * numSamples -
+		1e-9;
+	intmax_t numCorrect = numModelCorrect;
+	uintmax_t numCascadeCorrect = numModelCorrect;
+	uintmax_t numExits = 0;
+	double gateThreshold = INFINITY;
+	for(
+		uintmax_t sampleNum = 0;
+		sampleNum < numSamples &&
+		outcomes[sampleNum].gateMargin > -INFINITY;
+		sampleNum++
+	   ){
+		numCorrect +=
+			(intmax_t)outcomes[sampleNum].isGateCorrect -
+			outcomes[sampleNum].isModelCorrect;
+		double margin = outcomes[sampleNum].gateMargin;
+		double nextMargin =
+			sampleNum + 1 < numSamples ?
+			outcomes[sampleNum + 1].gateMargin :
+			-INFINITY;
+		if(nextMargin == margin || numCorrect < minCorrect)
+			continue;
+		numExits = sampleNum + 1;
+		numCascadeCorrect = numCorrect;
+		gateThreshold =
+			nextMargin > -INFINITY ?
+			(margin + nextMargin) / 2 :
+			-INFINITY;
+	}
+	free(outcomes);
+
+	FILE *output = fopen(pathToOutputFile, "wb");
+	if(!output){
 		fprintf(
 			stderr,
-			"Error opening %s for reading\n",
-			pathToInputFile
+			"Error opening %s for writing\n",
+			pathToOutputFile
 		       );
-		fclose(svm);
+		free(gateBytes);
+		free(modelBytes);
 		return false;
 	}
-	if(fseek(sample, 10, SEEK_SET) != 0){
+	uint64_t gateFileSize = gateSize;
+	bool isWritten =
+		fwrite("NSVC", 1, 4, output) == 4 &&
+		fwrite(&gateThreshold, sizeof(double), 1, output) &&
+		fwrite(&gateFileSize, sizeof(uint64_t), 1, output) &&
+		fwrite(gateBytes, 1, gateSize, output) == gateSize &&
+		fwrite(modelBytes, 1, modelSize, output) == modelSize;
+	free(gateBytes);
+	free(modelBytes);
+	if(!isWritten){
 		fprintf(
 			stderr,
-			"Error seeking to offset to data in %s\n",
-			pathToInputFile
+			"Error writing cascade to %s\n",
+			pathToOutputFile
 		       );
-		fclose(svm);
-		fclose(sample);
+		fclose(output);
 		return false;
 	}
-	uint32_t offsetToData;
-	if(!fread(&offsetToData, sizeof(uint32_t), 1, sample)){
+	if(fclose(output) != 0){
 		fprintf(
 			stderr,
-			"Error reading offset to data from %s\n",
-			pathToInputFile
+			"Error closing %s\n",
+			pathToOutputFile
 		       );
-		fclose(svm);
-		fclose(sample);
 		return false;
 	}
 
-	// Get relevant values for the sample
-	double normDivisor = getNormDivisor(pathToInputFile);
-	if(normDivisor < 0.0){
+	double exitFraction = (double)numExits / numSamples;
+	fprintf(
+		stdout,
+		"Gate accuracy: %lf%% (%ju of %ju)\n"
+		"Full model accuracy: %lf%% (%ju of %ju)\n"
+		"Cascade accuracy: %lf%% (%ju of %ju)\n"
+		"Accuracy change: %+lf percentage points\n"
+		"Gate margin threshold: %lf\n"
+		"%ju of %ju samples (%lf%%) exit at the gate\n"
+		"Scoring takes about %lf%% of the full model's multiply-adds\n",
+		(double)numGateCorrect / numSamples * 100,
+		numGateCorrect,
+		numSamples,
+		(double)numModelCorrect / numSamples * 100,
+		numModelCorrect,
+		numSamples,
+		(double)numCascadeCorrect / numSamples * 100,
+		numCascadeCorrect,
+		numSamples,
+		((double)numCascadeCorrect - numModelCorrect) /
+		numSamples * 100,
+		gateThreshold,
+		numExits,
+		numSamples,
+		exitFraction * 100,
+		(gateCost + (1.0 - exitFraction) * modelCost) /
+		modelCost * 100
+	       );
+	return true;
+}
+
+bool writeBundleEntry(FILE *output, const BundleEntry *entry){
+	return
+		fwrite(&entry->width, sizeof(uint32_t), 1, output) &&
+		fwrite(&entry->height, sizeof(int32_t), 1, output) &&
+		fwrite(&entry->bitsPerPixel, sizeof(uint16_t), 1, output) &&
+		fwrite(&entry->offset, sizeof(uint64_t), 1, output) &&
+		fwrite(&entry->size, sizeof(uint64_t), 1, output);
+}
+
+// Write padding bytes up to the next BUNDLE_ALIGNMENT boundary
+bool writeBundlePadding(FILE *output, uintmax_t *position){
+	static const uint8_t zeros[BUNDLE_ALIGNMENT];
+	uintmax_t numPadding =
+		(BUNDLE_ALIGNMENT - *position % BUNDLE_ALIGNMENT) %
+		BUNDLE_ALIGNMENT;
+	*position += numPadding;
+	return fwrite(zeros, 1, numPadding, output) == numPadding;
+}
+
+// Combine SVM and cascade files trained on the same classes into one bundle
+// file, which classifies each image with the file made for its dimensions
+bool createBundle(
+		char *pathToOutputFile,
+		uint32_t numInputs,
+		char **pathsToInputFiles
+		){
+	if(access(pathToOutputFile, F_OK) == 0){
+		if(access(pathToOutputFile, W_OK) != 0){
+			fprintf(
+				stderr,
+				"Insufficient permission to overwrite %s\n",
+				pathToOutputFile
+			       );
+			return false;
+		}
+	}
+	uint8_t **inputBytes = (uint8_t **)calloc(numInputs, sizeof(uint8_t *));
+	BundleEntry *entries =
+		(BundleEntry *)malloc(numInputs * sizeof(BundleEntry));
+	if(!inputBytes || !entries){
 		fprintf(
 			stderr,
-			"Error getting norm divisor from %s\n",
-			pathToInputFile
+			"Error allocating memory for %" PRIu32 " files\n",
+			numInputs
 		       );
-		fclose(svm);
-		fclose(sample);
+		free(inputBytes);
+		free(entries);
 		return false;
 	}
 
-	uintmax_t totalVectors = 0;
-	uint64_t numRows = (uint64_t)imaxabs(height);
-	uint16_t bytesPerPixel = bitsPerPixel >> 3;
-	uint8_t rowPadding = (4 - width % 4) % 4;
-	bool heightIsPositive = height > 0;
+	// The first file's classes are the bundle's, and every other file must
+	// have the same ones
+	SvmModel classTable;
+	bool hasClassTable = false;
+	bool isValid = true;
+	for(
+		uint32_t inputNum = 0;
+		inputNum < numInputs && isValid;
+		inputNum++
+	   ){
+		char *pathToInputFile = pathsToInputFiles[inputNum];
+		uintmax_t inputSize;
+		inputBytes[inputNum] =
+			readFileBytes(pathToInputFile, &inputSize);
+		if(!inputBytes[inputNum]){
+			isValid = false;
+			break;
+		}
+		SvmModel gate;
+		SvmModel model;
+		double gateThreshold;
+		bool isCascade =
+			inputSize >= 4 &&
+			memcmp(inputBytes[inputNum], "NSVC", 4) == 0;
+		isValid =
+			isCascade ?
+			parseCascade(
+				inputBytes[inputNum],
+				inputSize,
+				pathToInputFile,
+				&gate,
+				&model,
+				&gateThreshold
+				) :
+			parseSvmModel(
+				inputBytes[inputNum],
+				inputSize,
+				pathToInputFile,
+				&model
+				);
+		if(!isValid)
+			break;
+		if(isCascade)
+			freeSvmModel(&gate);
+		entries[inputNum].width = model.width;
+		entries[inputNum].height = model.height;
+		entries[inputNum].bitsPerPixel = model.bitsPerPixel;
+		entries[inputNum].size = inputSize;
 
-	for(uint64_t posClass = 0; posClass < numClasses - 1; posClass++){
+		// Only the first file made for some dimensions would be used
 		for(
-			uint64_t negClass = posClass + 1;
-			negClass < numClasses;
-			negClass++
+			uint32_t earlierNum = 0;
+			earlierNum < inputNum && isValid;
+			earlierNum++
 		   ){
-
-			double dotProduct; 
-			if(
-				!tryGetDotProduct(
-					svm,
-					sample,
-					normDivisor,
-					numRows,
-					offsetToData,
-					width,
-					bytesPerPixel,
-					rowPadding,
-					heightIsPositive,
-					&dotProduct
-					)
-			  ){
+			const BundleEntry *earlier = entries + earlierNum;
+			isValid =
+				earlier->width != model.width ||
+				imaxabs(earlier->height) !=
+				imaxabs(model.height) ||
+				earlier->bitsPerPixel != model.bitsPerPixel;
+			if(!isValid){
 				fprintf(
 					stderr,
-					"Error getting dot product between %s "
-					"and vector in %s\n",
+					"%s and %s are both made for %" PRIu32
+					"x%jd images with %" PRIu16 " bits per "
+					"pixel\n",
+					pathsToInputFiles[earlierNum],
 					pathToInputFile,
-					pathToSvmFile
-				       );
-				fclose(svm);
-				fclose(sample);
-				return false;
-			}
-			if(dotProduct > 0.0)
-				vectorsInFavor[posClass]++;
-			else
-				vectorsInFavor[negClass]++;
-			totalVectors++;
-			if(DEBUG_LEVEL < 1){
-				fprintf(
-					stderr,
-					"Vector %d:\n"
-					"\tDot Product = %lf\n"
-					"\tClass = %s\n",
-					totalVectors,
-					dotProduct,
-					classNames
-						[
-						dotProduct > 0.0 ? 
-						posClass : 
-						negClass
-						]
+					model.width,
+					imaxabs(model.height),
+					model.bitsPerPixel
 				       );
 			}
 		}
-	}
-	if(fclose(svm) != 0){
-		fprintf(
-			stderr,
-			"Error closing %s\n",
-			pathToSvmFile
-		       );
-		fclose(sample);
+		if(!isValid){
+			freeSvmModel(&model);
+			break;
+		}
+		if(inputNum == 0){
+			classTable = model;
+			hasClassTable = true;
+			continue;
+		}
+		isValid = hasSameClasses(&model, &classTable);
+		if(!isValid){
+			fprintf(
+				stderr,
+				"%s must be trained on the same classes as "
+				"%s\n",
+				pathToInputFile,
+				pathsToInputFiles[0]
+			       );
+		}
+		freeSvmModel(&model);
+	}
+	if(!isValid){
+		if(hasClassTable)
+			freeSvmModel(&classTable);
+		for(uint32_t inputNum = 0; inputNum < numInputs; inputNum++)
+			free(inputBytes[inputNum]);
+		free(inputBytes);
+		free(entries);
 		return false;
 	}
-	if(fclose(sample) != 0){
+
+	FILE *output = fopen(pathToOutputFile, "wb");
+	if(!output){
 		fprintf(
 			stderr,
-			"Error closing %s\n",
-			pathToInputFile
+			"Error opening %s for writing\n",
+			pathToOutputFile
 		       );
-		return false;
+		isValid = false;
 	}
-
-	// Find out and display results
-	uint64_t numClassesFavorite = 0;
-	uint64_t numVectorsFavor = vectorsInFavor[0];
-	uint64_t *favoriteClasses = 
-		(uint64_t *)malloc(numClasses * sizeof(uint64_t));
-	for(uint64_t classNum = 0; classNum < numClasses; classNum++){
-		if(vectorsInFavor[classNum] > numVectorsFavor){
-			numClassesFavorite = 1;
-			numVectorsFavor = vectorsInFavor[classNum];
-			favoriteClasses[0] = classNum;
-		}else if(vectorsInFavor[classNum] == numVectorsFavor){
-			favoriteClasses[numClassesFavorite] = classNum;
-			numClassesFavorite++;
+	uintmax_t position = 4 + sizeof(uint32_t) + sizeof(uint64_t);
+	for(uint64_t classNum = 0; classNum < classTable.numClasses; classNum++)
+		position += 1 + strlen(classTable.classNames[classNum]);
+	position +=
+		numInputs *
+		(
+		 sizeof(uint32_t) +
+		 sizeof(int32_t) +
+		 sizeof(uint16_t) +
+		 2 * sizeof(uint64_t)
+		);
+	for(uint32_t inputNum = 0; inputNum < numInputs; inputNum++){
+		position +=
+			(BUNDLE_ALIGNMENT - position % BUNDLE_ALIGNMENT) %
+			BUNDLE_ALIGNMENT;
+		entries[inputNum].offset = position;
+		position += entries[inputNum].size;
+	}
+	if(isValid){
+		isValid =
+			fwrite("NSVB", 1, 4, output) == 4 &&
+			fwrite(&numInputs, sizeof(uint32_t), 1, output) &&
+			fwrite(
+				&classTable.numClasses,
+				sizeof(uint64_t),
+				1,
+				output
+			      ) &&
+			writeClassNames(output, &classTable, pathToOutputFile);
+		for(
+			uint32_t inputNum = 0;
+			inputNum < numInputs && isValid;
+			inputNum++
+		   ){
+			isValid = writeBundleEntry(output, entries + inputNum);
+		}
+		position = ftell(output);
+		for(
+			uint32_t inputNum = 0;
+			inputNum < numInputs && isValid;
+			inputNum++
+		   ){
+			isValid =
+				writeBundlePadding(output, &position) &&
+				fwrite(
+					inputBytes[inputNum],
+					1,
+					entries[inputNum].size,
+					output
+				      ) == entries[inputNum].size;
+			position += entries[inputNum].size;
+		}
+		if(!isValid){
+			fprintf(
+				stderr,
+				"Error writing bundle to %s\n",
+				pathToOutputFile
+			       );
+		}
+		if(fclose(output) != 0 && isValid){
+			fprintf(
+				stderr,
+				"Error closing %s\n",
+				pathToOutputFile
+			       );
+			isValid = false;
 		}
 	}
-	uintmax_t totalVectorsFavor = numClassesFavorite * numVectorsFavor;
-	uintmax_t totalVectorsRelevant = 
-		(uintmax_t)numClassesFavorite * 
-		(numClasses - 1);
-	fprintf(
-		stdout,
-		"%lf%% (%d of %d) of relevant vectors point to %s belonging "
-		"to one of the following classes:\n",
-		(double)totalVectorsFavor / totalVectorsRelevant * 100,
-		totalVectorsFavor,
-		totalVectorsRelevant,
-		pathToInputFile
-	       );
-	for(
-		uint64_t favVectorNum = 0; 
-		favVectorNum < numClassesFavorite; 
-		favVectorNum++
-	){
+	for(uint32_t inputNum = 0; inputNum < numInputs; inputNum++)
+		free(inputBytes[inputNum]);
+	free(inputBytes);
+	if(isValid){
 		fprintf(
 			stdout,
-			"\t%s\n",
-			classNames[favoriteClasses[favVectorNum]]
+			"Bundled %" PRIu32 " files sharing %ju classes:\n",
+			numInputs,
+			(uintmax_t)classTable.numClasses
 		       );
+		for(uint32_t inputNum = 0; inputNum < numInputs; inputNum++){
+			fprintf(
+				stdout,
+				"\t%s for %" PRIu32 "x%jd images with %" PRIu16
+				" bits per pixel, at byte %ju\n",
+				pathsToInputFiles[inputNum],
+				entries[inputNum].width,
+				imaxabs(entries[inputNum].height),
+				entries[inputNum].bitsPerPixel,
+				(uintmax_t)entries[inputNum].offset
+			       );
+		}
 	}
-	free(favoriteClasses);
-	freeClassNames(classNames, numClasses);
-	return true;
+	freeSvmModel(&classTable);
+	free(entries);
+	return isValid;
 }
 
 int main(int argc, char **argv){
@@ -2998,6 +13461,141 @@ int main(int argc, char **argv){
 		usage(argv[0]);
 		exit(EXIT_FAILURE);
 	}
+
+	// Commands other than training and classification are named by the
+	// first argument
+	if(argc > 1 && strcmp(argv[1], "cross-validate") == 0){
+		if(argc != 3 || !crossValidateDir(argv[2])){
+			usage(argv[0]);
+			exit(EXIT_FAILURE);
+		}
+		exit(EXIT_SUCCESS);
+	}
+	if(argc > 1 && strcmp(argv[1], "search") == 0){
+		if(argc != 4 || !searchDir(argv[2], argv[3])){
+			usage(argv[0]);
+			exit(EXIT_FAILURE);
+		}
+		fprintf(
+			stdout,
+			"Search successful\n"
+		       );
+		exit(EXIT_SUCCESS);
+	}
+	if(argc > 1 && strcmp(argv[1], "prune") == 0){
+		if(
+			(argc != 4 && argc != 5) ||
+			!pruneSvmModel(
+				argv[2],
+				argv[3],
+				argc == 5 ? argv[4] : NULL
+				)
+		  ){
+			usage(argv[0]);
+			exit(EXIT_FAILURE);
+		}
+		fprintf(
+			stdout,
+			"Pruning successful\n"
+		       );
+		exit(EXIT_SUCCESS);
+	}
+	if(argc > 1 && strcmp(argv[1], "convert") == 0){
+		if(
+			(argc != 4 && argc != 5) ||
+			!convertSvmModel(
+				argv[2],
+				argv[3],
+				argc == 5 ? argv[4] : NULL
+				)
+		  ){
+			usage(argv[0]);
+			exit(EXIT_FAILURE);
+		}
+		fprintf(
+			stdout,
+			"Conversion successful\n"
+		       );
+		exit(EXIT_SUCCESS);
+	}
+	if(argc > 1 && strcmp(argv[1], "detect") == 0){
+		if(argc != 4 || !detectInFileFromSvm(argv[2], argv[3])){
+			usage(argv[0]);
+			exit(EXIT_FAILURE);
+		}
+		exit(EXIT_SUCCESS);
+	}
+	if(argc > 1 && strcmp(argv[1], "classify") == 0){
+		if(
+			argc < 4 ||
+			!classifyFilesFromSvm(argv[2], argc - 3, argv + 3)
+		  ){
+			usage(argv[0]);
+			exit(EXIT_FAILURE);
+		}
+		exit(EXIT_SUCCESS);
+	}
+	if(argc > 1 && strcmp(argv[1], "ensemble") == 0){
+		if(
+			argc < 4 ||
+			!classifyFileWithEnsemble(argv[2], argc - 3, argv + 3)
+		  ){
+			usage(argv[0]);
+			exit(EXIT_FAILURE);
+		}
+		exit(EXIT_SUCCESS);
+	}
+	if(argc > 1 && strcmp(argv[1], "evaluate") == 0){
+		if(
+			(argc != 4 && argc != 5) ||
+			!evaluateSvmModel(
+				argv[2],
+				argv[3],
+				argc == 5 ? argv[4] : NULL
+				)
+		  ){
+			usage(argv[0]);
+			exit(EXIT_FAILURE);
+		}
+		exit(EXIT_SUCCESS);
+	}
+	if(argc > 1 && strcmp(argv[1], "export") == 0){
+		if(argc != 4 || !exportSvmModel(argv[2], argv[3])){
+			usage(argv[0]);
+			exit(EXIT_FAILURE);
+		}
+		fprintf(
+			stdout,
+			"Export successful\n"
+		       );
+		exit(EXIT_SUCCESS);
+	}
+	if(argc > 1 && strcmp(argv[1], "cascade") == 0){
+		if(
+			argc != 6 ||
+			!createCascade(argv[2], argv[3], argv[4], argv[5])
+		  ){
+			usage(argv[0]);
+			exit(EXIT_FAILURE);
+		}
+		fprintf(
+			stdout,
+			"Cascade successful\n"
+		       );
+		exit(EXIT_SUCCESS);
+	}
+	if(argc > 1 && strcmp(argv[1], "bundle") == 0){
+		if(argc < 4 || !createBundle(argv[2], argc - 3, argv + 3)){
+			usage(argv[0]);
+			exit(EXIT_FAILURE);
+		}
+		fprintf(
+			stdout,
+			"Bundling successful\n"
+		       );
+		exit(EXIT_SUCCESS);
+	}
+
 	bool firstArgIsDir;
 	if(!validArgs(argc, argv, &firstArgIsDir)){
 		usage(argv[0]);
@@ -3014,7 +13612,7 @@ int main(int argc, char **argv){
 			"Training successful\n"
 		       );
 	}else{
-		if(!classifyFileFromSvm(argv[1], argv[2])){
+		if(!classifyFilesFromSvm(argv[2], 1, argv + 1)){
 			usage(argv[0]);
 			exit(EXIT_FAILURE);
 		}